@@ -340,6 +340,19 @@ mcp_account_storage_get_type (void)
  *  mcp_account_storage_get_additional_info()
  * @get_restrictions: implementation of mcp_account_storage_get_restrictions()
  * @create: implementation of mcp_account_storage_create()
+ * @owns: implementation of mcp_account_storage_owns()
+ * @set_attribute: implementation of mcp_account_storage_set_attribute()
+ * @set_parameter: implementation of mcp_account_storage_set_parameter()
+ * @commit_async: implementation of mcp_account_storage_commit_async();
+ *  %NULL means the default implementation, which calls @commit_one or
+ *  @commit (since 5.17.0)
+ * @commit_finish: implementation of mcp_account_storage_commit_finish(),
+ *  which must be set if @commit_async is (since 5.17.0)
+ * @list_async: implementation of mcp_account_storage_list_async();
+ *  %NULL means the default implementation, which calls @list
+ *  (since 5.17.0)
+ * @list_finish: implementation of mcp_account_storage_list_finish(),
+ *  which must be set if @list_async is (since 5.17.0)
  *
  * The interface vtable for an account storage plugin.
  */
@@ -503,7 +516,8 @@ mcp_account_storage_priority (const McpAccountStorage *storage)
  * @am: object used to call back into the account manager
  * @account: the unique name of the account
  * @key: the setting whose value we wish to fetch: either an attribute
- *  like "DisplayName", or "param-" plus a parameter like "account"
+ *  like "DisplayName", "param-" plus a parameter like "account", or
+ *  "paramtype-" plus a parameter
  *
  * An implementation of mcp_account_storage_get().
  *
@@ -516,7 +530,8 @@ mcp_account_storage_priority (const McpAccountStorage *storage)
  * @am: an #McpAccountManager instance
  * @account: the unique name of the account
  * @key: the setting whose value we wish to fetch: either an attribute
- *  like "DisplayName", or "param-" plus a parameter like "account"
+ *  like "DisplayName", "param-" plus a parameter like "account", or
+ *  "paramtype-" plus a parameter
  *
  * Get a value from the plugin's in-memory cache.
  * Before emitting this signal, the plugin must call
@@ -529,6 +544,14 @@ mcp_account_storage_priority (const McpAccountStorage *storage)
  * Note that mcp_account_manager_set_parameter() does not use the
  * "param-" prefix, even if called from this function.
  *
+ * Keys starting with "paramtype-" are the ones Mission Control stored
+ * with mcp_account_storage_set() to record the D-Bus signature of a
+ * parameter, such as "u" for "paramtype-port". They should be given back
+ * with mcp_account_manager_set_value(), either before or after the
+ * parameter itself. A plugin that doesn't keep them still works, but
+ * Mission Control then has to ask the connection manager how to decode
+ * the parameter.
+ *
  * If @key is %NULL the plugin should iterate through all attributes and
  * parameters, and push each of them into @am, as if this method had
  * been called once for each attribute or parameter. It must then return
@@ -558,7 +581,8 @@ mcp_account_storage_get (const McpAccountStorage *storage,
  * @am: an #McpAccountManager instance
  * @account: the unique name of the account
  * @key: the setting whose value we wish to store: either an attribute
- *  like "DisplayName", or "param-" plus a parameter like "account"
+ *  like "DisplayName", "param-" plus a parameter like "account", or
+ *  "paramtype-" plus a parameter
  * @val: a non-%NULL value for @key
  *
  * An implementation of mcp_account_storage_set().
@@ -572,7 +596,8 @@ mcp_account_storage_get (const McpAccountStorage *storage,
  * @am: an #McpAccountManager instance
  * @account: the unique name of the account
  * @key: the non-%NULL setting whose value we wish to store: either an
- *  attribute like "DisplayName", or "param-" plus a parameter like "account"
+ *  attribute like "DisplayName", "param-" plus a parameter like "account",
+ *  or "paramtype-" plus a parameter
  * @value: a value to associate with @key, escaped as if for a #GKeyFile
  *
  * The plugin is expected to either quickly and synchronously
@@ -588,6 +613,13 @@ mcp_account_storage_get (const McpAccountStorage *storage,
  * mcp_account_storage_set_parameter() can just return %FALSE here.
  * There is a default implementation, which just returns %FALSE.
  *
+ * Whenever the plugin accepts a "param-" key here, Mission Control
+ * follows it with "paramtype-" plus the same parameter, whose value is the
+ * parameter's D-Bus signature (not escaped), so that the parameter can
+ * be decoded later without asking the connection manager. The plugin
+ * should store it like any other key, and return it from
+ * mcp_account_storage_get().
+ *
  * Returns: %TRUE if the attribute was claimed, %FALSE otherwise
  */
 gboolean
@@ -761,8 +793,9 @@ mcp_account_storage_create (const McpAccountStorage *storage,
  * @am: an #McpAccountManager instance
  * @account: the unique name of the account
  * @key: (allow-none): the setting whose value we wish to store - either an
- *  attribute like "DisplayName", or "param-" plus a parameter like
- *  "account" - or %NULL to delete the entire account
+ *  attribute like "DisplayName", "param-" plus a parameter like
+ *  "account", or "paramtype-" plus a parameter - or %NULL to delete the
+ *  entire account
  *
  * An implementation of mcp_account_storage_delete().
  *
@@ -776,8 +809,9 @@ mcp_account_storage_create (const McpAccountStorage *storage,
  * @am: an #McpAccountManager instance
  * @account: the unique name of the account
  * @key: (allow-none): the setting whose value we wish to store - either an
- *  attribute like "DisplayName", or "param-" plus a parameter like
- *  "account" - or %NULL to delete the entire account
+ *  attribute like "DisplayName", "param-" plus a parameter like
+ *  "account", or "paramtype-" plus a parameter - or %NULL to delete the
+ *  entire account
  *
  * The plugin is expected to remove the setting for @key from its
  * internal cache and to remember that its state has changed, so
@@ -787,6 +821,9 @@ mcp_account_storage_create (const McpAccountStorage *storage,
  * If @key is %NULL, the plugin should forget all its settings for
  * @account,and remember to delete the entire account from its storage later.
  *
+ * When a parameter is deleted, Mission Control also deletes the
+ * corresponding "paramtype-" key, if any.
+ *
  * The plugin is not expected to update its long term storage at
  * this point.
  *
@@ -952,6 +989,237 @@ mcp_account_storage_list (const McpAccountStorage *storage,
   return iface->list (storage, am);
 }
 
+/**
+ * McpAccountStorageCommitAsyncFunc:
+ * @storage: an #McpAccountStorage instance
+ * @am: an #McpAccountManager instance
+ * @account: (allow-none): the unique suffix of an account's object path,
+ *  or %NULL to commit all accounts
+ * @cancellable: (allow-none): used to cancel the commit, or %NULL
+ * @callback: called when the commit has finished
+ * @user_data: user data for @callback
+ *
+ * An implementation of mcp_account_storage_commit_async().
+ */
+
+/**
+ * McpAccountStorageCommitFinishFunc:
+ * @storage: an #McpAccountStorage instance
+ * @result: the result passed to the #GAsyncReadyCallback
+ * @error: (allow-none): used to raise an error if %FALSE is returned
+ *
+ * An implementation of mcp_account_storage_commit_finish().
+ *
+ * Returns: %TRUE if the account or accounts were written to long-term storage
+ */
+
+/**
+ * mcp_account_storage_commit_async:
+ * @storage: an #McpAccountStorage instance
+ * @am: an #McpAccountManager instance
+ * @account: (allow-none): the unique suffix of an account's object path,
+ *  or %NULL to commit all accounts
+ * @cancellable: (allow-none): used to cancel the commit, or %NULL
+ * @callback: called when the commit has finished
+ * @user_data: user data for @callback
+ *
+ * Write the given account, or all accounts, to long-term storage, without
+ * blocking the main loop.
+ *
+ * Plugins whose storage is slow, such as a database, should implement
+ * this. The values to be written are the ones the plugin was given before
+ * this method was called; Mission Control may continue to call
+ * mcp_account_storage_set() and similar methods while the commit is in
+ * progress, and those changes will be committed later.
+ *
+ * A call to mcp_account_storage_commit() or
+ * mcp_account_storage_commit_one() made while this commit is in progress
+ * must not return until what this commit was writing has been written,
+ * without relying on the main loop: Mission Control does that before it
+ * exits.
+ *
+ * The default implementation calls mcp_account_storage_commit_one() or
+ * mcp_account_storage_commit() and reports its result from an idle
+ * callback. It does not run them in another thread: they were not
+ * written to be called while other methods are in progress.
+ *
+ * Since: 5.17.0
+ */
+void
+mcp_account_storage_commit_async (McpAccountStorage *storage,
+    McpAccountManager *am,
+    const gchar *account,
+    GCancellable *cancellable,
+    GAsyncReadyCallback callback,
+    gpointer user_data)
+{
+  McpAccountStorageIface *iface = MCP_ACCOUNT_STORAGE_GET_IFACE (storage);
+  GTask *task;
+  gboolean ok;
+
+  SDEBUG (storage, "called for %s", account ? account : "<all accounts>");
+  g_return_if_fail (iface != NULL);
+
+  if (iface->commit_async != NULL)
+    {
+      g_return_if_fail (iface->commit_finish != NULL);
+      iface->commit_async (storage, am, account, cancellable, callback,
+          user_data);
+      return;
+    }
+
+  task = g_task_new (storage, cancellable, callback, user_data);
+  g_task_set_source_tag (task, mcp_account_storage_commit_async);
+
+  if (account != NULL)
+    ok = mcp_account_storage_commit_one (storage, am, account);
+  else
+    ok = mcp_account_storage_commit (storage, am);
+
+  if (ok)
+    g_task_return_boolean (task, TRUE);
+  else
+    g_task_return_new_error (task, TP_ERROR, TP_ERROR_NOT_AVAILABLE,
+        "Plugin %s was unable to commit %s",
+        mcp_account_storage_name (storage),
+        account != NULL ? account : "its accounts");
+
+  g_object_unref (task);
+}
+
+/**
+ * mcp_account_storage_commit_finish:
+ * @storage: an #McpAccountStorage instance
+ * @result: the result passed to the #GAsyncReadyCallback
+ * @error: (allow-none): used to raise an error if %FALSE is returned
+ *
+ * Finish a call to mcp_account_storage_commit_async().
+ *
+ * Returns: %TRUE if the account or accounts were written to long-term storage
+ *
+ * Since: 5.17.0
+ */
+gboolean
+mcp_account_storage_commit_finish (McpAccountStorage *storage,
+    GAsyncResult *result,
+    GError **error)
+{
+  McpAccountStorageIface *iface = MCP_ACCOUNT_STORAGE_GET_IFACE (storage);
+
+  g_return_val_if_fail (iface != NULL, FALSE);
+
+  if (iface->commit_async != NULL)
+    return iface->commit_finish (storage, result, error);
+
+  g_return_val_if_fail (g_task_is_valid (result, storage), FALSE);
+  g_return_val_if_fail (g_task_get_source_tag (G_TASK (result)) ==
+      mcp_account_storage_commit_async, FALSE);
+
+  return g_task_propagate_boolean (G_TASK (result), error);
+}
+
+/**
+ * McpAccountStorageListAsyncFunc:
+ * @storage: an #McpAccountStorage instance
+ * @am: an #McpAccountManager instance
+ * @cancellable: (allow-none): used to cancel listing, or %NULL
+ * @callback: called when the accounts have been listed
+ * @user_data: user data for @callback
+ *
+ * An implementation of mcp_account_storage_list_async().
+ */
+
+/**
+ * McpAccountStorageListFinishFunc:
+ * @storage: an #McpAccountStorage instance
+ * @result: the result passed to the #GAsyncReadyCallback
+ * @error: (allow-none): used to raise an error if %NULL is returned
+ *
+ * An implementation of mcp_account_storage_list_finish().
+ *
+ * Returns: (element-type utf8) (transfer full): a list of account names
+ */
+
+static void
+free_account_list (gpointer p)
+{
+  g_list_free_full (p, g_free);
+}
+
+/**
+ * mcp_account_storage_list_async:
+ * @storage: an #McpAccountStorage instance
+ * @am: an #McpAccountManager instance
+ * @cancellable: (allow-none): used to cancel listing, or %NULL
+ * @callback: called when the accounts have been listed
+ * @user_data: user data for @callback
+ *
+ * The same as mcp_account_storage_list(), but without blocking the main
+ * loop. The default implementation calls mcp_account_storage_list() and
+ * reports its result from an idle callback.
+ *
+ * Since: 5.17.0
+ */
+void
+mcp_account_storage_list_async (McpAccountStorage *storage,
+    McpAccountManager *am,
+    GCancellable *cancellable,
+    GAsyncReadyCallback callback,
+    gpointer user_data)
+{
+  McpAccountStorageIface *iface = MCP_ACCOUNT_STORAGE_GET_IFACE (storage);
+  GTask *task;
+
+  SDEBUG (storage, "");
+  g_return_if_fail (iface != NULL);
+
+  if (iface->list_async != NULL)
+    {
+      g_return_if_fail (iface->list_finish != NULL);
+      iface->list_async (storage, am, cancellable, callback, user_data);
+      return;
+    }
+
+  task = g_task_new (storage, cancellable, callback, user_data);
+  g_task_set_source_tag (task, mcp_account_storage_list_async);
+  g_task_return_pointer (task, mcp_account_storage_list (storage, am),
+      free_account_list);
+  g_object_unref (task);
+}
+
+/**
+ * mcp_account_storage_list_finish:
+ * @storage: an #McpAccountStorage instance
+ * @result: the result passed to the #GAsyncReadyCallback
+ * @error: (allow-none): used to raise an error if %NULL is returned
+ *
+ * Finish a call to mcp_account_storage_list_async().
+ *
+ * Returns: (element-type utf8) (transfer full): a list of account names
+ * that the plugin has settings for, to be freed as for
+ * mcp_account_storage_list()
+ *
+ * Since: 5.17.0
+ */
+GList *
+mcp_account_storage_list_finish (McpAccountStorage *storage,
+    GAsyncResult *result,
+    GError **error)
+{
+  McpAccountStorageIface *iface = MCP_ACCOUNT_STORAGE_GET_IFACE (storage);
+
+  g_return_val_if_fail (iface != NULL, NULL);
+
+  if (iface->list_async != NULL)
+    return iface->list_finish (storage, result, error);
+
+  g_return_val_if_fail (g_task_is_valid (result, storage), NULL);
+  g_return_val_if_fail (g_task_get_source_tag (G_TASK (result)) ==
+      mcp_account_storage_list_async, NULL);
+
+  return g_task_propagate_pointer (G_TASK (result), error);
+}
+
 /**
  * McpAccountStorageReadyFunc:
  * @storage: an #McpAccountStorage instance
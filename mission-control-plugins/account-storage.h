@@ -106,6 +106,27 @@ typedef GHashTable * (*McpAccountStorageGetAdditionalInfoFunc) (
 typedef guint (*McpAccountStorageGetRestrictionsFunc) (
     const McpAccountStorage *storage,
     const gchar *account);
+typedef void (*McpAccountStorageCommitAsyncFunc) (
+    McpAccountStorage *storage,
+    McpAccountManager *am,
+    const gchar *account,
+    GCancellable *cancellable,
+    GAsyncReadyCallback callback,
+    gpointer user_data);
+typedef gboolean (*McpAccountStorageCommitFinishFunc) (
+    McpAccountStorage *storage,
+    GAsyncResult *result,
+    GError **error);
+typedef void (*McpAccountStorageListAsyncFunc) (
+    McpAccountStorage *storage,
+    McpAccountManager *am,
+    GCancellable *cancellable,
+    GAsyncReadyCallback callback,
+    gpointer user_data);
+typedef GList * (*McpAccountStorageListFinishFunc) (
+    McpAccountStorage *storage,
+    GAsyncResult *result,
+    GError **error);
 
 struct _McpAccountStorageIface
 {
@@ -144,6 +165,12 @@ struct _McpAccountStorageIface
       const gchar *parameter,
       GVariant *val,
       McpParameterFlags flags);
+
+  /* Since 5.17.0 */
+  McpAccountStorageCommitAsyncFunc commit_async;
+  McpAccountStorageCommitFinishFunc commit_finish;
+  McpAccountStorageListAsyncFunc list_async;
+  McpAccountStorageListFinishFunc list_finish;
 };
 
 #ifndef __GTK_DOC_IGNORE__
@@ -249,6 +276,25 @@ mcp_account_storage_commit_one (const McpAccountStorage *storage,
 GList *mcp_account_storage_list (const McpAccountStorage *storage,
     const McpAccountManager *am);
 
+void mcp_account_storage_commit_async (McpAccountStorage *storage,
+    McpAccountManager *am,
+    const gchar *account,
+    GCancellable *cancellable,
+    GAsyncReadyCallback callback,
+    gpointer user_data);
+gboolean mcp_account_storage_commit_finish (McpAccountStorage *storage,
+    GAsyncResult *result,
+    GError **error);
+
+void mcp_account_storage_list_async (McpAccountStorage *storage,
+    McpAccountManager *am,
+    GCancellable *cancellable,
+    GAsyncReadyCallback callback,
+    gpointer user_data);
+GList *mcp_account_storage_list_finish (McpAccountStorage *storage,
+    GAsyncResult *result,
+    GError **error);
+
 void mcp_account_storage_get_identifier (const McpAccountStorage *storage,
     const gchar *account,
     GValue *identifier);
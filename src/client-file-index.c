@@ -0,0 +1,380 @@
+/* Index of Telepathy clients' .client files
+ *
+ * Copyright © 2012 Collabora Ltd.
+ *
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public License
+ * version 2.1 as published by the Free Software Foundation.
+ *
+ * This library is distributed in the hope that it will be useful, but
+ * WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the GNU
+ * Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with this library; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin St, Fifth Floor, Boston, MA
+ * 02110-1301 USA
+ *
+ */
+
+/*
+ * Looking for each client's .client file used to mean trying each
+ * directory in turn until we found it, so a client without one (which is
+ * allowed) cost a stat() per directory. Instead we list each directory
+ * once, remember which files it contains, and load each file the first
+ * time someone asks for it. Each directory is monitored, and a change to
+ * one of them throws away what we know about that directory, to be listed
+ * again the next time it's needed; .client files are installed and removed
+ * rarely enough that there's no point in being cleverer. A directory that
+ * can't be monitored is listed again if what we know about it is more
+ * than RESCAN_INTERVAL old.
+ */
+
+#include "config.h"
+
+#include "client-file-index.h"
+
+#include <string.h>
+
+#include <gio/gio.h>
+#include <telepathy-glib/telepathy-glib.h>
+
+#include "mcd-debug.h"
+
+#define SUFFIX ".client"
+
+/* how long we trust the listing of a directory we can't monitor, in
+ * microseconds */
+#define RESCAN_INTERVAL (G_USEC_PER_SEC)
+
+typedef struct
+{
+  gchar *filename;
+  /* NULL until first needed */
+  GKeyFile *file;
+  /* TRUE if we tried to load it and failed */
+  gboolean broken;
+} Entry;
+
+typedef struct
+{
+  gchar *path;
+  /* NULL if we couldn't monitor it */
+  GFileMonitor *monitor;
+  /* owned gchar *client_name => owned Entry *, or NULL if the directory
+   * needs listing again */
+  GHashTable *entries;
+  /* monotonic time at which @entries was built */
+  gint64 scanned_at;
+} Dir;
+
+struct _McdClientFileIndex
+{
+  /* owned Dir *, in decreasing order of priority */
+  GPtrArray *dirs;
+  /* TRUE once we have tried to monitor each of dirs */
+  gboolean monitoring;
+};
+
+/*
+ * Returns: (transfer full): the directories that can contain .client
+ *  files, in decreasing order of priority: $MC_CLIENTS_DIR if set (for
+ *  testing), then $XDG_DATA_HOME/telepathy/clients, then
+ *  telepathy/clients in each of $XDG_DATA_DIRS
+ */
+GStrv
+_mcd_client_file_index_dup_default_dirs (void)
+{
+  GPtrArray *dirs = g_ptr_array_new ();
+  const gchar * const *system_dirs;
+  const gchar *env_dirname;
+
+  env_dirname = g_getenv ("MC_CLIENTS_DIR");
+
+  if (env_dirname != NULL)
+    g_ptr_array_add (dirs, g_strdup (env_dirname));
+
+  if (G_LIKELY (g_get_user_data_dir () != NULL))
+    g_ptr_array_add (dirs, g_build_filename (g_get_user_data_dir (),
+          "telepathy", "clients", NULL));
+
+  for (system_dirs = g_get_system_data_dirs ();
+      *system_dirs != NULL;
+      system_dirs++)
+    g_ptr_array_add (dirs, g_build_filename (*system_dirs, "telepathy",
+          "clients", NULL));
+
+  g_ptr_array_add (dirs, NULL);
+  return (GStrv) g_ptr_array_free (dirs, FALSE);
+}
+
+static void
+entry_free (gpointer p)
+{
+  Entry *entry = p;
+
+  g_free (entry->filename);
+  tp_clear_pointer (&entry->file, g_key_file_unref);
+  g_slice_free (Entry, entry);
+}
+
+static void
+monitor_changed_cb (GFileMonitor *monitor,
+    GFile *file,
+    GFile *other_file,
+    GFileMonitorEvent event_type,
+    gpointer user_data)
+{
+  Dir *dir = user_data;
+
+  if (event_type == G_FILE_MONITOR_EVENT_ATTRIBUTE_CHANGED)
+    return;
+
+  if (dir->entries != NULL)
+    {
+      gchar *path = g_file_get_path (file);
+
+      DEBUG ("%s changed, forgetting .client files in %s", path, dir->path);
+      g_free (path);
+      tp_clear_pointer (&dir->entries, g_hash_table_unref);
+    }
+}
+
+static void
+dir_free (gpointer p)
+{
+  Dir *dir = p;
+
+  if (dir->monitor != NULL)
+    {
+      g_signal_handlers_disconnect_by_func (dir->monitor,
+          monitor_changed_cb, dir);
+      g_file_monitor_cancel (dir->monitor);
+      g_object_unref (dir->monitor);
+    }
+
+  tp_clear_pointer (&dir->entries, g_hash_table_unref);
+  g_free (dir->path);
+  g_slice_free (Dir, dir);
+}
+
+static void
+start_monitoring (McdClientFileIndex *self)
+{
+  guint i;
+
+  for (i = 0; i < self->dirs->len; i++)
+    {
+      Dir *dir = g_ptr_array_index (self->dirs, i);
+      GError *error = NULL;
+      GFile *file = g_file_new_for_path (dir->path);
+
+      dir->monitor = g_file_monitor_directory (file, G_FILE_MONITOR_NONE,
+          NULL, &error);
+      g_object_unref (file);
+
+      if (dir->monitor == NULL)
+        {
+          DEBUG ("cannot monitor %s, will look for .client files there "
+              "at most every %d ms: %s", dir->path,
+              (gint) (RESCAN_INTERVAL / 1000), error->message);
+          g_error_free (error);
+          continue;
+        }
+
+      g_signal_connect (dir->monitor, "changed",
+          G_CALLBACK (monitor_changed_cb), dir);
+    }
+
+  self->monitoring = TRUE;
+}
+
+McdClientFileIndex *
+_mcd_client_file_index_new (const gchar * const *dirs)
+{
+  McdClientFileIndex *self;
+  guint i;
+
+  g_return_val_if_fail (dirs != NULL, NULL);
+
+  self = g_slice_new0 (McdClientFileIndex);
+  self->dirs = g_ptr_array_new_with_free_func (dir_free);
+
+  for (i = 0; dirs[i] != NULL; i++)
+    {
+      Dir *dir = g_slice_new0 (Dir);
+
+      dir->path = g_strdup (dirs[i]);
+      g_ptr_array_add (self->dirs, dir);
+    }
+
+  return self;
+}
+
+void
+_mcd_client_file_index_free (McdClientFileIndex *self)
+{
+  g_return_if_fail (self != NULL);
+
+  g_ptr_array_unref (self->dirs);
+  g_slice_free (McdClientFileIndex, self);
+}
+
+/*
+ * Forget everything we know about .client files, and look again next
+ * time.
+ */
+void
+_mcd_client_file_index_invalidate (McdClientFileIndex *self)
+{
+  guint i;
+
+  g_return_if_fail (self != NULL);
+
+  for (i = 0; i < self->dirs->len; i++)
+    {
+      Dir *dir = g_ptr_array_index (self->dirs, i);
+
+      tp_clear_pointer (&dir->entries, g_hash_table_unref);
+    }
+}
+
+/*
+ * Returns: the number of directories whose changes we are watching for
+ */
+guint
+_mcd_client_file_index_get_n_monitors (McdClientFileIndex *self)
+{
+  guint i;
+  guint n = 0;
+
+  g_return_val_if_fail (self != NULL, 0);
+
+  for (i = 0; i < self->dirs->len; i++)
+    {
+      Dir *dir = g_ptr_array_index (self->dirs, i);
+
+      if (dir->monitor != NULL)
+        n++;
+    }
+
+  return n;
+}
+
+static void
+scan_dir (Dir *self)
+{
+  GDir *dir;
+  const gchar *basename;
+
+  self->entries = g_hash_table_new_full (g_str_hash, g_str_equal, g_free,
+      entry_free);
+  self->scanned_at = g_get_monotonic_time ();
+
+  dir = g_dir_open (self->path, 0, NULL);
+
+  if (dir == NULL)
+    return;
+
+  while ((basename = g_dir_read_name (dir)) != NULL)
+    {
+      gchar *filename;
+      Entry *entry;
+
+      if (!g_str_has_suffix (basename, SUFFIX))
+        continue;
+
+      filename = g_build_filename (self->path, basename, NULL);
+
+      if (!g_file_test (filename, G_FILE_TEST_IS_REGULAR))
+        {
+          g_free (filename);
+          continue;
+        }
+
+      entry = g_slice_new0 (Entry);
+      entry->filename = filename;
+      g_hash_table_insert (self->entries,
+          g_strndup (basename, strlen (basename) - strlen (SUFFIX)), entry);
+    }
+
+  g_dir_close (dir);
+  DEBUG ("found %u .client files in %s", g_hash_table_size (self->entries),
+      self->path);
+}
+
+static void
+ensure_entries (Dir *dir)
+{
+  /* If we can't monitor a directory, we look again once what we know about
+   * it is old enough; otherwise we only look again when it changes */
+  if (dir->monitor == NULL && dir->entries != NULL &&
+      g_get_monotonic_time () - dir->scanned_at >= RESCAN_INTERVAL)
+    tp_clear_pointer (&dir->entries, g_hash_table_unref);
+
+  if (dir->entries == NULL)
+    scan_dir (dir);
+}
+
+/*
+ * @client_name: a client name, without the org.freedesktop.Telepathy.Client.
+ *  prefix
+ * @filename: (out) (transfer none) (allow-none): used to return the name
+ *  of the file, valid until the index changes or the next lookup
+ *
+ * Returns: (transfer none): the contents of the highest-priority .client
+ *  file for @client_name, valid until the index changes or the next lookup,
+ *  or %NULL if there is none or it could not be loaded. Use
+ *  g_key_file_ref() to keep it.
+ */
+GKeyFile *
+_mcd_client_file_index_lookup (McdClientFileIndex *self,
+    const gchar *client_name,
+    const gchar **filename)
+{
+  Entry *entry = NULL;
+  guint i;
+
+  g_return_val_if_fail (self != NULL, NULL);
+  g_return_val_if_fail (client_name != NULL, NULL);
+
+  /* We must start monitoring before we look, so that we can't miss a
+   * change */
+  if (!self->monitoring)
+    start_monitoring (self);
+
+  for (i = 0; i < self->dirs->len; i++)
+    {
+      Dir *dir = g_ptr_array_index (self->dirs, i);
+
+      ensure_entries (dir);
+      entry = g_hash_table_lookup (dir->entries, client_name);
+
+      /* the highest-priority directory that has one wins */
+      if (entry != NULL)
+        break;
+    }
+
+  if (entry != NULL && entry->file == NULL && !entry->broken)
+    {
+      GError *error = NULL;
+
+      entry->file = g_key_file_new ();
+
+      if (!g_key_file_load_from_file (entry->file, entry->filename, 0,
+            &error))
+        {
+          g_warning ("Loading file %s failed: %s", entry->filename,
+              error->message);
+          g_error_free (error);
+          tp_clear_pointer (&entry->file, g_key_file_unref);
+          entry->broken = TRUE;
+        }
+    }
+
+  if (filename != NULL)
+    *filename = (entry == NULL ? NULL : entry->filename);
+
+  return (entry == NULL ? NULL : entry->file);
+}
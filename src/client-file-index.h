@@ -0,0 +1,46 @@
+/* Index of Telepathy clients' .client files
+ *
+ * Copyright © 2012 Collabora Ltd.
+ *
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public License
+ * version 2.1 as published by the Free Software Foundation.
+ *
+ * This library is distributed in the hope that it will be useful, but
+ * WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the GNU
+ * Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with this library; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin St, Fifth Floor, Boston, MA
+ * 02110-1301 USA
+ *
+ */
+
+#ifndef MCD_CLIENT_FILE_INDEX_H
+#define MCD_CLIENT_FILE_INDEX_H
+
+#include <glib.h>
+
+G_BEGIN_DECLS
+
+typedef struct _McdClientFileIndex McdClientFileIndex;
+
+G_GNUC_INTERNAL GStrv _mcd_client_file_index_dup_default_dirs (void);
+
+G_GNUC_INTERNAL McdClientFileIndex *_mcd_client_file_index_new (
+    const gchar * const *dirs);
+G_GNUC_INTERNAL void _mcd_client_file_index_free (McdClientFileIndex *self);
+
+G_GNUC_INTERNAL GKeyFile *_mcd_client_file_index_lookup (
+    McdClientFileIndex *self, const gchar *client_name,
+    const gchar **filename);
+G_GNUC_INTERNAL void _mcd_client_file_index_invalidate (
+    McdClientFileIndex *self);
+G_GNUC_INTERNAL guint _mcd_client_file_index_get_n_monitors (
+    McdClientFileIndex *self);
+
+G_END_DECLS
+
+#endif
@@ -0,0 +1,325 @@
+/* Index of Telepathy clients' channel filters
+ *
+ * Copyright © 2012 Collabora Ltd.
+ *
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public License
+ * version 2.1 as published by the Free Software Foundation.
+ *
+ * This library is distributed in the hope that it will be useful, but
+ * WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the GNU
+ * Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with this library; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin St, Fifth Floor, Boston, MA
+ * 02110-1301 USA
+ *
+ */
+
+/*
+ * Almost every channel filter says which ChannelType and TargetHandleType
+ * it is interested in, and a channel only has one of each, so most filters
+ * can be ruled out without looking at them. We put each filter in a bucket
+ * keyed by those two values, using 0 for a filter that doesn't constrain
+ * one of them (or constrains it in a way we can't easily predict, which is
+ * just as correct, if slower). A channel can then only match the filters
+ * in at most four buckets: its own ChannelType or 0, combined with its own
+ * TargetHandleType or 0. The filters in those buckets are checked in full
+ * as usual.
+ *
+ * Most channels are one of a few classes (1-1 text, chatrooms, calls and
+ * so on), which give the same results every time, so we also remember the
+ * results for recently-seen channels. They're keyed by a fingerprint of
+ * the channel's values for the properties that appear in some filter, so
+ * per-channel values like TargetID don't affect it unless a filter
+ * actually looks at them. The registry throws away the whole index, and
+ * with it the remembered results, when a client comes, goes or changes
+ * its filters.
+ */
+
+#include "config.h"
+
+#include "client-filter-index.h"
+
+#include "client-filter.h"
+
+typedef struct
+{
+  /* opaque, usually a McdClientProxy */
+  gpointer client;
+  /* borrowed from the client */
+  const McdClientFilter *filter;
+  guint quality;
+} IndexEntry;
+
+typedef struct
+{
+  /* ChannelType quark in the high 32 bits, 1 + TargetHandleType in the
+   * low 32 bits, either of which may be 0 for "any" */
+  guint64 key;
+  /* IndexEntry */
+  GArray *entries;
+} Bucket;
+
+/* enough for every class of channel that's likely to be around at once */
+#define MAX_MEMO_SIZE 64
+
+struct _McdClientFilterIndex
+{
+  /* borrowed &Bucket.key => owned Bucket */
+  GHashTable *buckets;
+
+  /* GQuark: every property mentioned by some filter, sorted and
+   * without duplicates if properties_sorted is TRUE */
+  GArray *properties;
+  gboolean properties_sorted;
+
+  /* owned GBytes fingerprint => owned GHashTable of results, as returned
+   * by _mcd_client_filter_index_match(); indexed by assume_requested */
+  GHashTable *memo[2];
+};
+
+static guint64
+make_key (GQuark channel_type,
+    gboolean has_handle_type,
+    guint handle_type)
+{
+  guint64 key = ((guint64) channel_type) << 32;
+
+  /* handle types are tiny in practice; anything that won't fit is just
+   * treated as "any" */
+  if (has_handle_type && handle_type < G_MAXUINT32)
+    key |= handle_type + 1;
+
+  return key;
+}
+
+static void
+bucket_free (gpointer p)
+{
+  Bucket *bucket = p;
+
+  g_array_unref (bucket->entries);
+  g_slice_free (Bucket, bucket);
+}
+
+McdClientFilterIndex *
+_mcd_client_filter_index_new (void)
+{
+  McdClientFilterIndex *self = g_slice_new0 (McdClientFilterIndex);
+
+  self->buckets = g_hash_table_new_full (g_int64_hash, g_int64_equal, NULL,
+      bucket_free);
+  self->properties = g_array_new (FALSE, FALSE, sizeof (GQuark));
+  self->properties_sorted = TRUE;
+  self->memo[FALSE] = g_hash_table_new_full (g_bytes_hash, g_bytes_equal,
+      (GDestroyNotify) g_bytes_unref, (GDestroyNotify) g_hash_table_unref);
+  self->memo[TRUE] = g_hash_table_new_full (g_bytes_hash, g_bytes_equal,
+      (GDestroyNotify) g_bytes_unref, (GDestroyNotify) g_hash_table_unref);
+  return self;
+}
+
+void
+_mcd_client_filter_index_free (McdClientFilterIndex *self)
+{
+  g_return_if_fail (self != NULL);
+
+  g_hash_table_unref (self->buckets);
+  g_array_unref (self->properties);
+  g_hash_table_unref (self->memo[FALSE]);
+  g_hash_table_unref (self->memo[TRUE]);
+  g_slice_free (McdClientFilterIndex, self);
+}
+
+/*
+ * _mcd_client_filter_index_add:
+ * @client: an opaque pointer identifying the client
+ * @filters: (element-type McdClientFilter): the client's filters, which
+ *  must not be freed until the index is
+ */
+void
+_mcd_client_filter_index_add (McdClientFilterIndex *self,
+    gpointer client,
+    const GList *filters)
+{
+  const GList *iter;
+
+  g_return_if_fail (self != NULL);
+
+  for (iter = filters; iter != NULL; iter = iter->next)
+    {
+      const McdClientFilter *filter = iter->data;
+      IndexEntry entry = { client, filter,
+          _mcd_client_filter_get_quality (filter) };
+      gboolean has_handle_type;
+      guint handle_type = 0;
+      guint64 key;
+      Bucket *bucket;
+      guint i;
+
+      has_handle_type = _mcd_client_filter_get_target_handle_type (filter,
+          &handle_type);
+      key = make_key (_mcd_client_filter_get_channel_type (filter),
+          has_handle_type, handle_type);
+      bucket = g_hash_table_lookup (self->buckets, &key);
+
+      if (bucket == NULL)
+        {
+          bucket = g_slice_new0 (Bucket);
+          bucket->key = key;
+          bucket->entries = g_array_new (FALSE, FALSE, sizeof (IndexEntry));
+          g_hash_table_insert (self->buckets, &bucket->key, bucket);
+        }
+
+      g_array_append_val (bucket->entries, entry);
+
+      for (i = 0; i < _mcd_client_filter_get_n_properties (filter); i++)
+        {
+          GQuark property = _mcd_client_filter_get_property (filter, i);
+
+          g_array_append_val (self->properties, property);
+        }
+
+      self->properties_sorted = FALSE;
+    }
+
+  /* any results we remembered might now be wrong */
+  g_hash_table_remove_all (self->memo[FALSE]);
+  g_hash_table_remove_all (self->memo[TRUE]);
+}
+
+static gint
+compare_quarks (gconstpointer a,
+    gconstpointer b)
+{
+  GQuark left = *(const GQuark *) a;
+  GQuark right = *(const GQuark *) b;
+
+  return (left > right) - (left < right);
+}
+
+static void
+sort_properties (McdClientFilterIndex *self)
+{
+  GQuark *properties = (GQuark *) self->properties->data;
+  guint i, j = 0;
+
+  if (self->properties_sorted)
+    return;
+
+  g_array_sort (self->properties, compare_quarks);
+
+  for (i = 0; i < self->properties->len; i++)
+    {
+      if (j == 0 || properties[j - 1] != properties[i])
+        properties[j++] = properties[i];
+    }
+
+  g_array_set_size (self->properties, j);
+  self->properties_sorted = TRUE;
+}
+
+static void
+match_bucket (McdClientFilterIndex *self,
+    guint64 key,
+    const McdClientChannelProperties *properties,
+    gboolean assume_requested,
+    GHashTable *matches)
+{
+  Bucket *bucket = g_hash_table_lookup (self->buckets, &key);
+  guint i;
+
+  if (bucket == NULL)
+    return;
+
+  for (i = 0; i < bucket->entries->len; i++)
+    {
+      IndexEntry *entry = &g_array_index (bucket->entries, IndexEntry, i);
+      guint best = GPOINTER_TO_UINT (g_hash_table_lookup (matches,
+            entry->client));
+
+      /* even if this filter matches, there's no way it can be a
+       * better-quality match than the best one we saw so far */
+      if (entry->quality <= best)
+        continue;
+
+      if (_mcd_client_filter_match (entry->filter, properties,
+            assume_requested))
+        g_hash_table_insert (matches, entry->client,
+            GUINT_TO_POINTER (entry->quality));
+    }
+}
+
+/*
+ * _mcd_client_filter_index_match:
+ * @properties: a channel's immutable properties, or a request
+ * @assume_requested: as for _mcd_client_match_filters()
+ *
+ * Returns: (transfer full): a map from each client with a matching
+ *  filter to the quality of its best match, as returned by
+ *  _mcd_client_match_filters(); it may be shared with later calls, so it
+ *  must not be modified
+ */
+GHashTable *
+_mcd_client_filter_index_match (McdClientFilterIndex *self,
+    const McdClientChannelProperties *properties,
+    gboolean assume_requested)
+{
+  GHashTable *memo;
+  GHashTable *matches;
+  GBytes *fingerprint;
+  GQuark channel_type;
+  gboolean has_handle_type;
+  guint handle_type = 0;
+
+  g_return_val_if_fail (self != NULL, NULL);
+  g_return_val_if_fail (properties != NULL, NULL);
+
+  sort_properties (self);
+  memo = self->memo[!!assume_requested];
+  fingerprint = _mcd_client_channel_properties_dup_fingerprint (properties,
+      (const GQuark *) self->properties->data, self->properties->len);
+  matches = g_hash_table_lookup (memo, fingerprint);
+
+  if (matches != NULL)
+    {
+      g_bytes_unref (fingerprint);
+      return g_hash_table_ref (matches);
+    }
+
+  matches = g_hash_table_new (NULL, NULL);
+
+  channel_type = _mcd_client_channel_properties_get_channel_type (
+      properties);
+  has_handle_type = _mcd_client_channel_properties_get_target_handle_type (
+      properties, &handle_type);
+
+  /* a channel type of 0 is one that no filter mentions, so only filters
+   * that don't care about the channel type can match */
+  if (channel_type != 0)
+    {
+      if (has_handle_type)
+        match_bucket (self, make_key (channel_type, TRUE, handle_type),
+            properties, assume_requested, matches);
+
+      match_bucket (self, make_key (channel_type, FALSE, 0),
+          properties, assume_requested, matches);
+    }
+
+  if (has_handle_type)
+    match_bucket (self, make_key (0, TRUE, handle_type),
+        properties, assume_requested, matches);
+
+  match_bucket (self, make_key (0, FALSE, 0),
+      properties, assume_requested, matches);
+
+  /* forgetting everything is crude, but we only get here if something is
+   * generating lots of unusual channels */
+  if (g_hash_table_size (memo) >= MAX_MEMO_SIZE)
+    g_hash_table_remove_all (memo);
+
+  g_hash_table_insert (memo, fingerprint, g_hash_table_ref (matches));
+  return matches;
+}
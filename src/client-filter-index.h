@@ -0,0 +1,46 @@
+/* Index of Telepathy clients' channel filters
+ *
+ * Copyright © 2012 Collabora Ltd.
+ *
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public License
+ * version 2.1 as published by the Free Software Foundation.
+ *
+ * This library is distributed in the hope that it will be useful, but
+ * WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the GNU
+ * Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with this library; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin St, Fifth Floor, Boston, MA
+ * 02110-1301 USA
+ *
+ */
+
+#ifndef MCD_CLIENT_FILTER_INDEX_H
+#define MCD_CLIENT_FILTER_INDEX_H
+
+#include <glib.h>
+
+#include "client-filter.h"
+
+G_BEGIN_DECLS
+
+typedef struct _McdClientFilterIndex McdClientFilterIndex;
+
+G_GNUC_INTERNAL McdClientFilterIndex *_mcd_client_filter_index_new (void);
+G_GNUC_INTERNAL void _mcd_client_filter_index_free (
+    McdClientFilterIndex *self);
+
+G_GNUC_INTERNAL void _mcd_client_filter_index_add (
+    McdClientFilterIndex *self, gpointer client, const GList *filters);
+
+G_GNUC_INTERNAL GHashTable *_mcd_client_filter_index_match (
+    McdClientFilterIndex *self,
+    const McdClientChannelProperties *properties,
+    gboolean assume_requested);
+
+G_END_DECLS
+
+#endif
@@ -0,0 +1,653 @@
+/* Compiled Telepathy client channel filters
+ *
+ * Copyright © 2012 Collabora Ltd.
+ *
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public License
+ * version 2.1 as published by the Free Software Foundation.
+ *
+ * This library is distributed in the hope that it will be useful, but
+ * WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the GNU
+ * Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with this library; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin St, Fifth Floor, Boston, MA
+ * 02110-1301 USA
+ *
+ */
+
+/*
+ * A client's channel filters are given to us as a{sv}, either in a
+ * .client file or in a *ChannelFilter D-Bus property, but they only use a
+ * handful of types and never change. When we get them, we turn each one
+ * into an array of (property, expected value) terms, sorted by property
+ * quark, with any strings replaced by their quarks.
+ *
+ * A channel's immutable properties are converted the same way, once, into
+ * McdClientChannelProperties. Every representation a value could be
+ * compared as is worked out in advance: for instance, a 'u' is both a
+ * valid guint64 and a valid gint64. A string that has never been interned
+ * can't be equal to any string in any filter, so we don't intern it, and
+ * give it quark 0, which never matches. The flip side is that compiled
+ * properties can be out of date with respect to filters compiled after
+ * them; _mcd_client_channel_properties_is_stale() says when that might be
+ * the case.
+ *
+ * Matching a filter against a channel is then a merge of two sorted
+ * arrays, comparing integers, with the same results as matching the
+ * GHashTable of GValues against the GVariant one property at a time.
+ */
+
+#include "config.h"
+
+#include "client-filter.h"
+
+#include <stdlib.h>
+
+#include <dbus/dbus-glib.h>
+
+#include <telepathy-glib/telepathy-glib.h>
+#include <telepathy-glib/telepathy-glib-dbus.h>
+
+typedef enum {
+    VALUE_STRING = (1 << 0),
+    VALUE_OBJECT_PATH = (1 << 1),
+    VALUE_BOOLEAN = (1 << 2),
+    VALUE_UINT64 = (1 << 3),
+    VALUE_INT64 = (1 << 4)
+} ValueType;
+
+typedef union {
+    /* VALUE_STRING and VALUE_OBJECT_PATH: 0 if NULL or never interned */
+    GQuark quark;
+    gboolean boolean;
+    guint64 u;
+    gint64 i;
+} Value;
+
+typedef struct {
+    GQuark property;
+    /* exactly one ValueType */
+    ValueType type;
+    Value value;
+} FilterTerm;
+
+struct _McdClientFilter {
+    guint n_terms;
+    /* sorted by property */
+    FilterTerm terms[];
+};
+
+typedef struct {
+    GQuark property;
+    /* the ValueTypes this value can be compared as */
+    guint types;
+    /* VALUE_STRING or VALUE_OBJECT_PATH */
+    GQuark quark;
+    /* VALUE_BOOLEAN */
+    gboolean boolean;
+    /* VALUE_UINT64 */
+    guint64 u;
+    /* VALUE_INT64 */
+    gint64 i;
+} ChannelEntry;
+
+struct _McdClientChannelProperties {
+    /* sorted by property */
+    GArray *entries;
+    /* filters_compiled when we were created */
+    guint filters_compiled;
+};
+
+/* incremented by every _mcd_client_filter_new(), which may intern new
+ * strings */
+static guint filters_compiled = 0;
+
+static gint
+compare_filter_terms (gconstpointer a,
+    gconstpointer b)
+{
+  const FilterTerm *left = a;
+  const FilterTerm *right = b;
+
+  return (left->property > right->property) -
+    (left->property < right->property);
+}
+
+static gint
+compare_channel_entries (gconstpointer a,
+    gconstpointer b)
+{
+  const ChannelEntry *left = a;
+  const ChannelEntry *right = b;
+
+  return (left->property > right->property) -
+    (left->property < right->property);
+}
+
+/*
+ * _mcd_client_filter_new:
+ * @channel_class: (element-type utf8 GObject.Value): a filter, with values
+ *  of the types allowed for ObserverChannelFilter
+ *
+ * Returns: (transfer full) (allow-none): the compiled filter, or %NULL if
+ *  a value in @channel_class has an unsupported type
+ */
+McdClientFilter *
+_mcd_client_filter_new (GHashTable *channel_class)
+{
+  McdClientFilter *self;
+  GHashTableIter iter;
+  gpointer k, v;
+  guint i = 0;
+
+  filters_compiled++;
+
+  self = g_malloc (sizeof (McdClientFilter) +
+      g_hash_table_size (channel_class) * sizeof (FilterTerm));
+  self->n_terms = g_hash_table_size (channel_class);
+
+  g_hash_table_iter_init (&iter, channel_class);
+
+  while (g_hash_table_iter_next (&iter, &k, &v))
+    {
+      FilterTerm *term = &self->terms[i++];
+      const GValue *value = v;
+      GType type = G_VALUE_TYPE (value);
+
+      term->property = g_quark_from_string (k);
+
+      if (type == G_TYPE_STRING)
+        {
+          term->type = VALUE_STRING;
+          term->value.quark = g_quark_from_string (
+              g_value_get_string (value));
+        }
+      else if (type == DBUS_TYPE_G_OBJECT_PATH)
+        {
+          term->type = VALUE_OBJECT_PATH;
+          term->value.quark = g_quark_from_string (
+              g_value_get_boxed (value));
+        }
+      else if (type == G_TYPE_BOOLEAN)
+        {
+          term->type = VALUE_BOOLEAN;
+          term->value.boolean = !!g_value_get_boolean (value);
+        }
+      else if (type == G_TYPE_UCHAR)
+        {
+          term->type = VALUE_UINT64;
+          term->value.u = g_value_get_uchar (value);
+        }
+      else if (type == G_TYPE_UINT)
+        {
+          term->type = VALUE_UINT64;
+          term->value.u = g_value_get_uint (value);
+        }
+      else if (type == G_TYPE_UINT64)
+        {
+          term->type = VALUE_UINT64;
+          term->value.u = g_value_get_uint64 (value);
+        }
+      else if (type == G_TYPE_INT)
+        {
+          term->type = VALUE_INT64;
+          term->value.i = g_value_get_int (value);
+        }
+      else if (type == G_TYPE_INT64)
+        {
+          term->type = VALUE_INT64;
+          term->value.i = g_value_get_int64 (value);
+        }
+      else
+        {
+          g_warning ("%s: Property %s has an invalid type (%s)",
+              G_STRFUNC, (const gchar *) k, g_type_name (type));
+          g_free (self);
+          return NULL;
+        }
+    }
+
+  qsort (self->terms, self->n_terms, sizeof (FilterTerm),
+      compare_filter_terms);
+  return self;
+}
+
+void
+_mcd_client_filter_free (McdClientFilter *self)
+{
+  g_free (self);
+}
+
+/*
+ * Returns: (transfer container) (element-type utf8 GObject.Value): the
+ *  filter in the form it was given to _mcd_client_filter_new(), except
+ *  that unsigned and signed integers are always guint64 and gint64
+ */
+GHashTable *
+_mcd_client_filter_dup_channel_class (const McdClientFilter *self)
+{
+  GHashTable *channel_class = g_hash_table_new_full (g_str_hash, g_str_equal,
+      g_free, (GDestroyNotify) tp_g_value_slice_free);
+  guint i;
+
+  for (i = 0; i < self->n_terms; i++)
+    {
+      const FilterTerm *term = &self->terms[i];
+      GValue *value;
+
+      switch (term->type)
+        {
+        case VALUE_STRING:
+          value = tp_g_value_slice_new_string (
+              g_quark_to_string (term->value.quark));
+          break;
+
+        case VALUE_OBJECT_PATH:
+          value = tp_g_value_slice_new_object_path (
+              g_quark_to_string (term->value.quark));
+          break;
+
+        case VALUE_BOOLEAN:
+          value = tp_g_value_slice_new_boolean (term->value.boolean);
+          break;
+
+        case VALUE_UINT64:
+          value = tp_g_value_slice_new_uint64 (term->value.u);
+          break;
+
+        case VALUE_INT64:
+          value = tp_g_value_slice_new_int64 (term->value.i);
+          break;
+
+        default:
+          g_assert_not_reached ();
+        }
+
+      g_hash_table_insert (channel_class,
+          g_strdup (g_quark_to_string (term->property)), value);
+    }
+
+  return channel_class;
+}
+
+/*
+ * Returns: 1 + the number of properties in the filter, which is what
+ *  _mcd_client_filter_match() returns if it matches
+ */
+guint
+_mcd_client_filter_get_quality (const McdClientFilter *self)
+{
+  return self->n_terms + 1;
+}
+
+guint
+_mcd_client_filter_get_n_properties (const McdClientFilter *self)
+{
+  return self->n_terms;
+}
+
+/*
+ * Returns: the @i'th property the filter mentions; they are in ascending
+ *  order
+ */
+GQuark
+_mcd_client_filter_get_property (const McdClientFilter *self,
+    guint i)
+{
+  g_return_val_if_fail (i < self->n_terms, 0);
+
+  return self->terms[i].property;
+}
+
+static const FilterTerm *
+filter_lookup (const McdClientFilter *self,
+    GQuark property)
+{
+  FilterTerm key = { property };
+
+  return bsearch (&key, self->terms, self->n_terms, sizeof (FilterTerm),
+      compare_filter_terms);
+}
+
+/*
+ * Returns: the ChannelType the filter requires, as a quark, or 0 if it
+ *  doesn't require a particular string
+ */
+GQuark
+_mcd_client_filter_get_channel_type (const McdClientFilter *self)
+{
+  const FilterTerm *term = filter_lookup (self,
+      g_quark_from_static_string (TP_PROP_CHANNEL_CHANNEL_TYPE));
+
+  if (term == NULL || term->type != VALUE_STRING)
+    return 0;
+
+  return term->value.quark;
+}
+
+/*
+ * Returns: %TRUE if the filter requires a particular unsigned
+ *  TargetHandleType that fits in a guint, which is stored in @handle_type
+ */
+gboolean
+_mcd_client_filter_get_target_handle_type (const McdClientFilter *self,
+    guint *handle_type)
+{
+  const FilterTerm *term = filter_lookup (self,
+      g_quark_from_static_string (TP_PROP_CHANNEL_TARGET_HANDLE_TYPE));
+
+  if (term == NULL || term->type != VALUE_UINT64 || term->value.u > G_MAXUINT)
+    return FALSE;
+
+  *handle_type = term->value.u;
+  return TRUE;
+}
+
+McdClientChannelProperties *
+_mcd_client_channel_properties_new (GVariant *properties)
+{
+  McdClientChannelProperties *self;
+  GVariantIter iter;
+  const gchar *name;
+  GVariant *value;
+
+  g_return_val_if_fail (g_variant_is_of_type (properties,
+        G_VARIANT_TYPE_VARDICT), NULL);
+
+  self = g_slice_new0 (McdClientChannelProperties);
+  self->filters_compiled = filters_compiled;
+  self->entries = g_array_sized_new (FALSE, TRUE, sizeof (ChannelEntry),
+      g_variant_n_children (properties));
+
+  g_variant_iter_init (&iter, properties);
+
+  while (g_variant_iter_loop (&iter, "{&sv}", &name, &value))
+    {
+      ChannelEntry entry = { 0 };
+
+      /* if nobody has interned the property name, no filter mentions it */
+      entry.property = g_quark_try_string (name);
+
+      if (entry.property == 0)
+        continue;
+
+      switch (g_variant_classify (value))
+        {
+        case G_VARIANT_CLASS_STRING:
+          entry.types = VALUE_STRING;
+          entry.quark = g_quark_try_string (g_variant_get_string (value,
+                NULL));
+          break;
+
+        case G_VARIANT_CLASS_OBJECT_PATH:
+          entry.types = VALUE_OBJECT_PATH;
+          entry.quark = g_quark_try_string (g_variant_get_string (value,
+                NULL));
+          break;
+
+        case G_VARIANT_CLASS_BOOLEAN:
+          entry.types = VALUE_BOOLEAN;
+          entry.boolean = !!g_variant_get_boolean (value);
+          break;
+
+        case G_VARIANT_CLASS_BYTE:
+          entry.u = g_variant_get_byte (value);
+          break;
+
+        case G_VARIANT_CLASS_UINT16:
+          entry.u = g_variant_get_uint16 (value);
+          break;
+
+        case G_VARIANT_CLASS_UINT32:
+          entry.u = g_variant_get_uint32 (value);
+          break;
+
+        case G_VARIANT_CLASS_UINT64:
+          entry.u = g_variant_get_uint64 (value);
+          break;
+
+        case G_VARIANT_CLASS_INT16:
+          entry.i = g_variant_get_int16 (value);
+          break;
+
+        case G_VARIANT_CLASS_INT32:
+          entry.i = g_variant_get_int32 (value);
+          break;
+
+        case G_VARIANT_CLASS_INT64:
+          entry.i = g_variant_get_int64 (value);
+          break;
+
+        default:
+          /* no filter can match this */
+          continue;
+        }
+
+      /* the same conversions as tp_vardict_get_uint64() and
+       * tp_vardict_get_int64() */
+      switch (g_variant_classify (value))
+        {
+        case G_VARIANT_CLASS_BYTE:
+        case G_VARIANT_CLASS_UINT16:
+        case G_VARIANT_CLASS_UINT32:
+        case G_VARIANT_CLASS_UINT64:
+          entry.types = VALUE_UINT64;
+
+          if (entry.u <= G_MAXINT64)
+            {
+              entry.types |= VALUE_INT64;
+              entry.i = entry.u;
+            }
+          break;
+
+        case G_VARIANT_CLASS_INT16:
+        case G_VARIANT_CLASS_INT32:
+        case G_VARIANT_CLASS_INT64:
+          entry.types = VALUE_INT64;
+
+          if (entry.i >= 0)
+            {
+              entry.types |= VALUE_UINT64;
+              entry.u = entry.i;
+            }
+          break;
+
+        default:
+          break;
+        }
+
+      g_array_append_val (self->entries, entry);
+    }
+
+  g_array_sort (self->entries, compare_channel_entries);
+  return self;
+}
+
+void
+_mcd_client_channel_properties_free (McdClientChannelProperties *self)
+{
+  g_array_unref (self->entries);
+  g_slice_free (McdClientChannelProperties, self);
+}
+
+/*
+ * Returns: %TRUE if a filter has been compiled since @self was, in which
+ *  case @self might not match that filter when it should, and should be
+ *  recreated from the channel's properties
+ */
+gboolean
+_mcd_client_channel_properties_is_stale (
+    const McdClientChannelProperties *self)
+{
+  return self->filters_compiled != filters_compiled;
+}
+
+static const ChannelEntry *
+channel_properties_lookup (const McdClientChannelProperties *self,
+    GQuark property)
+{
+  ChannelEntry key = { property };
+
+  return bsearch (&key, self->entries->data, self->entries->len,
+      sizeof (ChannelEntry), compare_channel_entries);
+}
+
+/*
+ * _mcd_client_channel_properties_dup_fingerprint:
+ * @properties: (array length=n_properties): property quarks in ascending
+ *  order, usually every property mentioned by some filter
+ *
+ * Returns: a summary of the values of @properties in @self, such that two
+ *  channels with the same fingerprint for the properties mentioned by a
+ *  filter are certain to give the same result from
+ *  _mcd_client_filter_match()
+ */
+GBytes *
+_mcd_client_channel_properties_dup_fingerprint (
+    const McdClientChannelProperties *self,
+    const GQuark *properties,
+    guint n_properties)
+{
+  const ChannelEntry *entries = (const ChannelEntry *) self->entries->data;
+  guint n_entries = self->entries->len;
+  GByteArray *fingerprint = g_byte_array_new ();
+  guint i, j = 0;
+
+  for (i = 0; i < n_properties; i++)
+    {
+      const ChannelEntry *entry;
+
+      while (j < n_entries && entries[j].property < properties[i])
+        j++;
+
+      if (j == n_entries)
+        break;
+
+      if (entries[j].property != properties[i])
+        continue;
+
+      /* each field separately, so padding can't get in */
+      entry = &entries[j];
+      g_byte_array_append (fingerprint, (const guint8 *) &entry->property,
+          sizeof (entry->property));
+      g_byte_array_append (fingerprint, (const guint8 *) &entry->types,
+          sizeof (entry->types));
+      g_byte_array_append (fingerprint, (const guint8 *) &entry->quark,
+          sizeof (entry->quark));
+      g_byte_array_append (fingerprint, (const guint8 *) &entry->boolean,
+          sizeof (entry->boolean));
+      g_byte_array_append (fingerprint, (const guint8 *) &entry->u,
+          sizeof (entry->u));
+      g_byte_array_append (fingerprint, (const guint8 *) &entry->i,
+          sizeof (entry->i));
+    }
+
+  return g_byte_array_free_to_bytes (fingerprint);
+}
+
+GQuark
+_mcd_client_channel_properties_get_channel_type (
+    const McdClientChannelProperties *self)
+{
+  const ChannelEntry *entry = channel_properties_lookup (self,
+      g_quark_from_static_string (TP_PROP_CHANNEL_CHANNEL_TYPE));
+
+  if (entry == NULL || entry->types != VALUE_STRING)
+    return 0;
+
+  return entry->quark;
+}
+
+gboolean
+_mcd_client_channel_properties_get_target_handle_type (
+    const McdClientChannelProperties *self,
+    guint *handle_type)
+{
+  const ChannelEntry *entry = channel_properties_lookup (self,
+      g_quark_from_static_string (TP_PROP_CHANNEL_TARGET_HANDLE_TYPE));
+
+  if (entry == NULL || (entry->types & VALUE_UINT64) == 0 ||
+      entry->u > G_MAXUINT)
+    return FALSE;
+
+  *handle_type = entry->u;
+  return TRUE;
+}
+
+static gboolean
+term_matches (const FilterTerm *term,
+    const ChannelEntry *entry)
+{
+  if ((entry->types & term->type) == 0)
+    return FALSE;
+
+  switch (term->type)
+    {
+    case VALUE_STRING:
+    case VALUE_OBJECT_PATH:
+      return term->value.quark != 0 && term->value.quark == entry->quark;
+
+    case VALUE_BOOLEAN:
+      return term->value.boolean == entry->boolean;
+
+    case VALUE_UINT64:
+      return term->value.u == entry->u;
+
+    case VALUE_INT64:
+      return term->value.i == entry->i;
+
+    default:
+      g_assert_not_reached ();
+    }
+
+  return FALSE;
+}
+
+/*
+ * _mcd_client_filter_match:
+ * @properties: a channel's immutable properties, or a request
+ * @assume_requested: if %TRUE, @properties are a request, and the channel
+ *  will have Requested=TRUE whether they say so or not
+ *
+ * Returns: 0 if the channel does not match the filter, or
+ *  _mcd_client_filter_get_quality() if it does
+ */
+guint
+_mcd_client_filter_match (const McdClientFilter *self,
+    const McdClientChannelProperties *properties,
+    gboolean assume_requested)
+{
+  const ChannelEntry *entries =
+    (const ChannelEntry *) properties->entries->data;
+  guint n_entries = properties->entries->len;
+  GQuark requested = 0;
+  guint i, j = 0;
+
+  if (assume_requested)
+    requested = g_quark_from_static_string (TP_PROP_CHANNEL_REQUESTED);
+
+  for (i = 0; i < self->n_terms; i++)
+    {
+      const FilterTerm *term = &self->terms[i];
+
+      if (term->property == requested)
+        {
+          if (term->type != VALUE_BOOLEAN || !term->value.boolean)
+            return 0;
+
+          continue;
+        }
+
+      while (j < n_entries && entries[j].property < term->property)
+        j++;
+
+      if (j == n_entries || entries[j].property != term->property ||
+          !term_matches (term, &entries[j]))
+        return 0;
+    }
+
+  return _mcd_client_filter_get_quality (self);
+}
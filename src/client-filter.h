@@ -0,0 +1,70 @@
+/* Compiled Telepathy client channel filters
+ *
+ * Copyright © 2012 Collabora Ltd.
+ *
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public License
+ * version 2.1 as published by the Free Software Foundation.
+ *
+ * This library is distributed in the hope that it will be useful, but
+ * WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the GNU
+ * Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with this library; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin St, Fifth Floor, Boston, MA
+ * 02110-1301 USA
+ *
+ */
+
+#ifndef MCD_CLIENT_FILTER_H
+#define MCD_CLIENT_FILTER_H
+
+#include <glib.h>
+
+G_BEGIN_DECLS
+
+typedef struct _McdClientFilter McdClientFilter;
+typedef struct _McdClientChannelProperties McdClientChannelProperties;
+
+G_GNUC_INTERNAL McdClientFilter *_mcd_client_filter_new (
+    GHashTable *channel_class);
+G_GNUC_INTERNAL void _mcd_client_filter_free (McdClientFilter *self);
+G_GNUC_INTERNAL GHashTable *_mcd_client_filter_dup_channel_class (
+    const McdClientFilter *self);
+
+G_GNUC_INTERNAL guint _mcd_client_filter_get_quality (
+    const McdClientFilter *self);
+G_GNUC_INTERNAL GQuark _mcd_client_filter_get_channel_type (
+    const McdClientFilter *self);
+G_GNUC_INTERNAL gboolean _mcd_client_filter_get_target_handle_type (
+    const McdClientFilter *self, guint *handle_type);
+G_GNUC_INTERNAL guint _mcd_client_filter_get_n_properties (
+    const McdClientFilter *self);
+G_GNUC_INTERNAL GQuark _mcd_client_filter_get_property (
+    const McdClientFilter *self, guint i);
+
+G_GNUC_INTERNAL McdClientChannelProperties *
+    _mcd_client_channel_properties_new (GVariant *properties);
+G_GNUC_INTERNAL void _mcd_client_channel_properties_free (
+    McdClientChannelProperties *self);
+G_GNUC_INTERNAL gboolean _mcd_client_channel_properties_is_stale (
+    const McdClientChannelProperties *self);
+
+G_GNUC_INTERNAL GQuark _mcd_client_channel_properties_get_channel_type (
+    const McdClientChannelProperties *self);
+G_GNUC_INTERNAL gboolean
+    _mcd_client_channel_properties_get_target_handle_type (
+    const McdClientChannelProperties *self, guint *handle_type);
+G_GNUC_INTERNAL GBytes *_mcd_client_channel_properties_dup_fingerprint (
+    const McdClientChannelProperties *self, const GQuark *properties,
+    guint n_properties);
+
+G_GNUC_INTERNAL guint _mcd_client_filter_match (const McdClientFilter *self,
+    const McdClientChannelProperties *properties,
+    gboolean assume_requested);
+
+G_END_DECLS
+
+#endif
@@ -25,6 +25,8 @@
 
 #include <telepathy-glib/telepathy-glib.h>
 
+#include "client-file-index.h"
+#include "client-filter-index.h"
 #include "mcd-debug.h"
 
 #include <dbus/dbus.h>
@@ -67,8 +69,31 @@ struct _McdClientRegistryPrivate
    * */
   gsize startup_lock;
   gboolean startup_completed;
+
+  /* indices of each kind of client's filters, indexed by
+   * McdClientInterface, or NULL if they need rebuilding */
+  McdClientFilterIndex *filter_indices[MCD_CLIENT_OBSERVER + 1];
+
+  /* where to find each client's .client file */
+  McdClientFileIndex *client_files;
 };
 
+static void
+_mcd_client_registry_clear_filter_index (McdClientRegistry *self,
+    McdClientInterface iface)
+{
+  tp_clear_pointer (&self->priv->filter_indices[iface],
+      _mcd_client_filter_index_free);
+}
+
+static void
+_mcd_client_registry_clear_filter_indices (McdClientRegistry *self)
+{
+  _mcd_client_registry_clear_filter_index (self, MCD_CLIENT_APPROVER);
+  _mcd_client_registry_clear_filter_index (self, MCD_CLIENT_HANDLER);
+  _mcd_client_registry_clear_filter_index (self, MCD_CLIENT_OBSERVER);
+}
+
 static void
 _mcd_client_registry_inc_startup_lock (McdClientRegistry *self)
 {
@@ -105,6 +130,9 @@ static void mcd_client_registry_ready_cb (McdClientProxy *client,
     McdClientRegistry *self);
 static void mcd_client_registry_gone_cb (McdClientProxy *client,
     McdClientRegistry *self);
+static void mcd_client_registry_filters_changed_cb (McdClientProxy *client,
+    guint iface,
+    McdClientRegistry *self);
 
 static void
 _mcd_client_registry_found_name (McdClientRegistry *self,
@@ -113,6 +141,8 @@ _mcd_client_registry_found_name (McdClientRegistry *self,
     gboolean activatable)
 {
   McdClientProxy *client;
+  GKeyFile *client_file;
+  const gchar *filename;
 
   if (!g_str_has_prefix (well_known_name, TP_CLIENT_BUS_NAME_BASE))
     {
@@ -151,10 +181,17 @@ _mcd_client_registry_found_name (McdClientRegistry *self,
 
   DEBUG ("Registering client %s", well_known_name);
 
+  client_file = _mcd_client_file_index_lookup (self->priv->client_files,
+      well_known_name + MC_CLIENT_BUS_NAME_BASE_LEN, &filename);
+
+  if (client_file != NULL)
+    DEBUG ("%s has .client file %s", well_known_name, filename);
+
   client = _mcd_client_proxy_new (self->priv->dbus_daemon,
-      well_known_name, unique_name_if_known, activatable);
+      well_known_name, unique_name_if_known, activatable, client_file);
   g_hash_table_insert (self->priv->clients, g_strdup (well_known_name),
       client);
+  _mcd_client_registry_clear_filter_indices (self);
 
   /* paired with one in mcd_client_registry_ready_cb, when the
    * McdClientProxy is ready */
@@ -168,6 +205,10 @@ _mcd_client_registry_found_name (McdClientRegistry *self,
                     G_CALLBACK (mcd_client_registry_gone_cb),
                     self);
 
+  g_signal_connect (client, "filters-changed",
+                    G_CALLBACK (mcd_client_registry_filters_changed_cb),
+                    self);
+
   g_signal_emit (self, signals[S_CLIENT_ADDED], 0, client);
 }
 
@@ -186,6 +227,8 @@ mcd_client_registry_disconnect_client_signals (gpointer k G_GNUC_UNUSED,
 {
   g_signal_handlers_disconnect_by_func (v, mcd_client_registry_ready_cb, data);
   g_signal_handlers_disconnect_by_func (v, mcd_client_registry_gone_cb, data);
+  g_signal_handlers_disconnect_by_func (v,
+      mcd_client_registry_filters_changed_cb, data);
 
   if (!_mcd_client_proxy_is_ready (v))
     {
@@ -211,7 +254,8 @@ _mcd_client_registry_remove (McdClientRegistry *self,
           client, self);
     }
 
-  g_hash_table_remove (self->priv->clients, well_known_name);
+  if (g_hash_table_remove (self->priv->clients, well_known_name))
+    _mcd_client_registry_clear_filter_indices (self);
 }
 
 void _mcd_client_registry_init_hash_iter (McdClientRegistry *self,
@@ -224,6 +268,8 @@ void _mcd_client_registry_init_hash_iter (McdClientRegistry *self,
 static void
 _mcd_client_registry_init (McdClientRegistry *self)
 {
+  GStrv dirs;
+
   self->priv = G_TYPE_INSTANCE_GET_PRIVATE (self, MCD_TYPE_CLIENT_REGISTRY,
       McdClientRegistryPrivate);
 
@@ -232,6 +278,11 @@ _mcd_client_registry_init (McdClientRegistry *self)
   self->priv->startup_lock = 1;
   self->priv->clients = g_hash_table_new_full (g_str_hash, g_str_equal, g_free,
       g_object_unref);
+
+  dirs = _mcd_client_file_index_dup_default_dirs ();
+  self->priv->client_files = _mcd_client_file_index_new (
+      (const gchar * const *) dirs);
+  g_strfreev (dirs);
 }
 
 static void
@@ -465,6 +516,8 @@ mcd_client_registry_dispose (GObject *object)
     }
 
   tp_clear_pointer (&self->priv->clients, g_hash_table_unref);
+  _mcd_client_registry_clear_filter_indices (self);
+  tp_clear_pointer (&self->priv->client_files, _mcd_client_file_index_free);
 
   if (chain_up != NULL)
     chain_up (object);
@@ -530,6 +583,107 @@ mcd_client_registry_gone_cb (McdClientProxy *client,
   _mcd_client_registry_remove (self, tp_proxy_get_bus_name (client));
 }
 
+static void
+mcd_client_registry_filters_changed_cb (McdClientProxy *client,
+    guint iface,
+    McdClientRegistry *self)
+{
+  /* the index borrows the filters that have just been freed, so it must go
+   * now; it's rebuilt the next time it's needed */
+  _mcd_client_registry_clear_filter_index (self, iface);
+}
+
+static McdClientFilterIndex *
+_mcd_client_registry_get_filter_index (McdClientRegistry *self,
+    McdClientInterface iface)
+{
+  GHashTableIter iter;
+  gpointer client_p;
+  GQuark iface_quark;
+
+  if (self->priv->filter_indices[iface] != NULL)
+    return self->priv->filter_indices[iface];
+
+  switch (iface)
+    {
+    case MCD_CLIENT_APPROVER:
+      iface_quark = TP_IFACE_QUARK_CLIENT_APPROVER;
+      break;
+
+    case MCD_CLIENT_HANDLER:
+      iface_quark = TP_IFACE_QUARK_CLIENT_HANDLER;
+      break;
+
+    case MCD_CLIENT_OBSERVER:
+      iface_quark = TP_IFACE_QUARK_CLIENT_OBSERVER;
+      break;
+
+    default:
+      g_return_val_if_reached (NULL);
+    }
+
+  self->priv->filter_indices[iface] = _mcd_client_filter_index_new ();
+
+  g_hash_table_iter_init (&iter, self->priv->clients);
+
+  while (g_hash_table_iter_next (&iter, NULL, &client_p))
+    {
+      McdClientProxy *client = MCD_CLIENT_PROXY (client_p);
+      const GList *filters;
+
+      if (!tp_proxy_has_interface_by_id (client, iface_quark))
+        continue;
+
+      switch (iface)
+        {
+        case MCD_CLIENT_APPROVER:
+          filters = _mcd_client_proxy_get_approver_filters (client);
+          break;
+
+        case MCD_CLIENT_HANDLER:
+          filters = _mcd_client_proxy_get_handler_filters (client);
+          break;
+
+        default:
+          filters = _mcd_client_proxy_get_observer_filters (client);
+          break;
+        }
+
+      _mcd_client_filter_index_add (self->priv->filter_indices[iface],
+          client, filters);
+    }
+
+  return self->priv->filter_indices[iface];
+}
+
+/*
+ * _mcd_client_registry_match_filters:
+ * @iface: which of the clients' filters to use
+ * @channel_properties: a channel's immutable properties, or a request
+ * @assume_requested: as for _mcd_client_match_filters()
+ *
+ * Returns: (transfer full): a map from borrowed McdClientProxy to the
+ *  quality of its best match, as for _mcd_client_match_filters(),
+ *  containing only the clients that implement @iface and match; it may be
+ *  shared, so it must not be modified
+ */
+GHashTable *
+_mcd_client_registry_match_filters (McdClientRegistry *self,
+    McdClientInterface iface,
+    const McdClientChannelProperties *channel_properties,
+    gboolean assume_requested)
+{
+  McdClientFilterIndex *index;
+
+  g_return_val_if_fail (MCD_IS_CLIENT_REGISTRY (self), NULL);
+
+  index = _mcd_client_registry_get_filter_index (self, iface);
+  g_return_val_if_fail (index != NULL, NULL);
+
+  return _mcd_client_filter_index_match (index, channel_properties,
+      assume_requested);
+}
+
 GPtrArray *
 _mcd_client_registry_dup_client_caps (McdClientRegistry *self)
 {
@@ -609,15 +763,43 @@ _mcd_client_registry_list_possible_handlers (McdClientRegistry *self,
 {
   GList *handlers = NULL;
   GList *handlers_iter;
+  GHashTable *matches;
   GHashTableIter client_iter;
-  gpointer client_p;
+  gpointer client_p, quality_p;
+  McdClientChannelProperties *compiled;
+
+  if (channel == NULL)
+    {
+      /* We don't know the channel's properties, so we must work out the
+       * quality of match from the channel request. We can assume that the
+       * request will return one channel, with the requested properties,
+       * plus Requested == TRUE.
+       */
+      g_assert (request_props != NULL);
+      compiled = _mcd_client_channel_properties_new (request_props);
+      matches = _mcd_client_registry_match_filters (self,
+          MCD_CLIENT_HANDLER, compiled, TRUE);
+    }
+  else
+    {
+      GVariant *properties;
+
+      g_assert (TP_IS_CHANNEL (channel));
+      properties = tp_channel_dup_immutable_properties (channel);
+      compiled = _mcd_client_channel_properties_new (properties);
+      matches = _mcd_client_registry_match_filters (self,
+          MCD_CLIENT_HANDLER, compiled, FALSE);
+      g_variant_unref (properties);
+    }
+
+  _mcd_client_channel_properties_free (compiled);
 
-  _mcd_client_registry_init_hash_iter (self, &client_iter);
+  g_hash_table_iter_init (&client_iter, matches);
 
-  while (g_hash_table_iter_next (&client_iter, NULL, &client_p))
+  while (g_hash_table_iter_next (&client_iter, &client_p, &quality_p))
     {
       McdClientProxy *client = MCD_CLIENT_PROXY (client_p);
-      gsize quality;
+      PossibleHandler *ph;
 
       if (must_have_unique_name != NULL &&
           tp_strdiff (must_have_unique_name,
@@ -628,47 +810,16 @@ _mcd_client_registry_list_possible_handlers (McdClientRegistry *self,
           continue;
         }
 
-      if (!tp_proxy_has_interface_by_id (client,
-            TP_IFACE_QUARK_CLIENT_HANDLER))
-        {
-            /* not a handler at all */
-            continue;
-        }
-
-      if (channel == NULL)
-        {
-          /* We don't know the channel's properties (the next part will not
-           * execute), so we must work out the quality of match from the
-           * channel request. We can assume that the request will return one
-           * channel, with the requested properties, plus Requested == TRUE.
-           */
-          g_assert (request_props != NULL);
-          quality = _mcd_client_match_filters (request_props,
-              _mcd_client_proxy_get_handler_filters (client), TRUE);
-        }
-      else
-        {
-          GVariant *properties;
-
-          g_assert (TP_IS_CHANNEL (channel));
-          properties = tp_channel_dup_immutable_properties (channel);
-          quality = _mcd_client_match_filters (properties,
-              _mcd_client_proxy_get_handler_filters (client), FALSE);
-          g_variant_unref (properties);
-        }
+      ph = g_slice_new0 (PossibleHandler);
+      ph->client = client;
+      ph->bypass = _mcd_client_proxy_get_bypass_approval (client);
+      ph->quality = GPOINTER_TO_UINT (quality_p);
 
-      if (quality > 0)
-        {
-          PossibleHandler *ph = g_slice_new0 (PossibleHandler);
-
-          ph->client = client;
-          ph->bypass = _mcd_client_proxy_get_bypass_approval (client);
-          ph->quality = quality;
-
-          handlers = g_list_prepend (handlers, ph);
-        }
+      handlers = g_list_prepend (handlers, ph);
     }
 
+  g_hash_table_unref (matches);
+
   /* if no handlers can take them all, fail - unless we're operating on
    * a request that specified a preferred handler, in which case assume
    * it's suitable */
@@ -80,6 +80,11 @@ G_GNUC_INTERNAL gboolean _mcd_client_registry_is_ready (
 G_GNUC_INTERNAL void _mcd_client_registry_init_hash_iter (
     McdClientRegistry *self, GHashTableIter *iter);
 
+G_GNUC_INTERNAL GHashTable *_mcd_client_registry_match_filters (
+    McdClientRegistry *self, McdClientInterface iface,
+    const McdClientChannelProperties *channel_properties,
+    gboolean assume_requested);
+
 G_GNUC_INTERNAL GList *_mcd_client_registry_list_possible_handlers (
     McdClientRegistry *self, const gchar *preferred_handler,
     GVariant *request_props, TpChannel *channel,
@@ -0,0 +1,154 @@
+/* Arguments shared by every client call for a dispatch operation
+ *
+ * Copyright © 2012 Collabora Ltd.
+ *
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public License
+ * version 2.1 as published by the Free Software Foundation.
+ *
+ * This library is distributed in the hope that it will be useful, but
+ * WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the GNU
+ * Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with this library; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin St, Fifth Floor, Boston, MA
+ * 02110-1301 USA
+ *
+ */
+
+/*
+ * ObserveChannels, AddDispatchOperation and HandleChannels all describe the
+ * same channel to each client, so we build the Channel_Details and the
+ * satisfied requests once per dispatch operation and pass the same
+ * (borrowed) copies to every call; dbus-glib serializes them immediately.
+ *
+ * The channel's object path and immutable properties can't change, so the
+ * Channel_Details are built at most once. A channel can start satisfying
+ * more requests while it is being dispatched (if someone calls
+ * EnsureChannel and gets it back), so the satisfied requests are rebuilt
+ * if the channel's serial number for them changes.
+ */
+
+#include "config.h"
+
+#include "dispatch-args.h"
+
+#include <telepathy-glib/telepathy-glib.h>
+
+#include "mcd-debug.h"
+
+struct _McdDispatchArgs
+{
+  const McdDispatchArgsFuncs *funcs;
+  /* borrowed; our owner keeps it alive */
+  gpointer channel;
+
+  /* NULL until first needed */
+  GPtrArray *channel_details;
+
+  /* NULL until first needed */
+  GPtrArray *satisfied_requests;
+  GHashTable *request_properties;
+  /* the serial from which satisfied_requests was built */
+  guint requests_serial;
+};
+
+McdDispatchArgs *
+_mcd_dispatch_args_new (const McdDispatchArgsFuncs *funcs,
+    gpointer channel)
+{
+  McdDispatchArgs *self;
+
+  g_return_val_if_fail (funcs != NULL, NULL);
+  g_return_val_if_fail (channel != NULL, NULL);
+
+  self = g_slice_new0 (McdDispatchArgs);
+  self->funcs = funcs;
+  self->channel = channel;
+  return self;
+}
+
+static void
+forget_satisfied_requests (McdDispatchArgs *self)
+{
+  tp_clear_pointer (&self->satisfied_requests, g_ptr_array_unref);
+  tp_clear_pointer (&self->request_properties, g_hash_table_unref);
+}
+
+void
+_mcd_dispatch_args_free (McdDispatchArgs *self)
+{
+  g_return_if_fail (self != NULL);
+
+  if (self->channel_details != NULL)
+    self->funcs->free_channel_details (self->channel_details);
+
+  forget_satisfied_requests (self);
+  g_slice_free (McdDispatchArgs, self);
+}
+
+/*
+ * Returns: (transfer none): a Channel_Details list containing the channel,
+ *  valid until @self is freed
+ */
+const GPtrArray *
+_mcd_dispatch_args_get_channel_details (McdDispatchArgs *self)
+{
+  g_return_val_if_fail (self != NULL, NULL);
+
+  if (self->channel_details == NULL)
+    {
+      DEBUG ("building Channel_Details for %p", self->channel);
+      self->channel_details = self->funcs->build_channel_details (
+          self->channel);
+    }
+
+  return self->channel_details;
+}
+
+static void
+ensure_satisfied_requests (McdDispatchArgs *self)
+{
+  guint serial = self->funcs->get_requests_serial (self->channel);
+
+  if (self->satisfied_requests != NULL && serial == self->requests_serial)
+    return;
+
+  DEBUG ("collecting satisfied requests for %p, serial %u", self->channel,
+      serial);
+  forget_satisfied_requests (self);
+  self->funcs->collect_satisfied_requests (self->channel,
+      &self->satisfied_requests, &self->request_properties);
+  self->requests_serial = serial;
+}
+
+/*
+ * Returns: (transfer none) (element-type utf8): the object paths of the
+ *  requests satisfied by the channel, valid until the next call to this
+ *  function or _mcd_dispatch_args_get_request_properties()
+ */
+const GPtrArray *
+_mcd_dispatch_args_get_satisfied_requests (McdDispatchArgs *self)
+{
+  g_return_val_if_fail (self != NULL, NULL);
+
+  ensure_satisfied_requests (self);
+  return self->satisfied_requests;
+}
+
+/*
+ * Returns: (transfer none) (element-type utf8 GHashTable): a map from
+ *  the object paths of the requests satisfied by the channel to their
+ *  immutable properties, for Observer_Info or Handler_Info; ref it to
+ *  keep it
+ */
+GHashTable *
+_mcd_dispatch_args_get_request_properties (McdDispatchArgs *self)
+{
+  g_return_val_if_fail (self != NULL, NULL);
+
+  ensure_satisfied_requests (self);
+  return self->request_properties;
+}
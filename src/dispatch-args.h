@@ -0,0 +1,54 @@
+/* Arguments shared by every client call for a dispatch operation
+ *
+ * Copyright © 2012 Collabora Ltd.
+ *
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public License
+ * version 2.1 as published by the Free Software Foundation.
+ *
+ * This library is distributed in the hope that it will be useful, but
+ * WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the GNU
+ * Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with this library; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin St, Fifth Floor, Boston, MA
+ * 02110-1301 USA
+ *
+ */
+
+#ifndef MCD_DISPATCH_ARGS_H
+#define MCD_DISPATCH_ARGS_H
+
+#include <glib.h>
+
+G_BEGIN_DECLS
+
+typedef struct _McdDispatchArgs McdDispatchArgs;
+
+typedef struct {
+    /* Returns a new Channel_Details list, freed with free_channel_details */
+    GPtrArray *(*build_channel_details) (gpointer channel);
+    void (*free_channel_details) (GPtrArray *channel_details);
+    /* As for collect_satisfied_requests() in mcd-dispatch-operation.c */
+    void (*collect_satisfied_requests) (gpointer channel,
+        GPtrArray **paths_out, GHashTable **props_out);
+    /* A number that changes whenever the satisfied requests do */
+    guint (*get_requests_serial) (gpointer channel);
+} McdDispatchArgsFuncs;
+
+G_GNUC_INTERNAL McdDispatchArgs *_mcd_dispatch_args_new (
+    const McdDispatchArgsFuncs *funcs, gpointer channel);
+G_GNUC_INTERNAL void _mcd_dispatch_args_free (McdDispatchArgs *self);
+
+G_GNUC_INTERNAL const GPtrArray *_mcd_dispatch_args_get_channel_details (
+    McdDispatchArgs *self);
+G_GNUC_INTERNAL const GPtrArray *_mcd_dispatch_args_get_satisfied_requests (
+    McdDispatchArgs *self);
+G_GNUC_INTERNAL GHashTable *_mcd_dispatch_args_get_request_properties (
+    McdDispatchArgs *self);
+
+G_END_DECLS
+
+#endif
@@ -0,0 +1,372 @@
+/* Table of channels being handled, and which handler has each
+ *
+ * Copyright © 2012 Collabora Ltd.
+ *
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public License
+ * version 2.1 as published by the Free Software Foundation.
+ *
+ * This library is distributed in the hope that it will be useful, but
+ * WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the GNU
+ * Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with this library; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin St, Fifth Floor, Boston, MA
+ * 02110-1301 USA
+ *
+ */
+
+/*
+ * We keep one record per channel, allocated together with its object path,
+ * which is the only copy of the path: it is also the key in the table of
+ * records and in the per-handler sets of paths. A handler's unique name is
+ * shared by all its channels (it's the key in the table of handlers), and
+ * well-known names and account paths come from a small set, so they are
+ * interned.
+ *
+ * A record goes away when its channel is invalidated, or if its handler
+ * crashes and we never had a TpChannel for it (as when recovering from
+ * our own crash).
+ */
+
+#include "config.h"
+
+#include "handled-channels.h"
+
+#include <string.h>
+
+struct _McdHandledChannels
+{
+  const McdHandledChannelsFuncs *funcs;
+  gpointer user_data;
+
+  /* borrowed gchar *object_path (from the record) =>
+   * owned McdHandledChannel * */
+  GHashTable *channels;
+  /* owned gchar *unique_name => owned GHashTable, a set of borrowed
+   * gchar *object_path (from the records); never empty */
+  GHashTable *handlers;
+};
+
+static McdHandledChannel *
+handled_channel_new (const gchar *object_path)
+{
+  gsize len = strlen (object_path);
+  McdHandledChannel *record = g_malloc0 (sizeof (McdHandledChannel) +
+      len + 1);
+  gchar *path = (gchar *) (record + 1);
+
+  memcpy (path, object_path, len + 1);
+  record->object_path = path;
+  return record;
+}
+
+static void
+handled_channel_free (gpointer p)
+{
+  McdHandledChannel *record = p;
+
+  if (record->channel != NULL)
+    g_object_unref (record->channel);
+
+  g_free (record);
+}
+
+McdHandledChannels *
+_mcd_handled_channels_new (const McdHandledChannelsFuncs *funcs,
+    gpointer user_data)
+{
+  McdHandledChannels *self;
+
+  g_return_val_if_fail (funcs != NULL, NULL);
+
+  self = g_slice_new0 (McdHandledChannels);
+  self->funcs = funcs;
+  self->user_data = user_data;
+  self->channels = g_hash_table_new_full (g_str_hash, g_str_equal, NULL,
+      handled_channel_free);
+  self->handlers = g_hash_table_new_full (g_str_hash, g_str_equal, g_free,
+      (GDestroyNotify) g_hash_table_unref);
+  return self;
+}
+
+/* Doesn't call any of the funcs. */
+void
+_mcd_handled_channels_free (McdHandledChannels *self)
+{
+  g_return_if_fail (self != NULL);
+
+  /* the sets of handlers borrow the records' paths */
+  g_hash_table_unref (self->handlers);
+  g_hash_table_unref (self->channels);
+  g_slice_free (McdHandledChannels, self);
+}
+
+/*
+ * Returns: (transfer none): what we know about @object_path, or %NULL if
+ *  it isn't being handled
+ */
+const McdHandledChannel *
+_mcd_handled_channels_lookup (McdHandledChannels *self,
+    const gchar *object_path)
+{
+  g_return_val_if_fail (self != NULL, NULL);
+
+  return g_hash_table_lookup (self->channels, object_path);
+}
+
+static McdHandledChannel *
+ensure_record (McdHandledChannels *self,
+    const gchar *object_path)
+{
+  McdHandledChannel *record = g_hash_table_lookup (self->channels,
+      object_path);
+
+  if (record == NULL)
+    {
+      record = handled_channel_new (object_path);
+      g_hash_table_insert (self->channels, (gchar *) record->object_path,
+          record);
+    }
+
+  return record;
+}
+
+static void
+maybe_drop_record (McdHandledChannels *self,
+    McdHandledChannel *record)
+{
+  if (record->unique_name == NULL && record->channel == NULL)
+    g_hash_table_remove (self->channels, record->object_path);
+}
+
+/* Forget that @record's handler is handling it, but don't drop it. */
+static void
+forget_handler (McdHandledChannels *self,
+    McdHandledChannel *record)
+{
+  GHashTable *paths = g_hash_table_lookup (self->handlers,
+      record->unique_name);
+
+  g_assert (paths != NULL);
+  g_hash_table_remove (paths, record->object_path);
+
+  if (g_hash_table_size (paths) == 0)
+    {
+      self->funcs->handler_removed (record->unique_name, self->user_data);
+      /* this frees the unique name */
+      g_hash_table_remove (self->handlers, record->unique_name);
+    }
+
+  record->unique_name = NULL;
+}
+
+/*
+ * @object_path: a channel
+ * @unique_name: the unique name of the handler
+ * @well_known_name: the well-known name of the handler, or %NULL if not known
+ *
+ * Record that @object_path is being handled by @unique_name, calling
+ * handler_removed for its previous handler and handler_added for
+ * @unique_name if appropriate.
+ */
+void
+_mcd_handled_channels_set_handler (McdHandledChannels *self,
+    const gchar *object_path,
+    const gchar *unique_name,
+    const gchar *well_known_name)
+{
+  McdHandledChannel *record;
+  gpointer name_p;
+  GHashTable *paths;
+
+  g_return_if_fail (self != NULL);
+  g_return_if_fail (object_path != NULL);
+  g_return_if_fail (unique_name != NULL);
+
+  record = ensure_record (self, object_path);
+  record->well_known_name = g_intern_string (well_known_name);
+
+  if (!tp_strdiff (record->unique_name, unique_name))
+    return;
+
+  if (record->unique_name != NULL)
+    forget_handler (self, record);
+
+  if (!g_hash_table_lookup_extended (self->handlers, unique_name, &name_p,
+        (gpointer *) &paths))
+    {
+      name_p = g_strdup (unique_name);
+      paths = g_hash_table_new (g_str_hash, g_str_equal);
+      g_hash_table_insert (self->handlers, name_p, paths);
+      self->funcs->handler_added (name_p, self->user_data);
+    }
+
+  g_hash_table_add (paths, (gchar *) record->object_path);
+  record->unique_name = name_p;
+}
+
+/*
+ * @channel: a channel
+ * @account_path: the account that @channel came from, or %NULL if not known
+ *
+ * Remember @channel and its account. The caller should also call
+ * _mcd_handled_channels_set_handler().
+ */
+void
+_mcd_handled_channels_set_channel (McdHandledChannels *self,
+    TpChannel *channel,
+    const gchar *account_path)
+{
+  McdHandledChannel *record;
+
+  g_return_if_fail (self != NULL);
+  g_return_if_fail (TP_IS_CHANNEL (channel));
+
+  record = ensure_record (self, tp_proxy_get_object_path (channel));
+
+  g_object_ref (channel);
+
+  if (record->channel != NULL)
+    g_object_unref (record->channel);
+
+  record->channel = channel;
+  record->account_path = g_intern_string (account_path);
+}
+
+/*
+ * Forget everything about @object_path, calling handler_removed for its
+ * handler if appropriate.
+ */
+void
+_mcd_handled_channels_remove (McdHandledChannels *self,
+    const gchar *object_path)
+{
+  McdHandledChannel *record;
+
+  g_return_if_fail (self != NULL);
+
+  record = g_hash_table_lookup (self->channels, object_path);
+
+  if (record == NULL)
+    return;
+
+  if (record->unique_name != NULL)
+    forget_handler (self, record);
+
+  g_hash_table_remove (self->channels, object_path);
+}
+
+/*
+ * Forget that @unique_name is handling any channels, calling
+ * handler_removed for it if it was. This is O(number of channels
+ * @unique_name was handling).
+ *
+ * Returns: (transfer full) (element-type utf8): the object paths of the
+ *  channels it was handling; free with g_list_free_full (paths, g_free)
+ */
+GList *
+_mcd_handled_channels_remove_handler (McdHandledChannels *self,
+    const gchar *unique_name)
+{
+  GHashTable *paths;
+  GHashTableIter iter;
+  gpointer path_p;
+  GList *ret = NULL;
+  GList *l;
+
+  g_return_val_if_fail (self != NULL, NULL);
+
+  paths = g_hash_table_lookup (self->handlers, unique_name);
+
+  if (paths == NULL)
+    return NULL;
+
+  g_hash_table_iter_init (&iter, paths);
+
+  while (g_hash_table_iter_next (&iter, &path_p, NULL))
+    {
+      McdHandledChannel *record = g_hash_table_lookup (self->channels,
+          path_p);
+
+      record->unique_name = NULL;
+      ret = g_list_prepend (ret, g_strdup (path_p));
+    }
+
+  self->funcs->handler_removed (unique_name, self->user_data);
+  g_hash_table_remove (self->handlers, unique_name);
+
+  for (l = ret; l != NULL; l = l->next)
+    maybe_drop_record (self, g_hash_table_lookup (self->channels, l->data));
+
+  return ret;
+}
+
+/*
+ * Returns: (transfer container) (element-type TelepathyGLib.Channel): all
+ *  the channels for which we have a TpChannel
+ */
+GList *
+_mcd_handled_channels_get_channels (McdHandledChannels *self)
+{
+  GHashTableIter iter;
+  gpointer record_p;
+  GList *ret = NULL;
+
+  g_return_val_if_fail (self != NULL, NULL);
+
+  g_hash_table_iter_init (&iter, self->channels);
+
+  while (g_hash_table_iter_next (&iter, NULL, &record_p))
+    {
+      McdHandledChannel *record = record_p;
+
+      if (record->channel != NULL)
+        ret = g_list_prepend (ret, record->channel);
+    }
+
+  return ret;
+}
+
+/*
+ * Returns: (transfer container) (element-type utf8): the unique names of
+ *  all the handlers that are handling at least one channel
+ */
+GList *
+_mcd_handled_channels_get_handlers (McdHandledChannels *self)
+{
+  g_return_val_if_fail (self != NULL, NULL);
+
+  return g_hash_table_get_keys (self->handlers);
+}
+
+/*
+ * Returns: (transfer full) (element-type utf8): the object paths of the
+ *  channels being handled by @unique_name, in no particular order; free
+ *  with g_list_free_full (paths, g_free)
+ */
+GList *
+_mcd_handled_channels_dup_handler_paths (McdHandledChannels *self,
+    const gchar *unique_name)
+{
+  GHashTable *paths;
+  GHashTableIter iter;
+  gpointer path_p;
+  GList *ret = NULL;
+
+  g_return_val_if_fail (self != NULL, NULL);
+
+  paths = g_hash_table_lookup (self->handlers, unique_name);
+
+  if (paths == NULL)
+    return NULL;
+
+  g_hash_table_iter_init (&iter, paths);
+
+  while (g_hash_table_iter_next (&iter, &path_p, NULL))
+    ret = g_list_prepend (ret, g_strdup (path_p));
+
+  return ret;
+}
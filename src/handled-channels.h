@@ -0,0 +1,79 @@
+/* Table of channels being handled, and which handler has each
+ *
+ * Copyright © 2012 Collabora Ltd.
+ *
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public License
+ * version 2.1 as published by the Free Software Foundation.
+ *
+ * This library is distributed in the hope that it will be useful, but
+ * WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the GNU
+ * Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with this library; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin St, Fifth Floor, Boston, MA
+ * 02110-1301 USA
+ *
+ */
+
+#ifndef MCD_HANDLED_CHANNELS_H
+#define MCD_HANDLED_CHANNELS_H
+
+#include <glib.h>
+#include <telepathy-glib/telepathy-glib.h>
+
+G_BEGIN_DECLS
+
+typedef struct _McdHandledChannels McdHandledChannels;
+
+/* Everything we know about one channel. All the strings are valid for as
+ * long as the record is, and must not be freed. */
+typedef struct {
+    const gchar *object_path;
+    /* the unique name of its handler, or NULL if its handler crashed */
+    const gchar *unique_name;
+    /* the well-known name we invoked, or NULL if not known */
+    const gchar *well_known_name;
+    /* the channel, or NULL if we only know its object path */
+    TpChannel *channel;
+    /* the account it belongs to, or NULL if not known */
+    const gchar *account_path;
+} McdHandledChannel;
+
+typedef struct {
+    /* @unique_name is now handling its first channel */
+    void (*handler_added) (const gchar *unique_name, gpointer user_data);
+    /* @unique_name is no longer handling any channels */
+    void (*handler_removed) (const gchar *unique_name, gpointer user_data);
+} McdHandledChannelsFuncs;
+
+G_GNUC_INTERNAL McdHandledChannels *_mcd_handled_channels_new (
+    const McdHandledChannelsFuncs *funcs, gpointer user_data);
+G_GNUC_INTERNAL void _mcd_handled_channels_free (McdHandledChannels *self);
+
+G_GNUC_INTERNAL const McdHandledChannel *_mcd_handled_channels_lookup (
+    McdHandledChannels *self, const gchar *object_path);
+
+G_GNUC_INTERNAL void _mcd_handled_channels_set_handler (
+    McdHandledChannels *self, const gchar *object_path,
+    const gchar *unique_name, const gchar *well_known_name);
+G_GNUC_INTERNAL void _mcd_handled_channels_set_channel (
+    McdHandledChannels *self, TpChannel *channel,
+    const gchar *account_path);
+G_GNUC_INTERNAL void _mcd_handled_channels_remove (McdHandledChannels *self,
+    const gchar *object_path);
+G_GNUC_INTERNAL GList *_mcd_handled_channels_remove_handler (
+    McdHandledChannels *self, const gchar *unique_name);
+
+G_GNUC_INTERNAL GList *_mcd_handled_channels_get_channels (
+    McdHandledChannels *self);
+G_GNUC_INTERNAL GList *_mcd_handled_channels_get_handlers (
+    McdHandledChannels *self);
+G_GNUC_INTERNAL GList *_mcd_handled_channels_dup_handler_paths (
+    McdHandledChannels *self, const gchar *unique_name);
+
+G_END_DECLS
+
+#endif
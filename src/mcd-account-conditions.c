@@ -39,19 +39,6 @@
 #include "mcd-account-manager.h"
 
 
-static void
-store_condition (gpointer key, gpointer value, gpointer userdata)
-{
-    McdAccount *account = MCD_ACCOUNT (userdata);
-    McdStorage *storage = _mcd_account_get_storage (account);
-    const gchar *account_name = mcd_account_get_unique_name (account);
-    const gchar *name = key, *condition = value;
-    gchar condition_key[256];
-
-    g_snprintf (condition_key, sizeof (condition_key), "condition-%s", name);
-    mcd_storage_set_string (storage, account_name, condition_key, condition);
-}
-
 static gboolean
 set_condition (TpSvcDBusProperties *self,
                const gchar *name,
@@ -62,8 +49,11 @@ set_condition (TpSvcDBusProperties *self,
     McdAccount *account = MCD_ACCOUNT (self);
     McdStorage *storage = _mcd_account_get_storage (account);
     const gchar *account_name = mcd_account_get_unique_name (account);
+    McdStorageTransaction *transaction;
     gchar **keys, **key;
     GHashTable *conditions;
+    GHashTableIter iter;
+    gpointer k, v;
 
     /* FIXME: some sort of validation beyond just the type? */
 
@@ -84,8 +74,10 @@ set_condition (TpSvcDBusProperties *self,
     }
 
     conditions = g_value_get_boxed (value);
+    transaction = mcd_storage_transaction_new (storage, account_name);
 
-    /* first, delete existing conditions */
+    /* first, delete existing conditions; conditions that are set again
+     * below are left alone */
     keys = mcd_storage_dup_attributes (storage, account_name, NULL);
 
     for (key = keys; *key != NULL; key++)
@@ -93,16 +85,31 @@ set_condition (TpSvcDBusProperties *self,
         if (strncmp (*key, "condition-", 10) != 0)
             continue;
 
-        mcd_storage_set_attribute (storage, account_name, *key, NULL);
+        mcd_storage_transaction_set_attribute (transaction, *key, NULL);
     }
 
     g_strfreev (keys);
 
     if (!(flags & MCD_DBUS_PROP_SET_FLAG_ALREADY_IN_STORAGE))
     {
-        g_hash_table_foreach (conditions, store_condition, account);
+        g_hash_table_iter_init (&iter, conditions);
+
+        while (g_hash_table_iter_next (&iter, &k, &v))
+        {
+            gchar condition_key[256];
+
+            g_snprintf (condition_key, sizeof (condition_key),
+                        "condition-%s", (const gchar *) k);
+            mcd_storage_transaction_set_string (transaction, condition_key,
+                                                v);
+        }
 
-        mcd_storage_commit (storage, account_name);
+        if (mcd_storage_transaction_apply (transaction))
+            mcd_storage_commit_later (storage, account_name);
+    }
+    else
+    {
+        mcd_storage_transaction_apply (transaction);
     }
 
     return TRUE;
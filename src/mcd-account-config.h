@@ -52,6 +52,10 @@
 /* obsoleted by MC_ACCOUNTS_KEY_AUTOMATIC_PRESENCE */
 #define MC_ACCOUNTS_KEY_AUTO_PRESENCE_TYPE "AutomaticPresenceType"
 
+/* signed 64-bit integer, 'x' */
+/* seconds since the Unix epoch, accurate to about an hour */
+#define MC_ACCOUNTS_KEY_LAST_ONLINE "LastOnline"
+
 /* boolean, 'b' */
 #define MC_ACCOUNTS_KEY_ALWAYS_DISPATCH "always_dispatch"
 #define MC_ACCOUNTS_KEY_CONNECT_AUTOMATICALLY "ConnectAutomatically"
@@ -37,6 +37,12 @@
 #define PLUGIN_DESCRIPTION "GKeyFile (default) account storage backend"
 #define INITIAL_CONFIG "# Telepathy accounts\n"
 
+/* Changes are appended to accounts.cfg.journal; accounts.cfg itself is only
+ * rewritten when the journal grows beyond this many bytes... */
+#define JOURNAL_MAX_SIZE (64 * 1024)
+/* ... or this many seconds after the first change that isn't in it */
+#define JOURNAL_COMPACT_INTERVAL 60
+
 static void account_storage_iface_init (McpAccountStorageIface *,
     gpointer);
 
@@ -74,14 +80,23 @@ account_filename_in (const gchar *dir)
 static void
 mcd_account_manager_default_init (McdAccountManagerDefault *self)
 {
+  gchar *journal;
+
   DEBUG ("mcd_account_manager_default_init");
   self->filename = account_filename_in (g_get_user_data_dir ());
+  journal = g_strconcat (self->filename, ".journal", NULL);
+  self->journal = mcd_storage_journal_new (journal);
+  g_free (journal);
+  self->snapshot_filename = g_build_filename (g_get_user_cache_dir (),
+      "telepathy", "mission-control", "accounts.snapshot", NULL);
   self->keyfile = g_key_file_new ();
   self->removed = g_key_file_new ();
   self->removed_accounts =
     g_hash_table_new_full (g_str_hash, g_str_equal, g_free, NULL);
   self->save = FALSE;
   self->loaded = FALSE;
+  g_mutex_init (&self->write_lock);
+  g_cond_init (&self->write_cond);
 }
 
 static void
@@ -90,6 +105,50 @@ mcd_account_manager_default_class_init (McdAccountManagerDefaultClass *cls)
   DEBUG ("mcd_account_manager_default_class_init");
 }
 
+static gboolean am_default_load_keyfile (McdAccountManagerDefault *self,
+    const gchar *filename);
+
+/* We answered from the snapshot until now, but we're about to change
+ * something, so we need the keyfile itself */
+static void
+am_default_drop_snapshot (McdAccountManagerDefault *self)
+{
+  if (self->snapshot == NULL)
+    return;
+
+  am_default_load_keyfile (self, self->filename);
+  mcd_storage_snapshot_free (self->snapshot);
+  self->snapshot = NULL;
+}
+
+static void
+am_default_save_snapshot (McdAccountManagerDefault *self,
+    GKeyFile *keyfile,
+    const gchar *contents,
+    gsize len)
+{
+  GError *error = NULL;
+
+  if (!mcd_storage_snapshot_write (self->snapshot_filename, self->filename,
+        contents, len, keyfile, &error))
+    {
+      DEBUG ("%s", error->message);
+      g_error_free (error);
+    }
+}
+
+static void
+am_default_journal (McdAccountManagerDefault *self,
+    const gchar *account,
+    const gchar *key,
+    const gchar *val)
+{
+  self->save = TRUE;
+
+  if (!mcd_storage_journal_append (self->journal, account, key, val))
+    self->force_compact = TRUE;
+}
+
 /* We happen to know that the string MC gave us is "sufficiently escaped" to
  * put it in the keyfile as-is. */
 static gboolean
@@ -101,13 +160,54 @@ _set (const McpAccountStorage *self,
 {
   McdAccountManagerDefault *amd = MCD_ACCOUNT_MANAGER_DEFAULT (self);
 
-  amd->save = TRUE;
+  am_default_drop_snapshot (amd);
 
   if (val != NULL)
     g_key_file_set_value (amd->keyfile, account, key, val);
   else
     g_key_file_remove_key (amd->keyfile, account, key, NULL);
 
+  am_default_journal (amd, account, key, val);
+
+  return TRUE;
+}
+
+static gboolean
+am_default_get_from_snapshot (McdAccountManagerDefault *self,
+    const McpAccountManager *am,
+    const gchar *account,
+    const gchar *key)
+{
+  gsize i;
+  gsize n = 0;
+  GStrv keys;
+
+  if (key != NULL)
+    {
+      gchar *v = mcd_storage_snapshot_dup_value (self->snapshot, account, key);
+
+      if (v == NULL)
+        return FALSE;
+
+      mcp_account_manager_set_value (am, account, key, v);
+      g_free (v);
+      return TRUE;
+    }
+
+  keys = mcd_storage_snapshot_dup_keys (self->snapshot, account, &n);
+
+  for (i = 0; i < n; i++)
+    {
+      gchar *v = mcd_storage_snapshot_dup_value (self->snapshot, account,
+          keys[i]);
+
+      if (v != NULL)
+        mcp_account_manager_set_value (am, account, keys[i], v);
+
+      g_free (v);
+    }
+
+  g_strfreev (keys);
   return TRUE;
 }
 
@@ -119,6 +219,9 @@ _get (const McpAccountStorage *self,
 {
   McdAccountManagerDefault *amd = MCD_ACCOUNT_MANAGER_DEFAULT (self);
 
+  if (amd->snapshot != NULL)
+    return am_default_get_from_snapshot (amd, am, account, key);
+
   if (key != NULL)
     {
       gchar *v = NULL;
@@ -183,21 +286,21 @@ _delete (const McpAccountStorage *self,
 {
   McdAccountManagerDefault *amd = MCD_ACCOUNT_MANAGER_DEFAULT (self);
 
+  am_default_drop_snapshot (amd);
+
   if (key == NULL)
     {
       if (g_key_file_remove_group (amd->keyfile, account, NULL))
-        amd->save = TRUE;
+        am_default_journal (amd, account, NULL, NULL);
     }
   else
     {
       gsize n;
       GStrv keys;
-      gboolean save = FALSE;
-
-      save = g_key_file_remove_key (amd->keyfile, account, key, NULL);
 
-      if (save)
-        amd->save = TRUE;
+      /* replaying this removes the group too, if it becomes empty */
+      if (g_key_file_remove_key (amd->keyfile, account, key, NULL))
+        am_default_journal (amd, account, key, NULL);
 
       keys = g_key_file_get_keys (amd->keyfile, account, &n, NULL);
 
@@ -214,54 +317,394 @@ _delete (const McpAccountStorage *self,
 }
 
 
+typedef enum {
+    WRITE_JOURNAL,
+    WRITE_FILE
+} WriteKind;
+
+/* Something for the writer thread to do. Everything it writes is copied
+ * on the main thread first, so that the main thread can carry on changing
+ * the keyfile meanwhile. */
+typedef struct {
+    /* borrowed: plugins are never freed */
+    McdAccountManagerDefault *self;
+    WriteKind kind;
+    /* a journal batch, or the whole of accounts.cfg */
+    GBytes *data;
+    /* set by the writer thread if it failed */
+    GError *error;
+    /* TRUE if the main thread is blocked until @done */
+    gboolean sync;
+    gboolean done;
+    /* for asynchronous jobs: where to finish, and (allow-none) what to
+     * finish */
+    GMainContext *context;
+    GTask *task;
+} WriteJob;
+
+static WriteJob *
+write_job_new (McdAccountManagerDefault *self,
+    WriteKind kind,
+    GBytes *data)
+{
+  WriteJob *job = g_slice_new0 (WriteJob);
+
+  job->self = self;
+  job->kind = kind;
+  job->data = data;
+  return job;
+}
+
+static void
+write_job_free (WriteJob *job)
+{
+  g_bytes_unref (job->data);
+  g_clear_error (&job->error);
+  tp_clear_pointer (&job->context, g_main_context_unref);
+  g_clear_object (&job->task);
+  g_slice_free (WriteJob, job);
+}
+
+/* Called in the writer thread */
 static gboolean
-_commit (const McpAccountStorage *self,
-    const McpAccountManager *am,
-    const gchar *account)
+am_default_write_file (McdAccountManagerDefault *self,
+    GBytes *data,
+    GError **error)
 {
+  GKeyFile *keyfile;
+  const gchar *contents;
   gsize n;
-  gchar *data;
-  McdAccountManagerDefault *amd = MCD_ACCOUNT_MANAGER_DEFAULT (self);
-  gboolean rval = FALSE;
   gchar *dir;
-  GError *error = NULL;
+  GError *local_error = NULL;
 
-  if (!amd->save)
-    return TRUE;
-
-  dir = g_path_get_dirname (amd->filename);
+  dir = g_path_get_dirname (self->filename);
 
-  DEBUG ("Saving accounts to %s", amd->filename);
+  DEBUG ("Saving accounts to %s", self->filename);
 
-  if (!mcd_ensure_directory (dir, &error))
+  if (!mcd_ensure_directory (dir, &local_error))
     {
-      g_warning ("%s", error->message);
-      g_clear_error (&error);
+      g_warning ("%s", local_error->message);
+      g_clear_error (&local_error);
       /* fall through anyway: writing to the file will fail, but it does
        * give us a chance to commit to the keyring too */
     }
 
   g_free (dir);
 
-  data = g_key_file_to_data (amd->keyfile, &n, NULL);
-  rval = g_file_set_contents (amd->filename, data, n, &error);
+  contents = g_bytes_get_data (data, &n);
+
+  if (!g_file_set_contents (self->filename, contents, n, error))
+    return FALSE;
 
-  if (rval)
+  if (!mcd_storage_journal_remove_file (self->journal, &local_error))
     {
-      amd->save = FALSE;
+      /* harmless: replaying it would only repeat what is in the file */
+      g_warning ("%s", local_error->message);
+      g_clear_error (&local_error);
     }
+
+  /* the main thread's copy may have moved on already */
+  keyfile = g_key_file_new ();
+
+  if (g_key_file_load_from_data (keyfile, contents, n,
+        G_KEY_FILE_KEEP_COMMENTS, NULL))
+    am_default_save_snapshot (self, keyfile, contents, n);
+
+  g_key_file_free (keyfile);
+  return TRUE;
+}
+
+static gboolean am_default_write_done_cb (gpointer user_data);
+
+/* Called in the writer thread */
+static void
+am_default_write_thread (gpointer data,
+    gpointer user_data)
+{
+  WriteJob *job = data;
+  McdAccountManagerDefault *self = user_data;
+
+  if (job->kind == WRITE_JOURNAL)
+    mcd_storage_journal_write_batch (self->journal, job->data, &job->error);
   else
+    am_default_write_file (self, job->data, &job->error);
+
+  if (job->sync)
     {
-      g_warning ("%s", error->message);
-      g_error_free (error);
+      g_mutex_lock (&self->write_lock);
+      job->done = TRUE;
+      g_cond_broadcast (&self->write_cond);
+      g_mutex_unlock (&self->write_lock);
     }
+  else
+    {
+      g_mutex_lock (&self->write_lock);
+      self->n_writing--;
 
-  g_free (data);
+      if (job->error != NULL)
+        self->async_failed = TRUE;
 
-  return rval;
+      g_cond_broadcast (&self->write_cond);
+      g_mutex_unlock (&self->write_lock);
+
+      g_main_context_invoke (job->context, am_default_write_done_cb, job);
+    }
+}
+
+static void
+am_default_push (McdAccountManagerDefault *self,
+    WriteJob *job)
+{
+  if (self->writer == NULL)
+    self->writer = g_thread_pool_new (am_default_write_thread, self, 1,
+        FALSE, NULL);
+
+  if (!job->sync)
+    {
+      g_mutex_lock (&self->write_lock);
+      self->n_writing++;
+      g_mutex_unlock (&self->write_lock);
+    }
+
+  g_thread_pool_push (self->writer, job, NULL);
+}
+
+/* Returns: a job to write out the whole keyfile, after which the journal
+ *  is redundant */
+static WriteJob *
+am_default_prepare_file (McdAccountManagerDefault *self)
+{
+  gsize n;
+  gchar *data;
+
+  if (self->compact_id != 0)
+    {
+      g_source_remove (self->compact_id);
+      self->compact_id = 0;
+    }
+
+  am_default_drop_snapshot (self);
+
+  data = g_key_file_to_data (self->keyfile, &n, NULL);
+  /* anything that was waiting to be journalled is in @data */
+  mcd_storage_journal_forget (self->journal);
+  self->save = FALSE;
+  self->force_compact = FALSE;
+
+  return write_job_new (self, WRITE_FILE, g_bytes_new_take (data, n));
+}
+
+static gboolean
+am_default_compact_cb (gpointer data)
+{
+  McdAccountManagerDefault *amd = data;
+  WriteJob *job;
+
+  amd->compact_id = 0;
+  job = am_default_prepare_file (amd);
+  job->context = g_main_context_ref_thread_default ();
+  am_default_push (amd, job);
+  return FALSE;
+}
+
+/* Committing one account only appends to the journal; committing all
+ * accounts (as MC does at startup and on exit) writes accounts.cfg.
+ *
+ * Returns: a job to write the changes, or %NULL if there is nothing to do */
+static WriteJob *
+am_default_prepare_write (McdAccountManagerDefault *self,
+    const gchar *account)
+{
+  GBytes *batch;
+
+  if (!self->save)
+    return NULL;
+
+  if (account == NULL || self->force_compact ||
+      mcd_storage_journal_get_size (self->journal) >= JOURNAL_MAX_SIZE)
+    return am_default_prepare_file (self);
+
+  batch = mcd_storage_journal_take_batch (self->journal);
+  self->save = FALSE;
+
+  if (batch == NULL)
+    return NULL;
+
+  if (self->compact_id == 0)
+    self->compact_id = g_timeout_add_seconds (JOURNAL_COMPACT_INTERVAL,
+        am_default_compact_cb, self);
+
+  return write_job_new (self, WRITE_JOURNAL, batch);
+}
+
+/* Whatever @job was writing now only exists in memory */
+static void
+am_default_write_failed (McdAccountManagerDefault *self,
+    WriteJob *job)
+{
+  if (job->kind == WRITE_JOURNAL)
+    DEBUG ("%s; saving the whole file instead", job->error->message);
+  else
+    g_warning ("%s", job->error->message);
+
+  self->save = TRUE;
+  self->force_compact = TRUE;
+}
+
+/* Called in the main thread when an asynchronous job has finished */
+static gboolean
+am_default_write_done_cb (gpointer user_data)
+{
+  WriteJob *job = user_data;
+  McdAccountManagerDefault *self = job->self;
+
+  if (job->error == NULL)
+    {
+      if (job->task != NULL)
+        g_task_return_boolean (job->task, TRUE);
+    }
+  else if (job->kind == WRITE_JOURNAL)
+    {
+      WriteJob *retry;
+
+      am_default_write_failed (self, job);
+      retry = am_default_prepare_file (self);
+      retry->context = g_main_context_ref (job->context);
+      retry->task = g_steal_pointer (&job->task);
+      am_default_push (self, retry);
+    }
+  else
+    {
+      am_default_write_failed (self, job);
+
+      if (job->task != NULL)
+        g_task_return_error (job->task, g_steal_pointer (&job->error));
+    }
+
+  write_job_free (job);
+  return FALSE;
+}
+
+/* Run @job and wait for it, and for any jobs before it */
+static gboolean
+am_default_write_sync (McdAccountManagerDefault *self,
+    WriteJob *job)
+{
+  WriteKind kind = job->kind;
+  gboolean ok;
+
+  job->sync = TRUE;
+  am_default_push (self, job);
+
+  g_mutex_lock (&self->write_lock);
+
+  while (!job->done)
+    g_cond_wait (&self->write_cond, &self->write_lock);
+
+  g_mutex_unlock (&self->write_lock);
+
+  ok = (job->error == NULL);
+
+  if (!ok)
+    am_default_write_failed (self, job);
+
+  write_job_free (job);
+
+  if (!ok && kind == WRITE_JOURNAL)
+    return am_default_write_sync (self, am_default_prepare_file (self));
+
+  return ok;
+}
+
+/* Wait for the asynchronous jobs that have already been pushed, without
+ * running the main loop.
+ *
+ * Returns: %FALSE if any of them failed */
+static gboolean
+am_default_wait_for_writer (McdAccountManagerDefault *self)
+{
+  gboolean failed;
+
+  g_mutex_lock (&self->write_lock);
+
+  while (self->n_writing > 0)
+    g_cond_wait (&self->write_cond, &self->write_lock);
+
+  failed = self->async_failed;
+  self->async_failed = FALSE;
+  g_mutex_unlock (&self->write_lock);
+
+  return !failed;
+}
+
+/* Once this returns, everything committed so far is on disk, including
+ * what earlier asynchronous commits were writing */
+static gboolean
+_commit (const McpAccountStorage *self,
+    const McpAccountManager *am,
+    const gchar *account)
+{
+  McdAccountManagerDefault *amd = MCD_ACCOUNT_MANAGER_DEFAULT (self);
+  WriteJob *job;
+
+  /* what failed only exists in memory, and the main loop might not run
+   * again to retry it, so write the whole file now */
+  if (!am_default_wait_for_writer (amd))
+    {
+      amd->save = TRUE;
+      amd->force_compact = TRUE;
+    }
+
+  job = am_default_prepare_write (amd, account);
+
+  if (job == NULL)
+    return TRUE;
+
+  return am_default_write_sync (amd, job);
 }
 
+/* The same as _commit(), but the main loop carries on while the writer
+ * thread waits for the disk */
 static void
+_commit_async (McpAccountStorage *self,
+    McpAccountManager *am,
+    const gchar *account,
+    GCancellable *cancellable,
+    GAsyncReadyCallback callback,
+    gpointer user_data)
+{
+  McdAccountManagerDefault *amd = MCD_ACCOUNT_MANAGER_DEFAULT (self);
+  GTask *task = g_task_new (self, cancellable, callback, user_data);
+  WriteJob *job;
+
+  g_task_set_source_tag (task, _commit_async);
+  job = am_default_prepare_write (amd, account);
+
+  if (job == NULL)
+    {
+      g_task_return_boolean (task, TRUE);
+      g_object_unref (task);
+      return;
+    }
+
+  job->context = g_main_context_ref_thread_default ();
+  job->task = task;
+  am_default_push (amd, job);
+}
+
+static gboolean
+_commit_finish (McpAccountStorage *self,
+    GAsyncResult *result,
+    GError **error)
+{
+  g_return_val_if_fail (g_task_is_valid (result, self), FALSE);
+  g_return_val_if_fail (g_task_get_source_tag (G_TASK (result)) ==
+      _commit_async, FALSE);
+
+  return g_task_propagate_boolean (G_TASK (result), error);
+}
+
+static gboolean
 am_default_load_keyfile (McdAccountManagerDefault *self,
     const gchar *filename)
 {
@@ -271,6 +714,7 @@ am_default_load_keyfile (McdAccountManagerDefault *self,
         G_KEY_FILE_KEEP_COMMENTS, &error))
     {
       DEBUG ("Loaded accounts from %s", filename);
+      return TRUE;
     }
   else
     {
@@ -283,6 +727,7 @@ am_default_load_keyfile (McdAccountManagerDefault *self,
        * do so. */
       g_key_file_load_from_data (self->keyfile, INITIAL_CONFIG, -1,
           G_KEY_FILE_KEEP_COMMENTS, NULL);
+      return FALSE;
     }
 }
 
@@ -296,14 +741,45 @@ _list (const McpAccountStorage *self,
   GList *rval = NULL;
   McdAccountManagerDefault *amd = MCD_ACCOUNT_MANAGER_DEFAULT (self);
 
+  /* The snapshot is only any use if there is nothing to replay on top */
+  if (!amd->loaded && mcd_storage_journal_get_size (amd->journal) == 0)
+    {
+      amd->snapshot = mcd_storage_snapshot_open (amd->snapshot_filename,
+          amd->filename);
+
+      if (amd->snapshot != NULL)
+        amd->loaded = TRUE;
+    }
+
   if (!amd->loaded && g_file_test (amd->filename, G_FILE_TEST_EXISTS))
     {
+      gboolean ok;
+
       /* If the file exists, but loading it fails, we deliberately
        * do not fall through to the "initial configuration" case,
        * because we don't want to overwrite a corrupted file
        * with an empty one until an actual write takes place. */
-      am_default_load_keyfile (amd, amd->filename);
+      ok = am_default_load_keyfile (amd, amd->filename);
       amd->loaded = TRUE;
+
+      /* Changes made since accounts.cfg was last written */
+      if (mcd_storage_journal_replay (amd->journal, amd->keyfile) > 0)
+        {
+          /* we'll save a snapshot when we compact */
+          amd->save = TRUE;
+          amd->force_compact = TRUE;
+        }
+      else if (ok)
+        {
+          gchar *contents = NULL;
+          gsize len;
+
+          /* save parsing it next time */
+          if (g_file_get_contents (amd->filename, &contents, &len, NULL))
+            am_default_save_snapshot (amd, amd->keyfile, contents, len);
+
+          g_free (contents);
+        }
     }
 
   if (!amd->loaded)
@@ -364,7 +840,10 @@ _list (const McpAccountStorage *self,
       _commit (self, am, NULL);
     }
 
-  accounts = g_key_file_get_groups (amd->keyfile, &n);
+  if (amd->snapshot != NULL)
+    accounts = mcd_storage_snapshot_dup_accounts (amd->snapshot, &n);
+  else
+    accounts = g_key_file_get_groups (amd->keyfile, &n);
 
   for (i = 0; i < n; i++)
     {
@@ -376,6 +855,50 @@ _list (const McpAccountStorage *self,
   return rval;
 }
 
+static void
+free_account_list (gpointer p)
+{
+  g_list_free_full (p, g_free);
+}
+
+static void
+am_default_list_thread (GTask *task,
+    gpointer source,
+    gpointer task_data,
+    GCancellable *cancellable)
+{
+  g_task_return_pointer (task, _list (source, task_data), free_account_list);
+}
+
+/* Nothing else uses the plugin until its accounts have been listed, so
+ * reading and parsing the file can happen in another thread */
+static void
+_list_async (McpAccountStorage *self,
+    McpAccountManager *am,
+    GCancellable *cancellable,
+    GAsyncReadyCallback callback,
+    gpointer user_data)
+{
+  GTask *task = g_task_new (self, cancellable, callback, user_data);
+
+  g_task_set_source_tag (task, _list_async);
+  g_task_set_task_data (task, g_object_ref (am), g_object_unref);
+  g_task_run_in_thread (task, am_default_list_thread);
+  g_object_unref (task);
+}
+
+static GList *
+_list_finish (McpAccountStorage *self,
+    GAsyncResult *result,
+    GError **error)
+{
+  g_return_val_if_fail (g_task_is_valid (result, self), NULL);
+  g_return_val_if_fail (g_task_get_source_tag (G_TASK (result)) ==
+      _list_async, NULL);
+
+  return g_task_propagate_pointer (G_TASK (result), error);
+}
+
 static void
 account_storage_iface_init (McpAccountStorageIface *iface,
     gpointer unused G_GNUC_UNUSED)
@@ -390,7 +913,10 @@ account_storage_iface_init (McpAccountStorageIface *iface,
   iface->delete = _delete;
   iface->commit_one = _commit;
   iface->list = _list;
-
+  iface->commit_async = _commit_async;
+  iface->commit_finish = _commit_finish;
+  iface->list_async = _list_async;
+  iface->list_finish = _list_finish;
 }
 
 McdAccountManagerDefault *
@@ -21,6 +21,9 @@
 
 #include <mission-control-plugins/mission-control-plugins.h>
 
+#include "mcd-storage-journal.h"
+#include "mcd-storage-snapshot.h"
+
 #ifndef __MCD_ACCOUNT_MANAGER_DEFAULT_H__
 #define __MCD_ACCOUNT_MANAGER_DEFAULT_H__
 
@@ -53,8 +56,27 @@ typedef struct {
   GKeyFile *removed;
   GHashTable *removed_accounts;
   gchar *filename;
+  /* changes since @filename was last written */
+  McdStorageJournal *journal;
+  guint compact_id;
+  /* TRUE if the journal can't be trusted and we must write @filename */
+  gboolean force_compact;
+  /* if not %NULL, @keyfile has not been loaded yet and this is used
+   * instead, until the first change */
+  McdStorageSnapshot *snapshot;
+  gchar *snapshot_filename;
   gboolean save;
   gboolean loaded;
+  /* writes @filename and the journal, one job at a time, in order */
+  GThreadPool *writer;
+  /* protect and signal the completion of jobs */
+  GMutex write_lock;
+  GCond write_cond;
+  /* protected by @write_lock: asynchronous jobs that the writer hasn't
+   * finished yet, and whether any of them has failed since the last
+   * synchronous commit */
+  guint n_writing;
+  gboolean async_failed;
 } _McdAccountManagerDefault;
 
 typedef struct {
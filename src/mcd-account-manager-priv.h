@@ -27,6 +27,7 @@
 #include "mcd-account-manager.h"
 
 #include "mcd-dbusprop.h"
+#include "mcd-property-coalescer.h"
 
 /* auto-generated stubs */
 #include "_gen/svc-Account_Manager_Interface_Hidden.h"
@@ -39,6 +40,9 @@ G_GNUC_INTERNAL void _mcd_account_manager_setup
 G_GNUC_INTERNAL GHashTable *_mcd_account_manager_get_accounts
     (McdAccountManager *account_manager);
 
+G_GNUC_INTERNAL McdPropertyCoalescer *
+    _mcd_account_manager_get_property_coalescer (McdAccountManager *self);
+
 typedef void (*McdGetAccountCb) (McdAccountManager *account_manager,
                                  McdAccount *account,
                                  const GError *error,
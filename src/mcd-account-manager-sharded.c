@@ -0,0 +1,656 @@
+/*
+ * The sharded account storage pseudo-plugin: like the default keyfile
+ * backend, but with one keyfile per account, so that saving one account
+ * does not rewrite all the others.
+ *
+ * Copyright © 2010 Nokia Corporation
+ * Copyright © 2010 Collabora Ltd.
+ *
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License as published by the Free Software Foundation; either
+ * version 2.1 of the License, or (at your option) any later version.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with this library; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin St, Fifth Floor, Boston, MA  02110-1301  USA
+ */
+
+#include "config.h"
+
+#include <errno.h>
+#include <string.h>
+
+#include <glib/gstdio.h>
+
+#include <telepathy-glib/telepathy-glib.h>
+
+#include "mcd-account-manager-sharded.h"
+#include "mcd-debug.h"
+#include "mcd-misc.h"
+#include "mcd-storage-journal.h"
+
+#define PLUGIN_NAME "sharded-gkeyfile"
+#define PLUGIN_PRIORITY MCP_ACCOUNT_STORAGE_PLUGIN_PRIO_DEFAULT
+#define PLUGIN_DESCRIPTION "GKeyFile account storage backend, one file per " \
+  "account"
+#define SHARD_SUFFIX ".cfg"
+
+static void account_storage_iface_init (McpAccountStorageIface *,
+    gpointer);
+
+G_DEFINE_TYPE_WITH_CODE (McdAccountManagerSharded,
+    mcd_account_manager_sharded,
+    G_TYPE_OBJECT,
+    G_IMPLEMENT_INTERFACE (MCP_TYPE_ACCOUNT_STORAGE,
+        account_storage_iface_init));
+
+static gchar *
+get_old_filename (void)
+{
+  const gchar *base;
+
+  base = g_getenv ("MC_ACCOUNT_DIR");
+
+  if (!base)
+    base = ACCOUNTS_DIR;
+
+  if (!base)
+    return NULL;
+
+  if (base[0] == '~')
+    return g_build_filename (g_get_home_dir(), base + 1, "accounts.cfg", NULL);
+  else
+    return g_build_filename (base, "accounts.cfg", NULL);
+}
+
+static gchar *
+account_filename_in (const gchar *dir)
+{
+  return g_build_filename (dir, "telepathy", "mission-control", "accounts.cfg",
+      NULL);
+}
+
+static gchar *
+shard_filename (McdAccountManagerSharded *self,
+    const gchar *account)
+{
+  /* Account names contain '/', so escape them into something that is
+   * a valid filename; the group inside the file is what we actually
+   * use as the account name when loading. */
+  gchar *escaped = tp_escape_as_identifier (account);
+  gchar *basename = g_strconcat (escaped, SHARD_SUFFIX, NULL);
+  gchar *ret = g_build_filename (self->directory, basename, NULL);
+
+  g_free (basename);
+  g_free (escaped);
+  return ret;
+}
+
+static void
+mcd_account_manager_sharded_init (McdAccountManagerSharded *self)
+{
+  DEBUG ("mcd_account_manager_sharded_init");
+  self->directory = g_build_filename (g_get_user_data_dir (), "telepathy",
+      "mission-control", "accounts.d", NULL);
+  self->accounts = g_hash_table_new_full (g_str_hash, g_str_equal,
+      g_free, (GDestroyNotify) g_key_file_free);
+  self->dirty = g_hash_table_new_full (g_str_hash, g_str_equal,
+      g_free, NULL);
+  self->loaded = FALSE;
+  self->from_system = FALSE;
+}
+
+static void
+mcd_account_manager_sharded_class_init (McdAccountManagerShardedClass *cls)
+{
+  DEBUG ("mcd_account_manager_sharded_class_init");
+}
+
+static GKeyFile *
+lookup_account (McdAccountManagerSharded *self,
+    const gchar *account)
+{
+  return g_hash_table_lookup (self->accounts, account);
+}
+
+static GKeyFile *
+ensure_account (McdAccountManagerSharded *self,
+    const gchar *account)
+{
+  GKeyFile *keyfile = lookup_account (self, account);
+
+  if (keyfile == NULL)
+    {
+      keyfile = g_key_file_new ();
+      g_hash_table_insert (self->accounts, g_strdup (account), keyfile);
+    }
+
+  return keyfile;
+}
+
+static void
+mark_dirty (McdAccountManagerSharded *self,
+    const gchar *account)
+{
+  g_hash_table_add (self->dirty, g_strdup (account));
+}
+
+/* We happen to know that the string MC gave us is "sufficiently escaped" to
+ * put it in the keyfile as-is. */
+static gboolean
+_set (const McpAccountStorage *self,
+    const McpAccountManager *am,
+    const gchar *account,
+    const gchar *key,
+    const gchar *val)
+{
+  McdAccountManagerSharded *amd = MCD_ACCOUNT_MANAGER_SHARDED (self);
+
+  if (val != NULL)
+    {
+      g_key_file_set_value (ensure_account (amd, account), account, key, val);
+      mark_dirty (amd, account);
+    }
+  else
+    {
+      GKeyFile *keyfile = lookup_account (amd, account);
+
+      if (keyfile != NULL &&
+          g_key_file_remove_key (keyfile, account, key, NULL))
+        mark_dirty (amd, account);
+    }
+
+  return TRUE;
+}
+
+static gboolean
+_get (const McpAccountStorage *self,
+    const McpAccountManager *am,
+    const gchar *account,
+    const gchar *key)
+{
+  McdAccountManagerSharded *amd = MCD_ACCOUNT_MANAGER_SHARDED (self);
+  GKeyFile *keyfile = lookup_account (amd, account);
+
+  /* Like the default backend: an unknown account has no keys, which is
+   * not an error, but any particular key is missing */
+  if (keyfile == NULL)
+    return (key == NULL);
+
+  if (key != NULL)
+    {
+      gchar *v = NULL;
+
+      v = g_key_file_get_value (keyfile, account, key, NULL);
+
+      if (v == NULL)
+        return FALSE;
+
+      mcp_account_manager_set_value (am, account, key, v);
+      g_free (v);
+    }
+  else
+    {
+      gsize i;
+      gsize n;
+      GStrv keys = g_key_file_get_keys (keyfile, account, &n, NULL);
+
+      if (keys == NULL)
+        n = 0;
+
+      for (i = 0; i < n; i++)
+        {
+          gchar *v = g_key_file_get_value (keyfile, account, keys[i], NULL);
+
+          if (v != NULL)
+            mcp_account_manager_set_value (am, account, keys[i], v);
+
+          g_free (v);
+        }
+
+      g_strfreev (keys);
+    }
+
+  return TRUE;
+}
+
+static gchar *
+_create (const McpAccountStorage *self,
+    const McpAccountManager *am,
+    const gchar *manager,
+    const gchar *protocol,
+    GHashTable *params,
+    GError **error)
+{
+  gchar *unique_name;
+
+  /* See comment in plugin-account.c::_storage_create_account() before changing
+   * this implementation, it's more subtle than it looks */
+  unique_name = mcp_account_manager_get_unique_name (MCP_ACCOUNT_MANAGER (am),
+                                                     manager, protocol, params);
+  g_return_val_if_fail (unique_name != NULL, NULL);
+
+  return unique_name;
+}
+
+static gboolean
+_delete (const McpAccountStorage *self,
+      const McpAccountManager *am,
+      const gchar *account,
+      const gchar *key)
+{
+  McdAccountManagerSharded *amd = MCD_ACCOUNT_MANAGER_SHARDED (self);
+  GKeyFile *keyfile = lookup_account (amd, account);
+
+  if (keyfile == NULL)
+    return TRUE;
+
+  if (key == NULL)
+    {
+      g_hash_table_remove (amd->accounts, account);
+      mark_dirty (amd, account);
+    }
+  else
+    {
+      gsize n;
+      GStrv keys;
+
+      if (g_key_file_remove_key (keyfile, account, key, NULL))
+        mark_dirty (amd, account);
+
+      keys = g_key_file_get_keys (keyfile, account, &n, NULL);
+
+      /* if that was the last parameter, the account is gone too */
+      if (keys == NULL || n == 0)
+        {
+          g_hash_table_remove (amd->accounts, account);
+          mark_dirty (amd, account);
+        }
+
+      g_strfreev (keys);
+    }
+
+  return TRUE;
+}
+
+/* Write out (or delete) the file for one account. Only the accounts
+ * that have actually changed get here, so the cost of a commit is
+ * proportional to the size of those accounts, not of the whole store. */
+static gboolean
+write_shard (McdAccountManagerSharded *self,
+    const gchar *account)
+{
+  GKeyFile *keyfile = lookup_account (self, account);
+  gchar *filename = shard_filename (self, account);
+  gboolean rval;
+
+  if (keyfile == NULL)
+    {
+      DEBUG ("Deleting %s (account %s)", filename, account);
+      rval = (g_unlink (filename) == 0 || errno == ENOENT);
+
+      if (!rval)
+        g_warning ("Unable to delete %s: %s", filename, g_strerror (errno));
+    }
+  else
+    {
+      GError *error = NULL;
+      gchar *data;
+      gsize n;
+
+      DEBUG ("Saving account %s to %s", account, filename);
+
+      data = g_key_file_to_data (keyfile, &n, NULL);
+      rval = g_file_set_contents (filename, data, n, &error);
+
+      if (!rval)
+        {
+          g_warning ("%s", error->message);
+          g_error_free (error);
+        }
+
+      g_free (data);
+    }
+
+  g_free (filename);
+  return rval;
+}
+
+static gboolean
+_commit (const McpAccountStorage *self,
+    const McpAccountManager *am,
+    const gchar *account)
+{
+  McdAccountManagerSharded *amd = MCD_ACCOUNT_MANAGER_SHARDED (self);
+  GError *error = NULL;
+  gboolean rval = TRUE;
+
+  if (g_hash_table_size (amd->dirty) == 0)
+    return TRUE;
+
+  /* Accounts from a system-wide file are not written to the user's
+   * directory until one of them changes; once it exists, it is all we
+   * read, so they must all be written then. */
+  if (amd->from_system)
+    {
+      GHashTableIter iter;
+      gpointer k;
+
+      DEBUG ("Copying system-wide accounts into %s", amd->directory);
+      g_hash_table_iter_init (&iter, amd->accounts);
+
+      while (g_hash_table_iter_next (&iter, &k, NULL))
+        mark_dirty (amd, k);
+
+      amd->from_system = FALSE;
+      account = NULL;
+    }
+
+  if (!mcd_ensure_directory (amd->directory, &error))
+    {
+      g_warning ("%s", error->message);
+      g_clear_error (&error);
+      /* fall through anyway: writing the files will fail, but it does
+       * give us a chance to commit to the keyring too */
+    }
+
+  if (account != NULL)
+    {
+      if (g_hash_table_contains (amd->dirty, account))
+        {
+          rval = write_shard (amd, account);
+
+          if (rval)
+            g_hash_table_remove (amd->dirty, account);
+        }
+    }
+  else
+    {
+      GHashTableIter iter;
+      gpointer k;
+
+      g_hash_table_iter_init (&iter, amd->dirty);
+
+      while (g_hash_table_iter_next (&iter, &k, NULL))
+        {
+          if (write_shard (amd, k))
+            g_hash_table_iter_remove (&iter);
+          else
+            rval = FALSE;
+        }
+    }
+
+  return rval;
+}
+
+/* Copy every group of @source into its own per-account keyfile. */
+static void
+am_sharded_take_groups (McdAccountManagerSharded *self,
+    GKeyFile *source,
+    gboolean dirty)
+{
+  gsize i, n;
+  GStrv groups = g_key_file_get_groups (source, &n);
+
+  for (i = 0; i < n; i++)
+    {
+      const gchar *account = groups[i];
+      GKeyFile *keyfile = ensure_account (self, account);
+      gsize j, n_keys;
+      GStrv keys = g_key_file_get_keys (source, account, &n_keys, NULL);
+
+      for (j = 0; j < n_keys; j++)
+        {
+          gchar *v = g_key_file_get_value (source, account, keys[j], NULL);
+
+          if (v != NULL)
+            g_key_file_set_value (keyfile, account, keys[j], v);
+
+          g_free (v);
+        }
+
+      if (dirty)
+        mark_dirty (self, account);
+
+      g_strfreev (keys);
+    }
+
+  g_strfreev (groups);
+}
+
+static void
+am_sharded_load_directory (McdAccountManagerSharded *self)
+{
+  GError *error = NULL;
+  GDir *dir = g_dir_open (self->directory, 0, &error);
+  const gchar *basename;
+
+  if (dir == NULL)
+    {
+      DEBUG ("Failed to open %s: %s", self->directory, error->message);
+      g_error_free (error);
+      return;
+    }
+
+  while ((basename = g_dir_read_name (dir)) != NULL)
+    {
+      GKeyFile *shard;
+      gchar *filename;
+
+      if (!g_str_has_suffix (basename, SHARD_SUFFIX))
+        continue;
+
+      filename = g_build_filename (self->directory, basename, NULL);
+      shard = g_key_file_new ();
+
+      if (g_key_file_load_from_file (shard, filename,
+            G_KEY_FILE_KEEP_COMMENTS, &error))
+        {
+          am_sharded_take_groups (self, shard, FALSE);
+        }
+      else
+        {
+          /* Leave it on disk: we don't want to lose a
+           * corrupt-but-maybe-recoverable account by overwriting it. */
+          g_warning ("Failed to load account from %s: %s", filename,
+              error->message);
+          g_clear_error (&error);
+        }
+
+      g_key_file_free (shard);
+      g_free (filename);
+    }
+
+  g_dir_close (dir);
+  DEBUG ("Loaded %u accounts from %s", g_hash_table_size (self->accounts),
+      self->directory);
+}
+
+/* Move a corrupt accounts.cfg out of the way, and create the directory
+ * so that we don't go on to migrate from somewhere else instead. The file
+ * is kept, in case the accounts in it can be recovered by hand. */
+static void
+am_sharded_set_aside (McdAccountManagerSharded *self,
+    const gchar *filename)
+{
+  GError *error = NULL;
+  gchar *broken = g_strconcat (filename, ".broken", NULL);
+
+  if (g_rename (filename, broken) == 0)
+    g_warning ("Moved unreadable %s to %s", filename, broken);
+  else
+    g_warning ("Unable to move unreadable %s to %s: %s", filename, broken,
+        g_strerror (errno));
+
+  if (!mcd_ensure_directory (self->directory, &error))
+    {
+      g_warning ("%s", error->message);
+      g_error_free (error);
+    }
+
+  g_free (broken);
+}
+
+/* One-time migration from the monolithic accounts.cfg used by
+ * default-gkeyfile. The source file is left where it is, so that switching
+ * back to the default backend does not lose any accounts.
+ *
+ * If @system is TRUE, @filename is a system-wide default, which is only
+ * copied into our directory when an account changes. Otherwise, changes
+ * that default-gkeyfile had only written to its journal are migrated too.
+ *
+ * Returns: TRUE if @filename exists, even if it could not be loaded, in
+ *  which case there is nothing else to migrate from */
+static gboolean
+am_sharded_migrate_from (McdAccountManagerSharded *self,
+    const gchar *filename,
+    gboolean system)
+{
+  GKeyFile *keyfile;
+  GError *error = NULL;
+
+  if (!g_file_test (filename, G_FILE_TEST_EXISTS))
+    return FALSE;
+
+  keyfile = g_key_file_new ();
+
+  if (g_key_file_load_from_file (keyfile, filename, G_KEY_FILE_KEEP_COMMENTS,
+        &error))
+    {
+      if (system)
+        {
+          DEBUG ("Using system-wide accounts from %s", filename);
+          self->from_system = TRUE;
+        }
+      else
+        {
+          gchar *journal_filename = g_strconcat (filename, ".journal", NULL);
+          McdStorageJournal *journal =
+            mcd_storage_journal_new (journal_filename);
+          guint n;
+
+          n = mcd_storage_journal_replay (journal, keyfile);
+          DEBUG ("Migrating accounts from %s to %s, with %u changes from %s",
+              filename, self->directory, n, journal_filename);
+
+          mcd_storage_journal_free (journal);
+          g_free (journal_filename);
+        }
+
+      am_sharded_take_groups (self, keyfile, !system);
+    }
+  else
+    {
+      DEBUG ("Failed to load accounts from %s: %s", filename, error->message);
+      g_error_free (error);
+
+      /* Like the default backend, don't replace a corrupt file with
+       * something else; but we can't touch system-wide files */
+      if (!system)
+        am_sharded_set_aside (self, filename);
+    }
+
+  g_key_file_free (keyfile);
+  return TRUE;
+}
+
+static GList *
+_list (const McpAccountStorage *self,
+    const McpAccountManager *am)
+{
+  GList *rval = NULL;
+  McdAccountManagerSharded *amd = MCD_ACCOUNT_MANAGER_SHARDED (self);
+  GHashTableIter iter;
+  gpointer k;
+
+  if (!amd->loaded && g_file_test (amd->directory, G_FILE_TEST_IS_DIR))
+    {
+      am_sharded_load_directory (amd);
+      amd->loaded = TRUE;
+    }
+
+  if (!amd->loaded)
+    {
+      gchar *filename = account_filename_in (g_get_user_data_dir ());
+
+      amd->loaded = am_sharded_migrate_from (amd, filename, FALSE);
+      g_free (filename);
+    }
+
+  if (!amd->loaded)
+    {
+      const gchar * const *iter;
+
+      for (iter = g_get_system_data_dirs ();
+          iter != NULL && *iter != NULL && !amd->loaded;
+          iter++)
+        {
+          gchar *filename = account_filename_in (*iter);
+
+          amd->loaded = am_sharded_migrate_from (amd, filename, TRUE);
+          g_free (filename);
+        }
+    }
+
+  if (!amd->loaded)
+    {
+      gchar *old_filename = get_old_filename ();
+
+      amd->loaded = am_sharded_migrate_from (amd, old_filename, FALSE);
+      g_free (old_filename);
+    }
+
+  if (!amd->loaded)
+    {
+      GError *error = NULL;
+
+      DEBUG ("Creating initial account directory");
+
+      if (!mcd_ensure_directory (amd->directory, &error))
+        {
+          g_warning ("%s", error->message);
+          g_error_free (error);
+        }
+
+      amd->loaded = TRUE;
+    }
+
+  /* Writes out anything we migrated, creating the directory, so the
+   * migration only ever happens once */
+  _commit (self, am, NULL);
+
+  g_hash_table_iter_init (&iter, amd->accounts);
+
+  while (g_hash_table_iter_next (&iter, &k, NULL))
+    rval = g_list_prepend (rval, g_strdup (k));
+
+  return rval;
+}
+
+static void
+account_storage_iface_init (McpAccountStorageIface *iface,
+    gpointer unused G_GNUC_UNUSED)
+{
+  iface->name = PLUGIN_NAME;
+  iface->desc = PLUGIN_DESCRIPTION;
+  iface->priority = PLUGIN_PRIORITY;
+
+  iface->get = _get;
+  iface->set = _set;
+  iface->create = _create;
+  iface->delete = _delete;
+  iface->commit_one = _commit;
+  iface->list = _list;
+}
+
+McdAccountManagerSharded *
+mcd_account_manager_sharded_new (void)
+{
+  return g_object_new (MCD_TYPE_ACCOUNT_MANAGER_SHARDED, NULL);
+}
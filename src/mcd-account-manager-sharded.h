@@ -0,0 +1,78 @@
+/*
+ * The sharded (one keyfile per account) account storage pseudo-plugin
+ *
+ * Copyright © 2010 Nokia Corporation
+ * Copyright © 2010 Collabora Ltd.
+ *
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License as published by the Free Software Foundation; either
+ * version 2.1 of the License, or (at your option) any later version.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with this library; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin St, Fifth Floor, Boston, MA  02110-1301  USA
+ */
+
+#include <mission-control-plugins/mission-control-plugins.h>
+
+#ifndef __MCD_ACCOUNT_MANAGER_SHARDED_H__
+#define __MCD_ACCOUNT_MANAGER_SHARDED_H__
+
+G_BEGIN_DECLS
+
+#define MCD_TYPE_ACCOUNT_MANAGER_SHARDED \
+  (mcd_account_manager_sharded_get_type ())
+
+#define MCD_ACCOUNT_MANAGER_SHARDED(o) \
+  (G_TYPE_CHECK_INSTANCE_CAST ((o), MCD_TYPE_ACCOUNT_MANAGER_SHARDED,   \
+      McdAccountManagerSharded))
+
+#define MCD_ACCOUNT_MANAGER_SHARDED_CLASS(k)     \
+    (G_TYPE_CHECK_CLASS_CAST((k), MCD_TYPE_ACCOUNT_MANAGER_SHARDED, \
+        McdAccountManagerShardedClass))
+
+#define MCD_IS_ACCOUNT_MANAGER_SHARDED(o) \
+  (G_TYPE_CHECK_INSTANCE_TYPE ((o), MCD_TYPE_ACCOUNT_MANAGER_SHARDED))
+
+#define MCD_IS_ACCOUNT_MANAGER_SHARDED_CLASS(k)  \
+  (G_TYPE_CHECK_CLASS_TYPE ((k), MCD_TYPE_ACCOUNT_MANAGER_SHARDED))
+
+#define MCD_ACCOUNT_MANAGER_SHARDED_GET_CLASS(o) \
+    (G_TYPE_INSTANCE_GET_CLASS ((o), MCD_TYPE_ACCOUNT_MANAGER_SHARDED, \
+        McdAccountManagerShardedClass))
+
+typedef struct {
+  GObject parent;
+  /* owned string (account) => owned GKeyFile containing one group */
+  GHashTable *accounts;
+  /* set of owned strings: accounts whose file must be rewritten or
+   * deleted on the next commit */
+  GHashTable *dirty;
+  /* $XDG_DATA_HOME/telepathy/mission-control/accounts.d */
+  gchar *directory;
+  gboolean loaded;
+  /* TRUE if the accounts were read from a system-wide accounts.cfg and
+   * have not been written to the directory yet */
+  gboolean from_system;
+} _McdAccountManagerSharded;
+
+typedef struct {
+  GObjectClass parent_class;
+} _McdAccountManagerShardedClass;
+
+typedef _McdAccountManagerSharded McdAccountManagerSharded;
+typedef _McdAccountManagerShardedClass McdAccountManagerShardedClass;
+
+GType mcd_account_manager_sharded_get_type (void) G_GNUC_CONST;
+
+McdAccountManagerSharded *mcd_account_manager_sharded_new (void);
+
+G_END_DECLS
+
+#endif
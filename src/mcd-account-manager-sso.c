@@ -1416,6 +1416,128 @@ _commit (const McpAccountStorage *self,
   return TRUE;
 }
 
+/* ag_account_store() calls that haven't called back yet, for a commit_async */
+typedef struct {
+    guint pending;
+    GError *error;
+} SsoCommit;
+
+static void
+sso_commit_free (gpointer p)
+{
+  SsoCommit *commit = p;
+
+  g_clear_error (&commit->error);
+  g_slice_free (SsoCommit, commit);
+}
+
+static void
+sso_commit_release (GTask *task)
+{
+  SsoCommit *commit = g_task_get_task_data (task);
+
+  if (--commit->pending > 0)
+    return;
+
+  if (commit->error != NULL)
+    g_task_return_error (task, g_steal_pointer (&commit->error));
+  else
+    g_task_return_boolean (task, TRUE);
+}
+
+static void
+_commit_async_stored_cb (AgAccount *account,
+    const GError *err,
+    gpointer user_data)
+{
+  GTask *task = user_data;
+  SsoCommit *commit = g_task_get_task_data (task);
+
+  _ag_account_stored_cb (account, err, g_task_get_source_object (task));
+
+  if (err != NULL && commit->error == NULL)
+    commit->error = g_error_copy (err);
+
+  sso_commit_release (task);
+  g_object_unref (task);
+}
+
+static void
+_sso_store_async (McdAccountManagerSso *sso,
+    GTask *task,
+    const gchar *name,
+    AgAccount *account)
+{
+  SsoCommit *commit = g_task_get_task_data (task);
+  Setting *setting = setting_data (MC_IDENTITY_KEY, SETTING_MC);
+
+  /* this value ties MC accounts to SSO accounts */
+  save_setting (sso, account, setting, name);
+  commit->pending++;
+  ag_account_store (account, _commit_async_stored_cb, g_object_ref (task));
+}
+
+/* Unlike _commit(), this stores the accounts straight away: nothing waits
+ * for it, so there is no need to defer it to avoid blocking */
+static void
+_commit_async (McpAccountStorage *self,
+    McpAccountManager *am,
+    const gchar *account_name,
+    GCancellable *cancellable,
+    GAsyncReadyCallback callback,
+    gpointer user_data)
+{
+  McdAccountManagerSso *sso = MCD_ACCOUNT_MANAGER_SSO (self);
+  GTask *task = g_task_new (self, cancellable, callback, user_data);
+  SsoCommit *commit = g_slice_new0 (SsoCommit);
+
+  g_task_set_source_tag (task, _commit_async);
+  g_task_set_task_data (task, commit, sso_commit_free);
+  /* held until we have started storing everything */
+  commit->pending = 1;
+
+  if (account_name != NULL)
+    {
+      AgAccount *account = g_hash_table_lookup (sso->accounts, account_name);
+
+      if (account != NULL)
+        _sso_store_async (sso, task, account_name, account);
+    }
+  else if (sso->save)
+    {
+      GHashTableIter iter;
+      gpointer key, value;
+
+      if (sso->commit_source != 0)
+        {
+          g_source_remove (sso->commit_source);
+          sso->commit_source = 0;
+        }
+
+      g_hash_table_iter_init (&iter, sso->accounts);
+
+      while (g_hash_table_iter_next (&iter, &key, &value))
+        _sso_store_async (sso, task, key, value);
+
+      sso->save = FALSE;
+    }
+
+  sso_commit_release (task);
+  g_object_unref (task);
+}
+
+static gboolean
+_commit_finish (McpAccountStorage *self,
+    GAsyncResult *result,
+    GError **error)
+{
+  g_return_val_if_fail (g_task_is_valid (result, self), FALSE);
+  g_return_val_if_fail (g_task_get_source_tag (G_TASK (result)) ==
+      _commit_async, FALSE);
+
+  return g_task_propagate_boolean (G_TASK (result), error);
+}
+
 static void
 _load_from_libaccounts (McdAccountManagerSso *sso,
     const McpAccountManager *am)
@@ -1732,6 +1854,8 @@ account_storage_iface_init (McpAccountStorageIface *iface,
   iface->set = _set;
   iface->delete = _delete;
   iface->commit = _commit;
+  iface->commit_async = _commit_async;
+  iface->commit_finish = _commit_finish;
   iface->list = _list;
   iface->ready = _ready;
   iface->get_identifier = _get_identifier;
@@ -44,6 +44,7 @@
 #include "mcd-dbusprop.h"
 #include "mcd-master-priv.h"
 #include "mcd-misc.h"
+#include "mcd-property-coalescer.h"
 #include "mcd-storage.h"
 #include "mission-control-plugins/mission-control-plugins.h"
 #include "mission-control-plugins/implementation.h"
@@ -54,6 +55,14 @@
 #define PARAM_PREFIX "param-"
 #define WRITE_CONF_DELAY    500
 
+/* At startup, let this many accounts connect automatically at a time... */
+#define DEFAULT_AUTOCONNECT_BATCH 4
+/* ... with this many milliseconds between batches */
+#define DEFAULT_AUTOCONNECT_INTERVAL 250
+
+/* Announce changes to accounts' properties within this many milliseconds */
+#define DEFAULT_PROPERTY_CHANGE_LATENCY 10
+
 #define MCD_ACCOUNT_MANAGER_PRIV(account_manager) \
     (MCD_ACCOUNT_MANAGER (account_manager)->priv)
 
@@ -98,6 +107,19 @@ struct _McdAccountManagerPrivate
     gchar *account_connections_dir;  /* directory for temporary file */
     gchar *account_connections_file; /* in account_connections_dir */
 
+    /* accounts loaded at startup that are waiting for their turn to
+     * connect automatically (owned refs), most important first */
+    GQueue autoconnect_queue;
+    guint autoconnect_source;
+    guint autoconnect_total;
+    /* how many accounts to let go at a time (0 for all of them), and
+     * how many milliseconds to wait between batches */
+    guint autoconnect_batch;
+    guint autoconnect_interval;
+
+    /* batches AccountPropertyChanged for all accounts */
+    McdPropertyCoalescer *property_coalescer;
+
     gboolean dbus_registered;
 };
 
@@ -107,6 +129,9 @@ typedef struct
     McpAccountStorage *storage_plugin;
     McdAccount *account;
     gint account_lock;
+    /* TRUE if this is the initial setup, after which accounts connect
+     * automatically a few at a time */
+    gboolean autoconnect;
 } McdLoadAccountsData;
 
 typedef struct
@@ -117,6 +142,9 @@ typedef struct
     McdGetAccountCb callback;
     gpointer user_data;
     GDestroyNotify destroy;
+    /* holds back everything the account is created with, so that it
+     * reaches the plugin in one commit */
+    McdStorageTransaction *transaction;
 
     gboolean ok;
     GError *error;
@@ -135,11 +163,10 @@ enum
     PROP_CLIENT_FACTORY
 };
 
-static guint write_conf_id = 0;
-
 static void register_dbus_service (McdAccountManager *account_manager);
 
 static void release_load_accounts_lock (McdLoadAccountsData *lad);
+static void queue_autoconnect (McdAccountManager *account_manager);
 static void add_account (McdAccountManager *manager, McdAccount *account,
     const gchar *source);
 static void account_loaded (McdAccount *account,
@@ -338,6 +365,7 @@ created_cb (GObject *storage_plugin_obj,
     lad->account_manager = am;
     lad->storage_plugin = plugin;
     lad->account_lock = 1; /* will be released at the end of this function */
+    lad->autoconnect = FALSE;
 
     /* actually fetch the data into our cache from the plugin: */
     if (mcd_storage_add_account_from_plugin (storage, plugin, name))
@@ -733,6 +761,7 @@ mcd_create_account_data_free (McdCreateAccountData *cad)
 {
     g_hash_table_unref (cad->parameters);
     tp_clear_pointer (&cad->properties, g_hash_table_unref);
+    tp_clear_pointer (&cad->transaction, mcd_storage_transaction_free);
 
     if (G_UNLIKELY (cad->error))
         g_error_free (cad->error);
@@ -781,15 +810,23 @@ complete_account_creation_finish (McdAccount *account,
 {
     McdAccountManager *account_manager = cad->account_manager;
 
-    if (!cad->ok)
+    if (cad->ok)
     {
+        /* write the new account's keys, parameters and properties, and
+         * commit them together */
+        mcd_storage_transaction_commit (cad->transaction);
+        cad->transaction = NULL;
+    }
+    else
+    {
+        /* nothing that was held back needs writing after this */
         mcd_account_delete (account, NULL, NULL);
+        tp_clear_pointer (&cad->transaction, mcd_storage_transaction_free);
         tp_clear_object (&account);
+        mcd_account_manager_write_conf_async (account_manager, NULL, NULL,
+                                              NULL);
     }
 
-    mcd_account_manager_write_conf_async (account_manager, account, NULL,
-                                          NULL);
-
     if (cad->callback != NULL)
         cad->callback (account_manager, account, cad->error, cad->user_data);
     mcd_create_account_data_free (cad);
@@ -881,6 +918,7 @@ _mcd_account_manager_create_account (McdAccountManager *account_manager,
 {
     McdAccountManagerPrivate *priv = account_manager->priv;
     McdStorage *storage = priv->storage;
+    McdStorageTransaction *transaction;
     McdCreateAccountData *cad;
     McdAccount *account;
     gchar *unique_name = NULL;
@@ -915,7 +953,10 @@ _mcd_account_manager_create_account (McdAccountManager *account_manager,
         return;
     }
 
-    /* create the basic account keys */
+    /* create the basic account keys; they, the parameters and the
+     * properties only reach the plugin when creation completes, and are
+     * committed together */
+    transaction = mcd_storage_transaction_begin (storage, unique_name);
     mcd_storage_set_string (storage, unique_name,
                             MC_ACCOUNTS_KEY_MANAGER, manager);
     mcd_storage_set_string (storage, unique_name,
@@ -937,12 +978,15 @@ _mcd_account_manager_create_account (McdAccountManager *account_manager,
         cad->callback = callback;
         cad->user_data = user_data;
         cad->destroy = destroy;
+        cad->transaction = transaction;
         cad->error = NULL;
         _mcd_account_load (account, complete_account_creation, cad);
     }
     else
     {
         GError error = { TP_ERROR, TP_ERROR_NOT_AVAILABLE, "" };
+
+        mcd_storage_transaction_free (transaction);
         callback (account_manager, NULL, &error, user_data);
         if (destroy)
             destroy (user_data);
@@ -1123,20 +1167,6 @@ properties_iface_init (TpSvcDBusPropertiesClass *iface, gpointer iface_data)
 #undef IMPLEMENT
 }
 
-static gboolean
-write_conf (gpointer userdata)
-{
-    McdStorage *storage = MCD_STORAGE (userdata);
-
-    DEBUG ("called");
-    g_source_remove (write_conf_id);
-    write_conf_id = 0;
-
-    mcd_storage_commit (storage, NULL);
-
-    return TRUE;
-}
-
 static void
 release_load_accounts_lock (McdLoadAccountsData *lad)
 {
@@ -1147,6 +1177,10 @@ release_load_accounts_lock (McdLoadAccountsData *lad)
     if (lad->account_lock == 0)
     {
         register_dbus_service (lad->account_manager);
+
+        if (lad->autoconnect)
+            queue_autoconnect (lad->account_manager);
+
         g_slice_free (McdLoadAccountsData, lad);
     }
 }
@@ -1166,6 +1200,108 @@ account_loaded (McdAccount *account, const GError *error, gpointer user_data)
     release_load_accounts_lock (lad);
 }
 
+/* Accounts that are always supposed to be available go first, then the
+ * ones that were used most recently */
+static gint
+compare_autoconnect_priority (gconstpointer a,
+                              gconstpointer b,
+                              gpointer user_data G_GNUC_UNUSED)
+{
+    McdAccount *account_a = MCD_ACCOUNT (a);
+    McdAccount *account_b = MCD_ACCOUNT (b);
+    gboolean urgent_a = _mcd_account_needs_dispatch (account_a) ||
+        _mcd_account_get_always_on (account_a);
+    gboolean urgent_b = _mcd_account_needs_dispatch (account_b) ||
+        _mcd_account_get_always_on (account_b);
+    gint64 last_a = _mcd_account_get_last_online (account_a);
+    gint64 last_b = _mcd_account_get_last_online (account_b);
+
+    if (urgent_a != urgent_b)
+        return urgent_a ? -1 : 1;
+
+    if (last_a != last_b)
+        return last_a > last_b ? -1 : 1;
+
+    return g_strcmp0 (mcd_account_get_unique_name (account_a),
+                      mcd_account_get_unique_name (account_b));
+}
+
+static gboolean
+autoconnect_next_batch (gpointer user_data)
+{
+    McdAccountManager *self = MCD_ACCOUNT_MANAGER (user_data);
+    McdAccountManagerPrivate *priv = self->priv;
+    guint n = 0;
+
+    priv->autoconnect_source = 0;
+
+    while (priv->autoconnect_batch == 0 || n < priv->autoconnect_batch)
+    {
+        McdAccount *account = g_queue_pop_head (&priv->autoconnect_queue);
+
+        if (account == NULL)
+            break;
+
+        /* it might have been deleted while it was waiting; if it has
+         * changed its mind, it doesn't use up a place in the batch */
+        if (g_hash_table_lookup (priv->accounts,
+                mcd_account_get_unique_name (account)) == account)
+        {
+            if (mcd_account_would_like_to_connect (account))
+                n++;
+
+            _mcd_account_release_autoconnect (account);
+        }
+
+        g_object_unref (account);
+    }
+
+    DEBUG ("%u of %u accounts have been allowed to connect automatically",
+           priv->autoconnect_total -
+           g_queue_get_length (&priv->autoconnect_queue),
+           priv->autoconnect_total);
+
+    if (!g_queue_is_empty (&priv->autoconnect_queue))
+        priv->autoconnect_source = g_timeout_add (priv->autoconnect_interval,
+                                                  autoconnect_next_batch,
+                                                  self);
+
+    return FALSE;
+}
+
+/* Called when every account has been loaded, so we know which ones would
+ * like to connect */
+static void
+queue_autoconnect (McdAccountManager *account_manager)
+{
+    McdAccountManagerPrivate *priv = account_manager->priv;
+    GHashTableIter iter;
+    gpointer v;
+
+    /* Connecting every account at once would compete with everything
+     * else that's starting up, so let the most important ones go first,
+     * and the rest a few at a time. Accounts that don't want to connect
+     * don't wait, so they don't take anyone's place. */
+    g_hash_table_iter_init (&iter, priv->accounts);
+
+    while (g_hash_table_iter_next (&iter, NULL, &v))
+    {
+        if (mcd_account_would_like_to_connect (v))
+            g_queue_push_tail (&priv->autoconnect_queue, g_object_ref (v));
+        else
+            _mcd_account_release_autoconnect (v);
+    }
+
+    g_queue_sort (&priv->autoconnect_queue, compare_autoconnect_priority,
+                  NULL);
+    priv->autoconnect_total = g_queue_get_length (&priv->autoconnect_queue);
+    DEBUG ("%u accounts to connect automatically, %u every %ums",
+           priv->autoconnect_total, priv->autoconnect_batch,
+           priv->autoconnect_interval);
+
+    autoconnect_next_batch (account_manager);
+}
+
 static void
 uncork_storage_plugins (McdAccountManager *account_manager)
 {
@@ -1420,8 +1556,6 @@ _mcd_account_manager_setup (McdAccountManager *account_manager)
     McdStorage *storage = priv->storage;
     McdLoadAccountsData *lad;
     gchar **accounts, **name;
-    GHashTableIter iter;
-    gpointer v;
 
     tp_list_connection_names (priv->dbus_daemon,
                               list_connection_names_cb, NULL, NULL,
@@ -1430,9 +1564,24 @@ _mcd_account_manager_setup (McdAccountManager *account_manager)
     lad = g_slice_new (McdLoadAccountsData);
     lad->account_manager = account_manager;
     lad->account_lock = 1; /* will be released at the end of this function */
+    lad->autoconnect = TRUE;
 
     accounts = mcd_storage_dup_accounts (storage, NULL);
 
+    /* Start finding out about every CM we're going to need before doing
+     * anything else, so that they are all prepared in parallel, rather
+     * than each one waiting until we get round to its first account. */
+    for (name = accounts; *name != NULL; name++)
+    {
+        gchar *cm_name = mcd_storage_dup_string (storage, *name,
+                                                 MC_ACCOUNTS_KEY_MANAGER);
+
+        if (!tp_str_empty (cm_name))
+            _mcd_master_lookup_manager (mcd_master_get_default (), cm_name);
+
+        g_free (cm_name);
+    }
+
     for (name = accounts; *name != NULL; name++)
     {
         gboolean plausible = FALSE;
@@ -1473,6 +1622,10 @@ _mcd_account_manager_setup (McdAccountManager *account_manager)
             continue;
         }
 
+        /* An account that is needed for a channel request doesn't wait its
+         * turn, but otherwise, nothing connects until we've seen them
+         * all */
+        _mcd_account_hold_autoconnect (account);
         lad->account_lock++;
         add_account (lad->account_manager, account, "keyfile");
         _mcd_account_load (account, account_loaded, lad);
@@ -1485,11 +1638,6 @@ _mcd_account_manager_setup (McdAccountManager *account_manager)
     migrate_accounts (account_manager, lad);
 
     release_load_accounts_lock (lad);
-
-    g_hash_table_iter_init (&iter, account_manager->priv->accounts);
-
-    while (g_hash_table_iter_next (&iter, NULL, &v))
-      _mcd_account_maybe_autoconnect (v);
 }
 
 static void
@@ -1566,12 +1714,6 @@ _mcd_account_manager_finalize (GObject *object)
 {
     McdAccountManagerPrivate *priv = MCD_ACCOUNT_MANAGER_PRIV (object);
 
-    if (write_conf_id)
-    {
-        write_conf (priv->storage);
-        g_assert (write_conf_id == 0);
-    }
-
     tp_clear_object (&priv->storage);
     g_free (priv->account_connections_dir);
     remove (priv->account_connections_file);
@@ -1587,6 +1729,24 @@ _mcd_account_manager_dispose (GObject *object)
 {
     McdAccountManagerPrivate *priv = MCD_ACCOUNT_MANAGER_PRIV (object);
 
+    if (priv->autoconnect_source != 0)
+    {
+        g_source_remove (priv->autoconnect_source);
+        priv->autoconnect_source = 0;
+    }
+
+    g_queue_foreach (&priv->autoconnect_queue, (GFunc) g_object_unref, NULL);
+    g_queue_clear (&priv->autoconnect_queue);
+
+    /* pending changes hold refs to the accounts, which hold refs to the
+     * coalescer */
+    if (priv->property_coalescer != NULL)
+    {
+        _mcd_property_coalescer_flush (priv->property_coalescer);
+        tp_clear_pointer (&priv->property_coalescer,
+                          _mcd_property_coalescer_unref);
+    }
+
     tp_clear_object (&priv->dbus_daemon);
     tp_clear_object (&priv->client_factory);
     tp_clear_object (&priv->minotaur);
@@ -1648,6 +1808,19 @@ mcd_account_manager_init (McdAccountManager *account_manager)
 					MCD_TYPE_ACCOUNT_MANAGER,
 					McdAccountManagerPrivate);
     account_manager->priv = priv;
+
+    g_queue_init (&priv->autoconnect_queue);
+    priv->autoconnect_batch = _mcd_get_uint_from_env (
+        "MC_AUTOCONNECT_BATCH", DEFAULT_AUTOCONNECT_BATCH);
+    priv->autoconnect_interval = _mcd_get_uint_from_env (
+        "MC_AUTOCONNECT_INTERVAL", DEFAULT_AUTOCONNECT_INTERVAL);
+}
+
+static void
+emit_account_property_changed (GObject *account,
+                               GHashTable *properties)
+{
+    tp_svc_account_emit_account_property_changed (account, properties);
 }
 
 static void
@@ -1668,6 +1841,10 @@ _mcd_account_manager_constructed (GObject *obj)
     DEBUG ("");
 
     priv->minotaur = mcd_connectivity_monitor_new ();
+    priv->property_coalescer = _mcd_property_coalescer_new (
+        _mcd_get_uint_from_env ("MC_PROPERTY_CHANGE_LATENCY",
+                                DEFAULT_PROPERTY_CHANGE_LATENCY),
+        emit_account_property_changed);
 
     priv->storage = mcd_storage_new (priv->dbus_daemon);
     priv->accounts = g_hash_table_new_full (g_str_hash, g_str_equal,
@@ -1724,6 +1901,13 @@ mcd_account_manager_get_connectivity_monitor (McdAccountManager *self)
   return self->priv->minotaur;
 }
 
+McdPropertyCoalescer *
+_mcd_account_manager_get_property_coalescer (McdAccountManager *self)
+{
+  g_return_val_if_fail (MCD_IS_ACCOUNT_MANAGER (self), NULL);
+  return self->priv->property_coalescer;
+}
+
 /**
  * McdAccountManagerWriteConfCb:
  * @account_manager: the #McdAccountManager
@@ -1742,7 +1926,10 @@ mcd_account_manager_get_connectivity_monitor (McdAccountManager *self)
  * @callback: a callback to be called on write success or failure
  * @user_data: data to be passed to @callback
  *
- * Write the account manager configuration to disk.
+ * Write the account manager configuration to disk. Changes to a single
+ * @account are coalesced with any others made shortly afterwards (see
+ * mcd_storage_commit_later()), so @callback does not imply that they have
+ * reached the disk yet; flushing all accounts is synchronous.
  */
 void
 mcd_account_manager_write_conf_async (McdAccountManager *account_manager,
@@ -1762,7 +1949,7 @@ mcd_account_manager_write_conf_async (McdAccountManager *account_manager,
         account_name = mcd_account_get_unique_name (account);
 
         DEBUG ("updating %s", account_name);
-        mcd_storage_commit (storage, account_name);
+        mcd_storage_commit_later (storage, account_name);
     }
     else
     {
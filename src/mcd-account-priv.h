@@ -73,8 +73,8 @@ G_GNUC_INTERNAL gboolean _mcd_account_set_avatar (McdAccount *account,
                                                   const gchar *mime_type,
                                                   const gchar *token,
                                                   GError **error);
-G_GNUC_INTERNAL void _mcd_account_get_avatar (McdAccount *account,
-                                              GArray **avatar,
+G_GNUC_INTERNAL void _mcd_account_dup_avatar (McdAccount *account,
+                                              GBytes **avatar,
                                               gchar **mime_type);
 G_GNUC_INTERNAL void _mcd_account_set_avatar_token (McdAccount *account,
                                                     const gchar *token);
@@ -175,6 +175,12 @@ G_GNUC_INTERNAL gboolean _mcd_account_presence_type_is_settable (
 gboolean _mcd_account_is_hidden (McdAccount *account);
 
 G_GNUC_INTERNAL gboolean _mcd_account_needs_dispatch (McdAccount *account);
+G_GNUC_INTERNAL gboolean _mcd_account_was_recently_online (
+    McdAccount *account);
+G_GNUC_INTERNAL gint64 _mcd_account_get_last_online (McdAccount *account);
+
+G_GNUC_INTERNAL void _mcd_account_hold_autoconnect (McdAccount *account);
+G_GNUC_INTERNAL void _mcd_account_release_autoconnect (McdAccount *account);
 
 G_GNUC_INTERNAL void _mcd_account_reconnect (McdAccount *self,
     gboolean user_initiated);
@@ -37,6 +37,7 @@
 #include "mcd-account-conditions.h"
 #include "mcd-account-manager-priv.h"
 #include "mcd-account-addressing.h"
+#include "mcd-avatar-cache.h"
 #include "mcd-connection-priv.h"
 #include "mcd-misc.h"
 #include "mcd-manager.h"
@@ -52,6 +53,11 @@
 
 #define MC_OLD_AVATAR_FILENAME	"avatar.bin"
 
+/* Total size of the avatars we keep in memory, across all accounts */
+#define MCD_AVATAR_CACHE_SIZE (1024 * 1024)
+/* Number of accounts whose avatar (or lack of one) we remember */
+#define MCD_AVATAR_CACHE_ENTRIES 64
+
 #define MCD_ACCOUNT_PRIV(account) (MCD_ACCOUNT (account)->priv)
 
 static void account_iface_init (TpSvcAccountClass *iface,
@@ -70,6 +76,8 @@ static void account_external_password_storage_iface_init (
     McSvcAccountInterfaceExternalPasswordStorageClass *iface,
     gpointer iface_data);
 
+static McdAvatarCache *get_avatar_cache (void);
+
 static const McdDBusProp account_properties[];
 static const McdDBusProp account_avatar_properties[];
 static const McdDBusProp account_storage_properties[];
@@ -139,6 +147,13 @@ struct _McdAccountPrivate
     TpConnectionStatusReason conn_reason;
     gchar *conn_dbus_error;
     GHashTable *conn_error_details;
+    /* monotonic time at which we were last CONNECTED, or 0 */
+    gint64 last_connected;
+    /* LastOnline: wall-clock time in seconds, or 0 if never */
+    gint64 last_online;
+
+    /* schedules automatic connection attempts */
+    McdReconnectScheduler *reconnect_scheduler;
 
     /* current presence fields */
     TpConnectionPresenceType curr_presence_type;
@@ -175,16 +190,17 @@ struct _McdAccountPrivate
     gboolean setting_avatar;
     gboolean waiting_for_initial_avatar;
     gboolean waiting_for_connectivity;
+    /* TRUE if McdAccountManager will tell us when to connect automatically */
+    gboolean autoconnect_held;
 
     gboolean hidden;
     /* In addition to affecting dispatching, this flag also makes this
      * account bypass connectivity checks. */
     gboolean always_dispatch;
 
-    /* These fields are used to cache the changed properties */
+    /* batches our AccountPropertyChanged signals with other accounts' */
+    McdPropertyCoalescer *property_coalescer;
     gboolean properties_frozen;
-    GHashTable *changed_properties;
-    guint properties_source;
 
     gboolean password_saved;
 };
@@ -194,6 +210,7 @@ enum
     PROP_0,
     PROP_DBUS_DAEMON,
     PROP_CONNECTIVITY_MONITOR,
+    PROP_PROPERTY_COALESCER,
     PROP_STORAGE,
     PROP_NAME,
     PROP_ALWAYS_ON,
@@ -235,6 +252,13 @@ _mcd_account_maybe_autoconnect (McdAccount *account)
     g_return_if_fail (MCD_IS_ACCOUNT (account));
     priv = account->priv;
 
+    if (priv->autoconnect_held)
+    {
+        DEBUG ("%s is waiting for its turn to connect automatically",
+               priv->unique_name);
+        return;
+    }
+
     if (!mcd_account_would_like_to_connect (account))
     {
         return;
@@ -561,14 +585,17 @@ account_external_password_storage_properties_changed_cb (TpProxy *cm,
     GObject *self)
 {
   McdAccount *account = MCD_ACCOUNT (self);
-  TpProtocol *protocol = tp_connection_manager_get_protocol_object (
-      TP_CONNECTION_MANAGER (cm), account->priv->protocol_name);
+  TpProtocol *protocol;
   GHashTable *params;
 
   if (tp_strdiff (iface,
         MC_IFACE_CONNECTION_MANAGER_INTERFACE_ACCOUNT_STORAGE))
     return;
 
+  protocol = _mcd_manager_dup_protocol (account->priv->manager,
+      account->priv->protocol_name);
+  g_return_if_fail (protocol != NULL);
+
   /* look up account identity so we can look up our value in
    * the Accounts map */
   params = _mcd_account_dup_parameters (account);
@@ -577,6 +604,7 @@ account_external_password_storage_properties_changed_cb (TpProxy *cm,
       NULL, NULL, G_OBJECT (account));
 
   g_hash_table_unref (params);
+  g_object_unref (protocol);
 }
 
 static void on_manager_ready (McdManager *manager, const GError *error,
@@ -600,8 +628,8 @@ static void on_manager_ready (McdManager *manager, const GError *error,
         if (tp_proxy_has_interface_by_id (cm,
                 MC_IFACE_QUARK_CONNECTION_MANAGER_INTERFACE_ACCOUNT_STORAGE))
         {
-            TpProtocol *protocol = tp_connection_manager_get_protocol_object (
-                cm, account->priv->protocol_name);
+            TpProtocol *protocol = _mcd_manager_dup_protocol (manager,
+                account->priv->protocol_name);
             GHashTable *params;
 
             DEBUG ("CM %s has CM.I.AccountStorage iface",
@@ -623,6 +651,7 @@ static void on_manager_ready (McdManager *manager, const GError *error,
                 NULL, NULL, G_OBJECT (account), NULL);
 
             g_hash_table_unref (params);
+            tp_clear_object (&protocol);
         }
     }
 }
@@ -728,7 +757,7 @@ mcd_account_delete (McdAccount *account,
         GHashTable *params;
 
         /* identify the account */
-        protocol = tp_connection_manager_get_protocol_object (cm,
+        protocol = _mcd_manager_dup_protocol (account->priv->manager,
             account->priv->protocol_name);
         params = _mcd_account_dup_parameters (account);
 
@@ -737,6 +766,7 @@ mcd_account_delete (McdAccount *account,
             NULL, NULL, g_object_ref (account));
 
         g_hash_table_unref (params);
+        tp_clear_object (&protocol);
     }
 
     /* got to turn the account off before removing it, otherwise we can *
@@ -751,6 +781,7 @@ mcd_account_delete (McdAccount *account,
     }
 
     mcd_storage_delete_account (priv->storage, name);
+    mcd_avatar_cache_remove (get_avatar_cache (), name);
 
     data_dir_str = get_old_account_data_path (priv);
 
@@ -957,29 +988,6 @@ _mcd_account_connect (McdAccount *account, GHashTable *params)
     _mcd_connection_connect (priv->connection, params);
 }
 
-static gboolean
-emit_property_changed (gpointer userdata)
-{
-    McdAccount *account = MCD_ACCOUNT (userdata);
-    McdAccountPrivate *priv = account->priv;
-
-    DEBUG ("called");
-
-    if (g_hash_table_size (priv->changed_properties) > 0)
-    {
-        tp_svc_account_emit_account_property_changed (account,
-            priv->changed_properties);
-        g_hash_table_remove_all (priv->changed_properties);
-    }
-
-    if (priv->properties_source != 0)
-    {
-      g_source_remove (priv->properties_source);
-      priv->properties_source = 0;
-    }
-    return FALSE;
-}
-
 static void
 mcd_account_freeze_properties (McdAccount *self)
 {
@@ -995,45 +1003,23 @@ mcd_account_thaw_properties (McdAccount *self)
     DEBUG ("%s", self->priv->unique_name);
     self->priv->properties_frozen = FALSE;
 
-    if (g_hash_table_size (self->priv->changed_properties) != 0)
-    {
-        emit_property_changed (self);
-    }
+    _mcd_property_coalescer_flush_object (self->priv->property_coalescer,
+                                          (GObject *) self);
 }
 
 /*
  * This function is responsible of emitting the AccountPropertyChanged signal.
- * One possible improvement would be to save the HashTable and have the signal
- * emitted in an idle function (or a timeout function with a very small delay)
- * to group together several property changes that occur at the same time.
+ * The account manager's coalescer groups together the changes to all
+ * accounts that occur at about the same time; if a property changes again
+ * before they are emitted, only its latest value is signalled.
  */
 static void
 mcd_account_changed_property (McdAccount *account, const gchar *key,
 			      const GValue *value)
 {
-    McdAccountPrivate *priv = account->priv;
-
     DEBUG ("called: %s", key);
-    if (priv->changed_properties &&
-	g_hash_table_lookup (priv->changed_properties, key))
-    {
-	/* the changed property was also changed before; then let's force the
-	 * emission of the signal now, so that the property will appear in two
-	 * separate signals */
-        DEBUG ("Forcibly emit PropertiesChanged now");
-	emit_property_changed (account);
-    }
-
-    if (priv->properties_source == 0)
-    {
-        DEBUG ("First changed property");
-        priv->properties_source = g_timeout_add_full (G_PRIORITY_DEFAULT, 10,
-                                                      emit_property_changed,
-                                                      g_object_ref (account),
-                                                      g_object_unref);
-    }
-    g_hash_table_insert (priv->changed_properties, (gpointer) key,
-                         tp_g_value_slice_dup (value));
+    _mcd_property_coalescer_add (account->priv->property_coalescer,
+                                 (GObject *) account, key, value);
 }
 
 typedef enum {
@@ -1085,7 +1071,7 @@ mcd_account_set_string_val (McdAccount *account,
     }
     else if (mcd_storage_set_string (storage, name, key, new_string))
     {
-        mcd_storage_commit (storage, name);
+        mcd_storage_commit_later (storage, name);
         mcd_account_changed_property (account, key, value);
         return SET_RESULT_CHANGED;
     }
@@ -1225,7 +1211,7 @@ _mcd_account_set_enabled (McdAccount *account,
                                        MC_ACCOUNTS_KEY_ENABLED, &value);
 
             if (write_out)
-                mcd_storage_commit (priv->storage, name);
+                mcd_storage_commit_later (priv->storage, name);
         }
 
         mcd_account_changed_property (account, "Enabled", &value);
@@ -1626,23 +1612,36 @@ set_avatar (TpSvcDBusProperties *self, const gchar *name, const GValue *value,
     return TRUE;
 }
 
+/* dbus-glib wants a GArray that owns its contents, so we have to copy the
+ * shared avatar at this point */
+static GArray *
+avatar_to_array (GBytes *avatar)
+{
+    GArray *arr = g_array_new (FALSE, FALSE, 1);
+
+    if (avatar != NULL)
+        g_array_append_vals (arr, g_bytes_get_data (avatar, NULL),
+                             (guint) g_bytes_get_size (avatar));
+
+    return arr;
+}
+
 static void
 get_avatar (TpSvcDBusProperties *self, const gchar *name, GValue *value)
 {
     McdAccount *account = MCD_ACCOUNT (self);
     gchar *mime_type;
-    GArray *avatar = NULL;
+    GBytes *avatar = NULL;
     GType type = TP_STRUCT_TYPE_AVATAR;
     GValueArray *va;
 
-    _mcd_account_get_avatar (account, &avatar, &mime_type);
-    if (!avatar)
-        avatar = g_array_new (FALSE, FALSE, 1);
+    _mcd_account_dup_avatar (account, &avatar, &mime_type);
 
     g_value_init (value, type);
     g_value_take_boxed (value, dbus_g_type_specialized_construct (type));
     va = (GValueArray *) g_value_get_boxed (value);
-    g_value_take_boxed (va->values, avatar);
+    g_value_take_boxed (va->values, avatar_to_array (avatar));
+    tp_clear_pointer (&avatar, g_bytes_unref);
     g_value_take_string (va->values + 1, mime_type);
 }
 
@@ -1762,7 +1761,7 @@ set_automatic_presence (TpSvcDBusProperties *self,
         mcd_storage_set_attribute (priv->storage, account_name,
                                    MC_ACCOUNTS_KEY_AUTOMATIC_PRESENCE,
                                    value);
-        mcd_storage_commit (priv->storage, account_name);
+        mcd_storage_commit_later (priv->storage, account_name);
         mcd_account_changed_property (account, name, value);
     }
 
@@ -1833,7 +1832,7 @@ set_connect_automatically (TpSvcDBusProperties *self,
             mcd_storage_set_attribute (priv->storage, account_name,
                                        MC_ACCOUNTS_KEY_CONNECT_AUTOMATICALLY,
                                        value);
-            mcd_storage_commit (priv->storage, account_name);
+            mcd_storage_commit_later (priv->storage, account_name);
         }
 
         priv->connect_automatically = connect_automatically;
@@ -2059,7 +2058,7 @@ set_supersedes (TpSvcDBusProperties *svc,
 
   mcd_storage_set_attribute (self->priv->storage, self->priv->unique_name,
       MC_ACCOUNTS_KEY_SUPERSEDES, value);
-  mcd_storage_commit (self->priv->storage, self->priv->unique_name);
+  mcd_storage_commit_later (self->priv->storage, self->priv->unique_name);
 
   return TRUE;
 }
@@ -2286,7 +2285,7 @@ set_hidden (TpSvcDBusProperties *self,
   if (mcd_storage_set_attribute (priv->storage, account_name,
           MC_ACCOUNTS_KEY_HIDDEN, value))
     {
-      mcd_storage_commit (priv->storage, account_name);
+      mcd_storage_commit_later (priv->storage, account_name);
       mcd_account_changed_property (account, MC_ACCOUNTS_KEY_HIDDEN, value);
       g_object_set_property (G_OBJECT (self), "hidden", value);
     }
@@ -2391,7 +2390,7 @@ account_external_password_storage_forget_password (
     }
 
   /* identify the account */
-  protocol = tp_connection_manager_get_protocol_object (cm,
+  protocol = _mcd_manager_dup_protocol (account->priv->manager,
       account->priv->protocol_name);
   params = _mcd_account_dup_parameters (account);
 
@@ -2400,6 +2399,7 @@ account_external_password_storage_forget_password (
       context, NULL, G_OBJECT (self));
 
   g_hash_table_unref (params);
+  tp_clear_object (&protocol);
 }
 
 static void
@@ -2687,23 +2687,32 @@ apply_parameter_updates (McdAccount *account,
                          GHashTable *dbus_properties)
 {
     McdAccountPrivate *priv = account->priv;
+    McdStorageTransaction *transaction;
     GHashTableIter iter;
     gpointer name, value;
     const gchar **unset_iter;
 
+    /* the caller commits all of these together */
+    transaction = mcd_storage_transaction_new (priv->storage,
+                                               priv->unique_name);
+
     g_hash_table_iter_init (&iter, params);
     while (g_hash_table_iter_next (&iter, &name, &value))
     {
-        _mcd_account_set_parameter (account, name, value);
+        mcd_storage_transaction_set_parameter (transaction, name, value,
+            mcd_account_parameter_is_secret (account, name));
     }
 
     for (unset_iter = unset;
          unset_iter != NULL && *unset_iter != NULL;
          unset_iter++)
     {
-        _mcd_account_set_parameter (account, *unset_iter, NULL);
+        mcd_storage_transaction_set_parameter (transaction, *unset_iter, NULL,
+            mcd_account_parameter_is_secret (account, *unset_iter));
     }
 
+    mcd_storage_transaction_apply (transaction);
+
     if (mcd_account_get_connection_status (account) ==
         TP_CONNECTION_STATUS_CONNECTED)
     {
@@ -2987,7 +2996,8 @@ account_update_parameters_cb (McdAccount *account, GPtrArray *not_yet,
     mcd_account_changed_property (account, "Parameters", &value);
     g_value_unset (&value);
 
-    /* Commit the changes to disk */
+    /* Commit the changes to disk before replying, rather than coalescing
+     * them: the caller may reasonably expect them to be stored by then */
     mcd_storage_commit (priv->storage, account_name);
 
     /* And finally, return from UpdateParameters() */
@@ -3105,6 +3115,18 @@ register_dbus_service (McdAccount *self,
     }
 }
 
+static McdAvatarCache *
+get_avatar_cache (void)
+{
+    static McdAvatarCache *cache = NULL;
+
+    if (G_UNLIKELY (cache == NULL))
+        cache = mcd_avatar_cache_new (MCD_AVATAR_CACHE_SIZE,
+            MCD_AVATAR_CACHE_ENTRIES);
+
+    return cache;
+}
+
 /*
  * @account: (allow-none):
  * @dir_out: (out): e.g. ~/.local/share/telepathy/mission-control
@@ -3167,16 +3189,30 @@ save_avatar (McdAccount *self,
     if (mcd_ensure_directory (dir, error) &&
         g_file_set_contents (file, data, len, error))
     {
+        const gchar *watch[] = { file, NULL };
+        GBytes *avatar = NULL;
+
         DEBUG ("Saved avatar to %s", file);
         ret = TRUE;
+
+        /* An empty file means we have no avatar, even if there is one in a
+         * lower-priority directory. */
+        if (len > 0)
+            avatar = g_bytes_new (data, len);
+
+        mcd_avatar_cache_insert (get_avatar_cache (),
+                                 self->priv->unique_name, avatar, watch);
+        tp_clear_pointer (&avatar, g_bytes_unref);
     }
     else if (len == 0)
     {
-        GArray *avatar = NULL;
+        GBytes *avatar = NULL;
 
         /* It failed, but maybe that's OK, since we didn't really want
          * an avatar anyway. */
-        _mcd_account_get_avatar (self, &avatar, NULL);
+        mcd_avatar_cache_remove (get_avatar_cache (),
+                                 self->priv->unique_name);
+        _mcd_account_dup_avatar (self, &avatar, NULL);
 
         if (avatar == NULL)
         {
@@ -3193,9 +3229,14 @@ save_avatar (McdAccount *self,
              * file into the highest-priority avatar directory, and we do
              * need it, since there is a non-empty avatar in either that
              * directory or a lower-priority directory */
-            g_array_free (avatar, TRUE);
+            g_bytes_unref (avatar);
         }
     }
+    else
+    {
+        mcd_avatar_cache_remove (get_avatar_cache (),
+                                 self->priv->unique_name);
+    }
 
     g_free (dir);
     g_free (file);
@@ -3285,6 +3326,9 @@ mcd_account_migrate_avatar (McdAccount *account)
         }
     }
 
+    mcd_avatar_cache_remove (get_avatar_cache (),
+                             mcd_account_get_unique_name (account));
+
     /* old_dir is typically ~/.mission-control/accounts/gabble/jabber/badger0.
      * We want to delete badger0, jabber, gabble, accounts if they are empty.
      * If they are not, we'll just get ENOTEMPTY and stop. */
@@ -3353,6 +3397,15 @@ mcd_account_setup (McdAccount *account)
 
     priv->has_been_online =
       mcd_storage_get_boolean (storage, name, MC_ACCOUNTS_KEY_HAS_BEEN_ONLINE);
+
+    g_value_init (&value, G_TYPE_INT64);
+
+    if (mcd_storage_get_attribute (storage, name, MC_ACCOUNTS_KEY_LAST_ONLINE,
+                                   &value, NULL))
+        priv->last_online = g_value_get_int64 (&value);
+
+    g_value_unset (&value);
+
     priv->hidden =
       mcd_storage_get_boolean (storage, name, MC_ACCOUNTS_KEY_HIDDEN);
 
@@ -3418,7 +3471,7 @@ mcd_account_setup (McdAccount *account)
             mcd_storage_set_attribute (storage, name,
                                        MC_ACCOUNTS_KEY_AUTO_PRESENCE_MESSAGE,
                                        NULL);
-            mcd_storage_commit (storage, name);
+            mcd_storage_commit_later (storage, name);
         }
     }
 
@@ -3496,6 +3549,12 @@ set_property (GObject *obj, guint prop_id,
         priv->connectivity = g_value_dup_object (val);
         break;
 
+    case PROP_PROPERTY_COALESCER:
+        g_assert (priv->property_coalescer == NULL);
+        priv->property_coalescer = _mcd_property_coalescer_ref (
+            g_value_get_pointer (val));
+        break;
+
     case PROP_NAME:
 	g_assert (priv->unique_name == NULL);
 	priv->unique_name = g_value_dup_string (val);
@@ -3559,10 +3618,8 @@ _mcd_account_finalize (GObject *object)
 
     DEBUG ("%p (%s)", object, priv->unique_name);
 
-    if (priv->changed_properties)
-	g_hash_table_unref (priv->changed_properties);
-    if (priv->properties_source != 0)
-	g_source_remove (priv->properties_source);
+    tp_clear_pointer (&priv->property_coalescer,
+                      _mcd_property_coalescer_unref);
 
     tp_clear_pointer (&priv->curr_presence_status, g_free);
     tp_clear_pointer (&priv->curr_presence_message, g_free);
@@ -3624,6 +3681,14 @@ _mcd_account_dispose (GObject *object)
     _mcd_account_set_connection_context (self, NULL);
     _mcd_account_set_connection (self, NULL);
 
+    if (priv->reconnect_scheduler != NULL)
+    {
+        _mcd_reconnect_scheduler_cancel (priv->reconnect_scheduler, self);
+        _mcd_reconnect_scheduler_finished (priv->reconnect_scheduler, self);
+        _mcd_reconnect_scheduler_unref (priv->reconnect_scheduler);
+        priv->reconnect_scheduler = NULL;
+    }
+
     G_OBJECT_CLASS (mcd_account_parent_class)->dispose (object);
 }
 
@@ -3649,6 +3714,46 @@ _mcd_account_constructor (GType type, guint n_params,
     return (GObject *) account;
 }
 
+/* Give back the slot held by whichever automatic attempt was in progress:
+ * the account's own, or its connection's if that was reconnecting */
+static void
+mcd_account_finish_reconnect_attempt (McdAccount *self)
+{
+  if (self->priv->reconnect_scheduler == NULL)
+    return;
+
+  _mcd_reconnect_scheduler_finished (self->priv->reconnect_scheduler, self);
+
+  if (self->priv->connection != NULL)
+    _mcd_reconnect_scheduler_finished (self->priv->reconnect_scheduler,
+        self->priv->connection);
+}
+
+/* Called by the reconnect scheduler when it's our turn to connect after
+ * connectivity has come back. Returns: %TRUE if we started connecting */
+static gboolean
+mcd_account_reconnect_cb (gpointer user_data)
+{
+  McdAccount *self = MCD_ACCOUNT (user_data);
+
+  if (self->priv->waiting_for_connectivity)
+    {
+      /* allow the account to actually try to connect */
+      DEBUG ("telling %s to proceed", self->priv->unique_name);
+      self->priv->waiting_for_connectivity = FALSE;
+      mcd_account_connection_proceed_with_reason (self, TRUE,
+          TP_CONNECTION_STATUS_REASON_NONE_SPECIFIED);
+    }
+  else if (mcd_account_would_like_to_connect (self))
+    {
+      DEBUG ("account %s would like to connect", self->priv->unique_name);
+      _mcd_account_connect_with_auto_presence (self, FALSE);
+    }
+
+  return (self->priv->conn_status == TP_CONNECTION_STATUS_CONNECTING &&
+      !self->priv->waiting_for_connectivity);
+}
+
 static void
 monitor_state_changed_cb (
     McdConnectivityMonitor *monitor,
@@ -3660,45 +3765,52 @@ monitor_state_changed_cb (
 
   if (connected)
     {
-      if (mcd_account_would_like_to_connect (self))
+      /* if every account did this immediately, they'd all hit the
+       * connection managers and servers at once */
+      if (self->priv->waiting_for_connectivity ||
+          (!self->priv->autoconnect_held &&
+           mcd_account_would_like_to_connect (self)))
         {
-          DEBUG ("account %s would like to connect",
-              self->priv->unique_name);
-          _mcd_account_connect_with_auto_presence (self, FALSE);
+          gchar *group = g_strdup_printf ("%s/%s", self->priv->manager_name,
+              self->priv->protocol_name);
+
+          _mcd_reconnect_scheduler_add (self->priv->reconnect_scheduler,
+              self, group, 0, _mcd_account_was_recently_online (self),
+              mcd_account_reconnect_cb, self);
+          g_free (group);
         }
+
+      return;
+    }
+
+  _mcd_reconnect_scheduler_cancel (self->priv->reconnect_scheduler, self);
+
+  if (_mcd_account_needs_dispatch (self))
+    {
+      /* special treatment for cellular accounts */
+      DEBUG ("account %s is always dispatched and does not need a "
+          "transport", self->priv->unique_name);
     }
   else
     {
-      if (_mcd_account_needs_dispatch (self))
-        {
-          /* special treatment for cellular accounts */
-          DEBUG ("account %s is always dispatched and does not need a "
-              "transport", self->priv->unique_name);
-        }
-      else
-        {
-          McdConnection *connection;
+      McdConnection *connection;
 
-          DEBUG ("account %s must disconnect", self->priv->unique_name);
-          connection = mcd_account_get_connection (self);
+      DEBUG ("account %s must disconnect", self->priv->unique_name);
+      connection = mcd_account_get_connection (self);
 
-          if (connection != NULL)
-            mcd_connection_close (connection, inhibit);
-        }
+      if (connection != NULL)
+        mcd_connection_close (connection, inhibit);
     }
 
   if (!self->priv->waiting_for_connectivity)
     return;
 
-  /* If we've gone online, allow the account to actually try to connect;
-   * if we've fallen offline, say as much. (I don't actually think this
-   * code will be reached if !connected, but.)
+  /* If we've fallen offline, say as much. (I don't actually think this
+   * code will be reached, but.)
    */
-  DEBUG ("telling %s to %s", self->priv->unique_name,
-      connected ? "proceed" : "give up");
-  mcd_account_connection_proceed_with_reason (self, connected,
-      connected ? TP_CONNECTION_STATUS_REASON_NONE_SPECIFIED
-                : TP_CONNECTION_STATUS_REASON_NETWORK_ERROR);
+  DEBUG ("telling %s to give up", self->priv->unique_name);
+  mcd_account_connection_proceed_with_reason (self, FALSE,
+      TP_CONNECTION_STATUS_REASON_NETWORK_ERROR);
   self->priv->waiting_for_connectivity = FALSE;
 }
 
@@ -3713,6 +3825,9 @@ _mcd_account_constructed (GObject *object)
 
     DEBUG ("%p (%s)", object, account->priv->unique_name);
 
+    account->priv->reconnect_scheduler = _mcd_reconnect_scheduler_ref (
+        _mcd_master_get_reconnect_scheduler (mcd_master_get_default ()));
+
     mcd_account_migrate_avatar (account);
     mcd_account_setup (account);
 
@@ -3759,6 +3874,14 @@ mcd_account_class_init (McdAccountClass * klass)
                               MCD_TYPE_CONNECTIVITY_MONITOR,
                               G_PARAM_WRITABLE | G_PARAM_CONSTRUCT_ONLY));
 
+    g_object_class_install_property
+        (object_class, PROP_PROPERTY_COALESCER,
+         g_param_spec_pointer ("property-coalescer",
+                               "Property coalescer",
+                               "McdPropertyCoalescer shared by all accounts",
+                               G_PARAM_WRITABLE | G_PARAM_CONSTRUCT_ONLY |
+                               G_PARAM_STATIC_STRINGS));
+
     g_object_class_install_property
         (object_class, PROP_STORAGE,
          g_param_spec_object ("storage", "storage",
@@ -3844,9 +3967,6 @@ mcd_account_init (McdAccount *account)
     priv->conn_error_details = g_hash_table_new_full (g_str_hash, g_str_equal,
         g_free, (GDestroyNotify) tp_g_value_slice_free);
 
-    priv->changed_properties = g_hash_table_new_full (g_str_hash, g_str_equal,
-        NULL, (GDestroyNotify) tp_g_value_slice_free);
-
     g_set_error (&priv->invalid_reason, TP_ERROR, TP_ERROR_NOT_YET,
         "This account is not yet fully loaded");
 }
@@ -3859,11 +3979,14 @@ mcd_account_new (McdAccountManager *account_manager,
     gpointer *obj;
     McdStorage *storage = mcd_account_manager_get_storage (account_manager);
     TpDBusDaemon *dbus = mcd_account_manager_get_dbus_daemon (account_manager);
+    McdPropertyCoalescer *coalescer =
+        _mcd_account_manager_get_property_coalescer (account_manager);
 
     obj = g_object_new (MCD_TYPE_ACCOUNT,
                         "storage", storage,
                         "dbus-daemon", dbus,
                         "connectivity-monitor", connectivity,
+                        "property-coalescer", coalescer,
 			"name", name,
 			NULL);
     return MCD_ACCOUNT (obj);
@@ -3941,10 +4064,12 @@ GHashTable *
 _mcd_account_dup_parameters (McdAccount *account)
 {
     McdAccountPrivate *priv;
-    TpProtocol *protocol;
-    GList *protocol_params;
-    GList *iter;
+    TpProtocol *protocol = NULL;
     GHashTable *params;
+    GHashTableIter iter;
+    gpointer k, v;
+    gchar **untyped, **name;
+    gboolean learned = FALSE;
 
     g_return_val_if_fail (MCD_IS_ACCOUNT (account), NULL);
 
@@ -3952,52 +4077,98 @@ _mcd_account_dup_parameters (McdAccount *account)
 
     DEBUG ("called");
 
-    /* FIXME: this is ridiculous. MC stores the parameters for the account, so
-     * it should be able to expose them on D-Bus even if the CM is uninstalled.
-     * It shouldn't need to iterate across the parameters supported by the CM.
-     * But it does, because MC doesn't store the types of parameters. So it
-     * needs the CM (or .manager file) to be around to tell it whether "true"
-     * is a string or a boolean…
-     */
-    if (!priv->manager && !load_manager (account))
+    /* Parameters are stored with their types, so we don't need the CM to
+     * tell us whether "true" is a string or a boolean; only the ones
+     * stored before that, or by a plugin that only deals in strings,
+     * still need it. */
+    params = mcd_storage_dup_typed_parameters (priv->storage,
+                                               priv->unique_name, &untyped);
+
+    /* We don't wait for the CM: if it hasn't been prepared yet, and
+     * wasn't cached, we just can't check the parameters against it this
+     * time. Looking it up does start preparing it if that hasn't happened
+     * already, which activates it if it has no .manager file; but that
+     * normally happened while the account was being loaded. */
+    if (priv->manager != NULL || load_manager (account))
+        protocol = _mcd_manager_dup_protocol (priv->manager,
+                                              priv->protocol_name);
+
+    if (protocol == NULL)
     {
-        DEBUG ("unable to load manager for account %s", priv->unique_name);
-        return NULL;
+        if (untyped[0] != NULL)
+        {
+            DEBUG ("unable to get protocol for %s account %s, needed for "
+                   "the types of %u parameters", priv->protocol_name,
+                   priv->unique_name, g_strv_length (untyped));
+            tp_clear_pointer (&params, g_hash_table_unref);
+        }
+
+        goto finally;
     }
 
-    protocol = _mcd_manager_dup_protocol (priv->manager,
-                                          priv->protocol_name);
+    /* as before, only pass on the parameters the CM supports, with the
+     * types it expects */
+    g_hash_table_iter_init (&iter, params);
 
-    if (G_UNLIKELY (protocol == NULL))
+    while (g_hash_table_iter_next (&iter, &k, &v))
     {
-        DEBUG ("unable to get protocol for %s account %s", priv->protocol_name,
-               priv->unique_name);
-        return NULL;
-    }
+        const TpConnectionManagerParam *param =
+            tp_protocol_get_param (protocol, k);
+        GValue coerced = G_VALUE_INIT;
+        GType type;
 
-    params = g_hash_table_new_full (g_str_hash, g_str_equal,
-                                    g_free,
-                                    (GDestroyNotify) tp_g_value_slice_free);
+        if (param == NULL)
+        {
+            DEBUG ("%s doesn't support parameter %s", priv->protocol_name,
+                   (const gchar *) k);
+            g_hash_table_iter_remove (&iter);
+            continue;
+        }
 
-    protocol_params = tp_protocol_dup_params (protocol);
+        type = mc_param_type (param);
 
-    for (iter = protocol_params; iter != NULL; iter = iter->next)
+        if (type != G_TYPE_INVALID && G_VALUE_TYPE (v) != type)
+        {
+            if (mcd_account_get_parameter (account, k, &coerced, NULL))
+            {
+                g_hash_table_iter_replace (&iter,
+                                           tp_g_value_slice_dup (&coerced));
+                g_value_unset (&coerced);
+            }
+            else
+            {
+                g_hash_table_iter_remove (&iter);
+            }
+        }
+    }
+
+    for (name = untyped; *name != NULL; name++)
     {
-        TpConnectionManagerParam *param = iter->data;
-        const gchar *name = tp_connection_manager_param_get_name (param);
-        GValue v = G_VALUE_INIT;
+        const TpConnectionManagerParam *param =
+            tp_protocol_get_param (protocol, *name);
+        GValue value = G_VALUE_INIT;
 
-        if (mcd_account_get_parameter (account, name, &v, NULL))
+        if (param != NULL && mcd_account_get_parameter (account, *name,
+                                                        &value, NULL))
         {
-            g_hash_table_insert (params, g_strdup (name),
-                                 tp_g_value_slice_dup (&v));
-            g_value_unset (&v);
+            g_hash_table_insert (params, g_strdup (*name),
+                                 tp_g_value_slice_dup (&value));
+            g_value_unset (&value);
+
+            learned |= mcd_storage_set_parameter_type (priv->storage,
+                priv->unique_name, *name,
+                tp_connection_manager_param_get_dbus_signature (param));
         }
     }
 
-    g_list_free_full (protocol_params,
-                      (GDestroyNotify) tp_connection_manager_param_free);
+    /* so that next time, we won't need to ask */
+    if (learned)
+        mcd_storage_commit_later (priv->storage, priv->unique_name);
+
     g_object_unref (protocol);
+
+finally:
+    g_strfreev (untyped);
     return params;
 }
 
@@ -4205,7 +4376,7 @@ _mcd_account_set_normalized_name (McdAccount *account, const gchar *name)
 
     mcd_storage_set_attribute (priv->storage, account_name,
                                MC_ACCOUNTS_KEY_NORMALIZED_NAME, &value);
-    mcd_storage_commit (priv->storage, account_name);
+    mcd_storage_commit_later (priv->storage, account_name);
     mcd_account_changed_property (account, MC_ACCOUNTS_KEY_NORMALIZED_NAME,
                                   &value);
 
@@ -4224,7 +4395,7 @@ _mcd_account_set_avatar_token (McdAccount *account, const gchar *token)
                             MC_ACCOUNTS_KEY_AVATAR_TOKEN,
                             token);
 
-    mcd_storage_commit (priv->storage, account_name);
+    mcd_storage_commit_later (priv->storage, account_name);
 }
 
 gchar *
@@ -4297,51 +4468,66 @@ _mcd_account_set_avatar (McdAccount *account, const GArray *avatar,
         mcd_account_send_avatar_to_connection (account, avatar, mime_type);
     }
 
-    mcd_storage_commit (priv->storage, account_name);
+    mcd_storage_commit_later (priv->storage, account_name);
 
     return TRUE;
 }
 
-static GArray *
-load_avatar_or_warn (const gchar *filename)
+/*
+ * Returns: %FALSE if @filename could not be read, or %TRUE with @avatar set
+ *  to its contents, or to %NULL if it was empty (meaning "no avatar")
+ */
+static gboolean
+load_avatar_or_warn (const gchar *filename,
+                     GBytes **avatar)
 {
     GError *error = NULL;
     gchar *data = NULL;
     gsize length;
 
+    *avatar = NULL;
+
     if (g_file_get_contents (filename, &data, &length, &error))
     {
         if (length > 0 && length < G_MAXUINT)
         {
-            GArray *ret;
-
-            ret = g_array_new (FALSE, FALSE, 1);
-            g_array_append_vals (ret, data, (guint) length);
-            return ret;
+            *avatar = g_bytes_new_take (data, length);
+            return TRUE;
         }
         else
         {
             DEBUG ("avatar %s was empty or ridiculously large (%"
                    G_GSIZE_FORMAT " bytes)", filename, length);
-            return NULL;
+            g_free (data);
+            return (length == 0);
         }
     }
     else
     {
         DEBUG ("error reading %s: %s", filename, error->message);
         g_error_free (error);
-        return NULL;
+        return FALSE;
     }
 }
 
+/*
+ * _mcd_account_dup_avatar:
+ * @avatar: (out) (transfer full) (allow-none): used to return a new
+ *  reference to the avatar, which is shared with the avatar cache and must
+ *  not be modified, or %NULL if there is none
+ * @mime_type: (out) (transfer full) (allow-none): used to return the
+ *  avatar's MIME type
+ */
 void
-_mcd_account_get_avatar (McdAccount *account, GArray **avatar,
+_mcd_account_dup_avatar (McdAccount *account, GBytes **avatar,
                          gchar **mime_type)
 {
     McdAccountPrivate *priv = MCD_ACCOUNT_PRIV (account);
     const gchar *account_name = mcd_account_get_unique_name (account);
+    GPtrArray *watch;
     gchar *basename;
     gchar *filename;
+    gboolean ok = FALSE;
 
     if (mime_type != NULL)
         *mime_type =  mcd_storage_dup_string (priv->storage, account_name,
@@ -4350,18 +4536,29 @@ _mcd_account_get_avatar (McdAccount *account, GArray **avatar,
     if (avatar == NULL)
         return;
 
+    if (mcd_avatar_cache_lookup (get_avatar_cache (), account_name, avatar))
+        return;
+
     *avatar = NULL;
 
     get_avatar_paths (account, NULL, &basename, &filename);
 
+    /* Any file that appears in a higher-priority directory than the one
+     * we used would change the result, so watch all of those too */
+    watch = g_ptr_array_new_with_free_func (g_free);
+    g_ptr_array_add (watch, filename);
+
     if (g_file_test (filename, G_FILE_TEST_EXISTS))
     {
-        *avatar = load_avatar_or_warn (filename);
+        ok = load_avatar_or_warn (filename, avatar);
     }
     else
     {
         const gchar * const *iter;
 
+        /* if it doesn't exist anywhere, that's a successful result too */
+        ok = TRUE;
+
         for (iter = g_get_system_data_dirs ();
              iter != NULL && *iter != NULL;
              iter++)
@@ -4370,18 +4567,24 @@ _mcd_account_get_avatar (McdAccount *account, GArray **avatar,
                                                  "mission-control",
                                                  basename, NULL);
 
+            g_ptr_array_add (watch, candidate);
+
             if (g_file_test (candidate, G_FILE_TEST_EXISTS))
             {
-                *avatar = load_avatar_or_warn (candidate);
-                g_free (candidate);
+                ok = load_avatar_or_warn (candidate, avatar);
                 break;
             }
-
-            g_free (candidate);
         }
     }
 
-    g_free (filename);
+    if (ok)
+    {
+        g_ptr_array_add (watch, NULL);
+        mcd_avatar_cache_insert (get_avatar_cache (), account_name, *avatar,
+                                 (const gchar * const *) watch->pdata);
+    }
+
+    g_ptr_array_unref (watch);
     g_free (basename);
 }
 
@@ -4502,7 +4705,7 @@ clear_register (McdAccount *self)
         mcd_account_changed_property (self, "Parameters", &value);
         g_value_unset (&value);
 
-        mcd_storage_commit (self->priv->storage, account_name);
+        mcd_storage_commit_later (self->priv->storage, account_name);
     }
     else
     {
@@ -4510,6 +4713,8 @@ clear_register (McdAccount *self)
     }
 }
 
+static void mcd_account_update_last_online (McdAccount *account);
+
 void
 _mcd_account_set_connection_status (McdAccount *account,
                                     TpConnectionStatus status,
@@ -4528,6 +4733,7 @@ _mcd_account_set_connection_status (McdAccount *account,
     if (status == TP_CONNECTION_STATUS_CONNECTED)
     {
         _mcd_account_set_has_been_online (account);
+        mcd_account_update_last_online (account);
         clear_register (account);
 
         DEBUG ("clearing connection error details");
@@ -4594,10 +4800,18 @@ _mcd_account_set_connection_status (McdAccount *account,
     {
         DEBUG ("changing connection status from %u to %u", priv->conn_status,
                status);
+
+        if (priv->conn_status == TP_CONNECTION_STATUS_CONNECTED)
+            priv->last_connected = g_get_monotonic_time ();
+
 	priv->conn_status = status;
 	changed = TRUE;
     }
 
+    /* whichever attempt was in progress is over, so let another start */
+    if (status != TP_CONNECTION_STATUS_CONNECTING)
+        mcd_account_finish_reconnect_attempt (account);
+
     if (reason != priv->conn_reason)
     {
         DEBUG ("changing connection status reason from %u to %u",
@@ -4857,7 +5071,7 @@ static void
 mcd_account_process_initial_avatar_token (McdAccount *self,
     const gchar *token)
 {
-  GArray *avatar = NULL;
+  GBytes *avatar = NULL;
   gchar *mime_type = NULL;
   gchar *prev_token;
 
@@ -4867,6 +5081,8 @@ mcd_account_process_initial_avatar_token (McdAccount *self,
 
   DEBUG ("%s", self->priv->unique_name);
 
+  _mcd_account_dup_avatar (self, &avatar, &mime_type);
+
   if (prev_token == NULL)
     DEBUG ("no previous local avatar token");
   else
@@ -4875,7 +5091,8 @@ mcd_account_process_initial_avatar_token (McdAccount *self,
   if (avatar == NULL)
     DEBUG ("no previous local avatar");
   else
-    DEBUG ("previous local avatar: %u bytes, MIME type '%s'", avatar->len,
+    DEBUG ("previous local avatar: %" G_GSIZE_FORMAT " bytes, "
+        "MIME type '%s'", g_bytes_get_size (avatar),
         (mime_type != NULL ? mime_type : "(null)"));
 
   if (token == NULL)
@@ -4883,8 +5100,6 @@ mcd_account_process_initial_avatar_token (McdAccount *self,
   else
     DEBUG ("remote avatar token: '%s'", token);
 
-  _mcd_account_get_avatar (self, &avatar, &mime_type);
-
   /* If we have a stored avatar but no avatar token, we must have
    * changed it locally; set it.
    *
@@ -4900,12 +5115,16 @@ mcd_account_process_initial_avatar_token (McdAccount *self,
 
       if (avatar != NULL)
         {
+          GArray *arr;
+
           if (tp_str_empty (prev_token))
             DEBUG ("We have an avatar that has never been uploaded");
           if (tp_str_empty (token))
             DEBUG ("We have an avatar and the server doesn't");
 
-          mcd_account_send_avatar_to_connection (self, avatar, mime_type);
+          arr = avatar_to_array (avatar);
+          mcd_account_send_avatar_to_connection (self, arr, mime_type);
+          g_array_unref (arr);
           goto out;
         }
     }
@@ -4937,7 +5156,7 @@ mcd_account_process_initial_avatar_token (McdAccount *self,
 
 out:
   g_free (prev_token);
-  tp_clear_pointer (&avatar, g_array_unref);
+  tp_clear_pointer (&avatar, g_bytes_unref);
   g_free (mime_type);
 }
 
@@ -5228,13 +5447,84 @@ _mcd_account_set_has_been_online (McdAccount *account)
         mcd_storage_set_attribute (account->priv->storage, account_name,
                                    MC_ACCOUNTS_KEY_HAS_BEEN_ONLINE, &value);
         account->priv->has_been_online = TRUE;
-        mcd_storage_commit (account->priv->storage, account_name);
+        mcd_storage_commit_later (account->priv->storage, account_name);
         mcd_account_changed_property (account, MC_ACCOUNTS_KEY_HAS_BEEN_ONLINE,
                                       &value);
         g_value_unset (&value);
     }
 }
 
+/* LastOnline only needs to be accurate enough to tell which accounts are in
+ * use, so don't write it out on every reconnection */
+#define LAST_ONLINE_RESOLUTION (60 * 60)
+
+static void
+mcd_account_update_last_online (McdAccount *account)
+{
+    McdAccountPrivate *priv = account->priv;
+    gint64 now = g_get_real_time () / G_USEC_PER_SEC;
+    GValue value = G_VALUE_INIT;
+
+    if (priv->last_online != 0 &&
+        ABS (now - priv->last_online) < LAST_ONLINE_RESOLUTION)
+        return;
+
+    priv->last_online = now;
+
+    g_value_init (&value, G_TYPE_INT64);
+    g_value_set_int64 (&value, now);
+    mcd_storage_set_attribute (priv->storage, priv->unique_name,
+                               MC_ACCOUNTS_KEY_LAST_ONLINE, &value);
+    mcd_storage_commit_later (priv->storage, priv->unique_name);
+    g_value_unset (&value);
+}
+
+/*
+ * _mcd_account_get_last_online:
+ *
+ * Returns: roughly when the account was last connected, in seconds since
+ *  the Unix epoch, or 0 if it never has been
+ */
+gint64
+_mcd_account_get_last_online (McdAccount *account)
+{
+    g_return_val_if_fail (MCD_IS_ACCOUNT (account), 0);
+
+    return account->priv->last_online;
+}
+
+/*
+ * _mcd_account_hold_autoconnect:
+ *
+ * Stop the account from connecting automatically until
+ * _mcd_account_release_autoconnect() is called.
+ */
+void
+_mcd_account_hold_autoconnect (McdAccount *account)
+{
+    g_return_if_fail (MCD_IS_ACCOUNT (account));
+
+    account->priv->autoconnect_held = TRUE;
+}
+
+/*
+ * _mcd_account_release_autoconnect:
+ *
+ * Undo _mcd_account_hold_autoconnect(), and connect automatically if the
+ * account would like to.
+ */
+void
+_mcd_account_release_autoconnect (McdAccount *account)
+{
+    g_return_if_fail (MCD_IS_ACCOUNT (account));
+
+    if (!account->priv->autoconnect_held)
+        return;
+
+    account->priv->autoconnect_held = FALSE;
+    _mcd_account_maybe_autoconnect (account);
+}
+
 McdAccountConnectionContext *
 _mcd_account_get_connection_context (McdAccount *self)
 {
@@ -5273,6 +5563,23 @@ _mcd_account_needs_dispatch (McdAccount *self)
     return self->priv->always_dispatch;
 }
 
+/* An account that was connected less than this many seconds ago is
+ * probably in use, so gets to reconnect before the others */
+#define RECENTLY_ONLINE_SEC (10 * 60)
+
+gboolean
+_mcd_account_was_recently_online (McdAccount *self)
+{
+    g_return_val_if_fail (MCD_IS_ACCOUNT (self), FALSE);
+
+    if (self->priv->conn_status == TP_CONNECTION_STATUS_CONNECTED)
+        return TRUE;
+
+    return (self->priv->last_connected != 0 &&
+            g_get_monotonic_time () - self->priv->last_connected <
+            RECENTLY_ONLINE_SEC * G_USEC_PER_SEC);
+}
+
 gboolean
 mcd_account_parameter_is_secret (McdAccount *self, const gchar *name)
 {
@@ -5344,4 +5651,10 @@ mcd_account_set_waiting_for_connectivity (McdAccount *self,
     gboolean waiting)
 {
   self->priv->waiting_for_connectivity = waiting;
+
+  /* We stay Connecting while we wait, but we're not using the connection
+   * manager or the server, so we shouldn't stop other accounts from
+   * connecting */
+  if (waiting)
+    mcd_account_finish_reconnect_attempt (self);
 }
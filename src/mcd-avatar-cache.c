@@ -0,0 +1,443 @@
+/*
+ * Size-bounded in-memory cache of account avatars
+ *
+ * Copyright © 2012 Collabora Ltd.
+ *
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License as published by the Free Software Foundation; either
+ * version 2.1 of the License, or (at your option) any later version.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with this library; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin St, Fifth Floor, Boston, MA  02110-1301  USA
+ */
+
+/*
+ * Reading the Avatar property used to mean reading the avatar file (or
+ * failing to find it in each of the XDG data directories) every time.
+ * This cache remembers what was found for each account, including "no
+ * avatar", and hands out references to the same GBytes. Each entry
+ * depends on a few files, and is dropped as soon as any of them changes;
+ * the least recently used entries are dropped when the cached avatars add
+ * up to more than the size limit, or when there are too many entries.
+ *
+ * Every account's avatar lives in the same few directories, so we watch
+ * each directory once, however many entries depend on files in it:
+ * monitoring each file separately would cost an inotify watch per file.
+ */
+
+#include "config.h"
+
+#include "mcd-avatar-cache.h"
+
+#include <gio/gio.h>
+
+#include "mcd-debug.h"
+
+typedef struct _McdAvatarCacheEntry McdAvatarCacheEntry;
+
+struct _McdAvatarCacheEntry {
+    McdAvatarCache *cache;
+    /* borrowed from the key in cache->entries */
+    const gchar *account;
+    /* (allow-none): NULL if the account has no avatar */
+    GBytes *avatar;
+    /* canonical paths of the files this entry depends on */
+    gchar **files;
+    /* our link in cache->lru */
+    GList *link;
+};
+
+typedef struct {
+    McdAvatarCache *cache;
+    GFileMonitor *monitor;
+    /* number of (entry, file) pairs in this directory */
+    guint refcount;
+} McdAvatarCacheDir;
+
+struct _McdAvatarCache {
+    gsize max_size;
+    guint max_entries;
+    /* sum of the sizes of the cached avatars */
+    gsize size;
+    /* owned account name => owned McdAvatarCacheEntry */
+    GHashTable *entries;
+    /* borrowed McdAvatarCacheEntry, most recently used first */
+    GQueue lru;
+    /* owned directory => owned McdAvatarCacheDir */
+    GHashTable *dirs;
+    /* owned canonical path => owned GPtrArray of borrowed
+     * McdAvatarCacheEntry */
+    GHashTable *watchers;
+};
+
+static void
+dir_free (gpointer p)
+{
+  McdAvatarCacheDir *dir = p;
+
+  g_signal_handlers_disconnect_matched (dir->monitor, G_SIGNAL_MATCH_DATA,
+      0, 0, NULL, NULL, dir);
+  g_file_monitor_cancel (dir->monitor);
+  g_object_unref (dir->monitor);
+  g_slice_free (McdAvatarCacheDir, dir);
+}
+
+static void
+invalidate_path (McdAvatarCache *self,
+    GFile *file)
+{
+  GPtrArray *watchers;
+  gchar *path;
+
+  if (file == NULL)
+    return;
+
+  path = g_file_get_path (file);
+
+  if (path == NULL)
+    return;
+
+  /* removing an entry removes it from @watchers, and frees @watchers
+   * along with the last one */
+  while ((watchers = g_hash_table_lookup (self->watchers, path)) != NULL)
+    {
+      McdAvatarCacheEntry *entry = g_ptr_array_index (watchers, 0);
+
+      DEBUG ("avatar for %s changed on disk", entry->account);
+      g_hash_table_remove (self->entries, entry->account);
+    }
+
+  g_free (path);
+}
+
+static void
+monitor_changed_cb (GFileMonitor *monitor,
+    GFile *file,
+    GFile *other_file,
+    GFileMonitorEvent event_type,
+    gpointer user_data)
+{
+  McdAvatarCacheDir *dir = user_data;
+  /* @dir might be freed while invalidating */
+  McdAvatarCache *self = dir->cache;
+
+  if (event_type == G_FILE_MONITOR_EVENT_ATTRIBUTE_CHANGED)
+    return;
+
+  invalidate_path (self, file);
+  invalidate_path (self, other_file);
+}
+
+static gboolean
+watch_path (McdAvatarCache *self,
+    McdAvatarCacheEntry *entry,
+    const gchar *path,
+    GError **error)
+{
+  McdAvatarCacheDir *dir;
+  GPtrArray *watchers;
+  gchar *dirname = g_path_get_dirname (path);
+
+  dir = g_hash_table_lookup (self->dirs, dirname);
+
+  if (dir == NULL)
+    {
+      GFile *file = g_file_new_for_path (dirname);
+      GFileMonitor *monitor = g_file_monitor_directory (file,
+          G_FILE_MONITOR_NONE, NULL, error);
+
+      g_object_unref (file);
+
+      if (monitor == NULL)
+        {
+          g_free (dirname);
+          return FALSE;
+        }
+
+      dir = g_slice_new0 (McdAvatarCacheDir);
+      dir->cache = self;
+      dir->monitor = monitor;
+      g_signal_connect (monitor, "changed", G_CALLBACK (monitor_changed_cb),
+          dir);
+      g_hash_table_insert (self->dirs, dirname, dir);
+    }
+  else
+    {
+      g_free (dirname);
+    }
+
+  dir->refcount++;
+
+  watchers = g_hash_table_lookup (self->watchers, path);
+
+  if (watchers == NULL)
+    {
+      watchers = g_ptr_array_new ();
+      g_hash_table_insert (self->watchers, g_strdup (path), watchers);
+    }
+
+  g_ptr_array_add (watchers, entry);
+  return TRUE;
+}
+
+static void
+unwatch_path (McdAvatarCache *self,
+    McdAvatarCacheEntry *entry,
+    const gchar *path)
+{
+  McdAvatarCacheDir *dir;
+  GPtrArray *watchers;
+  gchar *dirname;
+
+  watchers = g_hash_table_lookup (self->watchers, path);
+  g_return_if_fail (watchers != NULL);
+  g_ptr_array_remove_fast (watchers, entry);
+
+  if (watchers->len == 0)
+    g_hash_table_remove (self->watchers, path);
+
+  dirname = g_path_get_dirname (path);
+  dir = g_hash_table_lookup (self->dirs, dirname);
+  g_return_if_fail (dir != NULL);
+
+  if (--dir->refcount == 0)
+    g_hash_table_remove (self->dirs, dirname);
+
+  g_free (dirname);
+}
+
+static void
+entry_free (gpointer p)
+{
+  McdAvatarCacheEntry *entry = p;
+  McdAvatarCache *self = entry->cache;
+  guint i;
+
+  for (i = 0; entry->files[i] != NULL; i++)
+    unwatch_path (self, entry, entry->files[i]);
+
+  g_strfreev (entry->files);
+
+  if (entry->avatar != NULL)
+    {
+      self->size -= g_bytes_get_size (entry->avatar);
+      g_bytes_unref (entry->avatar);
+    }
+
+  g_queue_delete_link (&self->lru, entry->link);
+  g_slice_free (McdAvatarCacheEntry, entry);
+}
+
+/*
+ * mcd_avatar_cache_new:
+ * @max_size: the most bytes of avatar data to keep
+ * @max_entries: the most accounts to remember, including those with no
+ *  avatar
+ */
+McdAvatarCache *
+mcd_avatar_cache_new (gsize max_size,
+    guint max_entries)
+{
+  McdAvatarCache *self;
+
+  g_return_val_if_fail (max_entries > 0, NULL);
+
+  self = g_slice_new0 (McdAvatarCache);
+  self->max_size = max_size;
+  self->max_entries = max_entries;
+  self->entries = g_hash_table_new_full (g_str_hash, g_str_equal, g_free,
+      entry_free);
+  g_queue_init (&self->lru);
+  self->dirs = g_hash_table_new_full (g_str_hash, g_str_equal, g_free,
+      dir_free);
+  self->watchers = g_hash_table_new_full (g_str_hash, g_str_equal, g_free,
+      (GDestroyNotify) g_ptr_array_unref);
+  return self;
+}
+
+void
+mcd_avatar_cache_free (McdAvatarCache *self)
+{
+  g_return_if_fail (self != NULL);
+
+  g_hash_table_unref (self->entries);
+  g_assert (g_queue_is_empty (&self->lru));
+  g_assert_cmpuint (self->size, ==, 0);
+  g_assert_cmpuint (g_hash_table_size (self->watchers), ==, 0);
+  g_assert_cmpuint (g_hash_table_size (self->dirs), ==, 0);
+  g_hash_table_unref (self->watchers);
+  g_hash_table_unref (self->dirs);
+  g_slice_free (McdAvatarCache, self);
+}
+
+/*
+ * mcd_avatar_cache_lookup:
+ * @account: the account's unique name
+ * @avatar: (out) (transfer full) (allow-none): used to return a new
+ *  reference to the cached avatar, or %NULL if the account has no avatar
+ *
+ * Returns: %TRUE if the account's avatar was cached, even if it is cached
+ *  as not existing
+ */
+gboolean
+mcd_avatar_cache_lookup (McdAvatarCache *self,
+    const gchar *account,
+    GBytes **avatar)
+{
+  McdAvatarCacheEntry *entry;
+
+  g_return_val_if_fail (self != NULL, FALSE);
+  g_return_val_if_fail (account != NULL, FALSE);
+  g_return_val_if_fail (avatar != NULL, FALSE);
+
+  entry = g_hash_table_lookup (self->entries, account);
+
+  if (entry == NULL)
+    return FALSE;
+
+  /* move it to the front */
+  g_queue_unlink (&self->lru, entry->link);
+  g_queue_push_head_link (&self->lru, entry->link);
+
+  if (entry->avatar == NULL)
+    *avatar = NULL;
+  else
+    *avatar = g_bytes_ref (entry->avatar);
+
+  return TRUE;
+}
+
+/*
+ * mcd_avatar_cache_insert:
+ * @account: the account's unique name
+ * @avatar: (allow-none): the avatar, or %NULL if the account has no avatar
+ * @watch: (array zero-terminated=1): the files that could have affected
+ *  the result, in decreasing order of priority
+ *
+ * Replace the cached avatar for @account with @avatar, until any of the
+ * files in @watch changes. If @avatar would not fit in the cache at all,
+ * or if the files' directories cannot be monitored, just forget any
+ * previous value.
+ */
+void
+mcd_avatar_cache_insert (McdAvatarCache *self,
+    const gchar *account,
+    GBytes *avatar,
+    const gchar * const *watch)
+{
+  McdAvatarCacheEntry *entry;
+  gsize size = 0;
+  gchar *key;
+  guint i;
+
+  g_return_if_fail (self != NULL);
+  g_return_if_fail (account != NULL);
+  g_return_if_fail (watch != NULL && watch[0] != NULL);
+
+  g_hash_table_remove (self->entries, account);
+
+  if (avatar != NULL)
+    size = g_bytes_get_size (avatar);
+
+  if (size > self->max_size)
+    {
+      DEBUG ("not caching %" G_GSIZE_FORMAT "-byte avatar for %s", size,
+          account);
+      return;
+    }
+
+  key = g_strdup (account);
+  entry = g_slice_new0 (McdAvatarCacheEntry);
+  entry->cache = self;
+  entry->account = key;
+  entry->files = g_new0 (gchar *, g_strv_length ((gchar **) watch) + 1);
+
+  for (i = 0; watch[i] != NULL; i++)
+    {
+      GError *error = NULL;
+      /* match the paths that GFileMonitor will report */
+      GFile *file = g_file_new_for_path (watch[i]);
+      gchar *path = g_file_get_path (file);
+
+      g_object_unref (file);
+
+      if (!watch_path (self, entry, path, &error))
+        {
+          DEBUG ("not caching avatar for %s: cannot monitor %s: %s",
+              account, watch[i], error->message);
+          g_error_free (error);
+          g_free (path);
+
+          while (i-- > 0)
+            unwatch_path (self, entry, entry->files[i]);
+
+          g_strfreev (entry->files);
+          g_slice_free (McdAvatarCacheEntry, entry);
+          g_free (key);
+          return;
+        }
+
+      entry->files[i] = path;
+    }
+
+  /* make room, least recently used first; "no avatar" entries count
+   * towards the number of entries even though they take no space */
+  while (self->size + size > self->max_size ||
+      g_hash_table_size (self->entries) >= self->max_entries)
+    {
+      McdAvatarCacheEntry *victim = g_queue_peek_tail (&self->lru);
+
+      g_assert (victim != NULL);
+      DEBUG ("evicting avatar for %s", victim->account);
+      g_hash_table_remove (self->entries, victim->account);
+    }
+
+  if (avatar != NULL)
+    entry->avatar = g_bytes_ref (avatar);
+
+  self->size += size;
+  g_queue_push_head (&self->lru, entry);
+  entry->link = self->lru.head;
+  g_hash_table_insert (self->entries, key, entry);
+}
+
+void
+mcd_avatar_cache_remove (McdAvatarCache *self,
+    const gchar *account)
+{
+  g_return_if_fail (self != NULL);
+  g_return_if_fail (account != NULL);
+
+  g_hash_table_remove (self->entries, account);
+}
+
+gsize
+mcd_avatar_cache_get_size (McdAvatarCache *self)
+{
+  g_return_val_if_fail (self != NULL, 0);
+
+  return self->size;
+}
+
+guint
+mcd_avatar_cache_get_n_entries (McdAvatarCache *self)
+{
+  g_return_val_if_fail (self != NULL, 0);
+
+  return g_hash_table_size (self->entries);
+}
+
+guint
+mcd_avatar_cache_get_n_monitors (McdAvatarCache *self)
+{
+  g_return_val_if_fail (self != NULL, 0);
+
+  return g_hash_table_size (self->dirs);
+}
@@ -0,0 +1,58 @@
+/*
+ * Size-bounded in-memory cache of account avatars
+ *
+ * Copyright © 2012 Collabora Ltd.
+ *
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License as published by the Free Software Foundation; either
+ * version 2.1 of the License, or (at your option) any later version.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with this library; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin St, Fifth Floor, Boston, MA  02110-1301  USA
+ */
+
+#ifndef MCD_AVATAR_CACHE_H
+#define MCD_AVATAR_CACHE_H
+
+#include <glib.h>
+
+G_BEGIN_DECLS
+
+typedef struct _McdAvatarCache McdAvatarCache;
+
+G_GNUC_INTERNAL
+McdAvatarCache *mcd_avatar_cache_new (gsize max_size,
+    guint max_entries);
+G_GNUC_INTERNAL
+void mcd_avatar_cache_free (McdAvatarCache *self);
+
+G_GNUC_INTERNAL
+gboolean mcd_avatar_cache_lookup (McdAvatarCache *self,
+    const gchar *account,
+    GBytes **avatar);
+G_GNUC_INTERNAL
+void mcd_avatar_cache_insert (McdAvatarCache *self,
+    const gchar *account,
+    GBytes *avatar,
+    const gchar * const *watch);
+G_GNUC_INTERNAL
+void mcd_avatar_cache_remove (McdAvatarCache *self,
+    const gchar *account);
+
+G_GNUC_INTERNAL
+gsize mcd_avatar_cache_get_size (McdAvatarCache *self);
+G_GNUC_INTERNAL
+guint mcd_avatar_cache_get_n_entries (McdAvatarCache *self);
+G_GNUC_INTERNAL
+guint mcd_avatar_cache_get_n_monitors (McdAvatarCache *self);
+
+G_END_DECLS
+
+#endif /* MCD_AVATAR_CACHE_H */
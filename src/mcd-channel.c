@@ -953,6 +953,37 @@ _mcd_channel_get_satisfied_requests (McdChannel *channel,
     return result;
 }
 
+/*
+ * _mcd_channel_get_satisfied_requests_serial:
+ * @channel: the #McdChannel.
+ *
+ * Returns: a number which changes whenever the result of
+ * _mcd_channel_get_satisfied_requests() would
+ */
+guint
+_mcd_channel_get_satisfied_requests_serial (McdChannel *channel)
+{
+    g_return_val_if_fail (MCD_IS_CHANNEL (channel), 0);
+
+    /* requests are only ever added */
+    return g_list_length (channel->priv->satisfied_requests);
+}
+
+/*
+ * _mcd_channel_get_latest_request_time:
+ * @channel: the #McdChannel.
+ *
+ * Returns: the most recent user action time of the requests satisfied by
+ * @channel, as for _mcd_channel_get_satisfied_requests()
+ */
+gint64
+_mcd_channel_get_latest_request_time (McdChannel *channel)
+{
+    g_return_val_if_fail (MCD_IS_CHANNEL (channel), 0);
+
+    return channel->priv->latest_request_time;
+}
+
 /*
  * _mcd_channel_get_request_preferred_handler:
  * @channel: the #McdChannel.
@@ -32,8 +32,17 @@
 #include <telepathy-glib/telepathy-glib.h>
 #include <telepathy-glib/telepathy-glib-dbus.h>
 
+#include "client-filter.h"
+
 G_BEGIN_DECLS
 
+typedef enum
+{
+    MCD_CLIENT_APPROVER,
+    MCD_CLIENT_HANDLER,
+    MCD_CLIENT_OBSERVER
+} McdClientInterface;
+
 typedef struct _McdClientProxy McdClientProxy;
 typedef struct _McdClientProxyClass McdClientProxyClass;
 typedef struct _McdClientProxyPrivate McdClientProxyPrivate;
@@ -71,7 +80,8 @@ G_GNUC_INTERNAL McdClientProxy *_mcd_client_proxy_new (
     TpDBusDaemon *dbus_daemon,
     const gchar *well_known_name,
     const gchar *unique_name_if_known,
-    gboolean activatable);
+    gboolean activatable,
+    GKeyFile *client_file);
 
 G_GNUC_INTERNAL gboolean _mcd_client_proxy_is_ready (McdClientProxy *self);
 
@@ -111,8 +121,8 @@ G_GNUC_INTERNAL void _mcd_client_proxy_dec_ready_lock (McdClientProxy *self);
 #define MC_CLIENT_BUS_NAME_BASE_LEN (sizeof (TP_CLIENT_BUS_NAME_BASE) - 1)
 
 G_GNUC_INTERNAL guint _mcd_client_match_filters (
-    GVariant *channel_properties, const GList *filters,
-    gboolean assume_requested);
+    const McdClientChannelProperties *channel_properties,
+    const GList *filters, gboolean assume_requested);
 
 G_GNUC_INTERNAL void _mcd_client_proxy_handle_channels (McdClientProxy *self,
     gint timeout_ms, const GList *channels,
@@ -120,6 +130,13 @@ G_GNUC_INTERNAL void _mcd_client_proxy_handle_channels (McdClientProxy *self,
     tp_cli_client_handler_callback_for_handle_channels callback,
     gpointer user_data, GDestroyNotify destroy, GObject *weak_object);
 
+G_GNUC_INTERNAL void _mcd_client_proxy_handle_channel_details (
+    McdClientProxy *self, gint timeout_ms, const GList *channels,
+    const GPtrArray *channel_details, const GPtrArray *requests_satisfied,
+    gint64 user_action_time, GHashTable *handler_info,
+    tp_cli_client_handler_callback_for_handle_channels callback,
+    gpointer user_data, GDestroyNotify destroy, GObject *weak_object);
+
 G_GNUC_INTERNAL void _mcd_client_recover_observer (McdClientProxy *self,
     TpChannel *channel, const gchar *account_path);
 
@@ -45,6 +45,7 @@ enum
     PROP_ACTIVATABLE,
     PROP_STRING_POOL,
     PROP_UNIQUE_NAME,
+    PROP_CLIENT_FILE,
 };
 
 enum
@@ -54,6 +55,7 @@ enum
     S_HANDLER_CAPABILITIES_CHANGED,
     S_GONE,
     S_NEED_RECOVERY,
+    S_FILTERS_CHANGED,
     N_SIGNALS
 };
 
@@ -63,6 +65,9 @@ struct _McdClientProxyPrivate
 {
     GStrv capability_tokens;
 
+    /* the contents of the .client file, or NULL if there isn't one */
+    GKeyFile *client_file;
+
     gchar *unique_name;
     guint ready_lock;
     gboolean introspect_started;
@@ -78,15 +83,8 @@ struct _McdClientProxyPrivate
     gboolean activatable;
 
     /* Channel filters
-     * A channel filter is a GHashTable of
-     * - key: gchar *property_name
-     * - value: GValue of one of the allowed types on the ObserverChannelFilter
-     *          spec. The following matching is observed:
-     *           * G_TYPE_STRING: 's'
-     *           * G_TYPE_BOOLEAN: 'b'
-     *           * DBUS_TYPE_G_OBJECT_PATH: 'o'
-     *           * G_TYPE_UINT64: 'y' (8b), 'q' (16b), 'u' (32b), 't' (64b)
-     *           * G_TYPE_INT64:            'n' (16b), 'i' (32b), 'x' (64b)
+     * A channel filter is a McdClientFilter, compiled from the a{sv} in
+     * the .client file or the *ChannelFilter D-Bus property.
      *
      * The list can be NULL if there is no filter, or the filters are not yet
      * retrieven from the D-Bus *ChannelFitler properties. In the last case,
@@ -99,13 +97,6 @@ struct _McdClientProxyPrivate
     gboolean disposed;
 };
 
-typedef enum
-{
-    MCD_CLIENT_APPROVER,
-    MCD_CLIENT_HANDLER,
-    MCD_CLIENT_OBSERVER
-} McdClientInterface;
-
 void
 _mcd_client_proxy_inc_ready_lock (McdClientProxy *self)
 {
@@ -148,56 +139,6 @@ static void _mcd_client_proxy_take_observer_filters
 static void _mcd_client_proxy_take_handler_filters
     (McdClientProxy *self, GList *filters);
 
-static gchar *
-_mcd_client_proxy_find_client_file (const gchar *client_name)
-{
-    const gchar * const *dirs;
-    const gchar *dirname;
-    const gchar *env_dirname;
-    gchar *filename, *absolute_filepath;
-
-    /*
-     * The full path is $XDG_DATA_DIRS/telepathy/clients/clientname.client
-     * or $XDG_DATA_HOME/telepathy/clients/clientname.client
-     * For testing purposes, we also look for $MC_CLIENTS_DIR/clientname.client
-     * if $MC_CLIENTS_DIR is set.
-     */
-    filename = g_strdup_printf ("%s.client", client_name);
-    env_dirname = g_getenv ("MC_CLIENTS_DIR");
-    if (env_dirname)
-    {
-        absolute_filepath = g_build_filename (env_dirname, filename, NULL);
-        if (g_file_test (absolute_filepath, G_FILE_TEST_IS_REGULAR))
-            goto finish;
-        g_free (absolute_filepath);
-    }
-
-    dirname = g_get_user_data_dir ();
-    if (G_LIKELY (dirname))
-    {
-        absolute_filepath = g_build_filename (dirname, "telepathy/clients",
-                                              filename, NULL);
-        if (g_file_test (absolute_filepath, G_FILE_TEST_IS_REGULAR))
-            goto finish;
-        g_free (absolute_filepath);
-    }
-
-    dirs = g_get_system_data_dirs ();
-    for (dirname = *dirs; dirname != NULL; dirs++, dirname = *dirs)
-    {
-        absolute_filepath = g_build_filename (dirname, "telepathy/clients",
-                                              filename, NULL);
-        if (g_file_test (absolute_filepath, G_FILE_TEST_IS_REGULAR))
-            goto finish;
-        g_free (absolute_filepath);
-    }
-
-    absolute_filepath = NULL;
-finish:
-    g_free (filename);
-    return absolute_filepath;
-}
-
 static GHashTable *
 parse_client_filter (GKeyFile *file, const gchar *group)
 {
@@ -324,6 +265,18 @@ parse_client_filter (GKeyFile *file, const gchar *group)
     return filter;
 }
 
+static McdClientFilter *
+compile_client_filter (GKeyFile *file, const gchar *group)
+{
+    GHashTable *channel_class = parse_client_filter (file, group);
+    McdClientFilter *filter = _mcd_client_filter_new (channel_class);
+
+    /* parse_client_filter only produces the types we can compile */
+    g_assert (filter != NULL);
+    g_hash_table_unref (channel_class);
+    return filter;
+}
+
 static void _mcd_client_proxy_set_cap_tokens (McdClientProxy *self,
                                               GStrv cap_tokens);
 static void _mcd_client_proxy_add_interfaces (McdClientProxy *self,
@@ -367,7 +320,7 @@ parse_client_file (McdClientProxy *client,
         {
             approver_filters =
                 g_list_prepend (approver_filters,
-                                parse_client_filter (file, groups[i]));
+                                compile_client_filter (file, groups[i]));
         }
         else if (is_handler &&
             g_str_has_prefix (groups[i], TP_IFACE_CLIENT_HANDLER
@@ -375,7 +328,7 @@ parse_client_file (McdClientProxy *client,
         {
             handler_filters =
                 g_list_prepend (handler_filters,
-                                parse_client_filter (file, groups[i]));
+                                compile_client_filter (file, groups[i]));
         }
         else if (is_observer &&
             g_str_has_prefix (groups[i], TP_IFACE_CLIENT_OBSERVER
@@ -383,7 +336,7 @@ parse_client_file (McdClientProxy *client,
         {
             observer_filters =
                 g_list_prepend (observer_filters,
-                                parse_client_filter (file, groups[i]));
+                                compile_client_filter (file, groups[i]));
         }
     }
     g_strfreev (groups);
@@ -430,64 +383,14 @@ _mcd_client_proxy_set_filters (McdClientProxy *client,
 
     for (i = 0 ; i < filters->len ; i++)
     {
-        GHashTable *channel_class = g_ptr_array_index (filters, i);
-        GHashTable *new_channel_class;
-        GHashTableIter iter;
-        gchar *property_name;
-        GValue *property_value;
-        gboolean valid_filter = TRUE;
-
-        new_channel_class = g_hash_table_new_full
-            (g_str_hash, g_str_equal, g_free,
-             (GDestroyNotify) tp_g_value_slice_free);
-
-        g_hash_table_iter_init (&iter, channel_class);
-        while (g_hash_table_iter_next (&iter, (gpointer *) &property_name,
-                                       (gpointer *) &property_value)) 
-        {
-            GValue *filter_value;
-            GType property_type = G_VALUE_TYPE (property_value);
+        McdClientFilter *filter;
 
-            if (property_type == G_TYPE_BOOLEAN ||
-                property_type == G_TYPE_STRING ||
-                property_type == DBUS_TYPE_G_OBJECT_PATH)
-            {
-                filter_value = tp_g_value_slice_new
-                    (G_VALUE_TYPE (property_value));
-                g_value_copy (property_value, filter_value);
-            }
-            else if (property_type == G_TYPE_UCHAR ||
-                     property_type == G_TYPE_UINT ||
-                     property_type == G_TYPE_UINT64)
-            {
-                filter_value = tp_g_value_slice_new (G_TYPE_UINT64);
-                g_value_transform (property_value, filter_value);
-            }
-            else if (property_type == G_TYPE_INT ||
-                     property_type == G_TYPE_INT64)
-            {
-                filter_value = tp_g_value_slice_new (G_TYPE_INT64);
-                g_value_transform (property_value, filter_value);
-            }
-            else
-            {
-                /* invalid type, do not add this filter */
-                g_warning ("%s: Property %s has an invalid type (%s)",
-                           G_STRFUNC, property_name,
-                           g_type_name (G_VALUE_TYPE (property_value)));
-                valid_filter = FALSE;
-                break;
-            }
-
-            g_hash_table_insert (new_channel_class, g_strdup (property_name),
-                                 filter_value);
-        }
+        /* this warns and returns NULL if a property has an invalid type, in
+         * which case we ignore that filter */
+        filter = _mcd_client_filter_new (g_ptr_array_index (filters, i));
 
-        if (valid_filter)
-            client_filters = g_list_prepend (client_filters,
-                                             new_channel_class);
-        else
-            g_hash_table_unref (new_channel_class);
+        if (filter != NULL)
+            client_filters = g_list_prepend (client_filters, filter);
     }
 
     switch (interface)
@@ -860,36 +763,12 @@ finally:
 static gboolean
 _mcd_client_proxy_parse_client_file (McdClientProxy *self)
 {
-    gboolean file_found = FALSE;
-    gchar *filename;
-    const gchar *bus_name = tp_proxy_get_bus_name (self);
-
-    filename = _mcd_client_proxy_find_client_file (
-        bus_name + MC_CLIENT_BUS_NAME_BASE_LEN);
-
-    if (filename)
-    {
-        GKeyFile *file;
-        GError *error = NULL;
-
-        file = g_key_file_new ();
-        g_key_file_load_from_file (file, filename, 0, &error);
-        if (G_LIKELY (!error))
-        {
-            DEBUG ("File found for %s: %s", bus_name, filename);
-            parse_client_file (self, file);
-            file_found = TRUE;
-        }
-        else
-        {
-            g_warning ("Loading file %s failed: %s", filename, error->message);
-            g_error_free (error);
-        }
-        g_key_file_free (file);
-        g_free (filename);
-    }
+    if (self->priv->client_file == NULL)
+        return FALSE;
 
-    return file_found;
+    DEBUG ("File found for %s", tp_proxy_get_bus_name (self));
+    parse_client_file (self, self->priv->client_file);
+    return TRUE;
 }
 
 static gboolean
@@ -942,10 +821,10 @@ mcd_client_proxy_introspect (gpointer data)
                  * activatable */
                 DEBUG ("%s is a Handler but not active", bus_name);
 
-                /* FIXME: we emit this even if the capabilities we got from the
-                 * .client file match those we already had, possibly causing
-                 * redundant UpdateCapabilities calls - however, those are
-                 * harmless */
+                /* we emit this even if the capabilities we got from the
+                 * .client file match those we already had, but the
+                 * McdDispatcher doesn't pass on capabilities that haven't
+                 * changed */
                 g_signal_emit (self,
                                signals[S_HANDLER_CAPABILITIES_CHANGED], 0);
             }
@@ -1021,6 +900,7 @@ mcd_client_proxy_finalize (GObject *object)
         ((GObjectClass *) _mcd_client_proxy_parent_class)->finalize;
 
     g_free (self->priv->unique_name);
+    tp_clear_pointer (&self->priv->client_file, g_key_file_unref);
 
     _mcd_client_proxy_take_approver_filters (self, NULL);
     _mcd_client_proxy_take_observer_filters (self, NULL);
@@ -1086,6 +966,11 @@ mcd_client_proxy_set_property (GObject *object,
             self->priv->unique_name = g_value_dup_string (value);
             break;
 
+        case PROP_CLIENT_FILE:
+            g_assert (self->priv->client_file == NULL);
+            self->priv->client_file = g_value_dup_boxed (value);
+            break;
+
         default:
             G_OBJECT_WARN_INVALID_PROPERTY_ID (object, property, param_spec);
     }
@@ -1141,6 +1026,14 @@ _mcd_client_proxy_class_init (McdClientProxyClass *klass)
         g_cclosure_marshal_VOID__VOID,
         G_TYPE_NONE, 0);
 
+    /* Emitted with the McdClientInterface whose filters were replaced */
+    signals[S_FILTERS_CHANGED] = g_signal_new ("filters-changed",
+        G_OBJECT_CLASS_TYPE (klass),
+        G_SIGNAL_RUN_LAST | G_SIGNAL_DETAILED,
+        0, NULL, NULL,
+        g_cclosure_marshal_VOID__UINT,
+        G_TYPE_NONE, 1, G_TYPE_UINT);
+
     g_object_class_install_property (object_class, PROP_ACTIVATABLE,
         g_param_spec_boolean ("activatable", "Activatable?",
             "TRUE if this client can be service-activated", FALSE,
@@ -1154,6 +1047,13 @@ _mcd_client_proxy_class_init (McdClientProxyClass *klass)
             G_PARAM_WRITABLE | G_PARAM_CONSTRUCT_ONLY |
             G_PARAM_STATIC_STRINGS));
 
+    g_object_class_install_property (object_class, PROP_CLIENT_FILE,
+        g_param_spec_boxed ("client-file", "Client file",
+            "The contents of this client's .client file, or NULL if it "
+            "has none",
+            G_TYPE_KEY_FILE,
+            G_PARAM_WRITABLE | G_PARAM_CONSTRUCT_ONLY |
+            G_PARAM_STATIC_STRINGS));
 }
 
 gboolean
@@ -1214,7 +1114,8 @@ McdClientProxy *
 _mcd_client_proxy_new (TpDBusDaemon *dbus_daemon,
                        const gchar *well_known_name,
                        const gchar *unique_name_if_known,
-                       gboolean activatable)
+                       gboolean activatable,
+                       GKeyFile *client_file)
 {
     McdClientProxy *self;
     const gchar *name_suffix;
@@ -1240,6 +1141,7 @@ _mcd_client_proxy_new (TpDBusDaemon *dbus_daemon,
                          "bus-name", well_known_name,
                          "unique-name", unique_name_if_known,
                          "activatable", activatable,
+                         "client-file", client_file,
                          NULL);
 
     g_free (object_path);
@@ -1324,12 +1226,21 @@ mcd_client_proxy_free_client_filters (GList **client_filters)
 
     if (*client_filters != NULL)
     {
-        g_list_foreach (*client_filters, (GFunc) g_hash_table_unref, NULL);
-        g_list_free (*client_filters);
+        g_list_free_full (*client_filters,
+                          (GDestroyNotify) _mcd_client_filter_free);
         *client_filters = NULL;
     }
 }
 
+static void
+mcd_client_proxy_filters_changed (McdClientProxy *self,
+                                  McdClientInterface iface)
+{
+    /* nobody can be looking at our filters once we are being torn down */
+    if (!self->priv->disposed)
+        g_signal_emit (self, signals[S_FILTERS_CHANGED], 0, iface);
+}
+
 void
 _mcd_client_proxy_take_approver_filters (McdClientProxy *self,
                                          GList *filters)
@@ -1338,6 +1249,7 @@ _mcd_client_proxy_take_approver_filters (McdClientProxy *self,
 
     mcd_client_proxy_free_client_filters (&(self->priv->approver_filters));
     self->priv->approver_filters = filters;
+    mcd_client_proxy_filters_changed (self, MCD_CLIENT_APPROVER);
 }
 
 void
@@ -1348,6 +1260,7 @@ _mcd_client_proxy_take_observer_filters (McdClientProxy *self,
 
     mcd_client_proxy_free_client_filters (&(self->priv->observer_filters));
     self->priv->observer_filters = filters;
+    mcd_client_proxy_filters_changed (self, MCD_CLIENT_OBSERVER);
 }
 
 void
@@ -1358,6 +1271,7 @@ _mcd_client_proxy_take_handler_filters (McdClientProxy *self,
 
     mcd_client_proxy_free_client_filters (&(self->priv->handler_filters));
     self->priv->handler_filters = filters;
+    mcd_client_proxy_filters_changed (self, MCD_CLIENT_HANDLER);
 }
 
 gboolean
@@ -1422,13 +1336,8 @@ _mcd_client_proxy_dup_handler_capabilities (McdClientProxy *self)
 
     for (list = self->priv->handler_filters; list != NULL; list = list->next)
     {
-        GHashTable *copy = g_hash_table_new_full (g_str_hash, g_str_equal,
-            g_free, (GDestroyNotify) tp_g_value_slice_free);
-
-        tp_g_hash_table_update (copy, list->data,
-                                (GBoxedCopyFunc) g_strdup,
-                                (GBoxedCopyFunc) tp_g_value_slice_dup);
-        g_ptr_array_add (filters, copy);
+        g_ptr_array_add (filters,
+                         _mcd_client_filter_dup_channel_class (list->data));
     }
 
     cap_tokens = self->priv->capability_tokens;
@@ -1469,92 +1378,6 @@ _mcd_client_proxy_dup_handler_capabilities (McdClientProxy *self)
     return va;
 }
 
-/* returns TRUE if the channel matches one property criteria
- */
-static gboolean
-_mcd_client_match_property (GVariant *channel_properties,
-                            gchar *property_name,
-                            GValue *filter_value)
-{
-    GType filter_type = G_VALUE_TYPE (filter_value);
-
-    g_return_val_if_fail (g_variant_is_of_type (channel_properties,
-            G_VARIANT_TYPE_VARDICT), FALSE);
-
-    g_assert (G_IS_VALUE (filter_value));
-
-    if (filter_type == G_TYPE_STRING)
-    {
-        const gchar *string;
-
-        string = tp_vardict_get_string (channel_properties, property_name);
-        if (!string)
-            return FALSE;
-
-        return !tp_strdiff (string, g_value_get_string (filter_value));
-    }
-
-    if (filter_type == DBUS_TYPE_G_OBJECT_PATH)
-    {
-        const gchar *path;
-
-        path = tp_vardict_get_object_path (channel_properties, property_name);
-        if (!path)
-            return FALSE;
-
-        return !tp_strdiff (path, g_value_get_boxed (filter_value));
-    }
-
-    if (filter_type == G_TYPE_BOOLEAN)
-    {
-        gboolean valid;
-        gboolean b;
-
-        b = tp_vardict_get_boolean (channel_properties, property_name, &valid);
-        if (!valid)
-            return FALSE;
-
-        return !!b == !!g_value_get_boolean (filter_value);
-    }
-
-    if (filter_type == G_TYPE_UCHAR || filter_type == G_TYPE_UINT ||
-        filter_type == G_TYPE_UINT64)
-    {
-        gboolean valid;
-        guint64 i;
-
-        i = tp_vardict_get_uint64 (channel_properties, property_name, &valid);
-        if (!valid)
-            return FALSE;
-
-        if (filter_type == G_TYPE_UCHAR)
-            return i == g_value_get_uchar (filter_value);
-        else if (filter_type == G_TYPE_UINT)
-            return i == g_value_get_uint (filter_value);
-        else
-            return i == g_value_get_uint64 (filter_value);
-    }
-
-    if (filter_type == G_TYPE_INT || filter_type == G_TYPE_INT64)
-    {
-        gboolean valid;
-        gint64 i;
-
-        i = tp_vardict_get_int64 (channel_properties, property_name, &valid);
-        if (!valid)
-            return FALSE;
-
-        if (filter_type == G_TYPE_INT)
-            return i == g_value_get_int (filter_value);
-        else
-            return i == g_value_get_int64 (filter_value);
-    }
-
-    g_warning ("%s: Invalid type: %s",
-               G_STRFUNC, g_type_name (filter_type));
-    return FALSE;
-}
-
 /* if the channel matches one of the channel filters, returns a positive
  * number that increases with more specific matches; otherwise, returns 0
  *
@@ -1562,60 +1385,31 @@ _mcd_client_match_property (GVariant *channel_properties,
  * largest filter that matched)
  */
 guint
-_mcd_client_match_filters (GVariant *channel_properties,
+_mcd_client_match_filters (const McdClientChannelProperties *channel_properties,
                            const GList *filters,
                            gboolean assume_requested)
 {
     const GList *list;
     guint best_quality = 0;
 
-    g_return_val_if_fail (g_variant_is_of_type (channel_properties,
-            G_VARIANT_TYPE_VARDICT), 0);
+    g_return_val_if_fail (channel_properties != NULL, 0);
 
     for (list = filters; list != NULL; list = list->next)
     {
-        GHashTable *filter = list->data;
-        GHashTableIter filter_iter;
-        gboolean filter_matched = TRUE;
-        gchar *property_name;
-        GValue *filter_value;
+        const McdClientFilter *filter = list->data;
         guint quality;
 
-        /* +1 because the empty hash table matches everything :-) */
-        quality = g_hash_table_size (filter) + 1;
-
-        if (quality <= best_quality)
+        if (_mcd_client_filter_get_quality (filter) <= best_quality)
         {
             /* even if this filter matches, there's no way it can be a
              * better-quality match than the best one we saw so far */
             continue;
         }
 
-        g_hash_table_iter_init (&filter_iter, filter);
-        while (g_hash_table_iter_next (&filter_iter,
-                                       (gpointer *) &property_name,
-                                       (gpointer *) &filter_value))
-        {
-            if (assume_requested &&
-                ! tp_strdiff (property_name, TP_IFACE_CHANNEL ".Requested"))
-            {
-                if (! G_VALUE_HOLDS_BOOLEAN (filter_value) ||
-                    ! g_value_get_boolean (filter_value))
-                {
-                    filter_matched = FALSE;
-                    break;
-                }
-            }
-            else if (! _mcd_client_match_property (channel_properties,
-                                                   property_name,
-                                                   filter_value))
-            {
-                filter_matched = FALSE;
-                break;
-            }
-        }
+        quality = _mcd_client_filter_match (filter, channel_properties,
+                                            assume_requested);
 
-        if (filter_matched)
+        if (quality > best_quality)
         {
             best_quality = quality;
         }
@@ -1656,10 +1450,23 @@ borrow_channel_connection_path (McdChannel *channel)
     return connection_path;
 }
 
+/*
+ * _mcd_client_proxy_handle_channel_details:
+ * @channels: the #McdChannel objects to be handled
+ * @channel_details: Channel_Details for @channels, in the same order
+ * @requests_satisfied: the object paths of the requests satisfied by
+ *  @channels
+ *
+ * Like _mcd_client_proxy_handle_channels(), but with the arguments that
+ * describe the channels already built, so a caller that sends the same
+ * channels to several clients need only build them once.
+ */
 void
-_mcd_client_proxy_handle_channels (McdClientProxy *self,
+_mcd_client_proxy_handle_channel_details (McdClientProxy *self,
     gint timeout_ms,
     const GList *channels,
+    const GPtrArray *channel_details,
+    const GPtrArray *requests_satisfied,
     gint64 user_action_time,
     GHashTable *handler_info,
     tp_cli_client_handler_callback_for_handle_channels callback,
@@ -1667,18 +1474,15 @@ _mcd_client_proxy_handle_channels (McdClientProxy *self,
     GDestroyNotify destroy,
     GObject *weak_object)
 {
-    GPtrArray *channel_details;
-    GPtrArray *requests_satisfied;
     const GList *iter;
 
     g_return_if_fail (MCD_IS_CLIENT_PROXY (self));
     g_return_if_fail (channels != NULL);
+    g_return_if_fail (channel_details != NULL);
+    g_return_if_fail (requests_satisfied != NULL);
 
     DEBUG ("calling HandleChannels on %s", tp_proxy_get_bus_name (self));
 
-    channel_details = _mcd_tp_channel_details_build_from_list (channels);
-    requests_satisfied = g_ptr_array_new_with_free_func (g_free);
-
     if (handler_info == NULL)
     {
         handler_info = g_hash_table_new (g_str_hash, g_str_equal);
@@ -1690,21 +1494,7 @@ _mcd_client_proxy_handle_channels (McdClientProxy *self,
 
     for (iter = channels; iter != NULL; iter = iter->next)
     {
-        gint64 req_time = 0;
-        GHashTable *requests;
-        GHashTableIter it;
-        gpointer path;
-
-        requests = _mcd_channel_get_satisfied_requests (iter->data,
-                                                             &req_time);
-
-        g_hash_table_iter_init (&it, requests);
-        while (g_hash_table_iter_next (&it, &path, NULL))
-        {
-            g_ptr_array_add (requests_satisfied, g_strdup (path));
-        }
-
-        g_hash_table_unref (requests);
+        gint64 req_time = _mcd_channel_get_latest_request_time (iter->data);
 
         /* Numerical order is correct for all currently supported values:
          *
@@ -1724,7 +1514,51 @@ _mcd_client_proxy_handle_channels (McdClientProxy *self,
         requests_satisfied, user_action_time, handler_info,
         callback, user_data, destroy, weak_object);
 
+    g_hash_table_unref (handler_info);
+}
+
+void
+_mcd_client_proxy_handle_channels (McdClientProxy *self,
+    gint timeout_ms,
+    const GList *channels,
+    gint64 user_action_time,
+    GHashTable *handler_info,
+    tp_cli_client_handler_callback_for_handle_channels callback,
+    gpointer user_data,
+    GDestroyNotify destroy,
+    GObject *weak_object)
+{
+    GPtrArray *channel_details;
+    GPtrArray *requests_satisfied;
+    const GList *iter;
+
+    g_return_if_fail (MCD_IS_CLIENT_PROXY (self));
+    g_return_if_fail (channels != NULL);
+
+    channel_details = _mcd_tp_channel_details_build_from_list (channels);
+    requests_satisfied = g_ptr_array_new_with_free_func (g_free);
+
+    for (iter = channels; iter != NULL; iter = iter->next)
+    {
+        GHashTable *requests;
+        GHashTableIter it;
+        gpointer path;
+
+        requests = _mcd_channel_get_satisfied_requests (iter->data, NULL);
+
+        g_hash_table_iter_init (&it, requests);
+        while (g_hash_table_iter_next (&it, &path, NULL))
+        {
+            g_ptr_array_add (requests_satisfied, g_strdup (path));
+        }
+
+        g_hash_table_unref (requests);
+    }
+
+    _mcd_client_proxy_handle_channel_details (self, timeout_ms, channels,
+        channel_details, requests_satisfied, user_action_time, handler_info,
+        callback, user_data, destroy, weak_object);
+
     _mcd_tp_channel_details_free (channel_details);
     g_ptr_array_unref (requests_satisfied);
-    g_hash_table_unref (handler_info);
 }
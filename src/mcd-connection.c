@@ -59,6 +59,7 @@
 #include "mcd-channel-priv.h"
 #include "mcd-connection-priv.h"
 #include "mcd-dispatcher-priv.h"
+#include "mcd-master-priv.h"
 #include "mcd-channel.h"
 #include "mcd-misc.h"
 #include "mcd-slacker.h"
@@ -93,7 +94,8 @@ struct _McdConnectionPrivate
     /* Things to do before calling Connect */
     guint tasks_before_connect;
 
-    guint reconnect_timer; 	/* timer for reconnection */
+    /* schedules reconnection attempts */
+    McdReconnectScheduler *reconnect_scheduler;
     guint reconnect_interval;
     guint probation_timer;      /* for mcd_connection_probation_ended_cb */
     guint probation_drop_count;
@@ -134,6 +136,11 @@ struct _McdConnectionPrivate
     /* Emergency service points' identifiers.
      * Set of (transfer full) (type utf8), lazily-allocated. */
     GHashTable *service_point_ids;
+
+    /* The primary McdChannel for each channel object path, among our
+     * missions (see _mcd_channel_is_primary_for_path)
+     * owned gchar *object_path => borrowed McdChannel * */
+    GHashTable *channels_by_path;
 };
 
 typedef struct
@@ -252,32 +259,32 @@ _check_presence (McdConnectionPrivate *priv, TpConnectionPresenceType presence,
     return TRUE;
 }
 
-static void
+/* Returns: %TRUE if a connection attempt was started */
+static gboolean
 _mcd_connection_attempt (McdConnection *connection)
 {
-    g_return_if_fail (connection->priv->tp_conn_mgr != NULL);
-    g_return_if_fail (connection->priv->account != NULL);
+    g_return_val_if_fail (connection->priv->tp_conn_mgr != NULL, FALSE);
+    g_return_val_if_fail (connection->priv->account != NULL, FALSE);
 
     DEBUG ("called for %p, account %s", connection,
            mcd_account_get_unique_name (connection->priv->account));
 
-    if (connection->priv->reconnect_timer != 0)
-    {
-        g_source_remove (connection->priv->reconnect_timer);
-        connection->priv->reconnect_timer = 0;
-    }
+    _mcd_reconnect_scheduler_cancel (connection->priv->reconnect_scheduler,
+                                     connection);
 
     if (mcd_account_get_connection_status (connection->priv->account) ==
         TP_CONNECTION_STATUS_DISCONNECTED)
     {
         /* not user-initiated */
         _mcd_account_connection_begin (connection->priv->account, FALSE);
+        return TRUE;
     }
     else
     {
         /* Can this happen? We just don't know. */
         DEBUG ("Not connecting because not disconnected (%i)",
                mcd_account_get_connection_status (connection->priv->account));
+        return FALSE;
     }
 }
 
@@ -474,11 +481,8 @@ _mcd_connection_request_presence (McdConnection *self,
         _mcd_connection_call_disconnect (self, NULL);
 
         /* if a reconnection attempt is scheduled, cancel it */
-        if (self->priv->reconnect_timer)
-        {
-            g_source_remove (self->priv->reconnect_timer);
-            self->priv->reconnect_timer = 0;
-        }
+        _mcd_reconnect_scheduler_cancel (self->priv->reconnect_scheduler,
+                                         self);
     }
     else
     {
@@ -545,11 +549,12 @@ _mcd_connection_setup_power_saving (McdConnection *connection)
 }
 
 static gboolean
-mcd_connection_reconnect (McdConnection *connection)
+mcd_connection_reconnect (gpointer user_data)
 {
+    McdConnection *connection = MCD_CONNECTION (user_data);
+
     DEBUG ("%p", connection);
-    _mcd_connection_attempt (connection);
-    return FALSE;
+    return _mcd_connection_attempt (connection);
 }
 
 /* Number of seconds after which to assume the connection is basically stable.
@@ -762,18 +767,22 @@ mcd_connection_invalidated_cb (TpConnection *tp_conn,
         /* we were disconnected by a network error or by a connection manager
          * crash (in the latter case, we get NoneSpecified as a reason): don't
          * abort the connection but try to reconnect later */
-        if (priv->reconnect_timer == 0)
-        {
-            DEBUG ("Preparing for reconnection in %u seconds",
-                priv->reconnect_interval);
-            priv->reconnect_timer = g_timeout_add_seconds
-                (priv->reconnect_interval,
-                 (GSourceFunc)mcd_connection_reconnect, connection);
-            priv->reconnect_interval *= RECONNECTION_MULTIPLIER;
-
-            if (priv->reconnect_interval >= MAXIMUM_RECONNECTION_TIME)
-                priv->reconnect_interval = MAXIMUM_RECONNECTION_TIME;
-        }
+        gchar *group = g_strdup_printf ("%s/%s",
+            mcd_account_get_manager_name (priv->account),
+            mcd_account_get_protocol_name (priv->account));
+
+        DEBUG ("Preparing for reconnection in about %u seconds",
+            priv->reconnect_interval);
+        _mcd_reconnect_scheduler_add (priv->reconnect_scheduler,
+            connection, group, priv->reconnect_interval * 1000,
+            _mcd_account_was_recently_online (priv->account),
+            mcd_connection_reconnect, connection);
+        g_free (group);
+
+        priv->reconnect_interval *= RECONNECTION_MULTIPLIER;
+
+        if (priv->reconnect_interval >= MAXIMUM_RECONNECTION_TIME)
+            priv->reconnect_interval = MAXIMUM_RECONNECTION_TIME;
     }
     else
     {
@@ -830,22 +839,58 @@ McdChannel *
 mcd_connection_find_channel_by_path (McdConnection *connection,
                       const gchar *object_path)
 {
-    const GList *list = NULL;
+    McdChannel *channel;
 
-    list = mcd_operation_get_missions (MCD_OPERATION (connection));
+    g_return_val_if_fail (MCD_IS_CONNECTION (connection), NULL);
 
-    while (list)
-    {
-        McdChannel *channel = MCD_CHANNEL (list->data);
+    channel = g_hash_table_lookup (connection->priv->channels_by_path,
+                                   object_path);
 
-        if (_mcd_channel_is_primary_for_path (channel, object_path))
-        {
-            return channel;
-        }
+    if (channel != NULL &&
+        !_mcd_channel_is_primary_for_path (channel, object_path))
+        return NULL;
 
-        list = list->next;
-    }
-    return NULL;
+    return channel;
+}
+
+/* Add @channel to channels_by_path if it has become the primary McdChannel
+ * for its object path. */
+static void
+mcd_connection_index_channel (McdConnection *connection,
+                              McdChannel *channel)
+{
+    const gchar *object_path = mcd_channel_get_object_path (channel);
+
+    if (object_path != NULL &&
+        _mcd_channel_is_primary_for_path (channel, object_path))
+        g_hash_table_insert (connection->priv->channels_by_path,
+                             g_strdup (object_path), channel);
+}
+
+static void
+mcd_connection_mission_taken (McdOperation *operation,
+                              McdMission *mission)
+{
+    if (MCD_IS_CHANNEL (mission))
+        mcd_connection_index_channel (MCD_CONNECTION (operation),
+                                      MCD_CHANNEL (mission));
+}
+
+static void
+mcd_connection_mission_removed (McdOperation *operation,
+                                McdMission *mission)
+{
+    McdConnectionPrivate *priv = MCD_CONNECTION (operation)->priv;
+    const gchar *object_path;
+
+    if (!MCD_IS_CHANNEL (mission))
+        return;
+
+    object_path = mcd_channel_get_object_path (MCD_CHANNEL (mission));
+
+    if (object_path != NULL &&
+        g_hash_table_lookup (priv->channels_by_path, object_path) == mission)
+        g_hash_table_remove (priv->channels_by_path, object_path);
 }
 
 static gboolean mcd_connection_need_dispatch (McdConnection *connection,
@@ -960,32 +1005,7 @@ mcd_connection_found_channel (McdConnection *self,
                               const gchar *object_path,
                               GHashTable *channel_props)
 {
-    const GList *list;
-    gboolean found = FALSE;
-
-    /* find the McdChannel */
-    /* NOTE: we cannot move the mcd_operation_get_missions() call out of
-     * the loop, because mcd_dispatcher_send() can cause the channel to be
-     * destroyed, at which point our list would contain a finalized channel
-     * (and a crash will happen) */
-    list = mcd_operation_get_missions ((McdOperation *) self);
-    for (; list != NULL; list = list->next)
-    {
-        McdChannel *channel = MCD_CHANNEL (list->data);
-
-        if (g_strcmp0 (object_path,
-                       mcd_channel_get_object_path (channel)) == 0)
-        {
-            found = TRUE;
-            break;
-        }
-
-        if (mcd_channel_get_status (channel) !=
-            MCD_CHANNEL_STATUS_UNDISPATCHED)
-            continue;
-    }
-
-    if (!found)
+    if (mcd_connection_find_channel_by_path (self, object_path) == NULL)
     {
         /* We don't have a McdChannel for this channel, which most likely
          * means that it was already present on the connection before MC
@@ -1550,6 +1570,7 @@ _mcd_connection_finalize (GObject * object)
 
     tp_clear_pointer (&priv->service_point_handles, tp_intset_destroy);
     tp_clear_pointer (&priv->service_point_ids, g_hash_table_unref);
+    tp_clear_pointer (&priv->channels_by_path, g_hash_table_unref);
 
     G_OBJECT_CLASS (mcd_connection_parent_class)->finalize (object);
 }
@@ -1643,6 +1664,9 @@ _mcd_connection_constructed (GObject * object)
     if (priv->slacker != NULL)
       g_signal_connect (priv->slacker, "inactivity-changed",
           G_CALLBACK (on_inactivity_changed), self);
+
+    priv->reconnect_scheduler = _mcd_reconnect_scheduler_ref (
+        _mcd_master_get_reconnect_scheduler (mcd_master_get_default ()));
 }
 
 static void
@@ -1666,10 +1690,14 @@ _mcd_connection_dispose (GObject * object)
         priv->probation_timer = 0;
     }
 
-    if (priv->reconnect_timer)
+    if (priv->reconnect_scheduler != NULL)
     {
-        g_source_remove (priv->reconnect_timer);
-        priv->reconnect_timer = 0;
+        _mcd_reconnect_scheduler_cancel (priv->reconnect_scheduler,
+                                         connection);
+        _mcd_reconnect_scheduler_finished (priv->reconnect_scheduler,
+                                           connection);
+        _mcd_reconnect_scheduler_unref (priv->reconnect_scheduler);
+        priv->reconnect_scheduler = NULL;
     }
 
     mcd_operation_foreach (MCD_OPERATION (connection),
@@ -1699,6 +1727,11 @@ _mcd_connection_dispose (GObject * object)
     tp_clear_object (&priv->dispatcher);
     tp_clear_object (&priv->client_factory);
 
+    /* the McdChannels are borrowed, and our parent class is about to drop
+     * its references to any that are left; the table itself stays until
+     * finalize, because removing them calls mcd_connection_mission_removed */
+    g_hash_table_remove_all (priv->channels_by_path);
+
     G_OBJECT_CLASS (mcd_connection_parent_class)->dispose (object);
 }
 
@@ -1884,6 +1917,7 @@ static void
 mcd_connection_class_init (McdConnectionClass * klass)
 {
     GObjectClass *object_class = G_OBJECT_CLASS (klass);
+    McdOperationClass *operation_class = MCD_OPERATION_CLASS (klass);
     g_type_class_add_private (object_class, sizeof (McdConnectionPrivate));
 
     object_class->finalize = _mcd_connection_finalize;
@@ -1891,6 +1925,8 @@ mcd_connection_class_init (McdConnectionClass * klass)
     object_class->constructed = _mcd_connection_constructed;
     object_class->set_property = _mcd_connection_set_property;
     object_class->get_property = _mcd_connection_get_property;
+    operation_class->mission_taken_signal = mcd_connection_mission_taken;
+    operation_class->mission_removed_signal = mcd_connection_mission_removed;
 
     _mcd_ext_register_dbus_glib_marshallers ();
 
@@ -1972,6 +2008,8 @@ mcd_connection_init (McdConnection * connection)
     priv->abort_reason = TP_CONNECTION_STATUS_REASON_NONE_SPECIFIED;
 
     priv->reconnect_interval = INITIAL_RECONNECTION_TIME;
+    priv->channels_by_path = g_hash_table_new_full (g_str_hash, g_str_equal,
+                                                    g_free, NULL);
 }
 
 /* Public methods */
@@ -2033,6 +2071,9 @@ common_request_channel_cb (TpConnection *proxy, gboolean yours,
         return;
     }
 
+    /* it was already one of our missions, but it had no object path */
+    mcd_connection_index_channel (connection, channel);
+
     /* if the channel request was cancelled, abort the channel now */
     if (mcd_channel_get_status (channel) == MCD_CHANNEL_STATUS_FAILED)
     {
@@ -2149,11 +2190,7 @@ _mcd_connection_connect (McdConnection *connection, GHashTable *params)
     DEBUG ("called for %p, account %s", connection,
            mcd_account_get_unique_name (priv->account));
 
-    if (priv->reconnect_timer)
-    {
-	g_source_remove (priv->reconnect_timer);
-	priv->reconnect_timer = 0;
-    }
+    _mcd_reconnect_scheduler_cancel (priv->reconnect_scheduler, connection);
 
     /* the account's status can be CONNECTING _before_ we get here, because
      * for the account that includes things like trying to bring up an IAP
@@ -37,6 +37,7 @@
 #include <telepathy-glib/telepathy-glib-dbus.h>
 
 #include "channel-utils.h"
+#include "dispatch-args.h"
 #include "mcd-channel-priv.h"
 #include "mcd-dbusprop.h"
 #include "mcd-master-priv.h"
@@ -198,6 +199,12 @@ struct _McdDispatchOperationPrivate
 
     /* Owned McdChannel we're dispatching */
     McdChannel *channel;
+    /* The channel's immutable properties, compiled for matching against
+     * client filters; created on first use, and again if they go stale */
+    McdClientChannelProperties *channel_filter_properties;
+    /* Arguments describing the channel to clients, borrowing the channel;
+     * created on first use, and freed if we lose the channel */
+    McdDispatchArgs *args;
     /* If non-NULL, we have lost the McdChannel but can't emit
      * ChannelLost yet */
     McdChannel *lost_channel;
@@ -1301,6 +1308,8 @@ mcd_dispatch_operation_finalize (GObject *object)
     tp_clear_pointer (&priv->possible_handlers, g_strfreev);
     tp_clear_pointer (&priv->properties, g_hash_table_unref);
     tp_clear_pointer (&priv->failed_handlers, g_hash_table_unref);
+    tp_clear_pointer (&priv->channel_filter_properties,
+                      _mcd_client_channel_properties_free);
     g_clear_error (&priv->result);
     g_free (priv->object_path);
 
@@ -1321,6 +1330,7 @@ mcd_dispatch_operation_dispose (GObject *object)
             mcd_dispatch_operation_channel_aborted_cb, object);
     }
 
+    tp_clear_pointer (&priv->args, _mcd_dispatch_args_free);
     tp_clear_object (&priv->channel);
     tp_clear_object (&priv->lost_channel);
     tp_clear_object (&priv->account);
@@ -1614,6 +1624,7 @@ _mcd_dispatch_operation_lose_channel (McdDispatchOperation *self,
 
     /* steal the reference */
     self->priv->channel = NULL;
+    tp_clear_pointer (&self->priv->args, _mcd_dispatch_args_free);
 
     object_path = mcd_channel_get_object_path (channel);
     error = mcd_channel_get_error (channel);
@@ -2021,72 +2032,122 @@ collect_satisfied_requests (McdChannel *channel,
         g_hash_table_unref (request_properties);
 }
 
+static GPtrArray *
+dispatch_args_build_channel_details (gpointer channel)
+{
+    return _mcd_tp_channel_details_build_from_tp_chan (
+        mcd_channel_get_tp_channel (channel));
+}
+
 static void
-_mcd_dispatch_operation_run_observers (McdDispatchOperation *self)
+dispatch_args_collect_satisfied_requests (gpointer channel,
+    GPtrArray **paths_out,
+    GHashTable **props_out)
 {
-    const gchar *dispatch_operation_path = "/";
-    GHashTable *observer_info;
-    GHashTableIter iter;
-    gpointer client_p;
+    collect_satisfied_requests (channel, paths_out, props_out);
+}
 
-    observer_info = tp_asv_new (NULL, NULL);
+static guint
+dispatch_args_get_requests_serial (gpointer channel)
+{
+    return _mcd_channel_get_satisfied_requests_serial (channel);
+}
+
+static const McdDispatchArgsFuncs dispatch_args_funcs = {
+    dispatch_args_build_channel_details,
+    _mcd_tp_channel_details_free,
+    dispatch_args_collect_satisfied_requests,
+    dispatch_args_get_requests_serial
+};
+
+/* must only be called while we have a channel */
+static McdDispatchArgs *
+_mcd_dispatch_operation_get_args (McdDispatchOperation *self)
+{
+    g_return_val_if_fail (self->priv->channel != NULL, NULL);
+
+    if (self->priv->args == NULL)
+        self->priv->args = _mcd_dispatch_args_new (&dispatch_args_funcs,
+                                                   self->priv->channel);
+
+    return self->priv->args;
+}
 
-    _mcd_client_registry_init_hash_iter (self->priv->client_registry, &iter);
+static const McdClientChannelProperties *
+_mcd_dispatch_operation_get_channel_filter_properties (
+    McdDispatchOperation *self)
+{
+    /* a client that appeared since we last looked might have a filter
+     * that mentions strings we didn't know about */
+    if (self->priv->channel_filter_properties != NULL &&
+        _mcd_client_channel_properties_is_stale (
+            self->priv->channel_filter_properties))
+    {
+        tp_clear_pointer (&self->priv->channel_filter_properties,
+                          _mcd_client_channel_properties_free);
+    }
 
-    while (g_hash_table_iter_next (&iter, NULL, &client_p))
+    if (self->priv->channel_filter_properties == NULL)
     {
-        McdClientProxy *client = MCD_CLIENT_PROXY (client_p);
-        gboolean observed = FALSE;
-        const gchar *account_path, *connection_path;
-        GPtrArray *channels_array, *satisfied_requests;
-        GHashTable *request_properties;
+        GVariant *properties;
 
-        if (!tp_proxy_has_interface_by_id (client,
-                                           TP_IFACE_QUARK_CLIENT_OBSERVER))
-            continue;
+        g_return_val_if_fail (self->priv->channel != NULL, NULL);
 
-        if (self->priv->channel != NULL)
-        {
-            McdChannel *channel = MCD_CHANNEL (self->priv->channel);
-            GVariant *properties;
+        properties = mcd_channel_dup_immutable_properties (
+            self->priv->channel);
+        g_assert (properties != NULL);
+        self->priv->channel_filter_properties =
+            _mcd_client_channel_properties_new (properties);
+        g_variant_unref (properties);
+    }
 
-            properties = mcd_channel_dup_immutable_properties (channel);
-            g_assert (properties != NULL);
+    return self->priv->channel_filter_properties;
+}
 
-            if (_mcd_client_match_filters (properties,
-                _mcd_client_proxy_get_observer_filters (client),
-                FALSE))
-                observed = TRUE;
+static void
+_mcd_dispatch_operation_run_observers (McdDispatchOperation *self)
+{
+    const gchar *dispatch_operation_path = "/";
+    const gchar *account_path, *connection_path;
+    McdDispatchArgs *args;
+    GHashTable *observer_info;
+    GHashTable *observers;
+    GHashTableIter iter;
+    gpointer client_p;
 
-            g_variant_unref (properties);
-        }
+    /* with no channel, there is nothing to observe */
+    if (self->priv->channel == NULL)
+        return;
 
-        /* in particular this happens if there is no channel at all */
-        if (!observed) continue;
+    observers = _mcd_client_registry_match_filters (
+        self->priv->client_registry, MCD_CLIENT_OBSERVER,
+        _mcd_dispatch_operation_get_channel_filter_properties (self), FALSE);
 
-        /* build up the parameters and invoke the observer */
+    if (g_hash_table_size (observers) == 0)
+    {
+        g_hash_table_unref (observers);
+        return;
+    }
 
-        connection_path = _mcd_dispatch_operation_get_connection_path (self);
-        account_path = _mcd_dispatch_operation_get_account_path (self);
+    args = _mcd_dispatch_operation_get_args (self);
+    connection_path = _mcd_dispatch_operation_get_connection_path (self);
+    account_path = _mcd_dispatch_operation_get_account_path (self);
 
-        /* TODO: there's room for optimization here: reuse the channels_array,
-         * if the observed list is the same */
-        channels_array = _mcd_tp_channel_details_build_from_tp_chan (
-            mcd_channel_get_tp_channel (self->priv->channel));
+    if (_mcd_dispatch_operation_needs_approval (self))
+    {
+        dispatch_operation_path = _mcd_dispatch_operation_get_path (self);
+    }
 
-        collect_satisfied_requests (self->priv->channel, &satisfied_requests,
-                                    &request_properties);
+    observer_info = tp_asv_new (NULL, NULL);
+    tp_asv_take_boxed (observer_info, "request-properties",
+        TP_HASH_TYPE_OBJECT_IMMUTABLE_PROPERTIES_MAP,
+        g_hash_table_ref (_mcd_dispatch_args_get_request_properties (args)));
 
-        /* transfer ownership into observer_info */
-        tp_asv_take_boxed (observer_info, "request-properties",
-            TP_HASH_TYPE_OBJECT_IMMUTABLE_PROPERTIES_MAP,
-            request_properties);
-        request_properties = NULL;
+    g_hash_table_iter_init (&iter, observers);
 
-        if (_mcd_dispatch_operation_needs_approval (self))
-        {
-            dispatch_operation_path = _mcd_dispatch_operation_get_path (self);
-        }
+    while (g_hash_table_iter_next (&iter, &client_p, NULL))
+    {
+        McdClientProxy *client = MCD_CLIENT_PROXY (client_p);
 
         _mcd_dispatch_operation_inc_observers_pending (self, client);
 
@@ -2094,17 +2155,16 @@ _mcd_dispatch_operation_run_observers (McdDispatchOperation *self)
                tp_proxy_get_bus_name (client), self);
         tp_cli_client_observer_call_observe_channels (
             (TpClient *) client, -1,
-            account_path, connection_path, channels_array,
-            dispatch_operation_path, satisfied_requests, observer_info,
+            account_path, connection_path,
+            _mcd_dispatch_args_get_channel_details (args),
+            dispatch_operation_path,
+            _mcd_dispatch_args_get_satisfied_requests (args), observer_info,
             observe_channels_cb,
             g_object_ref (self), g_object_unref, NULL);
-
-        g_ptr_array_unref (satisfied_requests);
-
-        _mcd_tp_channel_details_free (channels_array);
     }
 
     g_hash_table_unref (observer_info);
+    g_hash_table_unref (observers);
 }
 
 static void
@@ -2144,68 +2204,56 @@ add_dispatch_operation_cb (TpClient *proxy,
 static void
 _mcd_dispatch_operation_run_approvers (McdDispatchOperation *self)
 {
+    GHashTable *approvers;
     GHashTableIter iter;
     gpointer client_p;
+    const gchar *dispatch_operation;
+    GHashTable *properties;
 
     /* we temporarily increment this count and decrement it at the end of the
      * function, to make sure it won't become 0 while we are still invoking
      * approvers */
     _mcd_dispatch_operation_inc_ado_pending (self);
 
-    _mcd_client_registry_init_hash_iter (self->priv->client_registry, &iter);
-    while (g_hash_table_iter_next (&iter, NULL, &client_p))
+    /* with no channel, no approver can match */
+    if (self->priv->channel != NULL)
     {
-        McdClientProxy *client = MCD_CLIENT_PROXY (client_p);
-        GPtrArray *channel_details;
-        const gchar *dispatch_operation;
-        GHashTable *properties;
-        gboolean matched = FALSE;
-
-        if (!tp_proxy_has_interface_by_id (client,
-                                           TP_IFACE_QUARK_CLIENT_APPROVER))
-            continue;
-
-        if (self->priv->channel != NULL)
-        {
-            McdChannel *channel = MCD_CHANNEL (self->priv->channel);
-            GVariant *channel_properties;
-
-            channel_properties = mcd_channel_dup_immutable_properties (channel);
-            g_assert (channel_properties != NULL);
-
-            if (_mcd_client_match_filters (channel_properties,
-                _mcd_client_proxy_get_approver_filters (client),
-                FALSE))
-            {
-                matched = TRUE;
-            }
+        approvers = _mcd_client_registry_match_filters (
+            self->priv->client_registry, MCD_CLIENT_APPROVER,
+            _mcd_dispatch_operation_get_channel_filter_properties (self),
+            FALSE);
+    }
+    else
+    {
+        approvers = g_hash_table_new (NULL, NULL);
+    }
 
-            g_variant_unref (channel_properties);
-        }
+    dispatch_operation = _mcd_dispatch_operation_get_path (self);
+    properties = _mcd_dispatch_operation_get_properties (self);
 
-        /* in particular, after this point, self->priv->channel can't
-         * be NULL */
-        if (!matched) continue;
+    g_hash_table_iter_init (&iter, approvers);
 
-        dispatch_operation = _mcd_dispatch_operation_get_path (self);
-        properties = _mcd_dispatch_operation_get_properties (self);
-        channel_details = _mcd_tp_channel_details_build_from_tp_chan (
-            mcd_channel_get_tp_channel (self->priv->channel));
+    while (g_hash_table_iter_next (&iter, &client_p, NULL))
+    {
+        McdClientProxy *client = MCD_CLIENT_PROXY (client_p);
 
         DEBUG ("Calling AddDispatchOperation on approver %s for CDO %s @ %p",
                tp_proxy_get_bus_name (client), dispatch_operation, self);
 
         _mcd_dispatch_operation_inc_ado_pending (self);
 
+        /* if there are any approvers, we have a channel */
         tp_cli_client_approver_call_add_dispatch_operation (
             (TpClient *) client, -1,
-            channel_details, dispatch_operation, properties,
+            _mcd_dispatch_args_get_channel_details (
+                _mcd_dispatch_operation_get_args (self)),
+            dispatch_operation, properties,
             add_dispatch_operation_cb,
             g_object_ref (self), g_object_unref, NULL);
-
-        g_boxed_free (TP_ARRAY_TYPE_CHANNEL_DETAILS_LIST, channel_details);
     }
 
+    g_hash_table_unref (approvers);
+
     /* This matches the approvers count set to 1 at the beginning of the
      * function */
     _mcd_dispatch_operation_dec_ado_pending (self);
@@ -2282,9 +2330,9 @@ _mcd_dispatch_operation_run_clients (McdDispatchOperation *self)
 static void
 mcd_dispatch_operation_handle_channels (McdDispatchOperation *self)
 {
-    GList *channels = NULL;
+    GList *channels;
     GHashTable *handler_info;
-    GHashTable *request_properties;
+    McdDispatchArgs *args;
 
     g_assert (self->priv->trying_handler != NULL);
 
@@ -2306,25 +2354,24 @@ mcd_dispatch_operation_handle_channels (McdDispatchOperation *self)
     }
 
     /* FIXME: it shouldn't be possible to get here without a channel */
-    if (self->priv->channel != NULL)
-    {
-        collect_satisfied_requests (self->priv->channel, NULL,
-                                    &request_properties);
-        channels = g_list_prepend (NULL, self->priv->channel);
-    }
-    else
+    if (self->priv->channel == NULL)
     {
-        request_properties = g_hash_table_new_full (g_str_hash,
-            g_str_equal, g_free, (GDestroyNotify) g_hash_table_unref);
+        g_critical ("%s: no channel to handle", G_STRFUNC);
+        return;
     }
 
+    args = _mcd_dispatch_operation_get_args (self);
+    channels = g_list_prepend (NULL, self->priv->channel);
+
     handler_info = tp_asv_new (NULL, NULL);
     tp_asv_take_boxed (handler_info, "request-properties",
-        TP_HASH_TYPE_OBJECT_IMMUTABLE_PROPERTIES_MAP, request_properties);
-    request_properties = NULL;
+        TP_HASH_TYPE_OBJECT_IMMUTABLE_PROPERTIES_MAP,
+        g_hash_table_ref (_mcd_dispatch_args_get_request_properties (args)));
 
-    _mcd_client_proxy_handle_channels (self->priv->trying_handler,
-        -1, channels, self->priv->handle_with_time,
+    _mcd_client_proxy_handle_channel_details (self->priv->trying_handler,
+        -1, channels, _mcd_dispatch_args_get_channel_details (args),
+        _mcd_dispatch_args_get_satisfied_requests (args),
+        self->priv->handle_with_time,
         handler_info, _mcd_dispatch_operation_handle_channels_cb,
         g_object_ref (self), g_object_unref, NULL);
 
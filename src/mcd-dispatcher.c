@@ -132,6 +132,20 @@ struct _McdDispatcherPrivate
     /* connection => itself, borrowed */
     GHashTable *connections;
 
+    /* Handlers whose capabilities have changed since we last told the
+     * connections, so we can tell them about all of them at once
+     * owned gchar *bus_name => ref'd McdClientProxy */
+    GHashTable *pending_client_caps;
+    /* idle source to flush pending_client_caps, or 0 */
+    guint client_caps_idle;
+    /* The capabilities we last told the connections about for each
+     * Handler that has changed since we became ready, so we don't tell
+     * them again if nothing actually changed; emptied when the last
+     * connection goes away, because new connections are told about every
+     * Handler anyway
+     * owned gchar *bus_name => ref'd GVariant of type (saa{sv}as) */
+    GHashTable *sent_client_caps;
+
     /* Initially FALSE, meaning we suppress OperationList.DispatchOperations
      * change notification signals because nobody has retrieved that property
      * yet. Set to TRUE the first time someone reads the DispatchOperations
@@ -597,6 +611,7 @@ mcd_dispatcher_client_needs_recovery_cb (McdClientProxy *client,
         TpChannel *channel = list->data;
         const gchar *object_path = tp_proxy_get_object_path (channel);
         GVariant *properties;
+        McdClientChannelProperties *compiled;
         McdClientProxy *handler;
 
         /* FIXME: This is not exactly the right behaviour, see fd.o#40305 */
@@ -608,8 +623,10 @@ mcd_dispatcher_client_needs_recovery_cb (McdClientProxy *client,
         }
 
         properties = tp_channel_dup_immutable_properties (channel);
+        compiled = _mcd_client_channel_properties_new (properties);
+        g_variant_unref (properties);
 
-        if (_mcd_client_match_filters (properties, observer_filters,
+        if (_mcd_client_match_filters (compiled, observer_filters,
             FALSE))
         {
             const gchar *account_path =
@@ -619,7 +636,7 @@ mcd_dispatcher_client_needs_recovery_cb (McdClientProxy *client,
             _mcd_client_recover_observer (client, channel, account_path);
         }
 
-        g_variant_unref (properties);
+        _mcd_client_channel_properties_free (compiled);
     }
 
     /* we also need to think about channels that are still being dispatched,
@@ -637,8 +654,12 @@ mcd_dispatcher_client_needs_recovery_cb (McdClientProxy *client,
             {
                 GVariant *properties =
                     mcd_channel_dup_immutable_properties (mcd_channel);
+                McdClientChannelProperties *compiled =
+                    _mcd_client_channel_properties_new (properties);
+
+                g_variant_unref (properties);
 
-                if (_mcd_client_match_filters (properties, observer_filters,
+                if (_mcd_client_match_filters (compiled, observer_filters,
                         FALSE))
                 {
                     _mcd_client_recover_observer (client,
@@ -646,7 +667,7 @@ mcd_dispatcher_client_needs_recovery_cb (McdClientProxy *client,
                         _mcd_dispatch_operation_get_account_path (op));
                 }
 
-                g_variant_unref (properties);
+                _mcd_client_channel_properties_free (compiled);
             }
         }
     }
@@ -749,6 +770,14 @@ _mcd_dispatcher_dispose (GObject * object)
         tp_clear_object (&priv->clients);
     }
 
+    if (priv->client_caps_idle != 0)
+    {
+        g_source_remove (priv->client_caps_idle);
+        priv->client_caps_idle = 0;
+    }
+
+    tp_clear_pointer (&priv->pending_client_caps, g_hash_table_unref);
+    tp_clear_pointer (&priv->sent_client_caps, g_hash_table_unref);
     tp_clear_pointer (&priv->connections, g_hash_table_unref);
     tp_clear_object (&priv->master);
     tp_clear_object (&priv->dbus_daemon);
@@ -756,37 +785,118 @@ _mcd_dispatcher_dispose (GObject * object)
     G_OBJECT_CLASS (mcd_dispatcher_parent_class)->dispose (object);
 }
 
-static void
-mcd_dispatcher_update_client_caps (McdDispatcher *self,
-                                   McdClientProxy *client)
+/* Returns: TRUE if @va (a Handler_Capabilities struct) differs from what
+ * we last told the connections about, in which case it is remembered */
+static gboolean
+mcd_dispatcher_client_caps_changed (McdDispatcher *self,
+                                    GValueArray *va)
 {
+    GValue value = G_VALUE_INIT;
+    GVariant *variant;
+    GVariant *old;
+    const gchar *bus_name = g_value_get_string (va->values + 0);
+
+    g_value_init (&value, TP_STRUCT_TYPE_HANDLER_CAPABILITIES);
+    g_value_set_static_boxed (&value, va);
+    variant = g_variant_ref_sink (dbus_g_value_build_g_variant (&value));
+    g_value_unset (&value);
+
+    old = g_hash_table_lookup (self->priv->sent_client_caps, bus_name);
+
+    if (old != NULL && g_variant_equal (old, variant))
+    {
+        g_variant_unref (variant);
+        return FALSE;
+    }
+
+    g_hash_table_insert (self->priv->sent_client_caps, g_strdup (bus_name),
+                         variant);
+    return TRUE;
+}
+
+static gboolean
+mcd_dispatcher_flush_client_caps (gpointer data)
+{
+    McdDispatcher *self = data;
     GPtrArray *vas;
     GHashTableIter iter;
-    gpointer k;
+    gpointer k, v;
 
-    /* If we haven't finished inspecting initial clients yet, we'll push all
-     * the client caps into all connections when we do, so do nothing.
-     *
-     * If we don't have any connections, on the other hand, then there's
-     * nothing to do. */
-    if (!_mcd_client_registry_is_ready (self->priv->clients)
-        || g_hash_table_size (self->priv->connections) == 0)
+    self->priv->client_caps_idle = 0;
+
+    /* connections that appear later get all the current capabilities
+     * anyway, so there's nothing to tell or remember */
+    if (g_hash_table_size (self->priv->connections) == 0)
     {
-        return;
+        DEBUG ("no connections to tell about %u Handlers",
+               g_hash_table_size (self->priv->pending_client_caps));
+        g_hash_table_remove_all (self->priv->pending_client_caps);
+        return FALSE;
     }
 
-    vas = g_ptr_array_sized_new (1);
-    g_ptr_array_add (vas, _mcd_client_proxy_dup_handler_capabilities (client));
+    vas = g_ptr_array_sized_new (
+        g_hash_table_size (self->priv->pending_client_caps));
 
-    g_hash_table_iter_init (&iter, self->priv->connections);
+    g_hash_table_iter_init (&iter, self->priv->pending_client_caps);
+
+    while (g_hash_table_iter_next (&iter, &k, &v))
+    {
+        GValueArray *va = _mcd_client_proxy_dup_handler_capabilities (v);
 
-    while (g_hash_table_iter_next (&iter, &k, NULL))
+        if (mcd_dispatcher_client_caps_changed (self, va))
+        {
+            g_ptr_array_add (vas, va);
+        }
+        else
+        {
+            DEBUG ("%s: capabilities unchanged", (const gchar *) k);
+            g_value_array_free (va);
+        }
+
+        g_hash_table_iter_remove (&iter);
+    }
+
+    if (vas->len > 0)
     {
-        _mcd_connection_update_client_caps (k, vas);
+        DEBUG ("telling %u connections about %u changed Handlers",
+               g_hash_table_size (self->priv->connections), vas->len);
+
+        g_hash_table_iter_init (&iter, self->priv->connections);
+
+        while (g_hash_table_iter_next (&iter, &k, NULL))
+        {
+            _mcd_connection_update_client_caps (k, vas);
+        }
     }
 
     g_ptr_array_foreach (vas, (GFunc) g_value_array_free, NULL);
     g_ptr_array_unref (vas);
+    return FALSE;
+}
+
+static void
+mcd_dispatcher_update_client_caps (McdDispatcher *self,
+                                   McdClientProxy *client)
+{
+    /* If we haven't finished inspecting initial clients yet, we'll push all
+     * the client caps into all connections when we do, so do nothing. */
+    if (!_mcd_client_registry_is_ready (self->priv->clients))
+    {
+        return;
+    }
+
+    /* Handlers often signal several changes in a row, and several Handlers
+     * often change at once (e.g. when a session starts), so wait until
+     * the main loop is idle and tell each connection about all of them in
+     * one UpdateCapabilities call */
+    g_hash_table_insert (self->priv->pending_client_caps,
+        g_strdup (tp_proxy_get_bus_name (client)), g_object_ref (client));
+
+    if (self->priv->client_caps_idle == 0)
+    {
+        self->priv->client_caps_idle = g_idle_add (
+            mcd_dispatcher_flush_client_caps, self);
+    }
 }
 
 static void
@@ -907,6 +1017,10 @@ mcd_dispatcher_init (McdDispatcher * dispatcher)
     priv->operation_list_active = FALSE;
 
     priv->connections = g_hash_table_new (NULL, NULL);
+    priv->pending_client_caps = g_hash_table_new_full (g_str_hash,
+        g_str_equal, g_free, g_object_unref);
+    priv->sent_client_caps = g_hash_table_new_full (g_str_hash, g_str_equal,
+        g_free, (GDestroyNotify) g_variant_unref);
 
     /* idempotent, not guaranteed to have been called yet */
     _mcd_plugin_loader_init ();
@@ -1492,6 +1606,11 @@ mcd_dispatcher_lost_connection (gpointer data,
     DEBUG ("%p: %p", self, corpse);
 
     g_hash_table_remove (self->priv->connections, corpse);
+
+    /* nobody has been told anything now */
+    if (g_hash_table_size (self->priv->connections) == 0)
+        g_hash_table_remove_all (self->priv->sent_client_caps);
+
     g_object_unref (self);
 }
 
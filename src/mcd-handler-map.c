@@ -29,6 +29,7 @@
 #include <telepathy-glib/telepathy-glib.h>
 
 #include "channel-utils.h"
+#include "handled-channels.h"
 #include "mcd-channel-priv.h"
 
 G_DEFINE_TYPE (McdHandlerMap, _mcd_handler_map, G_TYPE_OBJECT);
@@ -36,18 +37,9 @@ G_DEFINE_TYPE (McdHandlerMap, _mcd_handler_map, G_TYPE_OBJECT);
 struct _McdHandlerMapPrivate
 {
     TpDBusDaemon *dbus_daemon;
-    /* The handler for each channel currently being handled
-     * owned gchar *object_path => owned gchar *unique_name */
-    GHashTable *channel_processes;
-    /* The well-known bus name we invoked in channel_processes[path]
-     * owned gchar *object_path => owned gchar *well_known_name */
-    GHashTable *channel_clients;
-    /* owned gchar *unique_name => malloc'd gsize, number of channels */
-    GHashTable *handler_processes;
-    /* owned gchar *object_path => ref'd TpChannel */
-    GHashTable *handled_channels;
-    /* owned gchar *object_path =>  owned gchar *account_path */
-    GHashTable *channel_accounts;
+    /* Each channel currently being handled, its handler, and what we know
+     * about it; we watch the unique name of every handler in here */
+    McdHandledChannels *channels;
 };
 
 enum {
@@ -55,40 +47,45 @@ enum {
     PROP_DBUS_DAEMON
 };
 
+static void mcd_handler_map_name_owner_cb (TpDBusDaemon *dbus_daemon,
+                                           const gchar *name,
+                                           const gchar *new_owner,
+                                           gpointer user_data);
+
 static void
-slice_free_gsize (gpointer p)
+mcd_handler_map_handler_added (const gchar *unique_name,
+                               gpointer user_data)
 {
-    g_slice_free (gsize, p);
+    McdHandlerMap *self = user_data;
+
+    tp_dbus_daemon_watch_name_owner (self->priv->dbus_daemon, unique_name,
+                                     mcd_handler_map_name_owner_cb, self,
+                                     NULL);
 }
 
 static void
-_mcd_handler_map_init (McdHandlerMap *self)
+mcd_handler_map_handler_removed (const gchar *unique_name,
+                                 gpointer user_data)
 {
-    self->priv = G_TYPE_INSTANCE_GET_PRIVATE (self, MCD_TYPE_HANDLER_MAP,
-                                              McdHandlerMapPrivate);
+    McdHandlerMap *self = user_data;
 
-    self->priv->channel_processes = g_hash_table_new_full (g_str_hash,
-                                                           g_str_equal,
-                                                           g_free, g_free);
-
-    self->priv->channel_clients = g_hash_table_new_full (g_str_hash,
-                                                         g_str_equal,
-                                                         g_free, g_free);
+    tp_dbus_daemon_cancel_name_owner_watch (self->priv->dbus_daemon,
+        unique_name, mcd_handler_map_name_owner_cb, self);
+}
 
-    self->priv->handler_processes = g_hash_table_new_full (g_str_hash,
-                                                           g_str_equal,
-                                                           g_free,
-                                                           slice_free_gsize);
+static const McdHandledChannelsFuncs handled_channels_funcs = {
+    mcd_handler_map_handler_added,
+    mcd_handler_map_handler_removed
+};
 
-    self->priv->handled_channels = g_hash_table_new_full (g_str_hash,
-                                                          g_str_equal,
-                                                          g_free,
-                                                          g_object_unref);
+static void
+_mcd_handler_map_init (McdHandlerMap *self)
+{
+    self->priv = G_TYPE_INSTANCE_GET_PRIVATE (self, MCD_TYPE_HANDLER_MAP,
+                                              McdHandlerMapPrivate);
 
-    self->priv->channel_accounts = g_hash_table_new_full (g_str_hash,
-                                                          g_str_equal,
-                                                          g_free,
-                                                          g_free);
+    self->priv->channels = _mcd_handled_channels_new (&handled_channels_funcs,
+                                                      self);
 }
 
 static void
@@ -131,53 +128,33 @@ _mcd_handler_map_set_property (GObject *object,
     }
 }
 
-static void mcd_handler_map_name_owner_cb (TpDBusDaemon *dbus_daemon,
-                                           const gchar *name,
-                                           const gchar *new_owner,
-                                           gpointer user_data);
-
 static void
 _mcd_handler_map_dispose (GObject *object)
 {
     McdHandlerMap *self = MCD_HANDLER_MAP (object);
 
-    tp_clear_pointer (&self->priv->handled_channels, g_hash_table_unref);
-
-    if (self->priv->handler_processes != NULL)
+    if (self->priv->channels != NULL)
     {
-        GHashTableIter iter;
-        gpointer k;
+        GList *handlers;
 
         g_assert (self->priv->dbus_daemon != NULL);
 
-        g_hash_table_iter_init (&iter, self->priv->handler_processes);
+        handlers = _mcd_handled_channels_get_handlers (self->priv->channels);
 
-        while (g_hash_table_iter_next (&iter, &k, NULL))
+        while (handlers != NULL)
         {
             tp_dbus_daemon_cancel_name_owner_watch (self->priv->dbus_daemon,
-                k, mcd_handler_map_name_owner_cb, object);
+                handlers->data, mcd_handler_map_name_owner_cb, object);
+            handlers = g_list_delete_link (handlers, handlers);
         }
-
     }
 
-    tp_clear_pointer (&self->priv->handler_processes, g_hash_table_unref);
+    tp_clear_pointer (&self->priv->channels, _mcd_handled_channels_free);
     tp_clear_object (&self->priv->dbus_daemon);
 
     G_OBJECT_CLASS (_mcd_handler_map_parent_class)->dispose (object);
 }
 
-static void
-_mcd_handler_map_finalize (GObject *object)
-{
-    McdHandlerMap *self = MCD_HANDLER_MAP (object);
-
-    tp_clear_pointer (&self->priv->channel_processes, g_hash_table_unref);
-    tp_clear_pointer (&self->priv->channel_clients, g_hash_table_unref);
-    tp_clear_pointer (&self->priv->channel_accounts, g_hash_table_unref);
-
-    G_OBJECT_CLASS (_mcd_handler_map_parent_class)->finalize (object);
-}
-
 static void
 _mcd_handler_map_class_init (McdHandlerMapClass *klass)
 {
@@ -187,7 +164,6 @@ _mcd_handler_map_class_init (McdHandlerMapClass *klass)
     object_class->dispose = _mcd_handler_map_dispose;
     object_class->get_property = _mcd_handler_map_get_property;
     object_class->set_property = _mcd_handler_map_set_property;
-    object_class->finalize = _mcd_handler_map_finalize;
 
     g_object_class_install_property (object_class, PROP_DBUS_DAEMON,
         g_param_spec_object ("dbus-daemon", "D-Bus daemon", "D-Bus daemon",
@@ -215,11 +191,13 @@ _mcd_handler_map_get_handler (McdHandlerMap *self,
                               const gchar *channel_path,
                               const gchar **well_known_name)
 {
+    const McdHandledChannel *record = _mcd_handled_channels_lookup (
+        self->priv->channels, channel_path);
+
     if (well_known_name != NULL)
-        *well_known_name = g_hash_table_lookup (self->priv->channel_clients,
-                                                channel_path);
+        *well_known_name = (record == NULL ? NULL : record->well_known_name);
 
-    return g_hash_table_lookup (self->priv->channel_processes, channel_path);
+    return (record == NULL ? NULL : record->unique_name);
 }
 
 /*
@@ -239,60 +217,13 @@ _mcd_handler_map_set_path_handled (McdHandlerMap *self,
                                    const gchar *unique_name,
                                    const gchar *well_known_name)
 {
-    const gchar *old;
-    gsize *counter;
-
-    /* In case we want to re-invoke the same client later, remember its
-     * well-known name, if we know it. (In edge cases where we're recovering
-     * from an MC crash, we can only guess, so we get NULL.) */
-    if (well_known_name == NULL)
-        g_hash_table_remove (self->priv->channel_clients, channel_path);
-    else
-        g_hash_table_insert (self->priv->channel_clients,
-                             g_strdup (channel_path),
-                             g_strdup (well_known_name));
-
-    old = g_hash_table_lookup (self->priv->channel_processes, channel_path);
-
-    if (!tp_strdiff (old, unique_name))
-    {
-        /* no-op - the new handler is the same as the old */
-        return;
-    }
-
-    if (old != NULL)
-    {
-        counter = g_hash_table_lookup (self->priv->handler_processes,
-                                       old);
-
-        if (--*counter == 0)
-        {
-            tp_dbus_daemon_cancel_name_owner_watch (self->priv->dbus_daemon,
-                old, mcd_handler_map_name_owner_cb, self);
-            g_hash_table_remove (self->priv->handler_processes, old);
-        }
-    }
-
-    g_hash_table_insert (self->priv->channel_processes,
-                         g_strdup (channel_path), g_strdup (unique_name));
-
-    counter = g_hash_table_lookup (self->priv->handler_processes,
-                                   unique_name);
-
-    if (counter == NULL)
-    {
-        counter = g_slice_new (gsize);
-        *counter = 1;
-        g_hash_table_insert (self->priv->handler_processes,
-                             g_strdup (unique_name), counter);
-        tp_dbus_daemon_watch_name_owner (self->priv->dbus_daemon, unique_name,
-                                         mcd_handler_map_name_owner_cb, self,
-                                         NULL);
-    }
-    else
-    {
-        ++*counter;
-    }
+    /* In case we want to re-invoke the same client later, this remembers
+     * its well-known name, if we know it. (In edge cases where we're
+     * recovering from an MC crash, we can only guess, so we get NULL.)
+     * If the handler has changed, we start watching the new one, and stop
+     * watching the old one if that was its last channel. */
+    _mcd_handled_channels_set_handler (self->priv->channels, channel_path,
+                                       unique_name, well_known_name);
 }
 
 static void
@@ -303,32 +234,14 @@ handled_channel_invalidated_cb (TpChannel *channel,
                                 gpointer user_data)
 {
     McdHandlerMap *self = MCD_HANDLER_MAP (user_data);
-    const gchar *path = tp_proxy_get_object_path (channel);
-    gchar *handler;
 
     g_signal_handlers_disconnect_by_func (channel,
                                           handled_channel_invalidated_cb,
                                           user_data);
 
-    handler = g_hash_table_lookup (self->priv->channel_processes, path);
-
-    if (handler != NULL)
-    {
-        gsize *counter = g_hash_table_lookup (self->priv->handler_processes,
-                                              handler);
-
-        g_assert (counter != NULL);
-
-        if (--*counter == 0)
-        {
-            g_hash_table_remove (self->priv->handler_processes, handler);
-        }
-
-        g_hash_table_remove (self->priv->channel_processes, path);
-    }
-
-    g_hash_table_remove (self->priv->handled_channels, path);
-    g_hash_table_remove (self->priv->channel_accounts, path);
+    if (self->priv->channels != NULL)
+        _mcd_handled_channels_remove (self->priv->channels,
+                                      tp_proxy_get_object_path (channel));
 
     g_object_unref (self);
 }
@@ -355,13 +268,8 @@ _mcd_handler_map_set_channel_handled (McdHandlerMap *self,
 {
     const gchar *path = tp_proxy_get_object_path (channel);
 
-    g_hash_table_insert (self->priv->handled_channels,
-                         g_strdup (path),
-                         g_object_ref (channel));
-
-    g_hash_table_insert (self->priv->channel_accounts,
-                         g_strdup (path),
-                         g_strdup (account_path));
+    _mcd_handled_channels_set_channel (self->priv->channels, channel,
+                                       account_path);
 
     g_signal_connect (channel, "invalidated",
                       G_CALLBACK (handled_channel_invalidated_cb),
@@ -375,55 +283,32 @@ static void
 _mcd_handler_map_set_handler_crashed (McdHandlerMap *self,
                                       const gchar *unique_name)
 {
-    gsize *counter = g_hash_table_lookup (self->priv->handler_processes,
-                                          unique_name);
+    /* This is O(number of channels handled by this handler); it also stops
+     * watching @unique_name */
+    GList *paths = _mcd_handled_channels_remove_handler (self->priv->channels,
+                                                         unique_name);
 
-    if (counter != NULL)
+    while (paths != NULL)
     {
-        GHashTableIter iter;
-        gpointer path_p, name_p;
-        GList *paths = NULL;
+        gchar *path = paths->data;
+        const McdHandledChannel *record = _mcd_handled_channels_lookup (
+            self->priv->channels, path);
+        TpChannel *channel = (record == NULL ? NULL : record->channel);
 
-        tp_dbus_daemon_cancel_name_owner_watch (self->priv->dbus_daemon,
-                                                unique_name,
-                                                mcd_handler_map_name_owner_cb,
-                                                self);
-        g_hash_table_remove (self->priv->handler_processes, unique_name);
+        DEBUG ("%s lost its handler %s", path, unique_name);
 
-        /* This is O(number of channels being handled) but then again
-         * it only happens if a handler crashes */
-        g_hash_table_iter_init (&iter, self->priv->channel_processes);
-
-        while (g_hash_table_iter_next (&iter, &path_p, &name_p))
+        /* this is NULL-safe */
+        if (_mcd_tp_channel_should_close (channel, "closing"))
         {
-            if (!tp_strdiff (name_p, unique_name))
-            {
-                DEBUG ("%s lost its handler %s", (const gchar *) path_p,
-                       (const gchar *) name_p);
-                paths = g_list_prepend (paths, g_strdup (path_p));
-                g_hash_table_iter_remove (&iter);
-            }
+            DEBUG ("Closing channel %s", path);
+            /* the corresponding McdChannel will get aborted when the
+             * Channel actually closes */
+            tp_cli_channel_call_close (channel, -1,
+                                       NULL, NULL, NULL, NULL);
         }
 
-        while (paths != NULL)
-        {
-            gchar *path = paths->data;
-            TpChannel *channel = g_hash_table_lookup (
-                self->priv->handled_channels, path);
-
-            /* this is NULL-safe */
-            if (_mcd_tp_channel_should_close (channel, "closing"))
-            {
-                DEBUG ("Closing channel %s", path);
-                /* the corresponding McdChannel will get aborted when the
-                 * Channel actually closes */
-                tp_cli_channel_call_close (channel, -1,
-                                           NULL, NULL, NULL, NULL);
-            }
-
-            paths = g_list_delete_link (paths, paths);
-            g_free (path);
-        }
+        paths = g_list_delete_link (paths, paths);
+        g_free (path);
     }
 }
 
@@ -445,7 +330,7 @@ mcd_handler_map_name_owner_cb (TpDBusDaemon *dbus_daemon,
 GList *
 _mcd_handler_map_get_handled_channels (McdHandlerMap *self)
 {
-    return g_hash_table_get_values (self->priv->handled_channels);
+    return _mcd_handled_channels_get_channels (self->priv->channels);
 }
 
 /*
@@ -456,8 +341,10 @@ const gchar *
 _mcd_handler_map_get_channel_account (McdHandlerMap *self,
     const gchar *channel_path)
 {
-    return g_hash_table_lookup (self->priv->channel_accounts,
-        channel_path);
+    const McdHandledChannel *record = _mcd_handled_channels_lookup (
+        self->priv->channels, channel_path);
+
+    return (record == NULL ? NULL : record->account_path);
 }
 
 /*
@@ -0,0 +1,275 @@
+/* Persistent cache of connection managers' protocol descriptions
+ *
+ * Copyright © 2012 Collabora Ltd.
+ *
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public License
+ * version 2.1 as published by the Free Software Foundation.
+ *
+ * This library is distributed in the hope that it will be useful, but
+ * WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the GNU
+ * Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with this library; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin St, Fifth Floor, Boston, MA
+ * 02110-1301 USA
+ *
+ */
+
+/*
+ * Finding out what a connection manager supports means either parsing its
+ * .manager file or, if it doesn't have one, activating it and asking it
+ * over D-Bus. Either way, the answer only changes when the CM is upgraded,
+ * so we keep it in a file under $XDG_CACHE_HOME, together with the name
+ * and modification time of the file that describes the CM: its .manager
+ * file if it has one, or its D-Bus .service file otherwise. If that file
+ * has moved or been modified since, the cached copy is ignored.
+ */
+
+#include "config.h"
+
+#include "mcd-manager-cache.h"
+
+#include <errno.h>
+#include <string.h>
+
+#include <glib/gstdio.h>
+#include <telepathy-glib/telepathy-glib.h>
+
+#include "mcd-debug.h"
+
+/* (source filename, source mtime, contents) */
+#define FILE_TYPE ((const GVariantType *) "(sx(asa{sa{sv}}))")
+
+static gchar *
+find_in_data_dirs (const gchar *subdir,
+    const gchar *basename)
+{
+  const gchar * const *system_dirs;
+  gchar *filename;
+
+  filename = g_build_filename (g_get_user_data_dir (), subdir, basename,
+      NULL);
+
+  if (g_file_test (filename, G_FILE_TEST_EXISTS))
+    return filename;
+
+  g_free (filename);
+
+  for (system_dirs = g_get_system_data_dirs ();
+      *system_dirs != NULL;
+      system_dirs++)
+    {
+      filename = g_build_filename (*system_dirs, subdir, basename, NULL);
+
+      if (g_file_test (filename, G_FILE_TEST_EXISTS))
+        return filename;
+
+      g_free (filename);
+    }
+
+  return NULL;
+}
+
+/*
+ * _mcd_manager_cache_find_source:
+ * @cm_name: the name of a connection manager, such as "gabble"
+ *
+ * Find the file whose modification invalidates anything we have cached
+ * about @cm_name. This searches for the .manager file in the same places
+ * as telepathy-glib, falling back to the D-Bus .service file.
+ *
+ * Returns: (transfer full): a filename, or %NULL if neither exists, in
+ *  which case there is nothing to validate a cache against
+ */
+gchar *
+_mcd_manager_cache_find_source (const gchar *cm_name)
+{
+  const gchar *env_data;
+  gchar *basename;
+  gchar *filename = NULL;
+
+  g_return_val_if_fail (cm_name != NULL, NULL);
+
+  basename = g_strdup_printf ("%s.manager", cm_name);
+  env_data = g_getenv ("TELEPATHY_DATA_PATH");
+
+  if (env_data != NULL)
+    {
+      gchar **path = g_strsplit (env_data, G_SEARCHPATH_SEPARATOR_S, 0);
+      gchar **iter;
+
+      for (iter = path; *iter != NULL && filename == NULL; iter++)
+        {
+          filename = g_build_filename (*iter, "managers", basename, NULL);
+
+          if (!g_file_test (filename, G_FILE_TEST_EXISTS))
+            tp_clear_pointer (&filename, g_free);
+        }
+
+      g_strfreev (path);
+    }
+
+  if (filename == NULL)
+    filename = find_in_data_dirs ("telepathy/managers", basename);
+
+  g_free (basename);
+
+  if (filename == NULL)
+    {
+      basename = g_strdup_printf ("%s%s.service", TP_CM_BUS_NAME_BASE,
+          cm_name);
+      filename = find_in_data_dirs ("dbus-1/services", basename);
+      g_free (basename);
+    }
+
+  return filename;
+}
+
+/*
+ * _mcd_manager_cache_dup_filename:
+ * @cm_name: the name of a connection manager
+ *
+ * Returns: (transfer full): where to cache information about @cm_name
+ */
+gchar *
+_mcd_manager_cache_dup_filename (const gchar *cm_name)
+{
+  gchar *basename = g_strdup_printf ("%s.cache", cm_name);
+  gchar *filename = g_build_filename (g_get_user_cache_dir (), "telepathy",
+      "mission-control", "managers", basename, NULL);
+
+  g_free (basename);
+  return filename;
+}
+
+static gboolean
+get_mtime (const gchar *filename,
+    gint64 *mtime)
+{
+  GStatBuf st;
+
+  if (g_stat (filename, &st) != 0)
+    return FALSE;
+
+  *mtime = st.st_mtime;
+  return TRUE;
+}
+
+/*
+ * _mcd_manager_cache_load:
+ * @filename: the cache file, from _mcd_manager_cache_dup_filename()
+ * @source: the file describing the CM, from
+ *  _mcd_manager_cache_find_source()
+ *
+ * Returns: (transfer full): the contents previously saved by
+ *  _mcd_manager_cache_save(), of type %MCD_MANAGER_CACHE_CONTENTS_TYPE,
+ *  or %NULL if there are none or they were saved for a different version
+ *  of @source
+ */
+GVariant *
+_mcd_manager_cache_load (const gchar *filename,
+    const gchar *source)
+{
+  gchar *data;
+  gsize len;
+  GVariant *file;
+  GVariant *contents = NULL;
+  const gchar *cached_source;
+  gint64 cached_mtime, mtime;
+
+  g_return_val_if_fail (filename != NULL, NULL);
+  g_return_val_if_fail (source != NULL, NULL);
+
+  if (!get_mtime (source, &mtime))
+    return NULL;
+
+  if (!g_file_get_contents (filename, &data, &len, NULL))
+    return NULL;
+
+  file = g_variant_ref_sink (g_variant_new_from_data (FILE_TYPE, data, len,
+        FALSE, g_free, data));
+
+  if (!g_variant_is_normal_form (file))
+    {
+      DEBUG ("ignoring corrupt cache file %s", filename);
+      goto finally;
+    }
+
+  g_variant_get (file, "(&sx@(asa{sa{sv}}))", &cached_source, &cached_mtime,
+      &contents);
+
+  if (tp_strdiff (cached_source, source) || cached_mtime != mtime)
+    {
+      DEBUG ("%s is out of date: it was for %s (%" G_GINT64_FORMAT ")",
+          filename, cached_source, cached_mtime);
+      tp_clear_pointer (&contents, g_variant_unref);
+    }
+
+finally:
+  g_variant_unref (file);
+  return contents;
+}
+
+/*
+ * _mcd_manager_cache_save:
+ * @filename: the cache file, from _mcd_manager_cache_dup_filename()
+ * @source: the file describing the CM, from
+ *  _mcd_manager_cache_find_source()
+ * @contents: a value of type %MCD_MANAGER_CACHE_CONTENTS_TYPE
+ * @error: used to raise an error if %FALSE is returned
+ *
+ * Save @contents, to be returned by _mcd_manager_cache_load() for as
+ * long as @source is not modified.
+ *
+ * Returns: %TRUE on success
+ */
+gboolean
+_mcd_manager_cache_save (const gchar *filename,
+    const gchar *source,
+    GVariant *contents,
+    GError **error)
+{
+  GVariant *file;
+  gchar *dir;
+  gint64 mtime;
+  gboolean ret;
+
+  g_return_val_if_fail (filename != NULL, FALSE);
+  g_return_val_if_fail (source != NULL, FALSE);
+  g_return_val_if_fail (g_variant_is_of_type (contents,
+        MCD_MANAGER_CACHE_CONTENTS_TYPE), FALSE);
+
+  if (!get_mtime (source, &mtime))
+    {
+      int e = errno;
+
+      g_set_error (error, G_FILE_ERROR, g_file_error_from_errno (e),
+          "Unable to stat %s: %s", source, g_strerror (e));
+      return FALSE;
+    }
+
+  dir = g_path_get_dirname (filename);
+
+  if (g_mkdir_with_parents (dir, 0700) != 0)
+    {
+      int e = errno;
+
+      g_set_error (error, G_FILE_ERROR, g_file_error_from_errno (e),
+          "Unable to create directory %s: %s", dir, g_strerror (e));
+      g_free (dir);
+      return FALSE;
+    }
+
+  g_free (dir);
+
+  file = g_variant_ref_sink (g_variant_new ("(sx@(asa{sa{sv}}))", source,
+        mtime, contents));
+  ret = g_file_set_contents (filename, g_variant_get_data (file),
+      g_variant_get_size (file), error);
+  g_variant_unref (file);
+
+  return ret;
+}
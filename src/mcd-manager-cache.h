@@ -0,0 +1,42 @@
+/*
+ * Persistent cache of connection managers' protocol descriptions
+ *
+ * Copyright © 2012 Collabora Ltd.
+ *
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public License
+ * version 2.1 as published by the Free Software Foundation.
+ *
+ * This library is distributed in the hope that it will be useful, but
+ * WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the GNU
+ * Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with this library; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin St, Fifth Floor, Boston, MA
+ * 02110-1301 USA
+ *
+ */
+
+#ifndef MCD_MANAGER_CACHE_H
+#define MCD_MANAGER_CACHE_H
+
+#include <glib.h>
+
+G_BEGIN_DECLS
+
+/* (interfaces, { protocol name => immutable properties }) */
+#define MCD_MANAGER_CACHE_CONTENTS_TYPE ((const GVariantType *) "(asa{sa{sv}})")
+
+G_GNUC_INTERNAL gchar *_mcd_manager_cache_find_source (const gchar *cm_name);
+G_GNUC_INTERNAL gchar *_mcd_manager_cache_dup_filename (const gchar *cm_name);
+
+G_GNUC_INTERNAL GVariant *_mcd_manager_cache_load (const gchar *filename,
+    const gchar *source);
+G_GNUC_INTERNAL gboolean _mcd_manager_cache_save (const gchar *filename,
+    const gchar *source, GVariant *contents, GError **error);
+
+G_END_DECLS
+
+#endif
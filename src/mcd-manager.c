@@ -38,6 +38,7 @@
 #include "config.h"
 #include "mcd-manager.h"
 #include "mcd-manager-priv.h"
+#include "mcd-manager-cache.h"
 #include "mcd-misc.h"
 #include "mcd-slacker.h"
 
@@ -48,6 +49,8 @@
 
 #include "mcd-connection.h"
 
+#include "_gen/interfaces.h"
+
 #define MANAGER_SUFFIX ".manager"
 
 #define MCD_MANAGER_PRIV(manager) (MCD_MANAGER (manager)->priv)
@@ -62,6 +65,11 @@ struct _McdManagerPrivate
     McdDispatcher *dispatcher;
 
     TpConnectionManager *tp_conn_mgr;
+    /* the file whose mtime validates our cache, or NULL */
+    gchar *cache_source;
+    /* owned gchar *protocol name => owned TpProtocol, built from the
+     * cache, or NULL if we prepared tp_conn_mgr instead */
+    GHashTable *cached_protocols;
 
     McdSlacker *slacker;
 
@@ -79,6 +87,152 @@ enum
 
 static GQuark readiness_quark = 0;
 
+/* The CM interfaces that MC cares about, and so needs to remember */
+static const gchar * const cached_interfaces[] = {
+    MC_IFACE_CONNECTION_MANAGER_INTERFACE_ACCOUNT_STORAGE,
+    NULL
+};
+
+static void
+mcd_manager_save_cache (McdManager *manager)
+{
+    McdManagerPrivate *priv = manager->priv;
+    GVariantBuilder interfaces, protocols;
+    GVariant *contents;
+    GError *error = NULL;
+    gchar **names;
+    gchar *filename;
+    guint i;
+
+    g_variant_builder_init (&interfaces, G_VARIANT_TYPE_STRING_ARRAY);
+
+    for (i = 0; cached_interfaces[i] != NULL; i++)
+    {
+        if (tp_proxy_has_interface (priv->tp_conn_mgr, cached_interfaces[i]))
+            g_variant_builder_add (&interfaces, "s", cached_interfaces[i]);
+    }
+
+    g_variant_builder_init (&protocols, G_VARIANT_TYPE ("a{sa{sv}}"));
+    names = tp_connection_manager_dup_protocol_names (priv->tp_conn_mgr);
+
+    for (i = 0; names != NULL && names[i] != NULL; i++)
+    {
+        TpProtocol *protocol = tp_connection_manager_get_protocol_object (
+            priv->tp_conn_mgr, names[i]);
+        GVariant *properties = NULL;
+
+        g_object_get (protocol,
+                      "protocol-properties-vardict", &properties,
+                      NULL);
+        g_variant_builder_add (&protocols, "{s@a{sv}}", names[i],
+                               properties);
+        g_variant_unref (properties);
+    }
+
+    g_strfreev (names);
+
+    contents = g_variant_ref_sink (g_variant_new ("(@as@a{sa{sv}})",
+        g_variant_builder_end (&interfaces),
+        g_variant_builder_end (&protocols)));
+    filename = _mcd_manager_cache_dup_filename (priv->name);
+
+    if (_mcd_manager_cache_save (filename, priv->cache_source, contents,
+                                 &error))
+    {
+        DEBUG ("saved %s for next time", filename);
+    }
+    else
+    {
+        DEBUG ("unable to save %s: %s", filename, error->message);
+        g_error_free (error);
+    }
+
+    g_free (filename);
+    g_variant_unref (contents);
+}
+
+/*
+ * Returns: %TRUE if the protocols and interfaces are now known without
+ *  having to prepare the #TpConnectionManager
+ */
+static gboolean
+mcd_manager_load_cache (McdManager *manager)
+{
+    McdManagerPrivate *priv = manager->priv;
+    GVariant *contents, *interfaces, *protocols, *properties;
+    GVariantIter iter;
+    const gchar *name;
+    gchar *filename;
+    gboolean ret = TRUE;
+
+    if (priv->cache_source == NULL)
+        return FALSE;
+
+    filename = _mcd_manager_cache_dup_filename (priv->name);
+    contents = _mcd_manager_cache_load (filename, priv->cache_source);
+    g_free (filename);
+
+    if (contents == NULL)
+        return FALSE;
+
+    g_variant_get (contents, "(@as@a{sa{sv}})", &interfaces, &protocols);
+
+    priv->cached_protocols = g_hash_table_new_full (g_str_hash, g_str_equal,
+                                                    g_free, g_object_unref);
+    g_variant_iter_init (&iter, protocols);
+
+    while (g_variant_iter_next (&iter, "{&s@a{sv}}", &name, &properties))
+    {
+        GError *error = NULL;
+        TpProtocol *protocol = tp_protocol_new_vardict (priv->dbus_daemon,
+            priv->name, name, properties, &error);
+
+        g_variant_unref (properties);
+
+        if (protocol == NULL)
+        {
+            DEBUG ("cached protocol %s/%s is unusable: %s", priv->name, name,
+                   error->message);
+            g_error_free (error);
+            tp_clear_pointer (&priv->cached_protocols, g_hash_table_unref);
+            ret = FALSE;
+            break;
+        }
+
+        g_hash_table_insert (priv->cached_protocols, g_strdup (name),
+                             protocol);
+    }
+
+    if (ret)
+    {
+        g_variant_iter_init (&iter, interfaces);
+
+        while (g_variant_iter_next (&iter, "&s", &name))
+            tp_proxy_add_interface_by_id ((TpProxy *) priv->tp_conn_mgr,
+                                          g_quark_from_string (name));
+    }
+
+    g_variant_unref (interfaces);
+    g_variant_unref (protocols);
+    g_variant_unref (contents);
+    return ret;
+}
+
+static gboolean
+manager_ready_from_cache_cb (gpointer user_data)
+{
+    McdManager *manager = MCD_MANAGER (user_data);
+
+    if (!manager->priv->is_disposed)
+    {
+        DEBUG ("manager %s is ready (from cache)", manager->priv->name);
+        manager->priv->ready = TRUE;
+        _mcd_object_ready (manager, readiness_quark, NULL);
+    }
+
+    return FALSE;
+}
+
 static void
 on_manager_ready (GObject *source_object,
                   GAsyncResult *result, gpointer user_data)
@@ -93,6 +247,12 @@ on_manager_ready (GObject *source_object,
     priv = manager->priv;
     DEBUG ("manager %s is ready", priv->name);
     priv->ready = TRUE;
+
+    if (error == NULL && priv->cache_source != NULL &&
+        tp_connection_manager_get_info_source (tp_conn_mgr) !=
+            TP_CM_INFO_SOURCE_NONE)
+        mcd_manager_save_cache (manager);
+
     _mcd_object_ready (manager, readiness_quark, error);
     g_clear_error (&error);
 }
@@ -103,6 +263,7 @@ _mcd_manager_finalize (GObject * object)
     McdManagerPrivate *priv = MCD_MANAGER_PRIV (object);
 
     g_free (priv->name);
+    g_free (priv->cache_source);
 
     G_OBJECT_CLASS (mcd_manager_parent_class)->finalize (object);
 }
@@ -126,6 +287,7 @@ _mcd_manager_dispose (GObject * object)
     tp_clear_object (&priv->client_factory);
     tp_clear_object (&priv->dbus_daemon);
     tp_clear_object (&priv->slacker);
+    tp_clear_pointer (&priv->cached_protocols, g_hash_table_unref);
 
     G_OBJECT_CLASS (mcd_manager_parent_class)->dispose (object);
 }
@@ -176,6 +338,18 @@ mcd_manager_setup (McdManager *manager)
         goto error;
     }
 
+    /* If nothing has changed since last time, don't bother reading the
+     * .manager file, or worse, activating the CM to introspect it. */
+    priv->cache_source = _mcd_manager_cache_find_source (priv->name);
+
+    if (mcd_manager_load_cache (manager))
+    {
+        DEBUG ("Manager %s created from cache", priv->name);
+        g_idle_add_full (G_PRIORITY_DEFAULT_IDLE, manager_ready_from_cache_cb,
+                         g_object_ref (manager), g_object_unref);
+        return TRUE;
+    }
+
     tp_proxy_prepare_async (priv->tp_conn_mgr, NULL, on_manager_ready, manager);
 
     DEBUG ("Manager %s created", priv->name);
@@ -342,6 +516,17 @@ mcd_manager_get_name (McdManager *manager)
     return priv->name;
 }
 
+static TpProtocol *
+mcd_manager_get_protocol_object (McdManager *manager,
+                                 const gchar *protocol)
+{
+    if (manager->priv->cached_protocols != NULL)
+        return g_hash_table_lookup (manager->priv->cached_protocols, protocol);
+
+    return tp_connection_manager_get_protocol_object (
+        manager->priv->tp_conn_mgr, protocol);
+}
+
 TpProtocol *
 _mcd_manager_dup_protocol (McdManager *manager,
                            const gchar *protocol)
@@ -350,8 +535,7 @@ _mcd_manager_dup_protocol (McdManager *manager,
     g_return_val_if_fail (MCD_IS_MANAGER (manager), NULL);
     g_return_val_if_fail (protocol != NULL, NULL);
 
-    p = tp_connection_manager_get_protocol_object (manager->priv->tp_conn_mgr,
-                                                   protocol);
+    p = mcd_manager_get_protocol_object (manager, protocol);
 
     if (p == NULL)
         return NULL;
@@ -363,17 +547,13 @@ const TpConnectionManagerParam *
 mcd_manager_get_protocol_param (McdManager *manager, const gchar *protocol,
                                 const gchar *param)
 {
-    McdManagerPrivate *priv;
     TpProtocol *cm_protocol;
 
     g_return_val_if_fail (MCD_IS_MANAGER (manager), NULL);
     g_return_val_if_fail (protocol != NULL, NULL);
     g_return_val_if_fail (param != NULL, NULL);
 
-    priv = manager->priv;
-
-    cm_protocol = tp_connection_manager_get_protocol_object (priv->tp_conn_mgr,
-                                                             protocol);
+    cm_protocol = mcd_manager_get_protocol_object (manager, protocol);
 
     if (cm_protocol == NULL)
         return NULL;
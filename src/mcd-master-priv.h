@@ -28,6 +28,7 @@
 #define MCD_MASTER_PRIV_H
 
 #include "mcd-master.h"
+#include "mcd-reconnect-scheduler.h"
 
 G_BEGIN_DECLS
 
@@ -36,5 +37,8 @@ G_GNUC_INTERNAL
 McdManager *_mcd_master_lookup_manager (McdMaster *master,
                                         const gchar *unique_name);
 
+G_GNUC_INTERNAL McdReconnectScheduler *_mcd_master_get_reconnect_scheduler (
+    McdMaster *master);
+
 G_END_DECLS
 #endif
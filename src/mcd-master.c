@@ -73,6 +73,8 @@
 #include "mcd-account-manager-priv.h"
 #include "mcd-account-conditions.h"
 #include "mcd-account-priv.h"
+#include "mcd-misc.h"
+#include "mcd-reconnect-scheduler.h"
 #include "plugin-loader.h"
 
 #ifdef G_OS_UNIX
@@ -92,6 +94,9 @@ struct _McdMasterPrivate
     TpDBusDaemon *dbus_daemon;
     TpSimpleClientFactory *client_factory;
 
+    /* Spreads out automatic connection attempts */
+    McdReconnectScheduler *reconnect_scheduler;
+
     /* Current pending sleep timer */
     gint shutdown_timeout_id;
 
@@ -173,6 +178,8 @@ _mcd_master_dispose (GObject * object)
     priv->is_disposed = TRUE;
 
     tp_clear_object (&priv->account_manager);
+    tp_clear_pointer (&priv->reconnect_scheduler,
+                      _mcd_reconnect_scheduler_unref);
     tp_clear_object (&priv->dbus_daemon);
     tp_clear_object (&priv->dispatcher);
     tp_clear_object (&priv->client_factory);
@@ -185,6 +192,26 @@ _mcd_master_dispose (GObject * object)
     G_OBJECT_CLASS (mcd_master_parent_class)->dispose (object);
 }
 
+static void
+_mcd_master_abort (McdMission *mission)
+{
+    McdMasterPrivate *priv = MCD_MASTER (mission)->priv;
+
+    /* Write out every account in full before we go, so that nothing has
+     * to be recovered from the storage journal on the next startup */
+    if (priv->account_manager != NULL)
+        mcd_account_manager_write_conf_async (priv->account_manager, NULL,
+                                              NULL, NULL);
+
+    MCD_MISSION_CLASS (mcd_master_parent_class)->abort (mission);
+}
+
+/* At most this many connection attempts in progress at once */
+#define DEFAULT_MAX_RECONNECT_ATTEMPTS 8
+/* Milliseconds by which to spread out attempts that would otherwise be
+ * simultaneous */
+#define DEFAULT_RECONNECT_JITTER 1000
+
 static GObject *
 mcd_master_constructor (GType type, guint n_params,
 			GObjectConstructParam *params)
@@ -204,6 +231,11 @@ mcd_master_constructor (GType type, guint n_params,
 #endif
 
     priv->client_factory = tp_simple_client_factory_new (priv->dbus_daemon);
+    priv->reconnect_scheduler = _mcd_reconnect_scheduler_new (
+        _mcd_get_uint_from_env ("MC_RECONNECT_MAX_ATTEMPTS",
+                                DEFAULT_MAX_RECONNECT_ATTEMPTS),
+        _mcd_get_uint_from_env ("MC_RECONNECT_JITTER",
+                                DEFAULT_RECONNECT_JITTER));
     priv->account_manager = mcd_account_manager_new (priv->client_factory);
 
     priv->dispatcher = mcd_dispatcher_new (priv->dbus_daemon, master);
@@ -223,8 +255,11 @@ static void
 mcd_master_class_init (McdMasterClass * klass)
 {
     GObjectClass *object_class = G_OBJECT_CLASS (klass);
+    McdMissionClass *mission_class = MCD_MISSION_CLASS (klass);
     g_type_class_add_private (object_class, sizeof (McdMasterPrivate));
 
+    mission_class->abort = _mcd_master_abort;
+
     object_class->constructor = mcd_master_constructor;
     object_class->get_property = _mcd_master_get_property;
     object_class->set_property = _mcd_master_set_property;
@@ -325,6 +360,20 @@ _mcd_master_lookup_manager (McdMaster *master,
     return manager;
 }
 
+/*
+ * _mcd_master_get_reconnect_scheduler:
+ * @master: the #McdMaster.
+ *
+ * Returns: (transfer none): the scheduler through which all automatic
+ * connection attempts should go
+ */
+McdReconnectScheduler *
+_mcd_master_get_reconnect_scheduler (McdMaster *master)
+{
+    g_return_val_if_fail (MCD_IS_MASTER (master), NULL);
+    return master->priv->reconnect_scheduler;
+}
+
 /**
  * mcd_master_get_dbus_daemon:
  * @master: the #McdMaster.
@@ -362,6 +411,12 @@ mcd_master_shutdown (McdMaster *self,
     g_return_if_fail (MCD_IS_MASTER (self));
     priv = self->priv;
 
+    /* the bus has gone, so nothing else will change: write out whatever
+     * the storage was still coalescing */
+    if (priv->account_manager != NULL)
+        mcd_storage_flush (mcd_account_manager_get_storage (
+            priv->account_manager));
+
     if(!priv->shutdown_timeout_id)
     {
         DEBUG ("MC will bail out because of \"%s\" out exit after %i",
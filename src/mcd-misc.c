@@ -220,6 +220,36 @@ _mcd_chmod_private (const gchar *filename)
     return ret;
 }
 
+/*
+ * _mcd_get_uint_from_env:
+ * @variable: an environment variable
+ * @fallback: the default
+ *
+ * Returns: the value of @variable as a non-negative decimal integer, or
+ *  @fallback if it is unset, empty or invalid
+ */
+guint
+_mcd_get_uint_from_env (const gchar *variable,
+                        guint fallback)
+{
+    const gchar *str = g_getenv (variable);
+    gchar *end;
+    guint64 value;
+
+    if (str == NULL || *str == '\0')
+        return fallback;
+
+    value = g_ascii_strtoull (str, &end, 10);
+
+    if (*end != '\0' || value > G_MAXUINT)
+    {
+        g_warning ("ignoring invalid %s=%s", variable, str);
+        return fallback;
+    }
+
+    return (guint) value;
+}
+
 gboolean
 mcd_nullable_variant_equal (GVariant *a,
                             GVariant *b)
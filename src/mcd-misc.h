@@ -55,6 +55,9 @@ gboolean mcd_ensure_directory (const gchar *dir, GError **error);
 
 G_GNUC_INTERNAL int _mcd_chmod_private (const gchar *filename);
 
+G_GNUC_INTERNAL guint _mcd_get_uint_from_env (const gchar *variable,
+                                              guint fallback);
+
 gboolean mcd_nullable_variant_equal (GVariant *a, GVariant *b);
 
 G_END_DECLS
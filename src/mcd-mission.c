@@ -68,6 +68,9 @@ G_DEFINE_TYPE (McdMission, mcd_mission, G_TYPE_OBJECT);
 typedef struct _McdMissionPrivate
 {
     McdMission *parent;
+    /* our handler for parent's "abort" signal; disconnecting by ID doesn't
+     * have to look through every child's handler */
+    gulong parent_abort_id;
 
     gboolean connected;
     gboolean is_disposed;
@@ -140,18 +143,17 @@ _mcd_mission_set_parent (McdMission * mission, McdMission * parent)
 
     DEBUG ("child = %p, parent = %p", mission, parent);
 
-    if (priv->parent)
+    if (priv->parent_abort_id != 0)
     {
-	g_signal_handlers_disconnect_by_func (priv->parent,
-					      on_parent_abort,
-					      mission);
+	g_signal_handler_disconnect (priv->parent, priv->parent_abort_id);
+	priv->parent_abort_id = 0;
     }
     
     if (parent)
     {
-	g_signal_connect (parent, "abort",
-			  G_CALLBACK (on_parent_abort),
-			  mission);
+	priv->parent_abort_id = g_signal_connect (parent, "abort",
+						  G_CALLBACK (on_parent_abort),
+						  mission);
 	g_object_ref (parent);
     }
     
@@ -181,11 +183,10 @@ _mcd_mission_dispose (GObject * object)
     priv->is_disposed = TRUE;
 
     DEBUG ("mission disposed %p", object);
-    if (priv->parent)
+    if (priv->parent_abort_id != 0)
     {
-	g_signal_handlers_disconnect_by_func (priv->parent,
-					      on_parent_abort,
-					      object);
+	g_signal_handler_disconnect (priv->parent, priv->parent_abort_id);
+	priv->parent_abort_id = 0;
     }
 
     tp_clear_object (&priv->parent);
@@ -53,7 +53,12 @@ G_DEFINE_TYPE (McdOperation, mcd_operation, MCD_TYPE_MISSION);
 
 typedef struct _McdOperationPrivate
 {
-    GList *missions;
+    /* owned McdMission *, most recently taken first; missions.head is what
+     * mcd_operation_get_missions() returns */
+    GQueue missions;
+    /* borrowed McdMission * => its borrowed GList * link in missions, so
+     * that removing a mission doesn't have to search for it */
+    GHashTable *links;
     gboolean is_disposed;
 } McdOperationPrivate;
 
@@ -85,6 +90,10 @@ _mcd_operation_disconnect_mission (McdMission *mission, McdOperation *operation)
 static void
 _mcd_operation_finalize (GObject * object)
 {
+    McdOperationPrivate *priv = MCD_OPERATION_PRIV (object);
+
+    g_hash_table_unref (priv->links);
+
     G_OBJECT_CLASS (mcd_operation_parent_class)->finalize (object);
 }
 
@@ -100,7 +109,7 @@ _mcd_operation_abort (McdOperation * operation)
     const GList *node;
     
     DEBUG ("Operation abort received, aborting all children");
-    node = MCD_OPERATION_PRIV (operation)->missions;
+    node = MCD_OPERATION_PRIV (operation)->missions.head;
     while (node)
     {
 	McdMission *mission = MCD_MISSION (node->data);
@@ -137,15 +146,15 @@ _mcd_operation_dispose (GObject * object)
     g_signal_handlers_disconnect_by_func (object,
 					  G_CALLBACK (_mcd_operation_abort),
 					  NULL);
-    if (priv->missions)
+    if (priv->missions.head)
     {
-	g_list_foreach (priv->missions,
+	g_list_foreach (priv->missions.head,
 			(GFunc) _mcd_operation_disconnect_mission,
 			object);
-	g_list_foreach (priv->missions, (GFunc) _mcd_operation_child_unref,
-			NULL);
-	g_list_free (priv->missions);
-	priv->missions = NULL;
+	g_list_foreach (priv->missions.head,
+			(GFunc) _mcd_operation_child_unref, NULL);
+	g_queue_clear (&priv->missions);
+	g_hash_table_remove_all (priv->links);
     }
     G_OBJECT_CLASS (mcd_operation_parent_class)->dispose (object);
 }
@@ -154,7 +163,7 @@ static void
 _mcd_operation_connect (McdMission * mission)
 {
     McdOperationPrivate *priv = MCD_OPERATION_PRIV (mission);
-    g_list_foreach (priv->missions, (GFunc) mcd_mission_connect, NULL);
+    g_list_foreach (priv->missions.head, (GFunc) mcd_mission_connect, NULL);
     MCD_MISSION_CLASS (mcd_operation_parent_class)->connect (mission);
 }
 
@@ -162,7 +171,8 @@ static void
 _mcd_operation_disconnect (McdMission * mission)
 {
     McdOperationPrivate *priv = MCD_OPERATION_PRIV (mission);
-    g_list_foreach (priv->missions, (GFunc) mcd_mission_disconnect, NULL);
+    g_list_foreach (priv->missions.head, (GFunc) mcd_mission_disconnect,
+		    NULL);
     MCD_MISSION_CLASS (mcd_operation_parent_class)->disconnect (mission);
 }
 
@@ -175,7 +185,10 @@ mcd_operation_take_mission (McdOperation * operation, McdMission * mission)
     g_return_if_fail (MCD_IS_MISSION (mission));
     priv = MCD_OPERATION_PRIV (operation);
 
-    priv->missions = g_list_prepend (priv->missions, mission);
+    g_return_if_fail (!g_hash_table_contains (priv->links, mission));
+
+    g_queue_push_head (&priv->missions, mission);
+    g_hash_table_insert (priv->links, mission, priv->missions.head);
     _mcd_mission_set_parent (mission, MCD_MISSION (operation));
 
     if (mcd_mission_is_connected (MCD_MISSION (operation)))
@@ -190,16 +203,19 @@ void
 mcd_operation_remove_mission (McdOperation * operation, McdMission * mission)
 {
     McdOperationPrivate *priv;
+    GList *link;
 
     g_return_if_fail (MCD_IS_OPERATION (operation));
     g_return_if_fail (MCD_IS_MISSION (mission));
     priv = MCD_OPERATION_PRIV (operation);
 
-    g_return_if_fail (g_list_find (priv->missions, mission) != NULL);
+    link = g_hash_table_lookup (priv->links, mission);
+    g_return_if_fail (link != NULL);
     
     _mcd_operation_disconnect_mission (mission, operation);
     
-    priv->missions = g_list_remove (priv->missions, mission);
+    g_hash_table_remove (priv->links, mission);
+    g_queue_delete_link (&priv->missions, link);
     _mcd_mission_set_parent (mission, NULL);
     
     g_signal_emit_by_name (G_OBJECT (operation), "mission-removed", mission);
@@ -247,7 +263,8 @@ static void
 mcd_operation_init (McdOperation * obj)
 {
     McdOperationPrivate *priv = MCD_OPERATION_PRIV (obj);
-    priv->missions = NULL;
+    g_queue_init (&priv->missions);
+    priv->links = g_hash_table_new (NULL, NULL);
     
     /* Listen to self abort so that we can propagate it to our
      * children
@@ -273,7 +290,7 @@ mcd_operation_get_missions (McdOperation * operation)
     g_return_val_if_fail (MCD_IS_OPERATION (operation), NULL);
     priv = MCD_OPERATION_PRIV (operation);
 
-    return priv->missions;
+    return priv->missions.head;
 }
 
 void
@@ -284,5 +301,5 @@ mcd_operation_foreach (McdOperation * operation, GFunc func, gpointer user_data)
     g_return_if_fail (MCD_IS_OPERATION (operation));
     priv = MCD_OPERATION_PRIV (operation);
 
-    g_list_foreach (priv->missions, (GFunc) func, user_data);
+    g_list_foreach (priv->missions.head, (GFunc) func, user_data);
 }
@@ -0,0 +1,300 @@
+/*
+ * Batching of property-change signals across objects
+ *
+ * Copyright © 2012 Collabora Ltd.
+ *
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License as published by the Free Software Foundation; either
+ * version 2.1 of the License, or (at your option) any later version.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with this library; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin St, Fifth Floor, Boston, MA  02110-1301  USA
+ */
+
+/*
+ * Each account used to have its own short timer for AccountPropertyChanged,
+ * and emitted early whenever a property changed twice before it fired; so
+ * changing the presence of every account at once meant a timer and at least
+ * one signal per account, and more if anything changed again meanwhile.
+ *
+ * Instead, the account manager has one of these. Changes to any object
+ * are collected here, keeping only the latest value of each property, and
+ * the first pending change arms a single timer; when it fires, every
+ * object with pending changes gets one signal, in the order in which they
+ * first changed. Further changes don't postpone the timer, so no change
+ * waits for longer than max_latency_ms.
+ */
+
+#include "config.h"
+
+#include "mcd-property-coalescer.h"
+
+#include <telepathy-glib/telepathy-glib.h>
+
+#include "mcd-debug.h"
+
+typedef struct
+{
+  /* owned */
+  GObject *object;
+  /* owned gchar * => slice-allocated GValue */
+  GHashTable *properties;
+  /* owned gchar * => itself: the properties that the old per-object
+   * timer would have been holding since its last signal */
+  GHashTable *old_keys;
+  /* number of signals the old per-object timer would have emitted, which
+   * emitted early whenever a property changed again */
+  guint n_old_signals;
+  /* borrowed link in McdPropertyCoalescer.order */
+  GList *link;
+} Pending;
+
+struct _McdPropertyCoalescer
+{
+  gint refcount;
+  guint max_latency_ms;
+  McdPropertyCoalescerEmitFunc emit;
+
+  /* borrowed GObject * => owned Pending * */
+  GHashTable *pending;
+  /* borrowed Pending *, in the order their objects first changed */
+  GQueue order;
+
+  /* source to emit everything, or 0 */
+  guint timer_id;
+
+  /* number of signals that per-object timers would have emitted, minus
+   * the number that actually were */
+  guint64 n_saved;
+};
+
+static void
+pending_free (gpointer p)
+{
+  Pending *pending = p;
+
+  g_hash_table_unref (pending->properties);
+  g_hash_table_unref (pending->old_keys);
+  g_object_unref (pending->object);
+  g_slice_free (Pending, pending);
+}
+
+/*
+ * @max_latency_ms: the longest that a change will wait before being
+ *  announced
+ * @emit: called to announce the changes to each object
+ */
+McdPropertyCoalescer *
+_mcd_property_coalescer_new (guint max_latency_ms,
+    McdPropertyCoalescerEmitFunc emit)
+{
+  McdPropertyCoalescer *self;
+
+  g_return_val_if_fail (emit != NULL, NULL);
+
+  self = g_slice_new0 (McdPropertyCoalescer);
+  self->refcount = 1;
+  self->max_latency_ms = max_latency_ms;
+  self->emit = emit;
+  self->pending = g_hash_table_new_full (NULL, NULL, NULL, pending_free);
+  g_queue_init (&self->order);
+
+  DEBUG ("announcing property changes within %ums", max_latency_ms);
+
+  return self;
+}
+
+McdPropertyCoalescer *
+_mcd_property_coalescer_ref (McdPropertyCoalescer *self)
+{
+  g_return_val_if_fail (self != NULL, NULL);
+  g_return_val_if_fail (self->refcount > 0, NULL);
+
+  self->refcount++;
+  return self;
+}
+
+/*
+ * Objects with pending changes are kept alive until their signal has been
+ * emitted, so the owner should call _mcd_property_coalescer_flush() before
+ * releasing its last reference.
+ */
+void
+_mcd_property_coalescer_unref (McdPropertyCoalescer *self)
+{
+  g_return_if_fail (self != NULL);
+  g_return_if_fail (self->refcount > 0);
+
+  if (--self->refcount > 0)
+    return;
+
+  if (self->timer_id != 0)
+    g_source_remove (self->timer_id);
+
+  g_queue_clear (&self->order);
+  g_hash_table_unref (self->pending);
+  g_slice_free (McdPropertyCoalescer, self);
+}
+
+static void
+emit_pending (McdPropertyCoalescer *self,
+    Pending *pending)
+{
+  /* take it out first: emitting might change the object again */
+  g_queue_delete_link (&self->order, pending->link);
+  g_hash_table_steal (self->pending, pending->object);
+
+  self->n_saved += pending->n_old_signals - 1;
+  self->emit (pending->object, pending->properties);
+  pending_free (pending);
+}
+
+static gboolean
+timer_cb (gpointer user_data)
+{
+  McdPropertyCoalescer *self = user_data;
+  guint n_signals = self->order.length;
+  guint i;
+
+  self->timer_id = 0;
+
+  /* only what was already pending: an object that is changed by a signal
+   * handler goes on the end of the queue, and arms a new timer */
+  for (i = 0; i < n_signals; i++)
+    emit_pending (self, g_queue_peek_head (&self->order));
+
+  DEBUG ("emitted %u signals, %" G_GUINT64_FORMAT " saved so far",
+      n_signals, self->n_saved);
+
+  return FALSE;
+}
+
+/*
+ * _mcd_property_coalescer_add:
+ * @self: the coalescer
+ * @object: the object whose property has changed
+ * @key: the property's name
+ * @value: its new value
+ *
+ * Announce, soon, that @object's @key is now @value. If it already had a
+ * pending change, the new value replaces it.
+ */
+void
+_mcd_property_coalescer_add (McdPropertyCoalescer *self,
+    GObject *object,
+    const gchar *key,
+    const GValue *value)
+{
+  Pending *pending;
+
+  g_return_if_fail (self != NULL);
+  g_return_if_fail (G_IS_OBJECT (object));
+  g_return_if_fail (key != NULL);
+  g_return_if_fail (G_IS_VALUE (value));
+
+  pending = g_hash_table_lookup (self->pending, object);
+
+  if (pending == NULL)
+    {
+      pending = g_slice_new0 (Pending);
+      pending->object = g_object_ref (object);
+      pending->properties = g_hash_table_new_full (g_str_hash, g_str_equal,
+          g_free, (GDestroyNotify) tp_g_value_slice_free);
+      pending->old_keys = g_hash_table_new_full (g_str_hash, g_str_equal,
+          g_free, NULL);
+      pending->n_old_signals = 1;
+      g_queue_push_tail (&self->order, pending);
+      pending->link = g_queue_peek_tail_link (&self->order);
+      g_hash_table_insert (self->pending, object, pending);
+    }
+
+  g_hash_table_insert (pending->properties, g_strdup (key),
+      tp_g_value_slice_dup (value));
+
+  if (g_hash_table_contains (pending->old_keys, key))
+    {
+      pending->n_old_signals++;
+      g_hash_table_remove_all (pending->old_keys);
+    }
+
+  g_hash_table_add (pending->old_keys, g_strdup (key));
+
+  if (self->timer_id == 0)
+    self->timer_id = g_timeout_add (self->max_latency_ms, timer_cb, self);
+}
+
+/*
+ * _mcd_property_coalescer_flush_object:
+ * @self: the coalescer
+ * @object: an object
+ *
+ * If @object has pending changes, announce them now.
+ */
+void
+_mcd_property_coalescer_flush_object (McdPropertyCoalescer *self,
+    GObject *object)
+{
+  Pending *pending;
+
+  g_return_if_fail (self != NULL);
+
+  pending = g_hash_table_lookup (self->pending, object);
+
+  if (pending != NULL)
+    emit_pending (self, pending);
+
+  if (self->order.length == 0 && self->timer_id != 0)
+    {
+      g_source_remove (self->timer_id);
+      self->timer_id = 0;
+    }
+}
+
+/*
+ * _mcd_property_coalescer_flush:
+ * @self: the coalescer
+ *
+ * Announce all pending changes now.
+ */
+void
+_mcd_property_coalescer_flush (McdPropertyCoalescer *self)
+{
+  g_return_if_fail (self != NULL);
+
+  while (self->order.length > 0)
+    emit_pending (self, g_queue_peek_head (&self->order));
+
+  if (self->timer_id != 0)
+    {
+      g_source_remove (self->timer_id);
+      self->timer_id = 0;
+    }
+}
+
+/*
+ * Returns: the number of objects with changes waiting to be announced
+ */
+guint
+_mcd_property_coalescer_get_n_pending (McdPropertyCoalescer *self)
+{
+  g_return_val_if_fail (self != NULL, 0);
+  return self->order.length;
+}
+
+/*
+ * Returns: how many fewer signals have been emitted than if each object
+ *  had its own timer, emitting early whenever a property changed again
+ */
+guint64
+_mcd_property_coalescer_get_n_saved (McdPropertyCoalescer *self)
+{
+  g_return_val_if_fail (self != NULL, 0);
+  return self->n_saved;
+}
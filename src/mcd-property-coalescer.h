@@ -0,0 +1,68 @@
+/*
+ * Batching of property-change signals across objects
+ *
+ * Copyright © 2012 Collabora Ltd.
+ *
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License as published by the Free Software Foundation; either
+ * version 2.1 of the License, or (at your option) any later version.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with this library; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin St, Fifth Floor, Boston, MA  02110-1301  USA
+ */
+
+#ifndef MCD_PROPERTY_COALESCER_H
+#define MCD_PROPERTY_COALESCER_H
+
+#include <glib-object.h>
+
+G_BEGIN_DECLS
+
+typedef struct _McdPropertyCoalescer McdPropertyCoalescer;
+
+/*
+ * McdPropertyCoalescerEmitFunc:
+ * @object: an object passed to _mcd_property_coalescer_add()
+ * @properties: (element-type utf8 GValue): the latest value of each
+ *  property of @object that has changed
+ *
+ * Emit a single signal announcing that @properties have changed.
+ */
+typedef void (*McdPropertyCoalescerEmitFunc) (GObject *object,
+    GHashTable *properties);
+
+G_GNUC_INTERNAL
+McdPropertyCoalescer *_mcd_property_coalescer_new (guint max_latency_ms,
+    McdPropertyCoalescerEmitFunc emit);
+G_GNUC_INTERNAL
+McdPropertyCoalescer *_mcd_property_coalescer_ref (
+    McdPropertyCoalescer *self);
+G_GNUC_INTERNAL
+void _mcd_property_coalescer_unref (McdPropertyCoalescer *self);
+
+G_GNUC_INTERNAL
+void _mcd_property_coalescer_add (McdPropertyCoalescer *self,
+    GObject *object,
+    const gchar *key,
+    const GValue *value);
+G_GNUC_INTERNAL
+void _mcd_property_coalescer_flush_object (McdPropertyCoalescer *self,
+    GObject *object);
+G_GNUC_INTERNAL
+void _mcd_property_coalescer_flush (McdPropertyCoalescer *self);
+
+G_GNUC_INTERNAL
+guint _mcd_property_coalescer_get_n_pending (McdPropertyCoalescer *self);
+G_GNUC_INTERNAL
+guint64 _mcd_property_coalescer_get_n_saved (McdPropertyCoalescer *self);
+
+G_END_DECLS
+
+#endif /* MCD_PROPERTY_COALESCER_H */
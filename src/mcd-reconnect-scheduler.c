@@ -0,0 +1,472 @@
+/*
+ * Rate-limited scheduling of automatic connection attempts
+ *
+ * Copyright © 2012 Collabora Ltd.
+ *
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License as published by the Free Software Foundation; either
+ * version 2.1 of the License, or (at your option) any later version.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with this library; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin St, Fifth Floor, Boston, MA  02110-1301  USA
+ */
+
+/*
+ * When the network comes back, or a connection manager crashes, every
+ * affected account wants to connect at once; if there are many of them,
+ * they all hit the connection manager and the servers together, and if
+ * that fails, their identical back-off timers bring them back together
+ * again. Instead, each automatic attempt is registered here under a key
+ * (the account or connection that wants it), with the delay it would
+ * have used. The scheduler adds random jitter to that delay, and once
+ * it has expired, starts the attempt only if fewer than max_attempts are
+ * already in progress.
+ *
+ * When choosing between attempts that are ready, accounts that were
+ * online recently go first, since they're the ones people are using;
+ * then attempts in the group (connection manager and protocol) with the
+ * fewest attempts already in progress, so that one busy server can't
+ * starve the rest; then whichever has been waiting longest.
+ *
+ * Attempts are only ever started from a main-loop callback, never from
+ * inside _mcd_reconnect_scheduler_add() or _finished(), so callers don't
+ * have to worry about re-entrancy.
+ */
+
+#include "config.h"
+
+#include "mcd-reconnect-scheduler.h"
+
+#include "mcd-debug.h"
+
+/* If an attempt hasn't been reported as finished after this long, assume
+ * its owner forgot, and let something else have its slot */
+#define ATTEMPT_TIMEOUT_SEC 60
+
+typedef struct
+{
+  McdReconnectScheduler *scheduler;
+  gpointer key;
+  gchar *group;
+  gboolean recently_online;
+  /* monotonic time in microseconds after which it may start */
+  gint64 due;
+  McdReconnectFunc func;
+  gpointer user_data;
+  /* while running: source to give up on it, or 0 */
+  guint timeout_id;
+} Entry;
+
+struct _McdReconnectScheduler
+{
+  gint refcount;
+  /* 0 for no limit */
+  guint max_attempts;
+  guint max_jitter_ms;
+
+  /* owned Entry *, in the order they were added */
+  GQueue waiting;
+  /* borrowed key => borrowed GList * in @waiting */
+  GHashTable *waiting_by_key;
+  /* borrowed key => owned Entry * */
+  GHashTable *running;
+  /* owned gchar *group => number of running entries in it */
+  GHashTable *running_per_group;
+
+  /* source to start the next attempts, or 0 */
+  guint timer_id;
+  /* TRUE while starting attempts */
+  gboolean admitting;
+};
+
+static void
+entry_free (gpointer p)
+{
+  Entry *entry = p;
+
+  if (entry->timeout_id != 0)
+    g_source_remove (entry->timeout_id);
+
+  g_free (entry->group);
+  g_slice_free (Entry, entry);
+}
+
+/*
+ * @max_attempts: the maximum number of attempts that can be in progress
+ *  at once, or 0 for no limit
+ * @max_jitter_ms: the maximum random delay to add to attempts that would
+ *  otherwise happen immediately; attempts that are delayed anyway get up
+ *  to a quarter of their delay, if that's more
+ */
+McdReconnectScheduler *
+_mcd_reconnect_scheduler_new (guint max_attempts,
+    guint max_jitter_ms)
+{
+  McdReconnectScheduler *self = g_slice_new0 (McdReconnectScheduler);
+
+  self->refcount = 1;
+  self->max_attempts = max_attempts;
+  self->max_jitter_ms = max_jitter_ms;
+  g_queue_init (&self->waiting);
+  self->waiting_by_key = g_hash_table_new (NULL, NULL);
+  self->running = g_hash_table_new_full (NULL, NULL, NULL, entry_free);
+  self->running_per_group = g_hash_table_new_full (g_str_hash, g_str_equal,
+      g_free, NULL);
+
+  DEBUG ("at most %u simultaneous attempts (0 = unlimited), jitter %ums",
+      max_attempts, max_jitter_ms);
+
+  return self;
+}
+
+McdReconnectScheduler *
+_mcd_reconnect_scheduler_ref (McdReconnectScheduler *self)
+{
+  g_return_val_if_fail (self != NULL, NULL);
+  g_return_val_if_fail (self->refcount > 0, NULL);
+
+  self->refcount++;
+  return self;
+}
+
+void
+_mcd_reconnect_scheduler_unref (McdReconnectScheduler *self)
+{
+  g_return_if_fail (self != NULL);
+  g_return_if_fail (self->refcount > 0);
+
+  if (--self->refcount > 0)
+    return;
+
+  if (self->timer_id != 0)
+    g_source_remove (self->timer_id);
+
+  g_queue_foreach (&self->waiting, (GFunc) entry_free, NULL);
+  g_queue_clear (&self->waiting);
+  g_hash_table_unref (self->waiting_by_key);
+  g_hash_table_unref (self->running);
+  g_hash_table_unref (self->running_per_group);
+  g_slice_free (McdReconnectScheduler, self);
+}
+
+static gboolean
+is_full (McdReconnectScheduler *self)
+{
+  return (self->max_attempts != 0 &&
+      g_hash_table_size (self->running) >= self->max_attempts);
+}
+
+static guint
+count_running (McdReconnectScheduler *self,
+    const gchar *group)
+{
+  return GPOINTER_TO_UINT (g_hash_table_lookup (self->running_per_group,
+        group));
+}
+
+/* Returns: the link in @waiting of the attempt that should start next,
+ * or %NULL if none are due */
+static GList *
+pick_next (McdReconnectScheduler *self,
+    gint64 now)
+{
+  GList *best = NULL;
+  guint best_running = 0;
+  GList *link;
+
+  for (link = self->waiting.head; link != NULL; link = link->next)
+    {
+      Entry *entry = link->data;
+      Entry *best_entry;
+      guint running;
+
+      if (entry->due > now)
+        continue;
+
+      running = count_running (self, entry->group);
+
+      if (best == NULL)
+        goto take;
+
+      best_entry = best->data;
+
+      if (entry->recently_online != best_entry->recently_online)
+        {
+          if (entry->recently_online)
+            goto take;
+
+          continue;
+        }
+
+      if (running != best_running)
+        {
+          if (running < best_running)
+            goto take;
+
+          continue;
+        }
+
+      if (entry->due >= best_entry->due)
+        continue;
+
+take:
+      best = link;
+      best_running = running;
+    }
+
+  return best;
+}
+
+static gboolean
+timer_cb (gpointer user_data);
+
+static void
+reschedule (McdReconnectScheduler *self)
+{
+  gint64 now;
+  gint64 next_due = G_MAXINT64;
+  GList *link;
+
+  /* we'll come back here when we've finished */
+  if (self->admitting)
+    return;
+
+  if (self->timer_id != 0)
+    {
+      g_source_remove (self->timer_id);
+      self->timer_id = 0;
+    }
+
+  /* if we're full, the next attempt to finish will call us again */
+  if (g_queue_is_empty (&self->waiting) || is_full (self))
+    return;
+
+  for (link = self->waiting.head; link != NULL; link = link->next)
+    {
+      Entry *entry = link->data;
+
+      next_due = MIN (next_due, entry->due);
+    }
+
+  now = g_get_monotonic_time ();
+
+  if (next_due <= now)
+    self->timer_id = g_timeout_add (0, timer_cb, self);
+  else
+    self->timer_id = g_timeout_add ((next_due - now + 999) / 1000,
+        timer_cb, self);
+}
+
+static gboolean
+attempt_timed_out_cb (gpointer user_data)
+{
+  Entry *entry = user_data;
+
+  DEBUG ("attempt for %p has taken more than %us, no longer counting it",
+      entry->key, ATTEMPT_TIMEOUT_SEC);
+  entry->timeout_id = 0;
+  _mcd_reconnect_scheduler_finished (entry->scheduler, entry->key);
+  return FALSE;
+}
+
+static void
+admit (McdReconnectScheduler *self)
+{
+  GList *link;
+  gint64 now = g_get_monotonic_time ();
+
+  g_assert (!self->admitting);
+  _mcd_reconnect_scheduler_ref (self);
+  self->admitting = TRUE;
+
+  while (!is_full (self) && (link = pick_next (self, now)) != NULL)
+    {
+      Entry *entry = link->data;
+      gpointer key = entry->key;
+
+      g_queue_delete_link (&self->waiting, link);
+      g_hash_table_remove (self->waiting_by_key, key);
+
+      g_hash_table_insert (self->running, key, entry);
+      g_hash_table_insert (self->running_per_group, g_strdup (entry->group),
+          GUINT_TO_POINTER (count_running (self, entry->group) + 1));
+      entry->timeout_id = g_timeout_add_seconds (ATTEMPT_TIMEOUT_SEC,
+          attempt_timed_out_cb, entry);
+
+      DEBUG ("starting attempt for %p (%s%s), %u in progress, %u waiting",
+          key, entry->group,
+          entry->recently_online ? ", recently online" : "",
+          g_hash_table_size (self->running),
+          g_queue_get_length (&self->waiting));
+
+      /* @entry might not survive this */
+      if (!entry->func (entry->user_data))
+        _mcd_reconnect_scheduler_finished (self, key);
+
+      now = g_get_monotonic_time ();
+    }
+
+  self->admitting = FALSE;
+  reschedule (self);
+  _mcd_reconnect_scheduler_unref (self);
+}
+
+static gboolean
+timer_cb (gpointer user_data)
+{
+  McdReconnectScheduler *self = user_data;
+
+  self->timer_id = 0;
+  admit (self);
+  return FALSE;
+}
+
+/*
+ * @key: the account or connection that wants to connect; if it already
+ *  has an attempt waiting, that attempt is replaced, but starts no later
+ *  than it would have
+ * @group: attempts in the same group share a connection manager and
+ *  server, and are spread out
+ * @delay_ms: how long to wait before the attempt, before adding jitter
+ * @recently_online: %TRUE if this attempt should go ahead of others
+ * @func: called to start the attempt
+ * @user_data: passed to @func
+ */
+void
+_mcd_reconnect_scheduler_add (McdReconnectScheduler *self,
+    gpointer key,
+    const gchar *group,
+    guint delay_ms,
+    gboolean recently_online,
+    McdReconnectFunc func,
+    gpointer user_data)
+{
+  GList *link;
+  Entry *entry;
+  guint max_jitter;
+  guint jitter = 0;
+  gint64 due;
+
+  g_return_if_fail (self != NULL);
+  g_return_if_fail (key != NULL);
+  g_return_if_fail (group != NULL);
+  g_return_if_fail (func != NULL);
+
+  /* if it's asking again, its previous attempt is over */
+  if (g_hash_table_contains (self->running, key))
+    _mcd_reconnect_scheduler_finished (self, key);
+
+  max_jitter = MAX (self->max_jitter_ms, delay_ms / 4);
+
+  if (max_jitter > 0)
+    jitter = g_random_int_range (0, max_jitter + 1);
+
+  due = g_get_monotonic_time () + ((gint64) delay_ms + jitter) * 1000;
+
+  link = g_hash_table_lookup (self->waiting_by_key, key);
+
+  if (link != NULL)
+    {
+      entry = link->data;
+      g_free (entry->group);
+      entry->due = MIN (entry->due, due);
+      entry->recently_online = entry->recently_online || recently_online;
+    }
+  else
+    {
+      entry = g_slice_new0 (Entry);
+      entry->scheduler = self;
+      entry->key = key;
+      entry->due = due;
+      entry->recently_online = recently_online;
+      g_queue_push_tail (&self->waiting, entry);
+      g_hash_table_insert (self->waiting_by_key, key, self->waiting.tail);
+    }
+
+  entry->group = g_strdup (group);
+  entry->func = func;
+  entry->user_data = user_data;
+
+  DEBUG ("%p (%s) may try to connect in %ums", key, group,
+      delay_ms + jitter);
+
+  reschedule (self);
+}
+
+/*
+ * Forget about @key's waiting attempt, if any. An attempt that has
+ * already started still counts until _mcd_reconnect_scheduler_finished().
+ */
+void
+_mcd_reconnect_scheduler_cancel (McdReconnectScheduler *self,
+    gpointer key)
+{
+  GList *link;
+
+  g_return_if_fail (self != NULL);
+
+  link = g_hash_table_lookup (self->waiting_by_key, key);
+
+  if (link == NULL)
+    return;
+
+  DEBUG ("%p no longer wants to connect", key);
+  g_hash_table_remove (self->waiting_by_key, key);
+  entry_free (link->data);
+  g_queue_delete_link (&self->waiting, link);
+  reschedule (self);
+}
+
+/*
+ * Release the slot held by @key's attempt, which has succeeded or failed.
+ * It's OK to call this when @key has no attempt in progress.
+ */
+void
+_mcd_reconnect_scheduler_finished (McdReconnectScheduler *self,
+    gpointer key)
+{
+  Entry *entry;
+  guint running;
+
+  g_return_if_fail (self != NULL);
+
+  entry = g_hash_table_lookup (self->running, key);
+
+  if (entry == NULL)
+    return;
+
+  running = count_running (self, entry->group);
+  g_assert (running > 0);
+
+  if (running > 1)
+    g_hash_table_insert (self->running_per_group, g_strdup (entry->group),
+        GUINT_TO_POINTER (running - 1));
+  else
+    g_hash_table_remove (self->running_per_group, entry->group);
+
+  g_hash_table_remove (self->running, key);
+  reschedule (self);
+}
+
+guint
+_mcd_reconnect_scheduler_get_n_waiting (McdReconnectScheduler *self)
+{
+  g_return_val_if_fail (self != NULL, 0);
+
+  return g_queue_get_length (&self->waiting);
+}
+
+guint
+_mcd_reconnect_scheduler_get_n_running (McdReconnectScheduler *self)
+{
+  g_return_val_if_fail (self != NULL, 0);
+
+  return g_hash_table_size (self->running);
+}
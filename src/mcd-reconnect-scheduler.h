@@ -0,0 +1,73 @@
+/*
+ * Rate-limited scheduling of automatic connection attempts
+ *
+ * Copyright © 2012 Collabora Ltd.
+ *
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License as published by the Free Software Foundation; either
+ * version 2.1 of the License, or (at your option) any later version.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with this library; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin St, Fifth Floor, Boston, MA  02110-1301  USA
+ */
+
+#ifndef MCD_RECONNECT_SCHEDULER_H
+#define MCD_RECONNECT_SCHEDULER_H
+
+#include <glib.h>
+
+G_BEGIN_DECLS
+
+typedef struct _McdReconnectScheduler McdReconnectScheduler;
+
+/*
+ * McdReconnectFunc:
+ * @user_data: the data passed to _mcd_reconnect_scheduler_add()
+ *
+ * Start a connection attempt.
+ *
+ * Returns: %TRUE if an attempt was started, in which case it occupies a
+ *  slot until _mcd_reconnect_scheduler_finished() is called for its key;
+ *  %FALSE if there was nothing to do
+ */
+typedef gboolean (*McdReconnectFunc) (gpointer user_data);
+
+G_GNUC_INTERNAL
+McdReconnectScheduler *_mcd_reconnect_scheduler_new (guint max_attempts,
+    guint max_jitter_ms);
+G_GNUC_INTERNAL
+McdReconnectScheduler *_mcd_reconnect_scheduler_ref (
+    McdReconnectScheduler *self);
+G_GNUC_INTERNAL
+void _mcd_reconnect_scheduler_unref (McdReconnectScheduler *self);
+
+G_GNUC_INTERNAL
+void _mcd_reconnect_scheduler_add (McdReconnectScheduler *self,
+    gpointer key,
+    const gchar *group,
+    guint delay_ms,
+    gboolean recently_online,
+    McdReconnectFunc func,
+    gpointer user_data);
+G_GNUC_INTERNAL
+void _mcd_reconnect_scheduler_cancel (McdReconnectScheduler *self,
+    gpointer key);
+G_GNUC_INTERNAL
+void _mcd_reconnect_scheduler_finished (McdReconnectScheduler *self,
+    gpointer key);
+
+G_GNUC_INTERNAL
+guint _mcd_reconnect_scheduler_get_n_waiting (McdReconnectScheduler *self);
+G_GNUC_INTERNAL
+guint _mcd_reconnect_scheduler_get_n_running (McdReconnectScheduler *self);
+
+G_END_DECLS
+
+#endif /* MCD_RECONNECT_SCHEDULER_H */
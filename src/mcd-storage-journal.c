@@ -0,0 +1,526 @@
+/*
+ * Append-only journal of keyfile changes, replayed on top of a snapshot
+ *
+ * Copyright © 2010 Nokia Corporation
+ * Copyright © 2010 Collabora Ltd.
+ *
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License as published by the Free Software Foundation; either
+ * version 2.1 of the License, or (at your option) any later version.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with this library; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin St, Fifth Floor, Boston, MA  02110-1301  USA
+ */
+
+/*
+ * The journal is a text file with one record per line:
+ *
+ *   S <tab> account <tab> key <tab> escaped value    -- set a key
+ *   D <tab> account <tab> key                        -- delete a key
+ *   R <tab> account                                  -- delete an account
+ *   C                                                -- end of a batch
+ *   A                                                -- abandon the batch
+ *
+ * Values are already escaped as if for a GKeyFile, so they never contain
+ * a newline. Records are only ever appended, and each batch is followed by
+ * a single fdatasync(), so after a crash the journal is a prefix of what
+ * was written. Only batches that end with their C record are replayed, so
+ * a batch (for instance, all the changes in one McdStorageTransaction)
+ * either reaches the keyfile completely or not at all. Replaying a record
+ * twice has no further effect, so it is safe to crash between writing a
+ * new snapshot and resetting the journal.
+ *
+ * Anything after the last C is cut off before we append to the journal
+ * again, so that the next batch cannot be run together with it. If that
+ * fails, the next batch starts with an A record on a line of its own,
+ * which tells the replay to discard the partial batch before it.
+ */
+
+#include "config.h"
+
+#include "mcd-storage-journal.h"
+
+#include <errno.h>
+#include <fcntl.h>
+#include <string.h>
+#include <unistd.h>
+
+#include <glib/gstdio.h>
+
+#include <telepathy-glib/telepathy-glib.h>
+
+#include "mcd-debug.h"
+
+struct _McdStorageJournal {
+    gchar *filename;
+    /* records not yet written out */
+    GString *pending;
+    /* bytes on disk up to the end of the last complete batch, plus those
+     * taken by mcd_storage_journal_take_batch() to be written */
+    gsize size;
+    /* TRUE if the file might continue past its last complete batch with
+     * part of another; only touched by whoever is writing */
+    gboolean torn;
+};
+
+McdStorageJournal *
+mcd_storage_journal_new (const gchar *filename)
+{
+  McdStorageJournal *self;
+  GStatBuf buf;
+
+  g_return_val_if_fail (filename != NULL, NULL);
+
+  self = g_slice_new0 (McdStorageJournal);
+  self->filename = g_strdup (filename);
+  self->pending = g_string_new ("");
+
+  if (g_stat (filename, &buf) == 0)
+    self->size = buf.st_size;
+
+  return self;
+}
+
+void
+mcd_storage_journal_free (McdStorageJournal *self)
+{
+  g_return_if_fail (self != NULL);
+
+  g_string_free (self->pending, TRUE);
+  g_free (self->filename);
+  g_slice_free (McdStorageJournal, self);
+}
+
+/*
+ * mcd_storage_journal_append:
+ * @account: the account
+ * @key: (allow-none): the key, or %NULL to delete the whole account
+ * @escaped: (allow-none): the keyfile-escaped value, or %NULL to delete @key
+ *
+ * Queue a change to be written by the next mcd_storage_journal_flush(), or
+ * taken by the next mcd_storage_journal_take_batch().
+ *
+ * Returns: %FALSE if the change cannot be represented in the journal, in
+ *  which case the caller must write a full snapshot instead
+ */
+gboolean
+mcd_storage_journal_append (McdStorageJournal *self,
+    const gchar *account,
+    const gchar *key,
+    const gchar *escaped)
+{
+  g_return_val_if_fail (self != NULL, FALSE);
+  g_return_val_if_fail (account != NULL, FALSE);
+
+  if (strpbrk (account, "\t\r\n") != NULL ||
+      (key != NULL && strpbrk (key, "\t\r\n") != NULL) ||
+      (escaped != NULL && strpbrk (escaped, "\r\n") != NULL))
+    {
+      DEBUG ("%s.%s cannot be journalled", account,
+          key == NULL ? "(all keys)" : key);
+      return FALSE;
+    }
+
+  if (key == NULL)
+    g_string_append_printf (self->pending, "R\t%s\n", account);
+  else if (escaped == NULL)
+    g_string_append_printf (self->pending, "D\t%s\t%s\n", account, key);
+  else
+    g_string_append_printf (self->pending, "S\t%s\t%s\t%s\n", account, key,
+        escaped);
+
+  return TRUE;
+}
+
+gboolean
+mcd_storage_journal_has_pending (McdStorageJournal *self)
+{
+  g_return_val_if_fail (self != NULL, FALSE);
+
+  return (self->pending->len > 0);
+}
+
+gsize
+mcd_storage_journal_get_size (McdStorageJournal *self)
+{
+  g_return_val_if_fail (self != NULL, 0);
+
+  return self->size;
+}
+
+static gboolean
+write_all (int fd,
+    const gchar *data,
+    gsize remaining)
+{
+  while (remaining > 0)
+    {
+      gssize written = write (fd, data, remaining);
+
+      if (written < 0)
+        {
+          if (errno == EINTR)
+            continue;
+
+          return FALSE;
+        }
+
+      data += written;
+      remaining -= written;
+    }
+
+  return TRUE;
+}
+
+/* Cut off whatever a failed write left after the last complete batch. */
+static void
+discard_partial_batch (McdStorageJournal *self,
+    int fd,
+    off_t good)
+{
+  if (ftruncate (fd, good) == 0)
+    return;
+
+  DEBUG ("Unable to truncate %s to %" G_GINT64_FORMAT " bytes: %s",
+      self->filename, (gint64) good, g_strerror (errno));
+  self->torn = TRUE;
+}
+
+/*
+ * mcd_storage_journal_take_batch:
+ *
+ * Take every pending record, to be written by
+ * mcd_storage_journal_write_batch(). They are counted towards
+ * mcd_storage_journal_get_size() straight away.
+ *
+ * Returns: (transfer full): the batch, or %NULL if nothing is pending
+ */
+GBytes *
+mcd_storage_journal_take_batch (McdStorageJournal *self)
+{
+  GString *batch;
+
+  g_return_val_if_fail (self != NULL, NULL);
+
+  if (self->pending->len == 0)
+    return NULL;
+
+  batch = self->pending;
+  self->pending = g_string_new ("");
+  g_string_append (batch, "C\n");
+  self->size += batch->len;
+  return g_string_free_to_bytes (batch);
+}
+
+/*
+ * mcd_storage_journal_write_batch:
+ * @batch: the result of mcd_storage_journal_take_batch()
+ *
+ * Append @batch to the journal file, then wait for it to reach the disk.
+ * If this fails, the partial batch is discarded, and the caller should
+ * write a snapshot and call mcd_storage_journal_reset().
+ *
+ * This blocks, so it may be called from another thread; but batches
+ * must be written one at a time, in the order they were taken, and not
+ * at the same time as mcd_storage_journal_replay() or
+ * mcd_storage_journal_remove_file().
+ */
+gboolean
+mcd_storage_journal_write_batch (McdStorageJournal *self,
+    GBytes *batch,
+    GError **error)
+{
+  static const gchar abandon[] = "\nA\n";
+  const gchar *data;
+  gsize len;
+  off_t good;
+  int fd;
+
+  g_return_val_if_fail (self != NULL, FALSE);
+  g_return_val_if_fail (batch != NULL, FALSE);
+
+  data = g_bytes_get_data (batch, &len);
+  fd = g_open (self->filename, O_WRONLY | O_APPEND | O_CREAT, 0600);
+
+  if (fd < 0)
+    {
+      g_set_error (error, G_FILE_ERROR, g_file_error_from_errno (errno),
+          "Unable to open %s: %s", self->filename, g_strerror (errno));
+      return FALSE;
+    }
+
+  good = lseek (fd, 0, SEEK_END);
+
+  if (good < 0)
+    {
+      g_set_error (error, G_FILE_ERROR, g_file_error_from_errno (errno),
+          "Unable to seek in %s: %s", self->filename, g_strerror (errno));
+      close (fd);
+      return FALSE;
+    }
+
+  if ((self->torn && !write_all (fd, abandon, strlen (abandon))) ||
+      !write_all (fd, data, len))
+    {
+      g_set_error (error, G_FILE_ERROR, g_file_error_from_errno (errno),
+          "Unable to write to %s: %s", self->filename, g_strerror (errno));
+      discard_partial_batch (self, fd, good);
+      close (fd);
+      return FALSE;
+    }
+
+#ifdef HAVE_FDATASYNC
+  if (fdatasync (fd) != 0)
+#else
+  if (fsync (fd) != 0)
+#endif
+    {
+      g_set_error (error, G_FILE_ERROR, g_file_error_from_errno (errno),
+          "Unable to sync %s: %s", self->filename, g_strerror (errno));
+      discard_partial_batch (self, fd, good);
+      close (fd);
+      return FALSE;
+    }
+
+  if (close (fd) != 0)
+    {
+      g_set_error (error, G_FILE_ERROR, g_file_error_from_errno (errno),
+          "Unable to close %s: %s", self->filename, g_strerror (errno));
+      /* we can't tell how much of it got there */
+      self->torn = TRUE;
+      return FALSE;
+    }
+
+  DEBUG ("appended %" G_GSIZE_FORMAT " bytes to %s", len, self->filename);
+  self->torn = FALSE;
+  return TRUE;
+}
+
+/*
+ * mcd_storage_journal_flush:
+ *
+ * Append every pending record to the journal file, then wait for it to
+ * reach the disk. If this fails, the partial batch is discarded; the
+ * caller should write a snapshot and call mcd_storage_journal_reset().
+ */
+gboolean
+mcd_storage_journal_flush (McdStorageJournal *self,
+    GError **error)
+{
+  GBytes *batch;
+  gboolean ok;
+
+  g_return_val_if_fail (self != NULL, FALSE);
+
+  batch = mcd_storage_journal_take_batch (self);
+
+  if (batch == NULL)
+    return TRUE;
+
+  ok = mcd_storage_journal_write_batch (self, batch, error);
+  g_bytes_unref (batch);
+  return ok;
+}
+
+static void
+remove_group_if_empty (GKeyFile *keyfile,
+    const gchar *group)
+{
+  gsize n = 0;
+  GStrv keys = g_key_file_get_keys (keyfile, group, &n, NULL);
+
+  if (keys == NULL || n == 0)
+    g_key_file_remove_group (keyfile, group, NULL);
+
+  g_strfreev (keys);
+}
+
+static void
+apply_record (gpointer data,
+    gpointer user_data)
+{
+  gchar **fields = data;
+  GKeyFile *keyfile = user_data;
+
+  switch (fields[0][0])
+    {
+      case 'S':
+        g_key_file_set_value (keyfile, fields[1], fields[2], fields[3]);
+        break;
+
+      case 'D':
+        g_key_file_remove_key (keyfile, fields[1], fields[2], NULL);
+        /* if that was the last parameter, the account is gone too */
+        remove_group_if_empty (keyfile, fields[1]);
+        break;
+
+      case 'R':
+        g_key_file_remove_group (keyfile, fields[1], NULL);
+        break;
+
+      default:
+        g_assert_not_reached ();
+    }
+}
+
+/*
+ * mcd_storage_journal_replay:
+ * @keyfile: the snapshot to which the journal applies
+ *
+ * Apply every complete batch of records in the journal file to @keyfile.
+ *
+ * Returns: the number of records applied
+ */
+guint
+mcd_storage_journal_replay (McdStorageJournal *self,
+    GKeyFile *keyfile)
+{
+  GError *error = NULL;
+  gchar *contents = NULL;
+  gsize len = 0;
+  gchar *line, *eol;
+  GPtrArray *batch;
+  guint n = 0;
+
+  g_return_val_if_fail (self != NULL, 0);
+  g_return_val_if_fail (keyfile != NULL, 0);
+
+  if (!g_file_get_contents (self->filename, &contents, &len, &error))
+    {
+      if (!g_error_matches (error, G_FILE_ERROR, G_FILE_ERROR_NOENT))
+        g_warning ("Unable to read %s: %s", self->filename, error->message);
+
+      g_error_free (error);
+      return 0;
+    }
+
+  /* records since the last C, each a GStrv */
+  batch = g_ptr_array_new_with_free_func ((GDestroyNotify) g_strfreev);
+  self->size = 0;
+
+  for (line = contents;
+      (eol = strchr (line, '\n')) != NULL;
+      line = eol + 1)
+    {
+      gchar **fields;
+
+      *eol = '\0';
+
+      if (!tp_strdiff (line, "C"))
+        {
+          n += batch->len;
+          g_ptr_array_foreach (batch, apply_record, keyfile);
+          g_ptr_array_set_size (batch, 0);
+          self->size = (eol + 1) - contents;
+          continue;
+        }
+
+      if (!tp_strdiff (line, "A"))
+        {
+          DEBUG ("Discarding %u records from an abandoned batch in %s",
+              batch->len, self->filename);
+          g_ptr_array_set_size (batch, 0);
+          continue;
+        }
+
+      /* the line that ended a partial record, before an A */
+      if (*line == '\0')
+        continue;
+
+      fields = g_strsplit (line, "\t", 4);
+
+      if ((!tp_strdiff (fields[0], "S") && g_strv_length (fields) == 4) ||
+          (!tp_strdiff (fields[0], "D") && g_strv_length (fields) == 3) ||
+          (!tp_strdiff (fields[0], "R") && g_strv_length (fields) == 2))
+        {
+          g_ptr_array_add (batch, fields);
+        }
+      else
+        {
+          g_warning ("Ignoring malformed record in %s: %s", self->filename,
+              line);
+          g_strfreev (fields);
+        }
+    }
+
+  if (self->size < len)
+    {
+      DEBUG ("Ignoring incomplete batch at end of %s", self->filename);
+
+      if (truncate (self->filename, self->size) != 0)
+        {
+          DEBUG ("Unable to truncate %s: %s", self->filename,
+              g_strerror (errno));
+          self->size = len;
+          self->torn = TRUE;
+        }
+    }
+
+  g_ptr_array_unref (batch);
+  DEBUG ("replayed %u records from %s", n, self->filename);
+  g_free (contents);
+  return n;
+}
+
+/*
+ * mcd_storage_journal_forget:
+ *
+ * Discard any pending records, and stop counting what has been written,
+ * once the in-memory state they describe is about to be written to a
+ * snapshot. The file itself should be removed by
+ * mcd_storage_journal_remove_file() once the snapshot has been written.
+ */
+void
+mcd_storage_journal_forget (McdStorageJournal *self)
+{
+  g_return_if_fail (self != NULL);
+
+  self->size = 0;
+  g_string_truncate (self->pending, 0);
+}
+
+/*
+ * mcd_storage_journal_remove_file:
+ *
+ * Delete the journal file. As for mcd_storage_journal_write_batch(), this
+ * may be called from another thread.
+ */
+gboolean
+mcd_storage_journal_remove_file (McdStorageJournal *self,
+    GError **error)
+{
+  g_return_val_if_fail (self != NULL, FALSE);
+
+  if (g_unlink (self->filename) != 0 && errno != ENOENT)
+    {
+      g_set_error (error, G_FILE_ERROR, g_file_error_from_errno (errno),
+          "Unable to delete %s: %s", self->filename, g_strerror (errno));
+      return FALSE;
+    }
+
+  self->torn = FALSE;
+  return TRUE;
+}
+
+/*
+ * mcd_storage_journal_reset:
+ *
+ * Discard the journal and any pending records, once the in-memory state
+ * they describe has been written to a snapshot.
+ */
+gboolean
+mcd_storage_journal_reset (McdStorageJournal *self,
+    GError **error)
+{
+  g_return_val_if_fail (self != NULL, FALSE);
+
+  mcd_storage_journal_forget (self);
+  return mcd_storage_journal_remove_file (self, error);
+}
@@ -0,0 +1,70 @@
+/*
+ * Append-only journal of keyfile changes, replayed on top of a snapshot
+ *
+ * Copyright © 2010 Nokia Corporation
+ * Copyright © 2010 Collabora Ltd.
+ *
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License as published by the Free Software Foundation; either
+ * version 2.1 of the License, or (at your option) any later version.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with this library; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin St, Fifth Floor, Boston, MA  02110-1301  USA
+ */
+
+#ifndef MCD_STORAGE_JOURNAL_H
+#define MCD_STORAGE_JOURNAL_H
+
+#include <glib.h>
+
+G_BEGIN_DECLS
+
+typedef struct _McdStorageJournal McdStorageJournal;
+
+G_GNUC_INTERNAL
+McdStorageJournal *mcd_storage_journal_new (const gchar *filename);
+G_GNUC_INTERNAL
+void mcd_storage_journal_free (McdStorageJournal *self);
+
+G_GNUC_INTERNAL
+gboolean mcd_storage_journal_append (McdStorageJournal *self,
+    const gchar *account,
+    const gchar *key,
+    const gchar *escaped);
+
+G_GNUC_INTERNAL
+gboolean mcd_storage_journal_has_pending (McdStorageJournal *self);
+G_GNUC_INTERNAL
+GBytes *mcd_storage_journal_take_batch (McdStorageJournal *self);
+G_GNUC_INTERNAL
+gboolean mcd_storage_journal_write_batch (McdStorageJournal *self,
+    GBytes *batch,
+    GError **error);
+G_GNUC_INTERNAL
+gboolean mcd_storage_journal_flush (McdStorageJournal *self,
+    GError **error);
+G_GNUC_INTERNAL
+gsize mcd_storage_journal_get_size (McdStorageJournal *self);
+
+G_GNUC_INTERNAL
+guint mcd_storage_journal_replay (McdStorageJournal *self,
+    GKeyFile *keyfile);
+G_GNUC_INTERNAL
+void mcd_storage_journal_forget (McdStorageJournal *self);
+G_GNUC_INTERNAL
+gboolean mcd_storage_journal_remove_file (McdStorageJournal *self,
+    GError **error);
+G_GNUC_INTERNAL
+gboolean mcd_storage_journal_reset (McdStorageJournal *self,
+    GError **error);
+
+G_END_DECLS
+
+#endif /* MCD_STORAGE_JOURNAL_H */
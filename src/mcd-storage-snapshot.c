@@ -0,0 +1,392 @@
+/*
+ * Binary snapshot of a keyfile, memory-mapped for fast loading
+ *
+ * Copyright © 2010 Nokia Corporation
+ * Copyright © 2010 Collabora Ltd.
+ *
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License as published by the Free Software Foundation; either
+ * version 2.1 of the License, or (at your option) any later version.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with this library; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin St, Fifth Floor, Boston, MA  02110-1301  USA
+ */
+
+/*
+ * Parsing a large accounts.cfg dominates startup time, so whenever we have
+ * it in memory we also save a copy as a serialized GVariant of type
+ * SNAPSHOT_TYPE:
+ *
+ *   ( magic,
+ *     (device, inode, size, mtime, ctime) of the keyfile,
+ *     [ (account, [ (key, escaped value), ... ]), ... ] )
+ *
+ * with accounts and keys sorted, so that lookups are a binary search using
+ * GVariant's offset tables. The file is mapped rather than read, so only
+ * the pages holding what we actually look at are faulted in. It is only
+ * used if the keyfile still matches; otherwise the caller parses the
+ * keyfile as usual and writes a new snapshot.
+ *
+ * Whether it matches is decided by stat() alone, so that checking costs
+ * the same however large the keyfile is. We save the keyfile by writing a
+ * new file and renaming it over the old one, so even a change within the
+ * same second that keeps the same size gives it a new inode.
+ */
+
+#include "config.h"
+
+#include "mcd-storage-snapshot.h"
+
+#include <errno.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include <glib/gstdio.h>
+
+#include "mcd-debug.h"
+#include "mcd-misc.h"
+
+#define SNAPSHOT_TYPE "(u(ttttt)a(sa(ss)))"
+/* "MCS2" - bump the digit if SNAPSHOT_TYPE changes */
+#define SNAPSHOT_MAGIC 0x4d435332
+
+struct _McdStorageSnapshot {
+    /* a(sa(ss)) backed by the mapped file */
+    GVariant *accounts;
+};
+
+/* Returns: (transfer floating): a (ttttt) identifying this version of
+ *  the file described by @buf */
+static GVariant *
+stat_to_variant (const GStatBuf *buf)
+{
+  return g_variant_new ("(ttttt)", (guint64) buf->st_dev,
+      (guint64) buf->st_ino, (guint64) buf->st_size, (guint64) buf->st_mtime,
+      (guint64) buf->st_ctime);
+}
+
+/*
+ * mcd_storage_snapshot_open:
+ * @filename: the snapshot
+ * @source: the keyfile of which it is meant to be a snapshot
+ *
+ * Returns: the snapshot, or %NULL if it is missing or does not match @source
+ */
+McdStorageSnapshot *
+mcd_storage_snapshot_open (const gchar *filename,
+    const gchar *source)
+{
+  McdStorageSnapshot *self = NULL;
+  GError *error = NULL;
+  GMappedFile *mapped;
+  GBytes *bytes;
+  GVariant *root;
+  GVariant *accounts;
+  GVariant *stamp;
+  GVariant *actual;
+  GStatBuf buf;
+  guint32 magic;
+
+  g_return_val_if_fail (filename != NULL, NULL);
+  g_return_val_if_fail (source != NULL, NULL);
+
+  if (g_stat (source, &buf) != 0)
+    return NULL;
+
+  mapped = g_mapped_file_new (filename, FALSE, &error);
+
+  if (mapped == NULL)
+    {
+      DEBUG ("%s", error->message);
+      g_error_free (error);
+      return NULL;
+    }
+
+  bytes = g_mapped_file_get_bytes (mapped);
+  g_mapped_file_unref (mapped);
+  /* not trusted: if the file is damaged we just see nonsense values */
+  root = g_variant_ref_sink (g_variant_new_from_bytes (
+        G_VARIANT_TYPE (SNAPSHOT_TYPE), bytes, FALSE));
+  g_bytes_unref (bytes);
+
+  g_variant_get (root, "(u@(ttttt)@a(sa(ss)))", &magic, &stamp, &accounts);
+  actual = g_variant_ref_sink (stat_to_variant (&buf));
+
+  if (magic != SNAPSHOT_MAGIC)
+    {
+      DEBUG ("%s is not a snapshot in a format we understand", filename);
+    }
+  else if (!g_variant_equal (stamp, actual))
+    {
+      DEBUG ("%s has changed since %s was written", source, filename);
+    }
+  else
+    {
+      DEBUG ("using %" G_GSIZE_FORMAT " accounts from %s",
+          g_variant_n_children (accounts), filename);
+      self = g_slice_new0 (McdStorageSnapshot);
+      self->accounts = g_variant_ref (accounts);
+    }
+
+  g_variant_unref (actual);
+  g_variant_unref (stamp);
+  g_variant_unref (accounts);
+  g_variant_unref (root);
+  return self;
+}
+
+void
+mcd_storage_snapshot_free (McdStorageSnapshot *self)
+{
+  g_return_if_fail (self != NULL);
+
+  g_variant_unref (self->accounts);
+  g_slice_free (McdStorageSnapshot, self);
+}
+
+/* @array is an array of tuples, sorted by their first member, which is a
+ * string. Return the tuple whose first member is @name, or %NULL. */
+static GVariant *
+lookup_sorted (GVariant *array,
+    const gchar *name)
+{
+  gsize lo = 0;
+  gsize hi = g_variant_n_children (array);
+
+  while (lo < hi)
+    {
+      gsize mid = lo + (hi - lo) / 2;
+      GVariant *child = g_variant_get_child_value (array, mid);
+      const gchar *s;
+      int cmp;
+
+      g_variant_get_child (child, 0, "&s", &s);
+      cmp = strcmp (name, s);
+
+      if (cmp == 0)
+        return child;
+
+      g_variant_unref (child);
+
+      if (cmp < 0)
+        hi = mid;
+      else
+        lo = mid + 1;
+    }
+
+  return NULL;
+}
+
+static GStrv
+dup_names (GVariant *array,
+    gsize *n)
+{
+  gsize i;
+  gsize len = g_variant_n_children (array);
+  GStrv ret = g_new0 (gchar *, len + 1);
+
+  for (i = 0; i < len; i++)
+    {
+      GVariant *child = g_variant_get_child_value (array, i);
+
+      g_variant_get_child (child, 0, "s", &ret[i]);
+      g_variant_unref (child);
+    }
+
+  if (n != NULL)
+    *n = len;
+
+  return ret;
+}
+
+GStrv
+mcd_storage_snapshot_dup_accounts (McdStorageSnapshot *self,
+    gsize *n)
+{
+  g_return_val_if_fail (self != NULL, NULL);
+
+  return dup_names (self->accounts, n);
+}
+
+/*
+ * Returns: the keys stored for @account, or %NULL if there is no such
+ *  account
+ */
+GStrv
+mcd_storage_snapshot_dup_keys (McdStorageSnapshot *self,
+    const gchar *account,
+    gsize *n)
+{
+  GVariant *tuple;
+  GVariant *keys;
+  GStrv ret;
+
+  g_return_val_if_fail (self != NULL, NULL);
+  g_return_val_if_fail (account != NULL, NULL);
+
+  tuple = lookup_sorted (self->accounts, account);
+
+  if (tuple == NULL)
+    return NULL;
+
+  keys = g_variant_get_child_value (tuple, 1);
+  ret = dup_names (keys, n);
+  g_variant_unref (keys);
+  g_variant_unref (tuple);
+  return ret;
+}
+
+/*
+ * Returns: the value of @key in @account, escaped as if for a #GKeyFile,
+ *  or %NULL if it is not stored
+ */
+gchar *
+mcd_storage_snapshot_dup_value (McdStorageSnapshot *self,
+    const gchar *account,
+    const gchar *key)
+{
+  GVariant *tuple;
+  GVariant *keys;
+  GVariant *pair;
+  gchar *ret = NULL;
+
+  g_return_val_if_fail (self != NULL, NULL);
+  g_return_val_if_fail (account != NULL, NULL);
+  g_return_val_if_fail (key != NULL, NULL);
+
+  tuple = lookup_sorted (self->accounts, account);
+
+  if (tuple == NULL)
+    return NULL;
+
+  keys = g_variant_get_child_value (tuple, 1);
+  pair = lookup_sorted (keys, key);
+
+  if (pair != NULL)
+    {
+      g_variant_get_child (pair, 1, "s", &ret);
+      g_variant_unref (pair);
+    }
+
+  g_variant_unref (keys);
+  g_variant_unref (tuple);
+  return ret;
+}
+
+static int
+compare_strings (gconstpointer a,
+    gconstpointer b)
+{
+  return strcmp (*(const gchar * const *) a, *(const gchar * const *) b);
+}
+
+/*
+ * mcd_storage_snapshot_write:
+ * @filename: where to save the snapshot
+ * @source: the file from which @keyfile was loaded, or to which it was saved
+ * @contents: the contents of @source
+ * @len: the length of @contents
+ * @keyfile: the parsed form of @contents
+ *
+ * Save a snapshot that mcd_storage_snapshot_open() will accept for as long
+ * as @source is not modified.
+ */
+gboolean
+mcd_storage_snapshot_write (const gchar *filename,
+    const gchar *source,
+    const gchar *contents,
+    gsize len,
+    GKeyFile *keyfile,
+    GError **error)
+{
+  GVariantBuilder accounts;
+  GVariant *root;
+  GStatBuf buf;
+  GStrv groups;
+  gsize i, n;
+  gchar *dir;
+  gboolean ret;
+
+  g_return_val_if_fail (filename != NULL, FALSE);
+  g_return_val_if_fail (source != NULL, FALSE);
+  g_return_val_if_fail (contents != NULL || len == 0, FALSE);
+  g_return_val_if_fail (keyfile != NULL, FALSE);
+
+  if (g_stat (source, &buf) != 0)
+    {
+      g_set_error (error, G_FILE_ERROR, g_file_error_from_errno (errno),
+          "Unable to stat %s: %s", source, g_strerror (errno));
+      return FALSE;
+    }
+
+  if ((guint64) buf.st_size != len)
+    {
+      g_set_error (error, G_FILE_ERROR, G_FILE_ERROR_FAILED,
+          "%s has changed, not writing a snapshot", source);
+      return FALSE;
+    }
+
+  groups = g_key_file_get_groups (keyfile, &n);
+  qsort (groups, n, sizeof (gchar *), compare_strings);
+  g_variant_builder_init (&accounts, G_VARIANT_TYPE ("a(sa(ss))"));
+
+  for (i = 0; i < n; i++)
+    {
+      GVariantBuilder values;
+      gsize j, n_keys = 0;
+      GStrv keys = g_key_file_get_keys (keyfile, groups[i], &n_keys, NULL);
+
+      if (keys == NULL)
+        n_keys = 0;
+      else
+        qsort (keys, n_keys, sizeof (gchar *), compare_strings);
+
+      g_variant_builder_init (&values, G_VARIANT_TYPE ("a(ss)"));
+
+      for (j = 0; j < n_keys; j++)
+        {
+          gchar *value = g_key_file_get_value (keyfile, groups[i], keys[j],
+              NULL);
+
+          if (value != NULL)
+            g_variant_builder_add (&values, "(ss)", keys[j], value);
+
+          g_free (value);
+        }
+
+      g_variant_builder_add (&accounts, "(s@a(ss))", groups[i],
+          g_variant_builder_end (&values));
+      g_strfreev (keys);
+    }
+
+  g_strfreev (groups);
+
+  root = g_variant_ref_sink (g_variant_new ("(u@(ttttt)@a(sa(ss)))",
+        SNAPSHOT_MAGIC, stat_to_variant (&buf),
+        g_variant_builder_end (&accounts)));
+
+  dir = g_path_get_dirname (filename);
+  ret = mcd_ensure_directory (dir, error);
+  g_free (dir);
+
+  /* the snapshot holds the same secrets as the keyfile */
+  if (ret)
+    ret = g_file_set_contents (filename, g_variant_get_data (root),
+        g_variant_get_size (root), error);
+
+  if (ret)
+    {
+      _mcd_chmod_private (filename);
+      DEBUG ("saved a snapshot of %s to %s", source, filename);
+    }
+
+  g_variant_unref (root);
+  return ret;
+}
@@ -0,0 +1,59 @@
+/*
+ * Binary snapshot of a keyfile, memory-mapped for fast loading
+ *
+ * Copyright © 2010 Nokia Corporation
+ * Copyright © 2010 Collabora Ltd.
+ *
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License as published by the Free Software Foundation; either
+ * version 2.1 of the License, or (at your option) any later version.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with this library; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin St, Fifth Floor, Boston, MA  02110-1301  USA
+ */
+
+#ifndef MCD_STORAGE_SNAPSHOT_H
+#define MCD_STORAGE_SNAPSHOT_H
+
+#include <glib.h>
+
+G_BEGIN_DECLS
+
+typedef struct _McdStorageSnapshot McdStorageSnapshot;
+
+G_GNUC_INTERNAL
+McdStorageSnapshot *mcd_storage_snapshot_open (const gchar *filename,
+    const gchar *source);
+G_GNUC_INTERNAL
+void mcd_storage_snapshot_free (McdStorageSnapshot *self);
+
+G_GNUC_INTERNAL
+GStrv mcd_storage_snapshot_dup_accounts (McdStorageSnapshot *self,
+    gsize *n);
+G_GNUC_INTERNAL
+GStrv mcd_storage_snapshot_dup_keys (McdStorageSnapshot *self,
+    const gchar *account,
+    gsize *n);
+G_GNUC_INTERNAL
+gchar *mcd_storage_snapshot_dup_value (McdStorageSnapshot *self,
+    const gchar *account,
+    const gchar *key);
+
+G_GNUC_INTERNAL
+gboolean mcd_storage_snapshot_write (const gchar *filename,
+    const gchar *source,
+    const gchar *contents,
+    gsize len,
+    GKeyFile *keyfile,
+    GError **error);
+
+G_END_DECLS
+
+#endif /* MCD_STORAGE_SNAPSHOT_H */
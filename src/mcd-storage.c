@@ -39,6 +39,7 @@
 
 /* these pseudo-plugins take care of the actual account storage/retrieval */
 #include "mcd-account-manager-default.h"
+#include "mcd-account-manager-sharded.h"
 
 #if ENABLE_LIBACCOUNTS_SSO
 #include "mcd-account-manager-sso.h"
@@ -47,10 +48,31 @@
 # endif
 #endif
 
-#define MAX_KEY_LENGTH (DBUS_MAXIMUM_NAME_LENGTH + 6)
+/* Parameters whose values plugins can only store as strings have their
+ * D-Bus signatures stored alongside, as "paramtype-" + the parameter's
+ * name */
+#define PARAM_TYPE_PREFIX "paramtype-"
+#define MAX_KEY_LENGTH (DBUS_MAXIMUM_NAME_LENGTH + sizeof (PARAM_TYPE_PREFIX))
+
+/* Changes made within this many milliseconds of each other are committed
+ * together, but nothing waits for longer than the maximum; both can be
+ * overridden with MC_STORAGE_COMMIT_DELAY and MC_STORAGE_MAX_COMMIT_DELAY */
+#define COMMIT_DELAY 250
+#define MAX_COMMIT_DELAY 2000
 
 static GList *stores = NULL;
 static void sort_and_cache_plugins (void);
+static void mcd_storage_transaction_hold (McdStorageTransaction *self,
+    const gchar *key,
+    GVariant *variant,
+    const gchar *escaped,
+    gboolean secret);
+static void update_storage (McdStorage *self,
+    const gchar *account,
+    const gchar *key,
+    GVariant *variant,
+    const gchar *escaped,
+    gboolean secret);
 
 enum {
   PROP_DBUS_DAEMON = 1,
@@ -67,39 +89,531 @@ G_DEFINE_TYPE_WITH_CODE (McdStorage, mcd_storage,
     G_TYPE_OBJECT,
     G_IMPLEMENT_INTERFACE (MCP_TYPE_ACCOUNT_MANAGER, plugin_iface_init))
 
+/* Attribute and parameter names are interned, and each account keeps them
+ * in arrays sorted by quark: there are only a few dozen distinct names
+ * across all accounts, and a hash table per account costs far more than
+ * what it holds. */
+
+typedef struct {
+    GQuark name;
+    /* owned, e.g. <'Frederick Bloggs'> */
+    GVariant *value;
+} McdStorageAttribute;
+
+typedef struct {
+    GQuark name;
+    /* exactly one of these is non-%NULL: the value, e.g. <'fred@example.com'>,
+     * or if we don't know its type yet, the value escaped as if for a
+     * keyfile, e.g. 'fred@example.com' */
+    GVariant *value;
+    gchar *escaped;
+    /* the last result of mcd_storage_get_parameter(), so that asking for
+     * the same type again doesn't have to decode it again; unset until
+     * then, and whenever the parameter changes */
+    GValue decoded;
+} McdStorageParameter;
+
+typedef struct {
+    GQuark name;
+    /* interned, e.g. "u" */
+    const gchar *signature;
+} McdStorageParameterType;
+
 typedef struct {
-    /* owned string => GVariant
-     * e.g. { 'DisplayName': <'Frederick Bloggs'> } */
-    GHashTable *attributes;
-    /* owned string => owned GVariant
-     * e.g. { 'account': <'fred@example.com'>, 'password': <'foo'> } */
-    GHashTable *parameters;
-    /* owned string => owned string escaped as if for a keyfile
-     * e.g. { 'account': 'fred@example.com', 'password': 'foo' }
-     * keys of @parameters and @escaped_parameters are disjoint */
-    GHashTable *escaped_parameters;
-    /* set of owned strings
-     * e.g. { 'password': 'password' } */
-    GHashTable *secrets;
+    /* McdStorageAttribute sorted by name
+     * e.g. [ { 'DisplayName', <'Frederick Bloggs'> } ] */
+    GArray *attributes;
+    /* McdStorageParameter sorted by name
+     * e.g. [ { 'account', <'fred@example.com'>, NULL },
+     *        { 'password', NULL, 'foo' } ] */
+    GArray *parameters;
+    /* McdStorageParameterType sorted by name: the types we've been told
+     * about, so that we can decode escaped values without the CM
+     * e.g. [ { 'port', 'u' } ] */
+    GArray *parameter_types;
+    /* bitset of secret parameters, indexed by secret_bit ()
+     * e.g. { 'password' } */
+    guint32 *secrets;
+    guint n_secret_words;
+    /* the plugin that stores this account, once we know it, or %NULL;
+     * borrowed, since plugins are never unloaded */
+    McpAccountStorage *storage;
+    /* borrowed McpAccountStorage *: other plugins that have stored keys
+     * which @storage refused, so they need to hear about deletions and
+     * commits too; usually empty */
+    GList *others;
 } McdStorageAccount;
 
+/* GQuark of parameter name => 1 + its bit in McdStorageAccount.secrets.
+ * In practice only a handful of parameters (password and the like) are
+ * ever secret. */
+static GHashTable *secret_bits = NULL;
+
+static void
+mcd_storage_attribute_clear (gpointer p)
+{
+  McdStorageAttribute *attr = p;
+
+  tp_clear_pointer (&attr->value, g_variant_unref);
+}
+
+static void
+mcd_storage_parameter_clear (gpointer p)
+{
+  McdStorageParameter *param = p;
+
+  tp_clear_pointer (&param->value, g_variant_unref);
+  tp_clear_pointer (&param->escaped, g_free);
+
+  if (G_IS_VALUE (&param->decoded))
+    g_value_unset (&param->decoded);
+}
+
+static McdStorageAccount *
+mcd_storage_account_new (void)
+{
+  McdStorageAccount *sa = g_slice_new0 (McdStorageAccount);
+
+  sa->attributes = g_array_new (FALSE, FALSE, sizeof (McdStorageAttribute));
+  g_array_set_clear_func (sa->attributes, mcd_storage_attribute_clear);
+  sa->parameters = g_array_new (FALSE, FALSE, sizeof (McdStorageParameter));
+  g_array_set_clear_func (sa->parameters, mcd_storage_parameter_clear);
+  sa->parameter_types = g_array_new (FALSE, FALSE,
+      sizeof (McdStorageParameterType));
+  return sa;
+}
+
 static void
 mcd_storage_account_free (gpointer p)
 {
   McdStorageAccount *sa = p;
 
-  g_hash_table_unref (sa->attributes);
-  g_hash_table_unref (sa->parameters);
-  g_hash_table_unref (sa->escaped_parameters);
-  g_hash_table_unref (sa->secrets);
+  g_array_unref (sa->attributes);
+  g_array_unref (sa->parameters);
+  g_array_unref (sa->parameter_types);
+  g_free (sa->secrets);
+  g_list_free (sa->others);
   g_slice_free (McdStorageAccount, sa);
 }
 
+/*
+ * @array: an array of structs whose first member is a #GQuark, sorted by it
+ * @index: set to the index of @name, or the index at which it would be
+ *  inserted
+ *
+ * Returns: %TRUE if @name is present
+ */
+static gboolean
+bsearch_quark (GArray *array,
+    GQuark name,
+    guint *index)
+{
+  guint element_size = g_array_get_element_size (array);
+  guint lo = 0;
+  guint hi = array->len;
+
+  while (lo < hi)
+    {
+      guint mid = lo + (hi - lo) / 2;
+      GQuark q = *(GQuark *) (array->data + mid * element_size);
+
+      if (q == name)
+        {
+          *index = mid;
+          return TRUE;
+        }
+
+      if (q < name)
+        lo = mid + 1;
+      else
+        hi = mid;
+    }
+
+  *index = lo;
+  return FALSE;
+}
+
+/* Returns: (transfer none): the value of @attribute, or %NULL */
+static GVariant *
+mcd_storage_account_get_attribute (McdStorageAccount *sa,
+    const gchar *attribute)
+{
+  GQuark name = g_quark_try_string (attribute);
+  guint i;
+
+  if (name == 0 || !bsearch_quark (sa->attributes, name, &i))
+    return NULL;
+
+  return g_array_index (sa->attributes, McdStorageAttribute, i).value;
+}
+
+/* @value: (transfer full) (allow-none): the new value, or %NULL to remove
+ *  @attribute */
+static void
+mcd_storage_account_take_attribute (McdStorageAccount *sa,
+    const gchar *attribute,
+    GVariant *value)
+{
+  GQuark name;
+  guint i;
+
+  if (value == NULL)
+    {
+      name = g_quark_try_string (attribute);
+
+      if (name != 0 && bsearch_quark (sa->attributes, name, &i))
+        g_array_remove_index (sa->attributes, i);
+
+      return;
+    }
+
+  name = g_quark_from_string (attribute);
+
+  if (bsearch_quark (sa->attributes, name, &i))
+    {
+      McdStorageAttribute *attr = &g_array_index (sa->attributes,
+          McdStorageAttribute, i);
+
+      g_variant_unref (attr->value);
+      attr->value = value;
+    }
+  else
+    {
+      McdStorageAttribute attr = { name, value };
+
+      g_array_insert_val (sa->attributes, i, attr);
+    }
+}
+
+/* Returns: (transfer none): the parameter, or %NULL */
+static McdStorageParameter *
+mcd_storage_account_lookup_parameter (McdStorageAccount *sa,
+    const gchar *parameter)
+{
+  GQuark name = g_quark_try_string (parameter);
+  guint i;
+
+  if (name == 0 || !bsearch_quark (sa->parameters, name, &i))
+    return NULL;
+
+  return &g_array_index (sa->parameters, McdStorageParameter, i);
+}
+
+/* @value: (transfer full) (allow-none): the new value
+ * @escaped: (transfer full) (allow-none): the new value escaped as if for a
+ *  keyfile, if @value is %NULL; if both are %NULL, @parameter is removed */
+static void
+mcd_storage_account_take_parameter (McdStorageAccount *sa,
+    const gchar *parameter,
+    GVariant *value,
+    gchar *escaped)
+{
+  GQuark name;
+  guint i;
+
+  g_assert (value == NULL || escaped == NULL);
+
+  if (value == NULL && escaped == NULL)
+    {
+      name = g_quark_try_string (parameter);
+
+      if (name != 0 && bsearch_quark (sa->parameters, name, &i))
+        g_array_remove_index (sa->parameters, i);
+
+      return;
+    }
+
+  name = g_quark_from_string (parameter);
+
+  if (bsearch_quark (sa->parameters, name, &i))
+    {
+      McdStorageParameter *param = &g_array_index (sa->parameters,
+          McdStorageParameter, i);
+
+      mcd_storage_parameter_clear (param);
+      param->value = value;
+      param->escaped = escaped;
+    }
+  else
+    {
+      McdStorageParameter param = { name, value, escaped, G_VALUE_INIT };
+
+      g_array_insert_val (sa->parameters, i, param);
+    }
+}
+
+/* Returns: (transfer none): the D-Bus signature of @parameter, or %NULL
+ *  if we don't know it */
+static const gchar *
+mcd_storage_account_get_parameter_type (McdStorageAccount *sa,
+    const gchar *parameter)
+{
+  GQuark name = g_quark_try_string (parameter);
+  guint i;
+
+  if (name == 0 || !bsearch_quark (sa->parameter_types, name, &i))
+    return NULL;
+
+  return g_array_index (sa->parameter_types, McdStorageParameterType,
+      i).signature;
+}
+
+static gboolean
+init_value_for_parameter_type (GValue *value,
+    const gchar *signature)
+{
+  GType type = G_TYPE_INVALID;
+
+  if (!tp_strdiff (signature, "as"))
+    type = G_TYPE_STRV;
+  else if (!tp_strdiff (signature, "ao"))
+    type = TP_ARRAY_TYPE_OBJECT_PATH_LIST;
+  else if (signature[0] != '\0' && signature[1] == '\0')
+    {
+      /* the same mapping as dbus-glib, and hence the CM's parameters */
+      switch (signature[0])
+        {
+          case 's':
+            type = G_TYPE_STRING;
+            break;
+
+          case 'b':
+            type = G_TYPE_BOOLEAN;
+            break;
+
+          case 'y':
+            type = G_TYPE_UCHAR;
+            break;
+
+          case 'n':
+          case 'i':
+            type = G_TYPE_INT;
+            break;
+
+          case 'q':
+          case 'u':
+            type = G_TYPE_UINT;
+            break;
+
+          case 'x':
+            type = G_TYPE_INT64;
+            break;
+
+          case 't':
+            type = G_TYPE_UINT64;
+            break;
+
+          case 'd':
+            type = G_TYPE_DOUBLE;
+            break;
+
+          case 'o':
+            type = DBUS_TYPE_G_OBJECT_PATH;
+            break;
+        }
+    }
+
+  if (type == G_TYPE_INVALID)
+    return FALSE;
+
+  g_value_init (value, type);
+  return TRUE;
+}
+
+/* Returns: (transfer full): @escaped decoded as a @signature, or %NULL */
+static GVariant *
+unescape_typed_parameter (const gchar *escaped,
+    const gchar *signature)
+{
+  GValue value = G_VALUE_INIT;
+  GError *error = NULL;
+  GVariant *ret;
+
+  if (!init_value_for_parameter_type (&value, signature))
+    {
+      DEBUG ("unsupported parameter type '%s'", signature);
+      return NULL;
+    }
+
+  if (!mcd_keyfile_unescape_value (escaped, &value, &error))
+    {
+      DEBUG ("'%s' is not a valid '%s': %s", escaped, signature,
+          error->message);
+      g_error_free (error);
+      g_value_unset (&value);
+      return NULL;
+    }
+
+  ret = g_variant_ref_sink (dbus_g_value_build_g_variant (&value));
+  g_value_unset (&value);
+  return ret;
+}
+
+/* @signature: (allow-none): the type of @parameter, or %NULL to forget it
+ *
+ * If @parameter only has an escaped value, decode it now. */
+static void
+mcd_storage_account_set_parameter_type (McdStorageAccount *sa,
+    const gchar *parameter,
+    const gchar *signature)
+{
+  McdStorageParameter *param;
+  GQuark name;
+  guint i;
+
+  if (signature != NULL && !g_variant_type_string_is_valid (signature))
+    {
+      DEBUG ("ignoring invalid type '%s' for parameter %s", signature,
+          parameter);
+      signature = NULL;
+    }
+
+  if (signature == NULL)
+    {
+      name = g_quark_try_string (parameter);
+
+      if (name != 0 && bsearch_quark (sa->parameter_types, name, &i))
+        g_array_remove_index (sa->parameter_types, i);
+
+      return;
+    }
+
+  name = g_quark_from_string (parameter);
+  signature = g_intern_string (signature);
+
+  if (bsearch_quark (sa->parameter_types, name, &i))
+    {
+      g_array_index (sa->parameter_types, McdStorageParameterType,
+          i).signature = signature;
+    }
+  else
+    {
+      McdStorageParameterType type = { name, signature };
+
+      g_array_insert_val (sa->parameter_types, i, type);
+    }
+
+  param = mcd_storage_account_lookup_parameter (sa, parameter);
+
+  if (param != NULL && param->value == NULL)
+    {
+      GVariant *value = unescape_typed_parameter (param->escaped, signature);
+
+      if (value != NULL)
+        mcd_storage_account_take_parameter (sa, parameter, value, NULL);
+    }
+}
+
+/* @escaped: (transfer full) (allow-none): as for
+ *  mcd_storage_account_take_parameter(); if we know its type, it is
+ *  decoded straight away */
+static void
+mcd_storage_account_take_escaped_parameter (McdStorageAccount *sa,
+    const gchar *parameter,
+    gchar *escaped)
+{
+  const gchar *signature = mcd_storage_account_get_parameter_type (sa,
+      parameter);
+  GVariant *value = NULL;
+
+  if (escaped != NULL && signature != NULL)
+    value = unescape_typed_parameter (escaped, signature);
+
+  if (value != NULL)
+    {
+      g_free (escaped);
+      mcd_storage_account_take_parameter (sa, parameter, value, NULL);
+    }
+  else
+    {
+      mcd_storage_account_take_parameter (sa, parameter, NULL, escaped);
+    }
+}
+
+/* Returns: 1 + the bit for @parameter, or 0 if it has never been secret
+ *  and @create is %FALSE */
+static guint
+secret_bit (const gchar *parameter,
+    gboolean create)
+{
+  GQuark name;
+  guint bit;
+
+  if (secret_bits == NULL)
+    secret_bits = g_hash_table_new (NULL, NULL);
+
+  if (create)
+    name = g_quark_from_string (parameter);
+  else
+    name = g_quark_try_string (parameter);
+
+  if (name == 0)
+    return 0;
+
+  bit = GPOINTER_TO_UINT (g_hash_table_lookup (secret_bits,
+        GUINT_TO_POINTER (name)));
+
+  if (bit == 0 && create)
+    {
+      bit = g_hash_table_size (secret_bits) + 1;
+      g_hash_table_insert (secret_bits, GUINT_TO_POINTER (name),
+          GUINT_TO_POINTER (bit));
+    }
+
+  return bit;
+}
+
+static gboolean
+mcd_storage_account_is_secret (McdStorageAccount *sa,
+    const gchar *parameter)
+{
+  guint bit = secret_bit (parameter, FALSE);
+
+  if (bit == 0)
+    return FALSE;
+
+  bit--;
+
+  if (bit / 32 >= sa->n_secret_words)
+    return FALSE;
+
+  return (sa->secrets[bit / 32] & (1U << (bit % 32))) != 0;
+}
+
+static void
+mcd_storage_account_make_secret (McdStorageAccount *sa,
+    const gchar *parameter)
+{
+  guint bit = secret_bit (parameter, TRUE) - 1;
+
+  if (bit / 32 >= sa->n_secret_words)
+    {
+      guint n = bit / 32 + 1;
+
+      sa->secrets = g_renew (guint32, sa->secrets, n);
+      memset (sa->secrets + sa->n_secret_words, 0,
+          (n - sa->n_secret_words) * sizeof (guint32));
+      sa->n_secret_words = n;
+    }
+
+  sa->secrets[bit / 32] |= (1U << (bit % 32));
+}
+
 static void
 mcd_storage_init (McdStorage *self)
 {
   self->accounts = g_hash_table_new_full (g_str_hash, g_str_equal,
       g_free, mcd_storage_account_free);
+  self->dirty = g_hash_table_new_full (g_str_hash, g_str_equal,
+      g_free, NULL);
+  self->capturing = g_hash_table_new (g_str_hash, g_str_equal);
+  self->commit_delay = _mcd_get_uint_from_env ("MC_STORAGE_COMMIT_DELAY",
+      COMMIT_DELAY);
+  self->max_commit_delay = _mcd_get_uint_from_env (
+      "MC_STORAGE_MAX_COMMIT_DELAY", MAX_COMMIT_DELAY);
+
+  if (self->max_commit_delay < self->commit_delay)
+    self->max_commit_delay = self->commit_delay;
 }
 
 static void
@@ -111,6 +625,10 @@ storage_finalize (GObject *object)
 
   g_hash_table_unref (self->accounts);
   self->accounts = NULL;
+  g_hash_table_unref (self->dirty);
+  self->dirty = NULL;
+  g_hash_table_unref (self->capturing);
+  self->capturing = NULL;
 
   if (finalize != NULL)
     finalize (object);
@@ -123,6 +641,9 @@ storage_dispose (GObject *object)
   GObjectFinalizeFunc dispose =
     G_OBJECT_CLASS (mcd_storage_parent_class)->dispose;
 
+  /* don't lose changes that were waiting to be coalesced */
+  mcd_storage_flush (self);
+
   tp_clear_object (&self->dbusd);
 
   if (dispose != NULL)
@@ -231,15 +752,7 @@ ensure_account (McdStorage *self,
 
   if (sa == NULL)
     {
-      sa = g_slice_new (McdStorageAccount);
-      sa->attributes = g_hash_table_new_full (g_str_hash, g_str_equal,
-          g_free, (GDestroyNotify) g_variant_unref);
-      sa->parameters = g_hash_table_new_full (g_str_hash, g_str_equal,
-          g_free, (GDestroyNotify) g_variant_unref);
-      sa->escaped_parameters = g_hash_table_new_full (g_str_hash, g_str_equal,
-          g_free, g_free);
-      sa->secrets = g_hash_table_new_full (g_str_hash, g_str_equal,
-          g_free, NULL);
+      sa = mcd_storage_account_new ();
       g_hash_table_insert (self->accounts, g_strdup (account), sa);
     }
 
@@ -254,43 +767,33 @@ get_value (const McpAccountManager *ma,
   McdStorage *self = MCD_STORAGE (ma);
   McdStorageAccount *sa = lookup_account (self, account);
   GVariant *variant;
-  gchar *ret;
 
   if (sa == NULL)
     return NULL;
 
   if (g_str_has_prefix (key, "param-"))
     {
-      variant = g_hash_table_lookup (sa->parameters, key + 6);
+      McdStorageParameter *param = mcd_storage_account_lookup_parameter (sa,
+          key + 6);
 
-      if (variant != NULL)
-        {
-          ret = mcd_keyfile_escape_variant (variant);
-          g_variant_unref (variant);
-          return ret;
-        }
-      else
-        {
-          /* OK, we don't have it as a variant. How about the keyfile-escaped
-           * version? */
-          return g_strdup (g_hash_table_lookup (sa->escaped_parameters,
-                key + 6));
-        }
+      if (param == NULL)
+        return NULL;
+
+      if (param->value != NULL)
+        return mcd_keyfile_escape_variant (param->value);
+
+      /* OK, we don't have it as a variant. How about the keyfile-escaped
+       * version? */
+      return g_strdup (param->escaped);
     }
   else
     {
-      variant = g_hash_table_lookup (sa->attributes, key);
+      variant = mcd_storage_account_get_attribute (sa, key);
 
       if (variant != NULL)
-        {
-          ret = mcd_keyfile_escape_variant (variant);
-          g_variant_unref (variant);
-          return ret;
-        }
+        return mcd_keyfile_escape_variant (variant);
       else
-        {
-          return NULL;
-        }
+        return NULL;
     }
 }
 
@@ -331,6 +834,7 @@ static struct {
 
     /* Integers */
       { "u", MC_ACCOUNTS_KEY_AUTO_PRESENCE_TYPE },
+      { "x", MC_ACCOUNTS_KEY_LAST_ONLINE },
 
       { NULL, NULL }
 };
@@ -377,6 +881,10 @@ mcd_storage_init_value_for_attribute (GValue *value,
         g_value_init (value, G_TYPE_INT);
         return TRUE;
 
+      case 'x':
+        g_value_init (value, G_TYPE_INT64);
+        return TRUE;
+
       case 'a':
           {
             switch (s[1])
@@ -425,14 +933,9 @@ mcpa_set_attribute (const McpAccountManager *ma,
   McdStorageAccount *sa = ensure_account (self, account);
 
   if (value != NULL)
-    {
-      g_hash_table_insert (sa->attributes, g_strdup (attribute),
-          g_variant_ref_sink (value));
-    }
-  else
-    {
-      g_hash_table_remove (sa->attributes, attribute);
-    }
+    g_variant_ref_sink (value);
+
+  mcd_storage_account_take_attribute (sa, attribute, value);
 }
 
 static void
@@ -445,17 +948,15 @@ mcpa_set_parameter (const McpAccountManager *ma,
   McdStorage *self = MCD_STORAGE (ma);
   McdStorageAccount *sa = ensure_account (self, account);
 
-  g_hash_table_remove (sa->parameters, parameter);
-  g_hash_table_remove (sa->escaped_parameters, parameter);
-
   if (value != NULL)
-    g_hash_table_insert (sa->parameters, g_strdup (parameter),
-        g_variant_ref_sink (value));
+    g_variant_ref_sink (value);
+
+  mcd_storage_account_take_parameter (sa, parameter, value, NULL);
 
   if (flags & MCP_PARAMETER_FLAG_SECRET)
     {
       DEBUG ("flagging %s parameter %s as secret", account, parameter);
-      g_hash_table_add (sa->secrets, g_strdup (parameter));
+      mcd_storage_account_make_secret (sa, parameter);
     }
 }
 
@@ -470,12 +971,13 @@ set_value (const McpAccountManager *ma,
 
   if (g_str_has_prefix (key, "param-"))
     {
-      g_hash_table_remove (sa->parameters, key + 6);
-      g_hash_table_remove (sa->escaped_parameters, key + 6);
-
-      if (value != NULL)
-        g_hash_table_insert (sa->escaped_parameters, g_strdup (key + 6),
-            g_strdup (value));
+      mcd_storage_account_take_escaped_parameter (sa, key + 6,
+          g_strdup (value));
+    }
+  else if (g_str_has_prefix (key, PARAM_TYPE_PREFIX))
+    {
+      mcd_storage_account_set_parameter_type (sa,
+          key + strlen (PARAM_TYPE_PREFIX), value);
     }
   else
     {
@@ -493,7 +995,7 @@ set_value (const McpAccountManager *ma,
 
           if (mcd_keyfile_unescape_value (value, &tmp, &error))
             {
-              g_hash_table_insert (sa->attributes, g_strdup (key),
+              mcd_storage_account_take_attribute (sa, key,
                   g_variant_ref_sink (dbus_g_value_build_g_variant (&tmp)));
               g_value_unset (&tmp);
             }
@@ -502,12 +1004,12 @@ set_value (const McpAccountManager *ma,
               g_warning ("Could not decode attribute '%s':'%s' from plugin: %s",
                   key, value, error->message);
               g_error_free (error);
-              g_hash_table_remove (sa->attributes, key);
+              mcd_storage_account_take_attribute (sa, key, NULL);
             }
         }
       else
         {
-          g_hash_table_remove (sa->attributes, key);
+          mcd_storage_account_take_attribute (sa, key, NULL);
         }
     }
 }
@@ -522,18 +1024,26 @@ list_keys (const McpAccountManager *ma,
 
   if (sa != NULL)
     {
-      GHashTableIter iter;
-      gpointer k;
+      guint i;
 
-      g_hash_table_iter_init (&iter, sa->attributes);
+      for (i = 0; i < sa->attributes->len; i++)
+        {
+          McdStorageAttribute *attr = &g_array_index (sa->attributes,
+              McdStorageAttribute, i);
 
-      while (g_hash_table_iter_next (&iter, &k, NULL))
-        g_ptr_array_add (ret, g_strdup (k));
+          g_ptr_array_add (ret, g_strdup (g_quark_to_string (attr->name)));
+        }
 
-      g_hash_table_iter_init (&iter, sa->parameters);
+      for (i = 0; i < sa->parameters->len; i++)
+        {
+          McdStorageParameter *param = &g_array_index (sa->parameters,
+              McdStorageParameter, i);
 
-      while (g_hash_table_iter_next (&iter, &k, NULL))
-        g_ptr_array_add (ret, g_strdup_printf ("param-%s", (gchar *) k));
+          /* as before, only the parameters whose type we know */
+          if (param->value != NULL)
+            g_ptr_array_add (ret, g_strdup_printf ("param-%s",
+                  g_quark_to_string (param->name)));
+        }
     }
 
   g_ptr_array_add (ret, NULL);
@@ -551,7 +1061,7 @@ is_secret (const McpAccountManager *ma,
   if (sa == NULL || !g_str_has_prefix (key, "param-"))
     return FALSE;
 
-  return g_hash_table_contains (sa->secrets, key + 6);
+  return mcd_storage_account_is_secret (sa, key + 6);
 }
 
 static void
@@ -570,7 +1080,7 @@ mcd_storage_make_secret (McdStorage *self,
 
   DEBUG ("flagging %s parameter %s as secret", account, key + 6);
   sa = ensure_account (self, account);
-  g_hash_table_add (sa->secrets, g_strdup (key + 6));
+  mcd_storage_account_make_secret (sa, key + 6);
 }
 
 static void
@@ -643,6 +1153,26 @@ add_storage_plugin (McpAccountStorage *plugin)
   stores = g_list_insert_sorted (stores, plugin, account_storage_cmp);
 }
 
+/* The keyfile backend that accepts arbitrary accounts: either the
+ * monolithic accounts.cfg, or one file per account in accounts.d */
+static McpAccountStorage *
+keyfile_plugin_new (void)
+{
+  const gchar *name = g_getenv ("MC_ACCOUNT_STORAGE");
+
+  if (name == NULL)
+    name = DEFAULT_ACCOUNT_STORAGE;
+
+  if (!tp_strdiff (name, "sharded-gkeyfile"))
+    return MCP_ACCOUNT_STORAGE (mcd_account_manager_sharded_new ());
+
+  if (tp_strdiff (name, "default-gkeyfile"))
+    g_warning ("Unknown account storage backend '%s', using "
+        "default-gkeyfile", name);
+
+  return MCP_ACCOUNT_STORAGE (mcd_account_manager_default_new ());
+}
+
 static void
 add_libaccounts_plugins_if_enabled (void)
 {
@@ -667,7 +1197,7 @@ sort_and_cache_plugins ()
   _mcd_plugin_loader_init ();
 
   /* Add compiled-in plugins */
-  add_storage_plugin (MCP_ACCOUNT_STORAGE (mcd_account_manager_default_new ()));
+  add_storage_plugin (keyfile_plugin_new ());
   add_libaccounts_plugins_if_enabled ();
 
   for (p = mcp_list_objects(); p != NULL; p = g_list_next (p))
@@ -711,6 +1241,36 @@ mcd_storage_connect_signal (const gchar *signame,
     }
 }
 
+typedef struct {
+    /* number of plugins that are still listing their accounts */
+    guint pending;
+    /* borrowed McpAccountStorage * => owned GList of owned account names */
+    GHashTable *listed;
+} McdStorageLoad;
+
+static void
+list_async_cb (GObject *source,
+    GAsyncResult *result,
+    gpointer user_data)
+{
+  McpAccountStorage *plugin = MCP_ACCOUNT_STORAGE (source);
+  McdStorageLoad *load = user_data;
+  GError *error = NULL;
+  GList *stored;
+
+  stored = mcp_account_storage_list_finish (plugin, result, &error);
+
+  if (error != NULL)
+    {
+      WARNING ("plugin %s failed to list its accounts: %s",
+          mcp_account_storage_name (plugin), error->message);
+      g_error_free (error);
+    }
+
+  g_hash_table_insert (load->listed, plugin, stored);
+  load->pending--;
+}
+
 /*
  * mcd_storage_load:
  * @storage: An object implementing the #McdStorage interface
@@ -723,12 +1283,34 @@ void
 mcd_storage_load (McdStorage *self)
 {
   McpAccountManager *ma = MCP_ACCOUNT_MANAGER (self);
+  McdStorageLoad load = { 0, NULL };
+  GMainContext *context;
   GList *store = NULL;
 
   g_return_if_fail (MCD_IS_STORAGE (self));
 
   sort_and_cache_plugins ();
 
+  /* Plugins that can list their accounts in the background all do so at
+   * the same time; but nothing else may happen until they have finished,
+   * so their callbacks are dispatched from a private main context. */
+  load.listed = g_hash_table_new (NULL, NULL);
+  context = g_main_context_new ();
+  g_main_context_push_thread_default (context);
+
+  for (store = stores; store != NULL; store = g_list_next (store))
+    {
+      load.pending++;
+      mcp_account_storage_list_async (store->data, ma, NULL, list_async_cb,
+          &load);
+    }
+
+  while (load.pending > 0)
+    g_main_context_iteration (context, TRUE);
+
+  g_main_context_pop_thread_default (context);
+  g_main_context_unref (context);
+
   store = g_list_last (stores);
 
   /* fetch accounts stored in plugins, in reverse priority so higher prio *
@@ -737,7 +1319,7 @@ mcd_storage_load (McdStorage *self)
     {
       GList *account;
       McpAccountStorage *plugin = store->data;
-      GList *stored = mcp_account_storage_list (plugin, ma);
+      GList *stored = g_hash_table_lookup (load.listed, plugin);
       const gchar *pname = mcp_account_storage_name (plugin);
       const gint prio = mcp_account_storage_priority (plugin);
 
@@ -755,6 +1337,8 @@ mcd_storage_load (McdStorage *self)
       g_list_free (stored);
       store = g_list_previous (store);
     }
+
+  g_hash_table_unref (load.listed);
 }
 
 /*
@@ -779,7 +1363,7 @@ mcd_storage_dup_accounts (McdStorage *self,
     {
       McdStorageAccount *sa = v;
 
-      if (g_hash_table_size (sa->attributes) > 0)
+      if (sa->attributes->len > 0)
         g_ptr_array_add (ret, g_strdup (k));
     }
 
@@ -807,13 +1391,15 @@ mcd_storage_dup_attributes (McdStorage *self,
 
   if (sa != NULL)
     {
-      GHashTableIter iter;
-      gpointer k;
+      guint i;
 
-      g_hash_table_iter_init (&iter, sa->attributes);
+      for (i = 0; i < sa->attributes->len; i++)
+        {
+          McdStorageAttribute *attr = &g_array_index (sa->attributes,
+              McdStorageAttribute, i);
 
-      while (g_hash_table_iter_next (&iter, &k, NULL))
-        g_ptr_array_add (ret, g_strdup (k));
+          g_ptr_array_add (ret, g_strdup (g_quark_to_string (attr->name)));
+        }
     }
 
   g_ptr_array_add (ret, NULL);
@@ -826,8 +1412,8 @@ mcd_storage_dup_attributes (McdStorage *self,
  * @account: unique name of the account
  *
  * Returns: the #McpAccountStorage object which is handling the account,
- * if any (if a new account has not yet been flushed to storage this can
- * be %NULL).
+ * if any (if a new account has not yet been flushed to storage, or the
+ * account is not known at all, this can be %NULL).
  *
  * Plugins are kept in permanent storage and can never be unloaded, so
  * the returned pointer need not be reffed or unreffed. (Indeed, it's
@@ -841,9 +1427,21 @@ mcd_storage_get_plugin (McdStorage *self,
   McpAccountManager *ma = MCP_ACCOUNT_MANAGER (self);
   McpAccountStorage *owner = NULL;
 
+  McdStorageAccount *sa;
+
   g_return_val_if_fail (MCD_IS_STORAGE (self), NULL);
   g_return_val_if_fail (account != NULL, NULL);
 
+  sa = lookup_account (self, account);
+
+  /* don't leave an empty entry behind for an account we've never heard of:
+   * no plugin has told us about it, so none of them can be handling it */
+  if (sa == NULL)
+    return NULL;
+
+  if (sa->storage != NULL)
+    return sa->storage;
+
   for (; store != NULL && owner == NULL; store = g_list_next (store))
     {
       McpAccountStorage *plugin = store->data;
@@ -852,6 +1450,7 @@ mcd_storage_get_plugin (McdStorage *self,
         owner = plugin;
     }
 
+  sa->storage = owner;
   return owner;
 }
 
@@ -946,7 +1545,7 @@ mcd_storage_get_attribute (McdStorage *self,
       return FALSE;
     }
 
-  variant = g_hash_table_lookup (sa->attributes, attribute);
+  variant = mcd_storage_account_get_attribute (sa, attribute);
 
   if (variant == NULL)
     {
@@ -974,8 +1573,7 @@ mcd_storage_get_parameter (McdStorage *self,
     GError **error)
 {
   McdStorageAccount *sa;
-  const gchar *escaped;
-  GVariant *variant;
+  McdStorageParameter *param;
 
   g_return_val_if_fail (MCD_IS_STORAGE (self), FALSE);
   g_return_val_if_fail (account != NULL, FALSE);
@@ -990,23 +1588,155 @@ mcd_storage_get_parameter (McdStorage *self,
       return FALSE;
     }
 
-  variant = g_hash_table_lookup (sa->parameters, parameter);
+  param = mcd_storage_account_lookup_parameter (sa, parameter);
 
-  if (variant != NULL)
-    return mcd_storage_coerce_variant_to_value (variant, value, error);
-
-  /* OK, we don't have it as a variant. How about the keyfile-escaped
-   * version? */
-  escaped = g_hash_table_lookup (sa->escaped_parameters, parameter);
-
-  if (escaped == NULL)
+  if (param == NULL)
     {
       g_set_error (error, TP_ERROR, TP_ERROR_NOT_AVAILABLE,
           "Parameter '%s' not stored by account %s", parameter, account);
       return FALSE;
     }
 
-  return mcd_keyfile_unescape_value (escaped, value, error);
+  /* Connect and GetAll ask for every parameter, always with the type the
+   * CM gave it, so usually we've already done the work */
+  if (G_VALUE_TYPE (&param->decoded) == G_VALUE_TYPE (value))
+    {
+      g_value_copy (&param->decoded, value);
+      return TRUE;
+    }
+
+  if (param->value != NULL)
+    {
+      if (!mcd_storage_coerce_variant_to_value (param->value, value, error))
+        return FALSE;
+    }
+  else
+    {
+      /* OK, we don't have it as a variant. How about the keyfile-escaped
+       * version? */
+      if (!mcd_keyfile_unescape_value (param->escaped, value, error))
+        return FALSE;
+    }
+
+  if (G_IS_VALUE (&param->decoded))
+    g_value_unset (&param->decoded);
+
+  g_value_init (&param->decoded, G_VALUE_TYPE (value));
+  g_value_copy (value, &param->decoded);
+  return TRUE;
+}
+
+/*
+ * mcd_storage_dup_typed_parameters:
+ * @storage: An object implementing the #McdStorage interface
+ * @account: unique name of the account
+ * @untyped: (out) (transfer full): set to the names of the parameters whose
+ *  types we don't know
+ *
+ * Returns: (transfer full): a map from parameter name to slice-allocated
+ *  #GValue, for every parameter of @account whose type we know
+ */
+GHashTable *
+mcd_storage_dup_typed_parameters (McdStorage *self,
+    const gchar *account,
+    GStrv *untyped)
+{
+  GHashTable *params;
+  GPtrArray *unknown;
+  McdStorageAccount *sa;
+
+  g_return_val_if_fail (MCD_IS_STORAGE (self), NULL);
+  g_return_val_if_fail (account != NULL, NULL);
+  g_return_val_if_fail (untyped != NULL, NULL);
+
+  params = g_hash_table_new_full (g_str_hash, g_str_equal, g_free,
+      (GDestroyNotify) tp_g_value_slice_free);
+  unknown = g_ptr_array_new ();
+  sa = lookup_account (self, account);
+
+  if (sa != NULL)
+    {
+      guint i;
+
+      for (i = 0; i < sa->parameters->len; i++)
+        {
+          McdStorageParameter *param = &g_array_index (sa->parameters,
+              McdStorageParameter, i);
+          const gchar *name = g_quark_to_string (param->name);
+          GValue value = G_VALUE_INIT;
+
+          if (param->value != NULL)
+            dbus_g_value_parse_g_variant (param->value, &value);
+
+          if (G_IS_VALUE (&value))
+            {
+              g_hash_table_insert (params, g_strdup (name),
+                  tp_g_value_slice_dup (&value));
+              g_value_unset (&value);
+            }
+          else
+            {
+              g_ptr_array_add (unknown, g_strdup (name));
+            }
+        }
+    }
+
+  g_ptr_array_add (unknown, NULL);
+  *untyped = (GStrv) g_ptr_array_free (unknown, FALSE);
+  return params;
+}
+
+/*
+ * mcd_storage_set_parameter_type:
+ * @storage: An object implementing the #McdStorage interface
+ * @account: unique name of the account
+ * @parameter: name of the parameter, e.g. 'port'
+ * @signature: its D-Bus signature, e.g. 'u'
+ *
+ * Remember the type of a parameter that was stored without one, so that
+ * we don't need to ask the CM next time. The caller is responsible for
+ * committing the account.
+ *
+ * Returns: %TRUE if the parameter's type was not already known
+ */
+gboolean
+mcd_storage_set_parameter_type (McdStorage *self,
+    const gchar *account,
+    const gchar *parameter,
+    const gchar *signature)
+{
+  McdStorageAccount *sa;
+  McdStorageParameter *param;
+  gchar key[MAX_KEY_LENGTH];
+
+  g_return_val_if_fail (MCD_IS_STORAGE (self), FALSE);
+  g_return_val_if_fail (account != NULL, FALSE);
+  g_return_val_if_fail (parameter != NULL, FALSE);
+  g_return_val_if_fail (signature != NULL, FALSE);
+
+  sa = lookup_account (self, account);
+
+  if (sa == NULL)
+    return FALSE;
+
+  param = mcd_storage_account_lookup_parameter (sa, parameter);
+
+  if (param == NULL || param->value != NULL)
+    return FALSE;
+
+  mcd_storage_account_set_parameter_type (sa, parameter, signature);
+  param = mcd_storage_account_lookup_parameter (sa, parameter);
+
+  /* if it didn't decode as that type, forget it */
+  if (param->value == NULL)
+    {
+      mcd_storage_account_set_parameter_type (sa, parameter, NULL);
+      return FALSE;
+    }
+
+  g_snprintf (key, sizeof (key), PARAM_TYPE_PREFIX "%s", parameter);
+  update_storage (self, account, key, NULL, signature, FALSE);
+  return TRUE;
 }
 
 static gboolean
@@ -1414,6 +2144,76 @@ mcd_storage_get_integer (McdStorage *self,
   return g_value_get_int (&tmp);
 }
 
+/*
+ * Store @key in @plugin, or delete it if @escaped is %NULL.
+ *
+ * Returns: %TRUE if @plugin claimed @key
+ */
+static gboolean
+update_plugin (McdStorage *self,
+    McpAccountStorage *plugin,
+    const gchar *account,
+    const gchar *key,
+    GVariant *variant,
+    const gchar *escaped,
+    gboolean secret)
+{
+  McpAccountManager *ma = MCP_ACCOUNT_MANAGER (self);
+  const gchar *pn = mcp_account_storage_name (plugin);
+  gboolean parameter = g_str_has_prefix (key, "param-");
+  gboolean done;
+
+  if (escaped == NULL)
+    {
+      DEBUG ("MCP:%s -> delete %s.%s", pn, account, key);
+      mcp_account_storage_delete (plugin, ma, account, key);
+
+      if (parameter)
+        {
+          gchar type_key[MAX_KEY_LENGTH];
+
+          g_snprintf (type_key, sizeof (type_key), PARAM_TYPE_PREFIX "%s",
+              key + 6);
+          mcp_account_storage_delete (plugin, ma, account, type_key);
+        }
+
+      return TRUE;
+    }
+
+  if (variant != NULL && !parameter &&
+      mcp_account_storage_set_attribute (plugin, ma, account, key, variant,
+        MCP_ATTRIBUTE_FLAG_NONE))
+    {
+      DEBUG ("MCP:%s -> store attribute %s.%s", pn, account, key);
+      return TRUE;
+    }
+
+  if (variant != NULL && parameter &&
+      mcp_account_storage_set_parameter (plugin, ma, account, key + 6,
+        variant,
+        secret ? MCP_PARAMETER_FLAG_SECRET : MCP_PARAMETER_FLAG_NONE))
+    {
+      DEBUG ("MCP:%s -> store parameter %s.%s", pn, account, key);
+      return TRUE;
+    }
+
+  done = mcp_account_storage_set (plugin, ma, account, key, escaped);
+  DEBUG ("MCP:%s -> %s %s.%s", pn, done ? "store" : "ignore", account, key);
+
+  /* the plugin only has the string, so it needs the type too */
+  if (done && parameter && variant != NULL)
+    {
+      gchar type_key[MAX_KEY_LENGTH];
+
+      g_snprintf (type_key, sizeof (type_key), PARAM_TYPE_PREFIX "%s",
+          key + 6);
+      mcp_account_storage_set (plugin, ma, account, type_key,
+          g_variant_get_type_string (variant));
+    }
+
+  return done;
+}
+
 static void
 update_storage (McdStorage *self,
     const gchar *account,
@@ -1424,12 +2224,47 @@ update_storage (McdStorage *self,
 {
   GList *store;
   gboolean done = FALSE;
-  gboolean parameter = g_str_has_prefix (key, "param-");
-  McpAccountManager *ma = MCP_ACCOUNT_MANAGER (self);
+  McdStorageAccount *sa;
+  McdStorageTransaction *capturing;
 
   if (secret)
     mcd_storage_make_secret (self, account, key);
 
+  capturing = g_hash_table_lookup (self->capturing, account);
+
+  if (capturing != NULL)
+    {
+      mcd_storage_transaction_hold (capturing, key, variant, escaped, secret);
+      return;
+    }
+
+  sa = ensure_account (self, account);
+
+  /* once we know which plugin has the account, nobody else needs to hear
+   * about it, unless that plugin refuses the key */
+  if (sa->storage != NULL)
+    {
+      GList *l;
+
+      /* deleting always succeeds */
+      if (escaped == NULL)
+        done = update_plugin (self, sa->storage, account, key, NULL, NULL,
+            secret);
+      else
+        done = update_plugin (self, sa->storage, account, key, variant,
+            escaped, secret);
+
+      if (done)
+        {
+          /* any plugin that took this key when the owner refused it
+           * mustn't keep its copy */
+          for (l = sa->others; l != NULL; l = l->next)
+            update_plugin (self, l->data, account, key, NULL, NULL, secret);
+
+          return;
+        }
+    }
+
   /* we're deleting, which is unconditional, no need to check if anyone *
    * claims this setting for themselves                                 */
   if (escaped == NULL)
@@ -1438,33 +2273,25 @@ update_storage (McdStorage *self,
   for (store = stores; store != NULL; store = g_list_next (store))
     {
       McpAccountStorage *plugin = store->data;
-      const gchar *pn = mcp_account_storage_name (plugin);
+
+      /* it has already refused */
+      if (plugin == sa->storage)
+        continue;
 
       if (done)
         {
-          DEBUG ("MCP:%s -> delete %s.%s", pn, account, key);
-          mcp_account_storage_delete (plugin, ma, account, key);
-        }
-      else if (variant != NULL && !parameter &&
-          mcp_account_storage_set_attribute (plugin, ma, account, key, variant,
-            MCP_ATTRIBUTE_FLAG_NONE))
-        {
-          done = TRUE;
-          DEBUG ("MCP:%s -> store attribute %s.%s", pn, account, key);
+          /* deleting always succeeds */
+          update_plugin (self, plugin, account, key, NULL, NULL, secret);
         }
-      else if (variant != NULL && parameter &&
-          mcp_account_storage_set_parameter (plugin, ma, account, key + 6,
-            variant,
-            secret ? MCP_PARAMETER_FLAG_SECRET : MCP_PARAMETER_FLAG_NONE))
+      else if (update_plugin (self, plugin, account, key, variant, escaped,
+            secret))
         {
           done = TRUE;
-          DEBUG ("MCP:%s -> store parameter %s.%s", pn, account, key);
-        }
-      else
-        {
-          done = mcp_account_storage_set (plugin, ma, account, key, escaped);
-          DEBUG ("MCP:%s -> %s %s.%s",
-              pn, done ? "store" : "ignore", account, key);
+
+          if (sa->storage == NULL)
+            sa->storage = plugin;
+          else if (g_list_find (sa->others, plugin) == NULL)
+            sa->others = g_list_prepend (sa->others, plugin);
         }
     }
 }
@@ -1554,19 +2381,16 @@ mcd_storage_set_attribute (McdStorage *self,
   else
     new_v = NULL;
 
-  old_v = g_hash_table_lookup (sa->attributes, attribute);
+  old_v = mcd_storage_account_get_attribute (sa, attribute);
 
   if (!mcd_nullable_variant_equal (old_v, new_v))
     {
       gchar *escaped = NULL;
 
-      /* First put it in the attributes hash table. (Watch out, this might
+      /* First put it in the attributes array. (Watch out, this might
        * invalidate old_v.) */
-      if (new_v == NULL)
-        g_hash_table_remove (sa->attributes, attribute);
-      else
-        g_hash_table_insert (sa->attributes, g_strdup (attribute),
-            g_variant_ref (new_v));
+      mcd_storage_account_take_attribute (sa, attribute,
+          new_v == NULL ? NULL : g_variant_ref (new_v));
 
       /* OK now we have to escape it in a stupid way for plugins */
       if (value != NULL)
@@ -1606,11 +2430,12 @@ mcd_storage_set_parameter (McdStorage *self,
     const GValue *value,
     gboolean secret)
 {
-  GVariant *old_v;
+  GVariant *old_v = NULL;
   GVariant *new_v = NULL;
-  const gchar *old_escaped;
+  const gchar *old_escaped = NULL;
   gchar *new_escaped = NULL;
   McdStorageAccount *sa;
+  McdStorageParameter *param;
   gboolean updated = FALSE;
 
   g_return_val_if_fail (MCD_IS_STORAGE (self), FALSE);
@@ -1625,8 +2450,13 @@ mcd_storage_set_parameter (McdStorage *self,
       new_v = g_variant_ref_sink (dbus_g_value_build_g_variant (value));
     }
 
-  old_v = g_hash_table_lookup (sa->parameters, parameter);
-  old_escaped = g_hash_table_lookup (sa->escaped_parameters, parameter);
+  param = mcd_storage_account_lookup_parameter (sa, parameter);
+
+  if (param != NULL)
+    {
+      old_v = param->value;
+      old_escaped = param->escaped;
+    }
 
   if (old_v != NULL)
     updated = !mcd_nullable_variant_equal (old_v, new_v);
@@ -1639,12 +2469,10 @@ mcd_storage_set_parameter (McdStorage *self,
     {
       gchar key[MAX_KEY_LENGTH];
 
-      g_hash_table_remove (sa->parameters, parameter);
-      g_hash_table_remove (sa->escaped_parameters, parameter);
-
-      if (new_v != NULL)
-        g_hash_table_insert (sa->parameters, g_strdup (parameter),
-            g_variant_ref (new_v));
+      mcd_storage_account_take_parameter (sa, parameter,
+          new_v == NULL ? NULL : g_variant_ref (new_v), NULL);
+      mcd_storage_account_set_parameter_type (sa, parameter,
+          new_v == NULL ? NULL : g_variant_get_type_string (new_v));
 
       g_snprintf (key, sizeof (key), "param-%s", parameter);
       update_storage (self, account, key, new_v, new_escaped, secret);
@@ -1922,6 +2750,10 @@ mcd_storage_create_account (McdStorage *self,
    * splits the account across two plugins, but in practice
    * it isn't a problem because the default plugin's create()
    * doesn't really do anything anyway.
+   *
+   * Whichever plugin claims the first set() becomes the account's owner,
+   * and from then on update_storage() only talks to that plugin, and to
+   * any plugin that stores a key the owner refuses.
    */
   for (store = stores; store != NULL; store = g_list_next (store))
     {
@@ -1947,6 +2779,27 @@ mcd_storage_create_account (McdStorage *self,
 }
 
 
+/* Returns: (transfer container): the plugins that hold @sa, in priority
+ *  order; that's every plugin if we don't know which one owns it */
+static GList *
+dup_account_plugins (McdStorageAccount *sa)
+{
+  GList *store;
+  GList *plugins = NULL;
+
+  if (sa == NULL || sa->storage == NULL)
+    return g_list_copy (stores);
+
+  for (store = stores; store != NULL; store = g_list_next (store))
+    {
+      if (store->data == sa->storage ||
+          g_list_find (sa->others, store->data) != NULL)
+        plugins = g_list_prepend (plugins, store->data);
+    }
+
+  return g_list_reverse (plugins);
+}
+
 /*
  * mcd_storage_delete_account:
  * @storage: An object implementing the #McdStorage interface
@@ -1961,69 +2814,346 @@ void
 mcd_storage_delete_account (McdStorage *self,
     const gchar *account)
 {
-  GList *store;
+  GList *plugins, *l;
   McpAccountManager *ma = MCP_ACCOUNT_MANAGER (self);
 
   g_return_if_fail (MCD_IS_STORAGE (self));
   g_return_if_fail (account != NULL);
 
+  plugins = dup_account_plugins (lookup_account (self, account));
   g_hash_table_remove (self->accounts, account);
 
-  for (store = stores; store != NULL; store = g_list_next (store))
-    {
-      McpAccountStorage *plugin = store->data;
+  for (l = plugins; l != NULL; l = l->next)
+    mcp_account_storage_delete (l->data, ma, account, NULL);
 
-      mcp_account_storage_delete (plugin, ma, account, NULL);
-    }
+  g_list_free (plugins);
 }
 
-/*
- * mcd_storage_commit:
- * @storage: An object implementing the #McdStorage interface
- * @account: the unique name of an account
- *
- * Sync the long term storage (whatever it might be) with the current
- * state of our internal cache.
- */
-void
-mcd_storage_commit (McdStorage *self, const gchar *account)
+static void
+commit_one (McdStorage *self,
+    const gchar *account)
 {
-  GList *store;
+  GList *plugins, *l;
   McpAccountManager *ma = MCP_ACCOUNT_MANAGER (self);
 
-  g_return_if_fail (MCD_IS_STORAGE (self));
+  plugins = dup_account_plugins (lookup_account (self, account));
 
-  for (store = stores; store != NULL; store = g_list_next (store))
+  for (l = plugins; l != NULL; l = l->next)
     {
-      McpAccountStorage *plugin = store->data;
-      const gchar *pname = mcp_account_storage_name (plugin);
-
-      if (account != NULL)
-        {
-          DEBUG ("flushing plugin %s %s to long term storage", pname, account);
-          mcp_account_storage_commit_one (plugin, ma, account);
-        }
-      else
-        {
-          DEBUG ("flushing plugin %s to long term storage", pname);
-          mcp_account_storage_commit (plugin, ma);
-        }
+      DEBUG ("flushing plugin %s %s to long term storage",
+          mcp_account_storage_name (l->data), account);
+      mcp_account_storage_commit_one (l->data, ma, account);
     }
+
+  g_list_free (plugins);
 }
 
-/*
- * mcd_storage_set_strv:
- * @storage: An object implementing the #McdStorage interface
- * @account: the unique name of an account
- * @attribute: the name of the attribute
- * @strv: the string vector to be stored (where %NULL is treated as equivalent
- * to an empty vector)
- *
- * Copies and stores the supplied string vector to the internal cache.
- *
- * Returns: a #gboolean indicating whether the cache actually required an
- * update (so that the caller can decide whether to request a commit to
- * long term storage or not). %TRUE indicates the cache was updated and
+typedef struct {
+    McdStorage *self;
+    gchar *account;
+} McdStorageCommit;
+
+static McdStorageCommit *
+storage_commit_new (McdStorage *self,
+    const gchar *account)
+{
+  McdStorageCommit *commit = g_slice_new0 (McdStorageCommit);
+
+  commit->self = g_object_ref (self);
+  commit->account = g_strdup (account);
+  self->pending_commits++;
+  return commit;
+}
+
+static void
+commit_async_cb (GObject *source,
+    GAsyncResult *result,
+    gpointer user_data)
+{
+  McpAccountStorage *plugin = MCP_ACCOUNT_STORAGE (source);
+  McdStorageCommit *commit = user_data;
+  GError *error = NULL;
+
+  if (mcp_account_storage_commit_finish (plugin, result, &error))
+    {
+      DEBUG ("plugin %s flushed %s", mcp_account_storage_name (plugin),
+          commit->account);
+    }
+  else
+    {
+      WARNING ("plugin %s failed to flush %s: %s",
+          mcp_account_storage_name (plugin), commit->account, error->message);
+      g_error_free (error);
+    }
+
+  commit->self->pending_commits--;
+  g_object_unref (commit->self);
+  g_free (commit->account);
+  g_slice_free (McdStorageCommit, commit);
+}
+
+/* As for commit_one(), but without waiting for plugins that can write
+ * in the background */
+static void
+commit_one_async (McdStorage *self,
+    const gchar *account)
+{
+  GList *plugins, *l;
+  McpAccountManager *ma = MCP_ACCOUNT_MANAGER (self);
+
+  plugins = dup_account_plugins (lookup_account (self, account));
+
+  for (l = plugins; l != NULL; l = l->next)
+    {
+      DEBUG ("flushing plugin %s %s to long term storage",
+          mcp_account_storage_name (l->data), account);
+      mcp_account_storage_commit_async (l->data, ma, account, NULL,
+          commit_async_cb, storage_commit_new (self, account));
+    }
+
+  g_list_free (plugins);
+}
+
+/* Returns: (transfer full): the set of dirty accounts, which is replaced
+ *  with an empty set */
+static GHashTable *
+steal_dirty (McdStorage *self)
+{
+  GHashTable *dirty = self->dirty;
+
+  self->dirty = g_hash_table_new_full (g_str_hash, g_str_equal, g_free, NULL);
+  return dirty;
+}
+
+/* Returns: (transfer container): the plugins that hold the accounts in
+ *  @dirty, each once, in priority order */
+static GList *
+dup_dirty_plugins (McdStorage *self,
+    GHashTable *dirty)
+{
+  GHashTable *wanted = g_hash_table_new (NULL, NULL);
+  GHashTableIter iter;
+  gpointer account;
+  GList *store;
+  GList *plugins = NULL;
+
+  g_hash_table_iter_init (&iter, dirty);
+
+  while (g_hash_table_iter_next (&iter, &account, NULL))
+    {
+      McdStorageAccount *sa = lookup_account (self, account);
+
+      if (sa != NULL && sa->storage != NULL)
+        {
+          GList *l;
+
+          g_hash_table_add (wanted, sa->storage);
+
+          for (l = sa->others; l != NULL; l = l->next)
+            g_hash_table_add (wanted, l->data);
+        }
+      else
+        {
+          /* we don't know where it lives, so commit_one() would have
+           * asked every plugin */
+          g_hash_table_unref (wanted);
+          return g_list_copy (stores);
+        }
+    }
+
+  for (store = stores; store != NULL; store = g_list_next (store))
+    {
+      if (g_hash_table_contains (wanted, store->data))
+        plugins = g_list_prepend (plugins, store->data);
+    }
+
+  g_hash_table_unref (wanted);
+  return g_list_reverse (plugins);
+}
+
+static void
+cancel_commit_later (McdStorage *self)
+{
+  if (self->commit_id != 0)
+    {
+      g_source_remove (self->commit_id);
+      self->commit_id = 0;
+    }
+}
+
+/*
+ * mcd_storage_commit:
+ * @storage: An object implementing the #McdStorage interface
+ * @account: the unique name of an account
+ *
+ * Sync the long term storage (whatever it might be) with the current
+ * state of our internal cache.
+ */
+void
+mcd_storage_commit (McdStorage *self, const gchar *account)
+{
+  GList *store;
+  McpAccountManager *ma = MCP_ACCOUNT_MANAGER (self);
+
+  g_return_if_fail (MCD_IS_STORAGE (self));
+
+  if (account != NULL)
+    {
+      g_hash_table_remove (self->dirty, account);
+
+      if (g_hash_table_size (self->dirty) == 0)
+        cancel_commit_later (self);
+    }
+  else
+    {
+      /* committing everything covers whatever was pending */
+      g_hash_table_remove_all (self->dirty);
+      cancel_commit_later (self);
+    }
+
+  if (account != NULL)
+    {
+      commit_one (self, account);
+      return;
+    }
+
+  for (store = stores; store != NULL; store = g_list_next (store))
+    {
+      McpAccountStorage *plugin = store->data;
+
+      DEBUG ("flushing plugin %s to long term storage",
+          mcp_account_storage_name (plugin));
+      mcp_account_storage_commit (plugin, ma);
+    }
+}
+
+static gboolean
+commit_later_cb (gpointer user_data)
+{
+  McdStorage *self = user_data;
+  GHashTable *dirty;
+  GHashTableIter iter;
+  gpointer account;
+
+  self->commit_id = 0;
+
+  DEBUG ("committing %u accounts", g_hash_table_size (self->dirty));
+
+  /* nobody is waiting for this, so plugins that can write in the
+   * background may do so */
+  dirty = steal_dirty (self);
+  g_hash_table_iter_init (&iter, dirty);
+
+  while (g_hash_table_iter_next (&iter, &account, NULL))
+    commit_one_async (self, account);
+
+  g_hash_table_unref (dirty);
+  return FALSE;
+}
+
+/*
+ * mcd_storage_commit_later:
+ * @storage: An object implementing the #McdStorage interface
+ * @account: the unique name of an account
+ *
+ * Arrange for @account to be synced to long term storage soon. Changes
+ * to any number of accounts that arrive within the commit delay of each
+ * other are written out together by mcd_storage_flush(), but no change
+ * waits longer than the maximum commit delay.
+ */
+void
+mcd_storage_commit_later (McdStorage *self,
+    const gchar *account)
+{
+  gint64 now = g_get_monotonic_time ();
+  gint64 elapsed;
+  guint delay;
+
+  g_return_if_fail (MCD_IS_STORAGE (self));
+  g_return_if_fail (account != NULL);
+
+  delay = self->commit_delay;
+
+  if (g_hash_table_size (self->dirty) == 0)
+    self->dirty_since = now;
+
+  g_hash_table_add (self->dirty, g_strdup (account));
+
+  /* each change pushes the commit back, until the oldest pending change
+   * has waited for max_commit_delay */
+  elapsed = (now - self->dirty_since) / 1000;
+
+  if (elapsed >= self->max_commit_delay)
+    delay = 0;
+  else if (elapsed + delay > self->max_commit_delay)
+    delay = self->max_commit_delay - elapsed;
+
+  cancel_commit_later (self);
+  self->commit_id = g_timeout_add (delay, commit_later_cb, self);
+}
+
+/*
+ * mcd_storage_flush:
+ * @storage: An object implementing the #McdStorage interface
+ *
+ * Synchronously commit every account that mcd_storage_commit_later() is
+ * waiting for, with one commit per plugin that holds any of them. This
+ * should be called before exiting.
+ *
+ * This doesn't run the main loop, so it doesn't wait for commits that are
+ * already in progress to finish; instead, if there are any, every plugin
+ * is committed, since a plugin's synchronous commit doesn't return until
+ * its earlier asynchronous commits have reached long term storage.
+ */
+void
+mcd_storage_flush (McdStorage *self)
+{
+  McpAccountManager *ma = MCP_ACCOUNT_MANAGER (self);
+  GHashTable *dirty;
+  GList *plugins, *l;
+
+  g_return_if_fail (MCD_IS_STORAGE (self));
+
+  cancel_commit_later (self);
+
+  if (g_hash_table_size (self->dirty) == 0 && self->pending_commits == 0)
+    return;
+
+  DEBUG ("committing %u accounts, %u commits in progress",
+      g_hash_table_size (self->dirty), self->pending_commits);
+
+  /* a plugin could conceivably call back into us */
+  dirty = steal_dirty (self);
+
+  if (self->pending_commits > 0)
+    plugins = g_list_copy (stores);
+  else
+    plugins = dup_dirty_plugins (self, dirty);
+
+  for (l = plugins; l != NULL; l = l->next)
+    {
+      DEBUG ("flushing plugin %s to long term storage",
+          mcp_account_storage_name (l->data));
+      mcp_account_storage_commit (l->data, ma);
+    }
+
+  g_list_free (plugins);
+  g_hash_table_unref (dirty);
+}
+
+/*
+ * mcd_storage_set_strv:
+ * @storage: An object implementing the #McdStorage interface
+ * @account: the unique name of an account
+ * @attribute: the name of the attribute
+ * @strv: the string vector to be stored (where %NULL is treated as equivalent
+ * to an empty vector)
+ *
+ * Copies and stores the supplied string vector to the internal cache.
+ *
+ * Returns: a #gboolean indicating whether the cache actually required an
+ * update (so that the caller can decide whether to request a commit to
+ * long term storage or not). %TRUE indicates the cache was updated and
  * may not be in sync with the store any longer, %FALSE indicates we already
  * held the value supplied.
  */
@@ -2049,6 +3179,379 @@ mcd_storage_set_strv (McdStorage *storage,
   return ret;
 }
 
+/* A change that was made to the cache while a McdStorageTransaction was
+ * capturing the account, but not passed on to the plugins yet */
+typedef struct {
+    GVariant *variant;
+    gchar *escaped;
+    gboolean secret;
+} McdStorageHeldWrite;
+
+static void
+mcd_storage_held_write_free (gpointer p)
+{
+  McdStorageHeldWrite *write = p;
+
+  tp_clear_pointer (&write->variant, g_variant_unref);
+  g_free (write->escaped);
+  g_slice_free (McdStorageHeldWrite, write);
+}
+
+/* A change staged in a McdStorageTransaction */
+typedef struct {
+    /* an attribute, or "param-" plus a parameter */
+    gchar *key;
+    /* unset if @key is to be removed */
+    GValue value;
+    gboolean secret;
+} McdStorageChange;
+
+struct _McdStorageTransaction {
+    McdStorage *storage;
+    gchar *account;
+    /* McdStorageChange, at most one per key, in the order they were first
+     * staged */
+    GArray *changes;
+    /* if the transaction is capturing its account: owned key => owned
+     * McdStorageHeldWrite, for the latest change to each key;
+     * otherwise %NULL */
+    GHashTable *held;
+};
+
+static void
+mcd_storage_change_clear (gpointer p)
+{
+  McdStorageChange *change = p;
+
+  g_free (change->key);
+
+  if (G_IS_VALUE (&change->value))
+    g_value_unset (&change->value);
+}
+
+/*
+ * mcd_storage_transaction_new:
+ * @storage: An object implementing the #McdStorage interface
+ * @account: the unique name of an account
+ *
+ * Start staging changes to @account. Nothing is changed, in the cache or
+ * in the plugins, until mcd_storage_transaction_apply() or
+ * mcd_storage_transaction_commit() is called; if the same key is changed
+ * more than once, only the last change counts.
+ *
+ * Returns: (transfer full): a new transaction
+ */
+McdStorageTransaction *
+mcd_storage_transaction_new (McdStorage *storage,
+    const gchar *account)
+{
+  McdStorageTransaction *self;
+
+  g_return_val_if_fail (MCD_IS_STORAGE (storage), NULL);
+  g_return_val_if_fail (account != NULL, NULL);
+
+  self = g_slice_new0 (McdStorageTransaction);
+  self->storage = g_object_ref (storage);
+  self->account = g_strdup (account);
+  self->changes = g_array_new (FALSE, FALSE, sizeof (McdStorageChange));
+  g_array_set_clear_func (self->changes, mcd_storage_change_clear);
+  return self;
+}
+
+/*
+ * mcd_storage_transaction_begin:
+ * @storage: An object implementing the #McdStorage interface
+ * @account: the unique name of an account
+ *
+ * As for mcd_storage_transaction_new(), but the transaction also captures
+ * @account: until it is applied, committed or freed, changes that are
+ * made to @account directly, with mcd_storage_set_attribute() and
+ * mcd_storage_set_parameter(), go into the cache straight away but are
+ * held back from the plugins. They are passed on when the transaction
+ * finishes, before its staged changes, so that
+ * mcd_storage_transaction_commit() writes everything in one commit.
+ *
+ * Returns: (transfer full): a new transaction
+ */
+McdStorageTransaction *
+mcd_storage_transaction_begin (McdStorage *storage,
+    const gchar *account)
+{
+  McdStorageTransaction *self;
+
+  self = mcd_storage_transaction_new (storage, account);
+  g_return_val_if_fail (self != NULL, NULL);
+  g_return_val_if_fail (!g_hash_table_contains (storage->capturing, account),
+      self);
+
+  self->held = g_hash_table_new_full (g_str_hash, g_str_equal, g_free,
+      mcd_storage_held_write_free);
+  g_hash_table_insert (storage->capturing, self->account, self);
+  return self;
+}
+
+static void
+mcd_storage_transaction_hold (McdStorageTransaction *self,
+    const gchar *key,
+    GVariant *variant,
+    const gchar *escaped,
+    gboolean secret)
+{
+  McdStorageHeldWrite *write = g_slice_new0 (McdStorageHeldWrite);
+
+  if (variant != NULL)
+    write->variant = g_variant_ref (variant);
+
+  write->escaped = g_strdup (escaped);
+  write->secret = secret;
+  g_hash_table_replace (self->held, g_strdup (key), write);
+}
+
+/* Stop capturing the account, and pass on what was held back.
+ *
+ * Returns: %TRUE if anything was */
+static gboolean
+mcd_storage_transaction_release (McdStorageTransaction *self)
+{
+  GHashTable *held = self->held;
+  GHashTableIter iter;
+  gpointer k, v;
+  gboolean released = FALSE;
+
+  if (held == NULL)
+    return FALSE;
+
+  self->held = NULL;
+  g_hash_table_remove (self->storage->capturing, self->account);
+
+  /* if the account was deleted meanwhile, nothing needs to be written */
+  if (lookup_account (self->storage, self->account) != NULL)
+    {
+      g_hash_table_iter_init (&iter, held);
+
+      while (g_hash_table_iter_next (&iter, &k, &v))
+        {
+          McdStorageHeldWrite *write = v;
+
+          update_storage (self->storage, self->account, k, write->variant,
+              write->escaped, write->secret);
+          released = TRUE;
+        }
+    }
+
+  g_hash_table_unref (held);
+  return released;
+}
+
+/*
+ * mcd_storage_transaction_free:
+ *
+ * Discard a transaction and any changes that have not been applied. If
+ * it was capturing its account, changes that were made to the account
+ * meanwhile are passed on to the plugins, but not committed.
+ */
+void
+mcd_storage_transaction_free (McdStorageTransaction *self)
+{
+  g_return_if_fail (self != NULL);
+
+  mcd_storage_transaction_release (self);
+  g_array_unref (self->changes);
+  g_free (self->account);
+  g_object_unref (self->storage);
+  g_slice_free (McdStorageTransaction, self);
+}
+
+static void
+mcd_storage_transaction_stage (McdStorageTransaction *self,
+    const gchar *key,
+    const GValue *value,
+    gboolean secret)
+{
+  McdStorageChange *change = NULL;
+  guint i;
+
+  for (i = 0; i < self->changes->len; i++)
+    {
+      McdStorageChange *c = &g_array_index (self->changes,
+          McdStorageChange, i);
+
+      if (!tp_strdiff (c->key, key))
+        {
+          change = c;
+          break;
+        }
+    }
+
+  if (change == NULL)
+    {
+      McdStorageChange c = { g_strdup (key), G_VALUE_INIT, FALSE };
+
+      g_array_append_val (self->changes, c);
+      change = &g_array_index (self->changes, McdStorageChange,
+          self->changes->len - 1);
+    }
+  else if (G_IS_VALUE (&change->value))
+    {
+      g_value_unset (&change->value);
+    }
+
+  if (value != NULL)
+    {
+      g_value_init (&change->value, G_VALUE_TYPE (value));
+      g_value_copy (value, &change->value);
+    }
+
+  change->secret = secret;
+}
+
+/*
+ * mcd_storage_transaction_set_attribute:
+ * @attribute: the name of the attribute
+ * @value: (allow-none): the value to be stored, or %NULL to erase it
+ *
+ * As for mcd_storage_set_attribute(), but staged in @self.
+ */
+void
+mcd_storage_transaction_set_attribute (McdStorageTransaction *self,
+    const gchar *attribute,
+    const GValue *value)
+{
+  g_return_if_fail (self != NULL);
+  g_return_if_fail (attribute != NULL);
+  g_return_if_fail (!g_str_has_prefix (attribute, "param-"));
+
+  mcd_storage_transaction_stage (self, attribute, value, FALSE);
+}
+
+/*
+ * mcd_storage_transaction_set_string:
+ * @attribute: the name of the attribute
+ * @value: (allow-none): the value to be stored, or %NULL to erase it
+ *
+ * As for mcd_storage_set_string(), but staged in @self.
+ */
+void
+mcd_storage_transaction_set_string (McdStorageTransaction *self,
+    const gchar *attribute,
+    const gchar *value)
+{
+  GValue tmp = G_VALUE_INIT;
+
+  if (value == NULL)
+    {
+      mcd_storage_transaction_set_attribute (self, attribute, NULL);
+      return;
+    }
+
+  g_value_init (&tmp, G_TYPE_STRING);
+  g_value_set_static_string (&tmp, value);
+  mcd_storage_transaction_set_attribute (self, attribute, &tmp);
+  g_value_unset (&tmp);
+}
+
+/*
+ * mcd_storage_transaction_set_parameter:
+ * @parameter: the name of the parameter, e.g. "account"
+ * @value: (allow-none): the value to be stored, or %NULL to erase it
+ * @secret: whether the value is confidential
+ *
+ * As for mcd_storage_set_parameter(), but staged in @self.
+ */
+void
+mcd_storage_transaction_set_parameter (McdStorageTransaction *self,
+    const gchar *parameter,
+    const GValue *value,
+    gboolean secret)
+{
+  gchar key[MAX_KEY_LENGTH];
+
+  g_return_if_fail (self != NULL);
+  g_return_if_fail (parameter != NULL);
+
+  g_snprintf (key, sizeof (key), "param-%s", parameter);
+  mcd_storage_transaction_stage (self, key, value, secret);
+}
+
+static gboolean
+mcd_storage_transaction_apply_changes (McdStorageTransaction *self)
+{
+  gboolean updated = FALSE;
+  guint i;
+
+  for (i = 0; i < self->changes->len; i++)
+    {
+      McdStorageChange *change = &g_array_index (self->changes,
+          McdStorageChange, i);
+      const GValue *value = NULL;
+
+      if (G_IS_VALUE (&change->value))
+        value = &change->value;
+
+      if (g_str_has_prefix (change->key, "param-"))
+        updated |= mcd_storage_set_parameter (self->storage, self->account,
+            change->key + 6, value, change->secret);
+      else
+        updated |= mcd_storage_set_attribute (self->storage, self->account,
+            change->key, value);
+    }
+
+  return updated;
+}
+
+/*
+ * mcd_storage_transaction_apply:
+ * @self: (transfer full): a transaction
+ *
+ * Apply every staged change to the cache and to the plugin that stores
+ * the account, and free @self. The caller is responsible for committing
+ * the account, for instance with mcd_storage_commit_later(); all the
+ * changes will be committed together.
+ *
+ * Returns: %TRUE if anything actually changed
+ */
+gboolean
+mcd_storage_transaction_apply (McdStorageTransaction *self)
+{
+  gboolean updated;
+
+  g_return_val_if_fail (self != NULL, FALSE);
+
+  updated = mcd_storage_transaction_release (self);
+  updated |= mcd_storage_transaction_apply_changes (self);
+  mcd_storage_transaction_free (self);
+  return updated;
+}
+
+/*
+ * mcd_storage_transaction_commit:
+ * @self: (transfer full): a transaction
+ *
+ * Apply every staged change as for mcd_storage_transaction_apply(), then,
+ * if anything changed, commit the account to long term storage before
+ * returning.
+ *
+ * Returns: %TRUE if anything actually changed
+ */
+gboolean
+mcd_storage_transaction_commit (McdStorageTransaction *self)
+{
+  gboolean updated;
+
+  g_return_val_if_fail (self != NULL, FALSE);
+
+  updated = mcd_storage_transaction_release (self);
+  updated |= mcd_storage_transaction_apply_changes (self);
+
+  /* one commit for each plugin involved, which is normally just the one
+   * that stores the account */
+  if (updated)
+    mcd_storage_commit (self->storage, self->account);
+
+  mcd_storage_transaction_free (self);
+  return updated;
+}
+
 void
 mcd_storage_ready (McdStorage *self)
 {
@@ -2098,5 +3601,6 @@ mcd_storage_add_account_from_plugin (McdStorage *self,
       return FALSE;
     }
 
+  ensure_account (self, account)->storage = plugin;
   return TRUE;
 }
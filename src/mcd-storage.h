@@ -32,6 +32,22 @@ typedef struct {
   TpDBusDaemon *dbusd;
   /* owned string => owned McdStorageAccount */
   GHashTable *accounts;
+  /* set of owned strings: accounts whose changes have not been committed */
+  GHashTable *dirty;
+  /* timeout for the next coalesced commit, or 0 */
+  guint commit_id;
+  /* monotonic time at which @dirty became non-empty */
+  gint64 dirty_since;
+  /* milliseconds to wait for further changes, and the most we will wait
+   * after the first change */
+  guint commit_delay;
+  guint max_commit_delay;
+  /* number of mcp_account_storage_commit_async() calls that haven't
+   * finished yet */
+  guint pending_commits;
+  /* borrowed account name => borrowed McdStorageTransaction from
+   * mcd_storage_transaction_begin() */
+  GHashTable *capturing;
 } McdStorage;
 
 typedef struct _McdStorageClass McdStorageClass;
@@ -100,7 +116,29 @@ gchar *mcd_storage_create_account (McdStorage *storage,
 
 void mcd_storage_delete_account (McdStorage *storage, const gchar *account);
 
+typedef struct _McdStorageTransaction McdStorageTransaction;
+
+McdStorageTransaction *mcd_storage_transaction_new (McdStorage *storage,
+    const gchar *account);
+McdStorageTransaction *mcd_storage_transaction_begin (McdStorage *storage,
+    const gchar *account);
+void mcd_storage_transaction_set_attribute (McdStorageTransaction *self,
+    const gchar *attribute,
+    const GValue *value);
+void mcd_storage_transaction_set_string (McdStorageTransaction *self,
+    const gchar *attribute,
+    const gchar *value);
+void mcd_storage_transaction_set_parameter (McdStorageTransaction *self,
+    const gchar *parameter,
+    const GValue *value,
+    gboolean secret);
+gboolean mcd_storage_transaction_apply (McdStorageTransaction *self);
+gboolean mcd_storage_transaction_commit (McdStorageTransaction *self);
+void mcd_storage_transaction_free (McdStorageTransaction *self);
+
 void mcd_storage_commit (McdStorage *storage, const gchar *account);
+void mcd_storage_commit_later (McdStorage *storage, const gchar *account);
+void mcd_storage_flush (McdStorage *storage);
 
 gchar *mcd_storage_dup_string (McdStorage *storage,
     const gchar *account,
@@ -118,6 +156,15 @@ gboolean mcd_storage_get_parameter (McdStorage *storage,
     GValue *value,
     GError **error);
 
+GHashTable *mcd_storage_dup_typed_parameters (McdStorage *storage,
+    const gchar *account,
+    GStrv *untyped);
+
+gboolean mcd_storage_set_parameter_type (McdStorage *storage,
+    const gchar *account,
+    const gchar *parameter,
+    const gchar *signature);
+
 gboolean mcd_storage_get_boolean (McdStorage *storage,
     const gchar *account,
     const gchar *attribute);
@@ -0,0 +1,236 @@
+/*
+ * Regression test for the in-memory avatar cache
+ *
+ * Copyright © 2012 Collabora Ltd.
+ *
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License as published by the Free Software Foundation; either
+ * version 2.1 of the License, or (at your option) any later version.
+ *
+ * This library is distributed in the hope that it will be useful, but
+ * WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the GNU
+ * Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with this library; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin St, Fifth Floor, Boston, MA
+ * 02110-1301 USA
+ *
+ */
+
+#include "config.h"
+
+#include <string.h>
+
+#include <glib/gstdio.h>
+
+#include "mcd-avatar-cache.h"
+
+typedef struct {
+    gchar *dir;
+    gchar *files[3];
+    McdAvatarCache *cache;
+} Fixture;
+
+static void
+setup (Fixture *f,
+    gconstpointer unused G_GNUC_UNUSED)
+{
+  GError *error = NULL;
+  guint i;
+
+  f->dir = g_dir_make_tmp ("mc-avatar-cache-XXXXXX", &error);
+  g_assert_no_error (error);
+
+  for (i = 0; i < G_N_ELEMENTS (f->files); i++)
+    {
+      gchar *basename = g_strdup_printf ("%u.avatar", i);
+
+      f->files[i] = g_build_filename (f->dir, basename, NULL);
+      g_free (basename);
+    }
+
+  /* room for two 4-byte avatars, and four accounts */
+  f->cache = mcd_avatar_cache_new (8, 4);
+}
+
+static void
+teardown (Fixture *f,
+    gconstpointer unused G_GNUC_UNUSED)
+{
+  guint i;
+
+  mcd_avatar_cache_free (f->cache);
+
+  for (i = 0; i < G_N_ELEMENTS (f->files); i++)
+    {
+      g_unlink (f->files[i]);
+      g_free (f->files[i]);
+    }
+
+  g_rmdir (f->dir);
+  g_free (f->dir);
+}
+
+static void
+insert (Fixture *f,
+    const gchar *account,
+    const gchar *data,
+    guint file)
+{
+  const gchar *watch[] = { f->files[file], NULL };
+  GBytes *avatar = NULL;
+
+  if (data != NULL)
+    avatar = g_bytes_new_static (data, strlen (data));
+
+  mcd_avatar_cache_insert (f->cache, account, avatar, watch);
+
+  if (avatar != NULL)
+    g_bytes_unref (avatar);
+}
+
+static void
+test_shared (Fixture *f,
+    gconstpointer unused G_GNUC_UNUSED)
+{
+  GBytes *first;
+  GBytes *second;
+
+  g_assert (!mcd_avatar_cache_lookup (f->cache, "a", &first));
+
+  insert (f, "a", "AAAA", 0);
+  insert (f, "b", NULL, 1);
+
+  g_assert (mcd_avatar_cache_lookup (f->cache, "a", &first));
+  g_assert (mcd_avatar_cache_lookup (f->cache, "a", &second));
+  g_assert (first != NULL);
+  g_assert (first == second);
+  g_assert_cmpuint (g_bytes_get_size (first), ==, 4);
+  g_bytes_unref (first);
+  g_bytes_unref (second);
+
+  /* "no avatar" is a result too */
+  g_assert (mcd_avatar_cache_lookup (f->cache, "b", &first));
+  g_assert (first == NULL);
+
+  g_assert_cmpuint (mcd_avatar_cache_get_size (f->cache), ==, 4);
+
+  mcd_avatar_cache_remove (f->cache, "a");
+  g_assert (!mcd_avatar_cache_lookup (f->cache, "a", &first));
+  g_assert_cmpuint (mcd_avatar_cache_get_size (f->cache), ==, 0);
+}
+
+static void
+test_lru (Fixture *f,
+    gconstpointer unused G_GNUC_UNUSED)
+{
+  GBytes *avatar;
+
+  insert (f, "a", "AAAA", 0);
+  insert (f, "b", "BBBB", 1);
+
+  /* use "a", so "b" is now the least recently used */
+  g_assert (mcd_avatar_cache_lookup (f->cache, "a", &avatar));
+  g_bytes_unref (avatar);
+
+  insert (f, "c", "CCCC", 2);
+  g_assert_cmpuint (mcd_avatar_cache_get_size (f->cache), ==, 8);
+
+  g_assert (!mcd_avatar_cache_lookup (f->cache, "b", &avatar));
+  g_assert (mcd_avatar_cache_lookup (f->cache, "a", &avatar));
+  g_bytes_unref (avatar);
+  g_assert (mcd_avatar_cache_lookup (f->cache, "c", &avatar));
+  g_bytes_unref (avatar);
+
+  /* something that could never fit is not cached at all, and doesn't
+   * evict anything */
+  insert (f, "d", "DDDDDDDDD", 0);
+  g_assert (!mcd_avatar_cache_lookup (f->cache, "d", &avatar));
+  g_assert_cmpuint (mcd_avatar_cache_get_size (f->cache), ==, 8);
+}
+
+static void
+test_max_entries (Fixture *f,
+    gconstpointer unused G_GNUC_UNUSED)
+{
+  GBytes *avatar;
+
+  insert (f, "a", NULL, 0);
+  insert (f, "b", NULL, 1);
+  insert (f, "c", NULL, 2);
+  insert (f, "d", NULL, 0);
+  g_assert_cmpuint (mcd_avatar_cache_get_n_entries (f->cache), ==, 4);
+
+  /* use "a", so "b" is now the least recently used */
+  g_assert (mcd_avatar_cache_lookup (f->cache, "a", &avatar));
+  g_assert (avatar == NULL);
+
+  /* "no avatar" takes no space, but still counts as an entry */
+  insert (f, "e", NULL, 1);
+  g_assert_cmpuint (mcd_avatar_cache_get_n_entries (f->cache), ==, 4);
+  g_assert_cmpuint (mcd_avatar_cache_get_size (f->cache), ==, 0);
+  g_assert (!mcd_avatar_cache_lookup (f->cache, "b", &avatar));
+  g_assert (mcd_avatar_cache_lookup (f->cache, "a", &avatar));
+  g_assert (mcd_avatar_cache_lookup (f->cache, "e", &avatar));
+
+  /* all the files are in one directory, which is only watched once */
+  g_assert_cmpuint (mcd_avatar_cache_get_n_monitors (f->cache), ==, 1);
+
+  mcd_avatar_cache_remove (f->cache, "a");
+  mcd_avatar_cache_remove (f->cache, "c");
+  mcd_avatar_cache_remove (f->cache, "d");
+  g_assert_cmpuint (mcd_avatar_cache_get_n_monitors (f->cache), ==, 1);
+  mcd_avatar_cache_remove (f->cache, "e");
+  g_assert_cmpuint (mcd_avatar_cache_get_n_entries (f->cache), ==, 0);
+  g_assert_cmpuint (mcd_avatar_cache_get_n_monitors (f->cache), ==, 0);
+}
+
+static void
+test_invalidate (Fixture *f,
+    gconstpointer unused G_GNUC_UNUSED)
+{
+  GError *error = NULL;
+  GBytes *avatar;
+  gint64 deadline;
+
+  insert (f, "a", "AAAA", 0);
+  insert (f, "b", NULL, 1);
+
+  g_file_set_contents (f->files[1], "BBBB", 4, &error);
+  g_assert_no_error (error);
+
+  deadline = g_get_monotonic_time () + 10 * G_USEC_PER_SEC;
+
+  while (mcd_avatar_cache_lookup (f->cache, "b", &avatar))
+    {
+      g_assert (avatar == NULL);
+      g_assert_cmpint (g_get_monotonic_time (), <, deadline);
+      if (!g_main_context_iteration (NULL, FALSE))
+        g_usleep (G_USEC_PER_SEC / 100);
+    }
+
+  /* the other account's file didn't change */
+  g_assert (mcd_avatar_cache_lookup (f->cache, "a", &avatar));
+  g_bytes_unref (avatar);
+}
+
+int
+main (int argc,
+      char **argv)
+{
+  g_test_init (&argc, &argv, NULL);
+
+  g_test_add ("/avatar-cache/shared", Fixture, NULL, setup,
+      test_shared, teardown);
+  g_test_add ("/avatar-cache/lru", Fixture, NULL, setup,
+      test_lru, teardown);
+  g_test_add ("/avatar-cache/max-entries", Fixture, NULL, setup,
+      test_max_entries, teardown);
+  g_test_add ("/avatar-cache/invalidate", Fixture, NULL, setup,
+      test_invalidate, teardown);
+
+  return g_test_run ();
+}
@@ -0,0 +1,258 @@
+/*
+ * Regression test for the index of .client files
+ *
+ * Copyright © 2012 Collabora Ltd.
+ *
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License as published by the Free Software Foundation; either
+ * version 2.1 of the License, or (at your option) any later version.
+ *
+ * This library is distributed in the hope that it will be useful, but
+ * WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the GNU
+ * Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with this library; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin St, Fifth Floor, Boston, MA
+ * 02110-1301 USA
+ *
+ */
+
+#include "config.h"
+
+#include <glib/gstdio.h>
+
+#include "client-file-index.h"
+
+typedef struct {
+    /* high priority, then low priority */
+    gchar *dirs[3];
+    GPtrArray *files;
+    McdClientFileIndex *index;
+    gboolean timed_out;
+} Fixture;
+
+static void
+write_client_file (Fixture *f,
+    guint dir,
+    const gchar *client_name,
+    const gchar *contents)
+{
+  gchar *basename = g_strconcat (client_name, ".client", NULL);
+  gchar *filename = g_build_filename (f->dirs[dir], basename, NULL);
+
+  g_assert (g_file_set_contents (filename, contents, -1, NULL));
+  g_ptr_array_add (f->files, filename);
+  g_free (basename);
+}
+
+static void
+setup (Fixture *f,
+    gconstpointer unused G_GNUC_UNUSED)
+{
+  f->dirs[0] = g_dir_make_tmp ("mc-client-file-index-XXXXXX", NULL);
+  f->dirs[1] = g_dir_make_tmp ("mc-client-file-index-XXXXXX", NULL);
+  f->dirs[2] = NULL;
+  g_assert (f->dirs[0] != NULL);
+  g_assert (f->dirs[1] != NULL);
+
+  f->files = g_ptr_array_new_with_free_func (g_free);
+
+  write_client_file (f, 0, "Both", "[Test]\nFrom=high\n");
+  write_client_file (f, 1, "Both", "[Test]\nFrom=low\n");
+  write_client_file (f, 1, "Low", "[Test]\nFrom=low\n");
+  write_client_file (f, 0, "Broken", "this is not a key file\n");
+
+  f->index = _mcd_client_file_index_new ((const gchar * const *) f->dirs);
+}
+
+static void
+teardown (Fixture *f,
+    gconstpointer unused G_GNUC_UNUSED)
+{
+  guint i;
+
+  _mcd_client_file_index_free (f->index);
+
+  for (i = 0; i < f->files->len; i++)
+    g_unlink (g_ptr_array_index (f->files, i));
+
+  g_ptr_array_unref (f->files);
+  g_rmdir (f->dirs[0]);
+  g_rmdir (f->dirs[1]);
+  g_free (f->dirs[0]);
+  g_free (f->dirs[1]);
+}
+
+static void
+assert_from (GKeyFile *file,
+    const gchar *expected)
+{
+  gchar *from;
+
+  g_assert (file != NULL);
+  from = g_key_file_get_string (file, "Test", "From", NULL);
+  g_assert_cmpstr (from, ==, expected);
+  g_free (from);
+}
+
+static void
+test_lookup (Fixture *f,
+    gconstpointer unused G_GNUC_UNUSED)
+{
+  GKeyFile *file;
+  const gchar *filename;
+
+  /* the higher-priority directory wins */
+  file = _mcd_client_file_index_lookup (f->index, "Both", &filename);
+  assert_from (file, "high");
+  g_assert (g_str_has_prefix (filename, f->dirs[0]));
+
+  /* it's only loaded once */
+  g_assert (_mcd_client_file_index_lookup (f->index, "Both", NULL) == file);
+
+  file = _mcd_client_file_index_lookup (f->index, "Low", &filename);
+  assert_from (file, "low");
+  g_assert (g_str_has_prefix (filename, f->dirs[1]));
+
+  filename = "not overwritten";
+  g_assert (_mcd_client_file_index_lookup (f->index, "Missing",
+        &filename) == NULL);
+  g_assert (filename == NULL);
+
+  /* it's not an error to have a .client file that's not a file */
+  write_client_file (f, 0, "Directory", "");
+  g_unlink (g_ptr_array_index (f->files, f->files->len - 1));
+  g_assert (g_mkdir (g_ptr_array_index (f->files, f->files->len - 1),
+        0700) == 0);
+  _mcd_client_file_index_invalidate (f->index);
+  g_assert (_mcd_client_file_index_lookup (f->index, "Directory",
+        NULL) == NULL);
+  g_rmdir (g_ptr_array_index (f->files, f->files->len - 1));
+}
+
+static void
+test_broken (Fixture *f,
+    gconstpointer unused G_GNUC_UNUSED)
+{
+  const gchar *filename;
+
+  /* we warn, but only once */
+  g_test_expect_message ("mcd", G_LOG_LEVEL_WARNING,
+      "Loading file*Broken.client failed:*");
+  g_assert (_mcd_client_file_index_lookup (f->index, "Broken",
+        &filename) == NULL);
+  g_test_assert_expected_messages ();
+  g_assert (g_str_has_suffix (filename, "Broken.client"));
+
+  g_assert (_mcd_client_file_index_lookup (f->index, "Broken",
+        NULL) == NULL);
+}
+
+static void
+test_invalidate (Fixture *f,
+    gconstpointer unused G_GNUC_UNUSED)
+{
+  GKeyFile *file;
+
+  g_assert (_mcd_client_file_index_lookup (f->index, "New", NULL) == NULL);
+
+  /* a lower-priority file for an existing client, and a new client */
+  write_client_file (f, 1, "New", "[Test]\nFrom=low\n");
+  _mcd_client_file_index_invalidate (f->index);
+
+  file = _mcd_client_file_index_lookup (f->index, "New", NULL);
+  assert_from (file, "low");
+
+  /* a higher-priority file takes over */
+  write_client_file (f, 0, "New", "[Test]\nFrom=high\n");
+  _mcd_client_file_index_invalidate (f->index);
+
+  file = _mcd_client_file_index_lookup (f->index, "New", NULL);
+  assert_from (file, "high");
+}
+
+static gboolean
+timeout_cb (gpointer user_data)
+{
+  Fixture *f = user_data;
+
+  f->timed_out = TRUE;
+  return FALSE;
+}
+
+/*
+ * Run the main loop until a lookup for @client_name finds a file if
+ * @present, or finds nothing if not.
+ */
+static GKeyFile *
+wait_for_lookup (Fixture *f,
+    const gchar *client_name,
+    gboolean present)
+{
+  guint timeout = g_timeout_add_seconds (10, timeout_cb, f);
+  GKeyFile *file;
+
+  f->timed_out = FALSE;
+
+  while ((_mcd_client_file_index_lookup (f->index, client_name,
+            NULL) != NULL) != present && !f->timed_out)
+    g_main_context_iteration (NULL, TRUE);
+
+  g_assert (!f->timed_out);
+  g_source_remove (timeout);
+
+  file = _mcd_client_file_index_lookup (f->index, client_name, NULL);
+  g_assert ((file != NULL) == present);
+  return file;
+}
+
+static void
+test_monitor (Fixture *f,
+    gconstpointer unused G_GNUC_UNUSED)
+{
+  GKeyFile *both;
+  GKeyFile *file;
+
+  both = _mcd_client_file_index_lookup (f->index, "Both", NULL);
+  assert_from (both, "high");
+  g_assert (_mcd_client_file_index_lookup (f->index, "New", NULL) == NULL);
+
+  if (_mcd_client_file_index_get_n_monitors (f->index) != 2)
+    {
+      g_test_skip ("cannot monitor the temporary directories");
+      return;
+    }
+
+  /* a new file is noticed without anyone invalidating the index */
+  write_client_file (f, 1, "New", "[Test]\nFrom=low\n");
+  file = wait_for_lookup (f, "New", TRUE);
+  assert_from (file, "low");
+
+  /* the other directory wasn't listed or loaded again */
+  g_assert (_mcd_client_file_index_lookup (f->index, "Both", NULL) == both);
+
+  /* so is a deleted file */
+  g_assert (g_unlink (g_ptr_array_index (f->files, f->files->len - 1)) == 0);
+  wait_for_lookup (f, "New", FALSE);
+}
+
+int
+main (int argc,
+      char **argv)
+{
+  g_test_init (&argc, &argv, NULL);
+
+  g_test_add ("/client-file-index/lookup", Fixture, NULL, setup,
+      test_lookup, teardown);
+  g_test_add ("/client-file-index/broken", Fixture, NULL, setup,
+      test_broken, teardown);
+  g_test_add ("/client-file-index/invalidate", Fixture, NULL, setup,
+      test_invalidate, teardown);
+  g_test_add ("/client-file-index/monitor", Fixture, NULL, setup,
+      test_monitor, teardown);
+
+  return g_test_run ();
+}
@@ -0,0 +1,408 @@
+/*
+ * Regression test and benchmark for the index of client channel filters
+ *
+ * Copyright © 2012 Collabora Ltd.
+ *
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License as published by the Free Software Foundation; either
+ * version 2.1 of the License, or (at your option) any later version.
+ *
+ * This library is distributed in the hope that it will be useful, but
+ * WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the GNU
+ * Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with this library; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin St, Fifth Floor, Boston, MA
+ * 02110-1301 USA
+ *
+ */
+
+#include "config.h"
+
+#include <telepathy-glib/telepathy-glib.h>
+
+#include "client-filter-index.h"
+#include "mcd-client-priv.h"
+
+/* about the number of clients on a busy desktop */
+#define N_CLIENTS 100
+
+static const gchar * const channel_types[] = {
+    TP_IFACE_CHANNEL_TYPE_TEXT,
+    TP_IFACE_CHANNEL_TYPE_CALL,
+    TP_IFACE_CHANNEL_TYPE_FILE_TRANSFER,
+    TP_IFACE_CHANNEL_TYPE_STREAM_TUBE,
+    TP_IFACE_CHANNEL_TYPE_DBUS_TUBE,
+    TP_IFACE_CHANNEL_TYPE_SERVER_TLS_CONNECTION,
+    TP_IFACE_CHANNEL_TYPE_SERVER_AUTHENTICATION,
+    TP_IFACE_CHANNEL_TYPE_CONTACT_SEARCH,
+};
+
+typedef struct {
+    /* each is a GList of McdClientFilter, indexed by client number */
+    GList *filters[N_CLIENTS];
+    McdClientFilterIndex *index;
+} Fixture;
+
+static GHashTable *
+new_filter (void)
+{
+  return g_hash_table_new_full (g_str_hash, g_str_equal, g_free,
+      (GDestroyNotify) tp_g_value_slice_free);
+}
+
+static void
+setup (Fixture *f,
+    gconstpointer unused G_GNUC_UNUSED)
+{
+  guint i;
+
+  /* Most clients have a filter or two for a specific ChannelType and
+   * TargetHandleType, some are also interested in a particular service,
+   * and a few are interested in everything (like a logger) or don't say
+   * what kind of handle (like a file-transfer UI). */
+  for (i = 0; i < N_CLIENTS; i++)
+    {
+      const gchar *type = channel_types[i % G_N_ELEMENTS (channel_types)];
+      GHashTable *filter = new_filter ();
+
+      if (i % 25 != 0)
+        g_hash_table_insert (filter,
+            g_strdup (TP_PROP_CHANNEL_CHANNEL_TYPE),
+            tp_g_value_slice_new_string (type));
+
+      if (i % 10 != 0)
+        g_hash_table_insert (filter,
+            g_strdup (TP_PROP_CHANNEL_TARGET_HANDLE_TYPE),
+            tp_g_value_slice_new_uint64 (
+              i % 3 == 0 ? TP_HANDLE_TYPE_ROOM : TP_HANDLE_TYPE_CONTACT));
+
+      if (i % 4 == 0)
+        g_hash_table_insert (filter,
+            g_strdup (TP_PROP_CHANNEL_TYPE_STREAM_TUBE_SERVICE),
+            tp_g_value_slice_new_string (i % 8 == 0 ? "x-chess" : "rsync"));
+
+      if (i % 5 == 0)
+        g_hash_table_insert (filter,
+            g_strdup (TP_PROP_CHANNEL_REQUESTED),
+            tp_g_value_slice_new_boolean (i % 2 == 0));
+
+      f->filters[i] = g_list_prepend (f->filters[i],
+          _mcd_client_filter_new (filter));
+      g_hash_table_unref (filter);
+
+      if (i % 2 == 0)
+        {
+          /* a second, less specific filter */
+          filter = new_filter ();
+          g_hash_table_insert (filter,
+              g_strdup (TP_PROP_CHANNEL_CHANNEL_TYPE),
+              tp_g_value_slice_new_string (type));
+          f->filters[i] = g_list_prepend (f->filters[i],
+              _mcd_client_filter_new (filter));
+          g_hash_table_unref (filter);
+        }
+    }
+
+  f->index = _mcd_client_filter_index_new ();
+
+  for (i = 0; i < N_CLIENTS; i++)
+    _mcd_client_filter_index_add (f->index, GUINT_TO_POINTER (i + 1),
+        f->filters[i]);
+}
+
+static void
+teardown (Fixture *f,
+    gconstpointer unused G_GNUC_UNUSED)
+{
+  guint i;
+
+  if (f->index != NULL)
+    _mcd_client_filter_index_free (f->index);
+
+  for (i = 0; i < N_CLIENTS; i++)
+    g_list_free_full (f->filters[i],
+        (GDestroyNotify) _mcd_client_filter_free);
+}
+
+static McdClientChannelProperties *
+new_channel (const gchar *type,
+    TpHandleType handle_type,
+    gboolean requested,
+    const gchar *service,
+    const gchar *target_id)
+{
+  GVariantDict dict;
+  GVariant *variant;
+  McdClientChannelProperties *properties;
+
+  g_variant_dict_init (&dict, NULL);
+
+  if (type != NULL)
+    g_variant_dict_insert (&dict, TP_PROP_CHANNEL_CHANNEL_TYPE, "s", type);
+
+  if (handle_type != TP_HANDLE_TYPE_NONE)
+    g_variant_dict_insert (&dict, TP_PROP_CHANNEL_TARGET_HANDLE_TYPE, "u",
+        handle_type);
+
+  g_variant_dict_insert (&dict, TP_PROP_CHANNEL_REQUESTED, "b", requested);
+
+  if (service != NULL)
+    g_variant_dict_insert (&dict, TP_PROP_CHANNEL_TYPE_STREAM_TUBE_SERVICE,
+        "s", service);
+
+  if (target_id != NULL)
+    g_variant_dict_insert (&dict, TP_PROP_CHANNEL_TARGET_ID, "s", target_id);
+
+  variant = g_variant_ref_sink (g_variant_dict_end (&dict));
+  properties = _mcd_client_channel_properties_new (variant);
+  g_variant_unref (variant);
+  return properties;
+}
+
+static GPtrArray *
+new_channels (void)
+{
+  GPtrArray *channels = g_ptr_array_new_with_free_func (
+      (GDestroyNotify) _mcd_client_channel_properties_free);
+  guint i;
+
+  for (i = 0; i < G_N_ELEMENTS (channel_types); i++)
+    {
+      g_ptr_array_add (channels, new_channel (channel_types[i],
+            TP_HANDLE_TYPE_CONTACT, FALSE, NULL, NULL));
+      g_ptr_array_add (channels, new_channel (channel_types[i],
+            TP_HANDLE_TYPE_ROOM, TRUE, "x-chess", NULL));
+      g_ptr_array_add (channels, new_channel (channel_types[i],
+            TP_HANDLE_TYPE_NONE, TRUE, "rsync", NULL));
+    }
+
+  /* odd things that only the least specific filters could match */
+  g_ptr_array_add (channels, new_channel ("com.example.Unknown",
+        TP_HANDLE_TYPE_CONTACT, FALSE, NULL, NULL));
+  g_ptr_array_add (channels, new_channel (NULL, TP_HANDLE_TYPE_ROOM, FALSE,
+        NULL, NULL));
+  g_ptr_array_add (channels, new_channel (NULL, TP_HANDLE_TYPE_NONE, TRUE,
+        NULL, NULL));
+
+  return channels;
+}
+
+static GHashTable *
+linear_match (Fixture *f,
+    const McdClientChannelProperties *channel,
+    gboolean assume_requested)
+{
+  GHashTable *matches = g_hash_table_new (NULL, NULL);
+  guint i;
+
+  for (i = 0; i < N_CLIENTS; i++)
+    {
+      guint quality = _mcd_client_match_filters (channel, f->filters[i],
+          assume_requested);
+
+      if (quality > 0)
+        g_hash_table_insert (matches, GUINT_TO_POINTER (i + 1),
+            GUINT_TO_POINTER (quality));
+    }
+
+  return matches;
+}
+
+static void
+assert_same_matches (GHashTable *expected,
+    GHashTable *actual)
+{
+  GHashTableIter iter;
+  gpointer k, v;
+
+  g_assert_cmpuint (g_hash_table_size (actual), ==,
+      g_hash_table_size (expected));
+
+  g_hash_table_iter_init (&iter, expected);
+
+  while (g_hash_table_iter_next (&iter, &k, &v))
+    g_assert_cmpuint (GPOINTER_TO_UINT (g_hash_table_lookup (actual, k)),
+        ==, GPOINTER_TO_UINT (v));
+}
+
+static guint
+check_channel (Fixture *f,
+    const McdClientChannelProperties *channel,
+    gboolean assume_requested)
+{
+  GHashTable *expected = linear_match (f, channel, assume_requested);
+  GHashTable *actual = _mcd_client_filter_index_match (f->index, channel,
+      assume_requested);
+  guint n = g_hash_table_size (expected);
+
+  assert_same_matches (expected, actual);
+
+  g_hash_table_unref (expected);
+  g_hash_table_unref (actual);
+  return n;
+}
+
+static void
+test_same (Fixture *f,
+    gconstpointer unused G_GNUC_UNUSED)
+{
+  GPtrArray *channels = new_channels ();
+  guint n_matched = 0;
+  guint i;
+
+  for (i = 0; i < channels->len; i++)
+    {
+      const McdClientChannelProperties *channel =
+        g_ptr_array_index (channels, i);
+
+      n_matched += check_channel (f, channel, FALSE);
+      n_matched += check_channel (f, channel, TRUE);
+    }
+
+  /* make sure the test is meaningful */
+  g_assert_cmpuint (n_matched, >, channels->len);
+
+  /* again, now that the index has seen them all before */
+  for (i = 0; i < channels->len; i++)
+    {
+      const McdClientChannelProperties *channel =
+        g_ptr_array_index (channels, i);
+
+      check_channel (f, channel, FALSE);
+      check_channel (f, channel, TRUE);
+    }
+
+  g_ptr_array_unref (channels);
+}
+
+static void
+test_memo (Fixture *f,
+    gconstpointer unused G_GNUC_UNUSED)
+{
+  McdClientChannelProperties *alice = new_channel (TP_IFACE_CHANNEL_TYPE_TEXT,
+      TP_HANDLE_TYPE_CONTACT, FALSE, NULL, "alice@example.com");
+  McdClientChannelProperties *bob = new_channel (TP_IFACE_CHANNEL_TYPE_TEXT,
+      TP_HANDLE_TYPE_CONTACT, FALSE, NULL, "bob@example.com");
+  McdClientChannelProperties *room = new_channel (TP_IFACE_CHANNEL_TYPE_TEXT,
+      TP_HANDLE_TYPE_ROOM, FALSE, NULL, "chess@conference.example.com");
+  GHashTable *first, *second;
+  GHashTable *filter;
+  GList *late_filters = NULL;
+  gpointer late_client = GUINT_TO_POINTER (N_CLIENTS + 1);
+
+  first = _mcd_client_filter_index_match (f->index, alice, FALSE);
+  g_assert (!g_hash_table_contains (first, late_client));
+
+  /* no filter looks at TargetID, so bob's channel is the same class */
+  second = _mcd_client_filter_index_match (f->index, bob, FALSE);
+  g_assert (second == first);
+  g_hash_table_unref (second);
+
+  second = _mcd_client_filter_index_match (f->index, room, FALSE);
+  g_assert (second != first);
+  g_hash_table_unref (second);
+
+  second = _mcd_client_filter_index_match (f->index, alice, TRUE);
+  g_assert (second != first);
+  g_hash_table_unref (second);
+
+  /* a new client arrives, and is interested in alice */
+  filter = new_filter ();
+  g_hash_table_insert (filter, g_strdup (TP_PROP_CHANNEL_TARGET_ID),
+      tp_g_value_slice_new_static_string ("alice@example.com"));
+  late_filters = g_list_prepend (late_filters,
+      _mcd_client_filter_new (filter));
+  g_hash_table_unref (filter);
+  _mcd_client_filter_index_add (f->index, late_client, late_filters);
+
+  /* the channels were compiled before anything had heard of TargetID */
+  g_assert (_mcd_client_channel_properties_is_stale (alice));
+  _mcd_client_channel_properties_free (alice);
+  alice = new_channel (TP_IFACE_CHANNEL_TYPE_TEXT, TP_HANDLE_TYPE_CONTACT,
+      FALSE, NULL, "alice@example.com");
+  _mcd_client_channel_properties_free (bob);
+  bob = new_channel (TP_IFACE_CHANNEL_TYPE_TEXT, TP_HANDLE_TYPE_CONTACT,
+      FALSE, NULL, "bob@example.com");
+
+  second = _mcd_client_filter_index_match (f->index, alice, FALSE);
+  g_assert (second != first);
+  g_assert_cmpuint (GPOINTER_TO_UINT (g_hash_table_lookup (second,
+          late_client)), ==, 2);
+  g_hash_table_unref (second);
+
+  /* and now TargetID matters */
+  second = _mcd_client_filter_index_match (f->index, bob, FALSE);
+  g_assert (!g_hash_table_contains (second, late_client));
+  g_hash_table_unref (second);
+
+  g_hash_table_unref (first);
+  _mcd_client_channel_properties_free (alice);
+  _mcd_client_channel_properties_free (bob);
+  _mcd_client_channel_properties_free (room);
+
+  /* the index borrows the filters, so free it first */
+  _mcd_client_filter_index_free (f->index);
+  f->index = NULL;
+  g_list_free_full (late_filters, (GDestroyNotify) _mcd_client_filter_free);
+}
+
+static void
+test_benchmark (Fixture *f,
+    gconstpointer unused G_GNUC_UNUSED)
+{
+  GPtrArray *channels = new_channels ();
+  guint iterations = g_test_perf () ? 10000 : 100;
+  GTimer *timer = g_timer_new ();
+  gdouble linear, indexed;
+  guint i, j;
+
+  for (i = 0; i < iterations; i++)
+    {
+      for (j = 0; j < channels->len; j++)
+        g_hash_table_unref (linear_match (f,
+              g_ptr_array_index (channels, j), FALSE));
+    }
+
+  linear = g_timer_elapsed (timer, NULL);
+  g_timer_start (timer);
+
+  for (i = 0; i < iterations; i++)
+    {
+      for (j = 0; j < channels->len; j++)
+        g_hash_table_unref (_mcd_client_filter_index_match (f->index,
+              g_ptr_array_index (channels, j), FALSE));
+    }
+
+  indexed = g_timer_elapsed (timer, NULL);
+
+  g_test_message ("matching %u channels against %u clients %u times: "
+      "linear scan %.3fs, index %.3fs", channels->len, N_CLIENTS,
+      iterations, linear, indexed);
+
+  if (g_test_perf ())
+    g_test_minimized_result (indexed, "index: %.3fs (linear scan: %.3fs)",
+        indexed, linear);
+
+  g_timer_destroy (timer);
+  g_ptr_array_unref (channels);
+}
+
+int
+main (int argc,
+      char **argv)
+{
+  g_test_init (&argc, &argv, NULL);
+
+  g_test_add ("/client-filter-index/same", Fixture, NULL, setup,
+      test_same, teardown);
+  g_test_add ("/client-filter-index/memo", Fixture, NULL, setup,
+      test_memo, teardown);
+  g_test_add ("/client-filter-index/benchmark", Fixture, NULL, setup,
+      test_benchmark, teardown);
+
+  return g_test_run ();
+}
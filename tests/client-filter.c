@@ -0,0 +1,274 @@
+/*
+ * Regression test for compiled client channel filters
+ *
+ * Copyright © 2012 Collabora Ltd.
+ *
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License as published by the Free Software Foundation; either
+ * version 2.1 of the License, or (at your option) any later version.
+ *
+ * This library is distributed in the hope that it will be useful, but
+ * WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the GNU
+ * Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with this library; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin St, Fifth Floor, Boston, MA
+ * 02110-1301 USA
+ *
+ */
+
+#include "config.h"
+
+#include <telepathy-glib/telepathy-glib.h>
+
+#include "client-filter.h"
+
+#define PROP "com.example.Channel.Property"
+
+static GHashTable *
+new_filter (void)
+{
+  return g_hash_table_new_full (g_str_hash, g_str_equal, g_free,
+      (GDestroyNotify) tp_g_value_slice_free);
+}
+
+/* Takes ownership of @value, which is the expected value of PROP. Returns
+ * the quality of the match of a one-term filter (so 0 or 2) against a
+ * channel where PROP is @channel_value, which may be floating. */
+static guint
+match_one (GValue *value,
+    GVariant *channel_value)
+{
+  GHashTable *table = new_filter ();
+  McdClientFilter *filter;
+  McdClientChannelProperties *properties;
+  GVariantDict dict;
+  GVariant *variant;
+  guint quality;
+
+  g_hash_table_insert (table, g_strdup (PROP), value);
+  filter = _mcd_client_filter_new (table);
+  g_hash_table_unref (table);
+  g_assert (filter != NULL);
+
+  g_variant_dict_init (&dict, NULL);
+  g_variant_dict_insert_value (&dict, PROP, channel_value);
+  variant = g_variant_ref_sink (g_variant_dict_end (&dict));
+  properties = _mcd_client_channel_properties_new (variant);
+  g_variant_unref (variant);
+
+  quality = _mcd_client_filter_match (filter, properties, FALSE);
+
+  _mcd_client_channel_properties_free (properties);
+  _mcd_client_filter_free (filter);
+  return quality;
+}
+
+static void
+test_strings (void)
+{
+  g_assert_cmpuint (match_one (tp_g_value_slice_new_static_string ("a"),
+        g_variant_new_string ("a")), ==, 2);
+  g_assert_cmpuint (match_one (tp_g_value_slice_new_static_string ("a"),
+        g_variant_new_string ("b")), ==, 0);
+  /* nothing has interned this string, but the answer is still right */
+  g_assert_cmpuint (match_one (tp_g_value_slice_new_static_string ("a"),
+        g_variant_new_string ("client-filter test: never interned")), ==, 0);
+  /* strings and object paths are not interchangeable */
+  g_assert_cmpuint (match_one (tp_g_value_slice_new_static_string ("/a"),
+        g_variant_new_object_path ("/a")), ==, 0);
+  g_assert_cmpuint (match_one (tp_g_value_slice_new_object_path ("/a"),
+        g_variant_new_object_path ("/a")), ==, 2);
+  g_assert_cmpuint (match_one (tp_g_value_slice_new_object_path ("/a"),
+        g_variant_new_string ("/a")), ==, 0);
+}
+
+static void
+test_integers (void)
+{
+  GValue *value;
+
+  /* unsigned filters match any integer with the same value */
+  g_assert_cmpuint (match_one (tp_g_value_slice_new_uint64 (5),
+        g_variant_new_byte (5)), ==, 2);
+  g_assert_cmpuint (match_one (tp_g_value_slice_new_uint (5),
+        g_variant_new_uint32 (5)), ==, 2);
+  g_assert_cmpuint (match_one (tp_g_value_slice_new_uint64 (5),
+        g_variant_new_int16 (5)), ==, 2);
+  g_assert_cmpuint (match_one (tp_g_value_slice_new_uint64 (5),
+        g_variant_new_uint32 (6)), ==, 0);
+  g_assert_cmpuint (match_one (tp_g_value_slice_new_uint64 (G_MAXUINT64),
+        g_variant_new_int64 (-1)), ==, 0);
+
+  value = tp_g_value_slice_new (G_TYPE_UCHAR);
+  g_value_set_uchar (value, 42);
+  g_assert_cmpuint (match_one (value, g_variant_new_uint64 (42)), ==, 2);
+
+  /* likewise signed filters */
+  g_assert_cmpuint (match_one (tp_g_value_slice_new_int (-1),
+        g_variant_new_int32 (-1)), ==, 2);
+  g_assert_cmpuint (match_one (tp_g_value_slice_new_int64 (7),
+        g_variant_new_uint16 (7)), ==, 2);
+  g_assert_cmpuint (match_one (tp_g_value_slice_new_int64 (-1),
+        g_variant_new_uint64 (G_MAXUINT64)), ==, 0);
+
+  /* but integers are not strings or booleans */
+  g_assert_cmpuint (match_one (tp_g_value_slice_new_uint64 (1),
+        g_variant_new_boolean (TRUE)), ==, 0);
+  g_assert_cmpuint (match_one (tp_g_value_slice_new_uint64 (1),
+        g_variant_new_string ("1")), ==, 0);
+}
+
+static void
+test_booleans (void)
+{
+  g_assert_cmpuint (match_one (tp_g_value_slice_new_boolean (TRUE),
+        g_variant_new_boolean (TRUE)), ==, 2);
+  g_assert_cmpuint (match_one (tp_g_value_slice_new_boolean (FALSE),
+        g_variant_new_boolean (TRUE)), ==, 0);
+  g_assert_cmpuint (match_one (tp_g_value_slice_new_boolean (FALSE),
+        g_variant_new_uint32 (0)), ==, 0);
+}
+
+static void
+test_requested (void)
+{
+  GHashTable *table = new_filter ();
+  McdClientFilter *yes, *no;
+  McdClientChannelProperties *properties;
+  GVariantDict dict;
+  GVariant *variant;
+
+  g_hash_table_insert (table, g_strdup (TP_PROP_CHANNEL_REQUESTED),
+      tp_g_value_slice_new_boolean (TRUE));
+  g_hash_table_insert (table, g_strdup (TP_PROP_CHANNEL_CHANNEL_TYPE),
+      tp_g_value_slice_new_static_string (TP_IFACE_CHANNEL_TYPE_TEXT));
+  yes = _mcd_client_filter_new (table);
+  g_hash_table_insert (table, g_strdup (TP_PROP_CHANNEL_REQUESTED),
+      tp_g_value_slice_new_boolean (FALSE));
+  no = _mcd_client_filter_new (table);
+  g_hash_table_unref (table);
+
+  /* a request doesn't necessarily say Requested=TRUE */
+  g_variant_dict_init (&dict, NULL);
+  g_variant_dict_insert (&dict, TP_PROP_CHANNEL_CHANNEL_TYPE, "s",
+      TP_IFACE_CHANNEL_TYPE_TEXT);
+  variant = g_variant_ref_sink (g_variant_dict_end (&dict));
+  properties = _mcd_client_channel_properties_new (variant);
+  g_variant_unref (variant);
+
+  g_assert_cmpuint (_mcd_client_filter_match (yes, properties, TRUE), ==, 3);
+  g_assert_cmpuint (_mcd_client_filter_match (no, properties, TRUE), ==, 0);
+  g_assert_cmpuint (_mcd_client_filter_match (yes, properties, FALSE), ==,
+      0);
+  g_assert_cmpuint (_mcd_client_filter_match (no, properties, FALSE), ==,
+      0);
+
+  g_assert_cmpuint (_mcd_client_channel_properties_get_channel_type (
+        properties), ==, _mcd_client_filter_get_channel_type (yes));
+
+  _mcd_client_channel_properties_free (properties);
+  _mcd_client_filter_free (yes);
+  _mcd_client_filter_free (no);
+}
+
+static void
+test_round_trip (void)
+{
+  GHashTable *table = new_filter ();
+  GHashTable *copy;
+  McdClientFilter *filter;
+  guint handle_type = 0;
+
+  g_hash_table_insert (table, g_strdup (TP_PROP_CHANNEL_CHANNEL_TYPE),
+      tp_g_value_slice_new_static_string (TP_IFACE_CHANNEL_TYPE_TEXT));
+  g_hash_table_insert (table, g_strdup (TP_PROP_CHANNEL_TARGET_HANDLE_TYPE),
+      tp_g_value_slice_new_uint (TP_HANDLE_TYPE_CONTACT));
+  g_hash_table_insert (table, g_strdup (PROP),
+      tp_g_value_slice_new_int (-3));
+  filter = _mcd_client_filter_new (table);
+  g_hash_table_unref (table);
+
+  g_assert_cmpuint (_mcd_client_filter_get_quality (filter), ==, 4);
+  g_assert_cmpstr (g_quark_to_string (
+        _mcd_client_filter_get_channel_type (filter)), ==,
+      TP_IFACE_CHANNEL_TYPE_TEXT);
+  g_assert (_mcd_client_filter_get_target_handle_type (filter,
+        &handle_type));
+  g_assert_cmpuint (handle_type, ==, TP_HANDLE_TYPE_CONTACT);
+
+  /* integers come back as 64-bit, like the filters we used to store */
+  copy = _mcd_client_filter_dup_channel_class (filter);
+  g_assert_cmpuint (g_hash_table_size (copy), ==, 3);
+  g_assert_cmpstr (tp_asv_get_string (copy, TP_PROP_CHANNEL_CHANNEL_TYPE),
+      ==, TP_IFACE_CHANNEL_TYPE_TEXT);
+  g_assert (G_VALUE_HOLDS_UINT64 (tp_asv_lookup (copy,
+          TP_PROP_CHANNEL_TARGET_HANDLE_TYPE)));
+  g_assert_cmpuint (tp_asv_get_uint32 (copy,
+        TP_PROP_CHANNEL_TARGET_HANDLE_TYPE, NULL), ==,
+      TP_HANDLE_TYPE_CONTACT);
+  g_assert (G_VALUE_HOLDS_INT64 (tp_asv_lookup (copy, PROP)));
+  g_assert_cmpint (tp_asv_get_int64 (copy, PROP, NULL), ==, -3);
+
+  g_hash_table_unref (copy);
+  _mcd_client_filter_free (filter);
+}
+
+/* Channel properties compiled before a filter that mentions a new string
+ * can't match it, and must say so. */
+static void
+test_late_filter (void)
+{
+  GHashTable *table = new_filter ();
+  McdClientFilter *filter;
+  McdClientChannelProperties *properties;
+  GVariantDict dict;
+  GVariant *variant;
+
+  g_variant_dict_init (&dict, NULL);
+  g_variant_dict_insert (&dict, PROP, "s",
+      "client-filter test: interned by a later filter");
+  variant = g_variant_ref_sink (g_variant_dict_end (&dict));
+  properties = _mcd_client_channel_properties_new (variant);
+  g_assert (!_mcd_client_channel_properties_is_stale (properties));
+
+  g_hash_table_insert (table, g_strdup (PROP),
+      tp_g_value_slice_new_static_string (
+        "client-filter test: interned by a later filter"));
+  filter = _mcd_client_filter_new (table);
+  g_hash_table_unref (table);
+  g_assert (filter != NULL);
+
+  g_assert (_mcd_client_channel_properties_is_stale (properties));
+  g_assert_cmpuint (_mcd_client_filter_match (filter, properties, FALSE),
+      ==, 0);
+
+  _mcd_client_channel_properties_free (properties);
+  properties = _mcd_client_channel_properties_new (variant);
+  g_assert (!_mcd_client_channel_properties_is_stale (properties));
+  g_assert_cmpuint (_mcd_client_filter_match (filter, properties, FALSE),
+      ==, 2);
+
+  _mcd_client_channel_properties_free (properties);
+  _mcd_client_filter_free (filter);
+  g_variant_unref (variant);
+}
+
+int
+main (int argc,
+      char **argv)
+{
+  g_test_init (&argc, &argv, NULL);
+
+  g_test_add_func ("/client-filter/strings", test_strings);
+  g_test_add_func ("/client-filter/integers", test_integers);
+  g_test_add_func ("/client-filter/booleans", test_booleans);
+  g_test_add_func ("/client-filter/requested", test_requested);
+  g_test_add_func ("/client-filter/round-trip", test_round_trip);
+  g_test_add_func ("/client-filter/late-filter", test_late_filter);
+
+  return g_test_run ();
+}
@@ -0,0 +1,208 @@
+/*
+ * Regression test for the arguments shared between a dispatch operation's
+ * client calls
+ *
+ * Copyright © 2012 Collabora Ltd.
+ *
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License as published by the Free Software Foundation; either
+ * version 2.1 of the License, or (at your option) any later version.
+ *
+ * This library is distributed in the hope that it will be useful, but
+ * WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the GNU
+ * Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with this library; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin St, Fifth Floor, Boston, MA
+ * 02110-1301 USA
+ *
+ */
+
+#include "config.h"
+
+#include "dispatch-args.h"
+
+#define N_OBSERVERS 20
+#define N_APPROVERS 5
+#define N_HANDLERS 3
+
+/* stands in for the McdChannel */
+typedef struct {
+    guint n_requests;
+
+    /* how many times we built each argument */
+    guint details_built;
+    guint requests_collected;
+} FakeChannel;
+
+typedef struct {
+    FakeChannel channel;
+    McdDispatchArgs *args;
+} Fixture;
+
+static GPtrArray *
+build_channel_details (gpointer p)
+{
+  FakeChannel *channel = p;
+
+  channel->details_built++;
+  return g_ptr_array_new ();
+}
+
+static void
+free_channel_details (GPtrArray *details)
+{
+  g_ptr_array_unref (details);
+}
+
+static void
+collect_satisfied_requests (gpointer p,
+    GPtrArray **paths_out,
+    GHashTable **props_out)
+{
+  FakeChannel *channel = p;
+  guint i;
+
+  channel->requests_collected++;
+
+  *paths_out = g_ptr_array_new_with_free_func (g_free);
+  *props_out = g_hash_table_new_full (g_str_hash, g_str_equal, g_free,
+      (GDestroyNotify) g_hash_table_unref);
+
+  for (i = 0; i < channel->n_requests; i++)
+    {
+      gchar *path = g_strdup_printf ("/Request%u", i);
+
+      g_ptr_array_add (*paths_out, g_strdup (path));
+      g_hash_table_insert (*props_out, path,
+          g_hash_table_new (g_str_hash, g_str_equal));
+    }
+}
+
+static guint
+get_requests_serial (gpointer p)
+{
+  FakeChannel *channel = p;
+
+  return channel->n_requests;
+}
+
+static const McdDispatchArgsFuncs funcs = {
+    build_channel_details,
+    free_channel_details,
+    collect_satisfied_requests,
+    get_requests_serial
+};
+
+static void
+setup (Fixture *f,
+    gconstpointer unused G_GNUC_UNUSED)
+{
+  f->channel.n_requests = 1;
+  f->args = _mcd_dispatch_args_new (&funcs, &f->channel);
+}
+
+static void
+teardown (Fixture *f,
+    gconstpointer unused G_GNUC_UNUSED)
+{
+  _mcd_dispatch_args_free (f->args);
+}
+
+/* what _mcd_dispatch_operation_run_observers() and friends look at, per
+ * client */
+static void
+call_observers (Fixture *f)
+{
+  GHashTable *request_properties;
+  guint i;
+
+  request_properties = _mcd_dispatch_args_get_request_properties (f->args);
+  g_assert_cmpuint (g_hash_table_size (request_properties), ==,
+      f->channel.n_requests);
+
+  for (i = 0; i < N_OBSERVERS; i++)
+    {
+      g_assert (_mcd_dispatch_args_get_channel_details (f->args) != NULL);
+      g_assert_cmpuint (
+          _mcd_dispatch_args_get_satisfied_requests (f->args)->len, ==,
+          f->channel.n_requests);
+    }
+}
+
+static void
+call_approvers (Fixture *f)
+{
+  guint i;
+
+  for (i = 0; i < N_APPROVERS; i++)
+    g_assert (_mcd_dispatch_args_get_channel_details (f->args) != NULL);
+}
+
+static void
+call_handlers (Fixture *f)
+{
+  guint i;
+
+  /* e.g. the first few handlers fail, so we try the next */
+  for (i = 0; i < N_HANDLERS; i++)
+    {
+      g_assert (_mcd_dispatch_args_get_request_properties (f->args) != NULL);
+      g_assert (_mcd_dispatch_args_get_channel_details (f->args) != NULL);
+      g_assert (_mcd_dispatch_args_get_satisfied_requests (f->args) != NULL);
+    }
+}
+
+static void
+test_once (Fixture *f,
+    gconstpointer unused G_GNUC_UNUSED)
+{
+  /* nothing is built until someone needs it */
+  g_assert_cmpuint (f->channel.details_built, ==, 0);
+  g_assert_cmpuint (f->channel.requests_collected, ==, 0);
+
+  call_observers (f);
+  call_approvers (f);
+  call_handlers (f);
+
+  /* however many clients we called */
+  g_assert_cmpuint (f->channel.details_built, ==, 1);
+  g_assert_cmpuint (f->channel.requests_collected, ==, 1);
+}
+
+static void
+test_new_request (Fixture *f,
+    gconstpointer unused G_GNUC_UNUSED)
+{
+  call_observers (f);
+  call_approvers (f);
+  g_assert_cmpuint (f->channel.requests_collected, ==, 1);
+
+  /* someone calls EnsureChannel and gets this channel back while it's
+   * waiting for approval */
+  f->channel.n_requests++;
+
+  call_handlers (f);
+
+  /* the requests are collected again, exactly once, but the channel
+   * itself hasn't changed */
+  g_assert_cmpuint (f->channel.requests_collected, ==, 2);
+  g_assert_cmpuint (f->channel.details_built, ==, 1);
+}
+
+int
+main (int argc,
+      char **argv)
+{
+  g_test_init (&argc, &argv, NULL);
+
+  g_test_add ("/dispatch-args/once", Fixture, NULL, setup,
+      test_once, teardown);
+  g_test_add ("/dispatch-args/new-request", Fixture, NULL, setup,
+      test_new_request, teardown);
+
+  return g_test_run ();
+}
@@ -0,0 +1,435 @@
+/*
+ * Regression test and benchmark for the table of handled channels
+ *
+ * Copyright © 2012 Collabora Ltd.
+ *
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License as published by the Free Software Foundation; either
+ * version 2.1 of the License, or (at your option) any later version.
+ *
+ * This library is distributed in the hope that it will be useful, but
+ * WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the GNU
+ * Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with this library; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin St, Fifth Floor, Boston, MA
+ * 02110-1301 USA
+ *
+ */
+
+#include "config.h"
+
+#ifdef HAVE_MALLOC_H
+#include <malloc.h>
+#endif
+
+#include "handled-channels.h"
+
+#define N_CHANNELS 50000
+#define N_HANDLERS 20
+
+#define CLIENT_PREFIX TP_CLIENT_BUS_NAME_BASE "Handler"
+
+typedef struct {
+    McdHandledChannels *channels;
+    /* unique name => number of times it was added minus times removed */
+    GHashTable *watched;
+} Fixture;
+
+static void
+handler_added (const gchar *unique_name,
+    gpointer user_data)
+{
+  Fixture *f = user_data;
+
+  g_assert (!g_hash_table_contains (f->watched, unique_name));
+  g_hash_table_add (f->watched, g_strdup (unique_name));
+}
+
+static void
+handler_removed (const gchar *unique_name,
+    gpointer user_data)
+{
+  Fixture *f = user_data;
+
+  g_assert (g_hash_table_remove (f->watched, unique_name));
+}
+
+static const McdHandledChannelsFuncs funcs = {
+    handler_added,
+    handler_removed
+};
+
+static void
+setup (Fixture *f,
+    gconstpointer unused G_GNUC_UNUSED)
+{
+  f->watched = g_hash_table_new_full (g_str_hash, g_str_equal, g_free, NULL);
+  f->channels = _mcd_handled_channels_new (&funcs, f);
+}
+
+static void
+teardown (Fixture *f,
+    gconstpointer unused G_GNUC_UNUSED)
+{
+  _mcd_handled_channels_free (f->channels);
+  g_hash_table_unref (f->watched);
+}
+
+static void
+assert_handler (Fixture *f,
+    const gchar *path,
+    const gchar *unique_name,
+    const gchar *well_known_name)
+{
+  const McdHandledChannel *record = _mcd_handled_channels_lookup (
+      f->channels, path);
+
+  g_assert (record != NULL);
+  g_assert_cmpstr (record->object_path, ==, path);
+  g_assert_cmpstr (record->unique_name, ==, unique_name);
+  g_assert_cmpstr (record->well_known_name, ==, well_known_name);
+  g_assert (record->channel == NULL);
+  g_assert (record->account_path == NULL);
+}
+
+static guint
+count_handler_paths (Fixture *f,
+    const gchar *unique_name)
+{
+  GList *paths = _mcd_handled_channels_dup_handler_paths (f->channels,
+      unique_name);
+  guint n = g_list_length (paths);
+
+  g_list_free_full (paths, g_free);
+  return n;
+}
+
+static void
+test_set_handler (Fixture *f,
+    gconstpointer unused G_GNUC_UNUSED)
+{
+  _mcd_handled_channels_set_handler (f->channels, "/a", ":1.1",
+      CLIENT_PREFIX "1");
+  _mcd_handled_channels_set_handler (f->channels, "/b", ":1.1",
+      CLIENT_PREFIX "1");
+  assert_handler (f, "/a", ":1.1", CLIENT_PREFIX "1");
+  assert_handler (f, "/b", ":1.1", CLIENT_PREFIX "1");
+  g_assert_cmpuint (g_hash_table_size (f->watched), ==, 1);
+  g_assert_cmpuint (count_handler_paths (f, ":1.1"), ==, 2);
+
+  /* well-known names are shared */
+  g_assert (_mcd_handled_channels_lookup (f->channels, "/a")->
+      well_known_name == g_intern_string (CLIENT_PREFIX "1"));
+
+  /* the same handler again, but we've forgotten its well-known name */
+  _mcd_handled_channels_set_handler (f->channels, "/a", ":1.1", NULL);
+  assert_handler (f, "/a", ":1.1", NULL);
+  g_assert_cmpuint (g_hash_table_size (f->watched), ==, 1);
+
+  /* a different handler takes /a */
+  _mcd_handled_channels_set_handler (f->channels, "/a", ":1.2",
+      CLIENT_PREFIX "2");
+  assert_handler (f, "/a", ":1.2", CLIENT_PREFIX "2");
+  g_assert (g_hash_table_contains (f->watched, ":1.1"));
+  g_assert (g_hash_table_contains (f->watched, ":1.2"));
+  g_assert_cmpuint (count_handler_paths (f, ":1.1"), ==, 1);
+  g_assert_cmpuint (count_handler_paths (f, ":1.2"), ==, 1);
+
+  /* and then /b, which was :1.1's last channel */
+  _mcd_handled_channels_set_handler (f->channels, "/b", ":1.2",
+      CLIENT_PREFIX "2");
+  g_assert (!g_hash_table_contains (f->watched, ":1.1"));
+  g_assert_cmpuint (count_handler_paths (f, ":1.1"), ==, 0);
+  g_assert_cmpuint (count_handler_paths (f, ":1.2"), ==, 2);
+
+  _mcd_handled_channels_remove (f->channels, "/a");
+  g_assert (_mcd_handled_channels_lookup (f->channels, "/a") == NULL);
+  g_assert (g_hash_table_contains (f->watched, ":1.2"));
+
+  _mcd_handled_channels_remove (f->channels, "/b");
+  g_assert (_mcd_handled_channels_lookup (f->channels, "/b") == NULL);
+  g_assert_cmpuint (g_hash_table_size (f->watched), ==, 0);
+
+  /* removing something we don't know about is harmless */
+  _mcd_handled_channels_remove (f->channels, "/b");
+}
+
+static void
+test_crash (Fixture *f,
+    gconstpointer unused G_GNUC_UNUSED)
+{
+  GList *paths;
+  GList *handlers;
+
+  _mcd_handled_channels_set_handler (f->channels, "/a", ":1.1", NULL);
+  _mcd_handled_channels_set_handler (f->channels, "/b", ":1.2", NULL);
+  _mcd_handled_channels_set_handler (f->channels, "/c", ":1.1", NULL);
+
+  handlers = _mcd_handled_channels_get_handlers (f->channels);
+  g_assert_cmpuint (g_list_length (handlers), ==, 2);
+  g_list_free (handlers);
+
+  paths = _mcd_handled_channels_remove_handler (f->channels, ":1.1");
+  paths = g_list_sort (paths, (GCompareFunc) g_strcmp0);
+  g_assert_cmpuint (g_list_length (paths), ==, 2);
+  g_assert_cmpstr (paths->data, ==, "/a");
+  g_assert_cmpstr (paths->next->data, ==, "/c");
+  g_list_free_full (paths, g_free);
+
+  /* we didn't have a TpChannel for them, so there's nothing left */
+  g_assert (_mcd_handled_channels_lookup (f->channels, "/a") == NULL);
+  g_assert (_mcd_handled_channels_lookup (f->channels, "/c") == NULL);
+  g_assert (!g_hash_table_contains (f->watched, ":1.1"));
+
+  /* the other handler is unaffected */
+  assert_handler (f, "/b", ":1.2", NULL);
+  g_assert (g_hash_table_contains (f->watched, ":1.2"));
+
+  /* it can't crash twice */
+  g_assert (_mcd_handled_channels_remove_handler (f->channels,
+        ":1.1") == NULL);
+}
+
+/* @expected: the paths that @unique_name should be handling, sorted */
+static void
+assert_handler_paths (Fixture *f,
+    const gchar *unique_name,
+    const gchar * const *expected)
+{
+  GList *paths = _mcd_handled_channels_dup_handler_paths (f->channels,
+      unique_name);
+  GList *l;
+  guint i = 0;
+
+  paths = g_list_sort (paths, (GCompareFunc) g_strcmp0);
+
+  for (l = paths; l != NULL; l = l->next)
+    {
+      const McdHandledChannel *record = _mcd_handled_channels_lookup (
+          f->channels, l->data);
+
+      g_assert_cmpstr (l->data, ==, expected[i]);
+      /* each path in the set has a record naming this handler */
+      g_assert (record != NULL);
+      g_assert_cmpstr (record->unique_name, ==, unique_name);
+      i++;
+    }
+
+  g_assert (expected[i] == NULL);
+  g_list_free_full (paths, g_free);
+}
+
+static void
+test_layout (Fixture *f,
+    gconstpointer unused G_GNUC_UNUSED)
+{
+  const gchar * const none[] = { NULL };
+  const gchar * const one_abc[] = { "/a", "/b", "/c", NULL };
+  const gchar * const one_ac[] = { "/a", "/c", NULL };
+  const gchar * const two_b[] = { "/b", NULL };
+  const gchar * const two_bd[] = { "/b", "/d", NULL };
+  GList *handlers;
+
+  _mcd_handled_channels_set_handler (f->channels, "/a", ":1.1", NULL);
+  _mcd_handled_channels_set_handler (f->channels, "/b", ":1.1", NULL);
+  _mcd_handled_channels_set_handler (f->channels, "/c", ":1.1", NULL);
+  assert_handler_paths (f, ":1.1", one_abc);
+  assert_handler_paths (f, ":1.2", none);
+
+  /* every channel with the same handler shares one copy of its name */
+  g_assert (_mcd_handled_channels_lookup (f->channels, "/a")->unique_name ==
+      _mcd_handled_channels_lookup (f->channels, "/c")->unique_name);
+
+  /* moving a channel moves its path from one set to the other */
+  _mcd_handled_channels_set_handler (f->channels, "/b", ":1.2", NULL);
+  assert_handler_paths (f, ":1.1", one_ac);
+  assert_handler_paths (f, ":1.2", two_b);
+
+  _mcd_handled_channels_set_handler (f->channels, "/d", ":1.2", NULL);
+  assert_handler_paths (f, ":1.2", two_bd);
+
+  handlers = _mcd_handled_channels_get_handlers (f->channels);
+  handlers = g_list_sort (handlers, (GCompareFunc) g_strcmp0);
+  g_assert_cmpuint (g_list_length (handlers), ==, 2);
+  g_assert_cmpstr (handlers->data, ==, ":1.1");
+  g_assert_cmpstr (handlers->next->data, ==, ":1.2");
+  g_list_free (handlers);
+
+  /* removing channels removes them from their handler's set, and the set
+   * goes away with its last channel */
+  _mcd_handled_channels_remove (f->channels, "/d");
+  assert_handler_paths (f, ":1.2", two_b);
+  _mcd_handled_channels_remove (f->channels, "/b");
+  assert_handler_paths (f, ":1.2", none);
+
+  handlers = _mcd_handled_channels_get_handlers (f->channels);
+  g_assert_cmpuint (g_list_length (handlers), ==, 1);
+  g_assert_cmpstr (handlers->data, ==, ":1.1");
+  g_list_free (handlers);
+
+  assert_handler_paths (f, ":1.1", one_ac);
+  g_assert (!g_hash_table_contains (f->watched, ":1.2"));
+  g_assert (g_hash_table_contains (f->watched, ":1.1"));
+}
+
+static gsize
+heap_in_use (void)
+{
+#if defined (HAVE_MALLOC_H) && defined (HAVE_MALLINFO2)
+  return mallinfo2 ().uordblks;
+#elif defined (HAVE_MALLOC_H) && defined (HAVE_MALLINFO)
+  return mallinfo ().uordblks;
+#else
+  return 0;
+#endif
+}
+
+static void
+slice_free_gsize (gpointer p)
+{
+  g_slice_free (gsize, p);
+}
+
+/* What McdHandlerMap used to do for each call to
+ * _mcd_handler_map_set_path_handled(). */
+static void
+legacy_set_path_handled (GHashTable *channel_processes,
+    GHashTable *channel_clients,
+    GHashTable *handler_processes,
+    const gchar *path,
+    const gchar *unique_name,
+    const gchar *well_known_name)
+{
+  gsize *counter;
+
+  g_hash_table_insert (channel_clients, g_strdup (path),
+      g_strdup (well_known_name));
+  g_hash_table_insert (channel_processes, g_strdup (path),
+      g_strdup (unique_name));
+
+  counter = g_hash_table_lookup (handler_processes, unique_name);
+
+  if (counter == NULL)
+    {
+      counter = g_slice_new0 (gsize);
+      g_hash_table_insert (handler_processes, g_strdup (unique_name),
+          counter);
+    }
+
+  ++*counter;
+}
+
+static void
+test_benchmark (Fixture *f,
+    gconstpointer unused G_GNUC_UNUSED)
+{
+  GPtrArray *paths = g_ptr_array_new_with_free_func (g_free);
+  gchar *unique_names[N_HANDLERS];
+  gchar *well_known_names[N_HANDLERS];
+  GHashTable *channel_processes, *channel_clients, *handler_processes;
+  GTimer *timer = g_timer_new ();
+  gsize before, legacy_bytes, table_bytes;
+  gdouble legacy_time, table_time;
+  guint i;
+
+  for (i = 0; i < N_HANDLERS; i++)
+    {
+      unique_names[i] = g_strdup_printf (":1.%u", 100 + i);
+      well_known_names[i] = g_strdup_printf (CLIENT_PREFIX "%u", i);
+    }
+
+  for (i = 0; i < N_CHANNELS; i++)
+    g_ptr_array_add (paths, g_strdup_printf (
+          "/org/freedesktop/Telepathy/Connection/gabble/jabber/"
+          "user_40example_2ecom_2fResource/TextChannel%u", i));
+
+  before = heap_in_use ();
+  g_timer_start (timer);
+
+  channel_processes = g_hash_table_new_full (g_str_hash, g_str_equal,
+      g_free, g_free);
+  channel_clients = g_hash_table_new_full (g_str_hash, g_str_equal,
+      g_free, g_free);
+  handler_processes = g_hash_table_new_full (g_str_hash, g_str_equal,
+      g_free, slice_free_gsize);
+
+  for (i = 0; i < N_CHANNELS; i++)
+    legacy_set_path_handled (channel_processes, channel_clients,
+        handler_processes, g_ptr_array_index (paths, i),
+        unique_names[i % N_HANDLERS], well_known_names[i % N_HANDLERS]);
+
+  legacy_time = g_timer_elapsed (timer, NULL);
+  legacy_bytes = heap_in_use () - before;
+
+  g_hash_table_unref (channel_processes);
+  g_hash_table_unref (channel_clients);
+  g_hash_table_unref (handler_processes);
+
+  before = heap_in_use ();
+  g_timer_start (timer);
+
+  for (i = 0; i < N_CHANNELS; i++)
+    _mcd_handled_channels_set_handler (f->channels,
+        g_ptr_array_index (paths, i), unique_names[i % N_HANDLERS],
+        well_known_names[i % N_HANDLERS]);
+
+  table_time = g_timer_elapsed (timer, NULL);
+  table_bytes = heap_in_use () - before;
+
+  g_assert_cmpuint (g_hash_table_size (f->watched), ==, N_HANDLERS);
+  g_assert_cmpuint (count_handler_paths (f, unique_names[0]), ==,
+      N_CHANNELS / N_HANDLERS);
+  assert_handler (f, g_ptr_array_index (paths, N_CHANNELS - 1),
+      unique_names[(N_CHANNELS - 1) % N_HANDLERS],
+      well_known_names[(N_CHANNELS - 1) % N_HANDLERS]);
+
+  if (legacy_bytes == 0)
+    g_test_message ("handling %u channels by %u handlers: "
+        "separate tables %.3fs, records %.3fs (heap usage not available)",
+        N_CHANNELS, N_HANDLERS, legacy_time, table_time);
+  else
+    g_test_message ("handling %u channels by %u handlers: "
+        "separate tables %.3fs, %" G_GSIZE_FORMAT " bytes; "
+        "records %.3fs, %" G_GSIZE_FORMAT " bytes",
+        N_CHANNELS, N_HANDLERS, legacy_time, legacy_bytes, table_time,
+        table_bytes);
+
+  if (g_test_perf ())
+    g_test_minimized_result (table_bytes,
+        "records: %" G_GSIZE_FORMAT " bytes (separate tables: %"
+        G_GSIZE_FORMAT " bytes)", table_bytes, legacy_bytes);
+
+  for (i = 0; i < N_HANDLERS; i++)
+    {
+      g_free (unique_names[i]);
+      g_free (well_known_names[i]);
+    }
+
+  g_timer_destroy (timer);
+  g_ptr_array_unref (paths);
+}
+
+int
+main (int argc,
+      char **argv)
+{
+  /* so that the heap usage we measure includes everything */
+  g_setenv ("G_SLICE", "always-malloc", TRUE);
+
+  g_test_init (&argc, &argv, NULL);
+
+  g_test_add ("/handled-channels/set-handler", Fixture, NULL, setup,
+      test_set_handler, teardown);
+  g_test_add ("/handled-channels/layout", Fixture, NULL, setup,
+      test_layout, teardown);
+  g_test_add ("/handled-channels/crash", Fixture, NULL, setup,
+      test_crash, teardown);
+  g_test_add ("/handled-channels/benchmark", Fixture, NULL, setup,
+      test_benchmark, teardown);
+
+  return g_test_run ();
+}
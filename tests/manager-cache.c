@@ -0,0 +1,206 @@
+/*
+ * Regression test for the cache of connection managers' protocols
+ *
+ * Copyright © 2012 Collabora Ltd.
+ *
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License as published by the Free Software Foundation; either
+ * version 2.1 of the License, or (at your option) any later version.
+ *
+ * This library is distributed in the hope that it will be useful, but
+ * WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the GNU
+ * Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with this library; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin St, Fifth Floor, Boston, MA
+ * 02110-1301 USA
+ *
+ */
+
+#include "config.h"
+
+#include "mcd-manager-cache.h"
+
+#include <utime.h>
+
+#include <glib/gstdio.h>
+
+typedef struct {
+    gchar *tmpdir;
+    gchar *source;
+    gchar *cache;
+    GVariant *contents;
+} Fixture;
+
+static void
+set_mtime (const gchar *filename,
+    time_t mtime)
+{
+  struct utimbuf times = { mtime, mtime };
+
+  g_assert_cmpint (g_utime (filename, &times), ==, 0);
+}
+
+static void
+setup (Fixture *f,
+    gconstpointer unused G_GNUC_UNUSED)
+{
+  GError *error = NULL;
+  gchar *dir;
+
+  f->tmpdir = g_dir_make_tmp ("mc-test-manager-cache.XXXXXX", &error);
+  g_assert_no_error (error);
+
+  f->source = g_build_filename (f->tmpdir, "managers", "fakecm.manager",
+      NULL);
+  dir = g_path_get_dirname (f->source);
+  g_assert_cmpint (g_mkdir (dir, 0700), ==, 0);
+  g_free (dir);
+  g_file_set_contents (f->source, "[ConnectionManager]\n", -1, &error);
+  g_assert_no_error (error);
+  set_mtime (f->source, 1000000000);
+
+  /* in a subdirectory that doesn't exist yet */
+  f->cache = g_build_filename (f->tmpdir, "cache", "fakecm.cache", NULL);
+
+  f->contents = g_variant_ref_sink (g_variant_parse (
+        MCD_MANAGER_CACHE_CONTENTS_TYPE,
+        "(['com.example.Foo'], "
+        "{'fakeproto': {'com.example.Bar': <uint32 42>}})",
+        NULL, NULL, &error));
+  g_assert_no_error (error);
+}
+
+static void
+teardown (Fixture *f,
+    gconstpointer unused G_GNUC_UNUSED)
+{
+  gchar *dir;
+
+  g_unlink (f->cache);
+  dir = g_path_get_dirname (f->cache);
+  g_rmdir (dir);
+  g_free (dir);
+
+  g_unlink (f->source);
+  dir = g_path_get_dirname (f->source);
+  g_rmdir (dir);
+  g_free (dir);
+
+  g_rmdir (f->tmpdir);
+
+  g_free (f->tmpdir);
+  g_free (f->source);
+  g_free (f->cache);
+  g_variant_unref (f->contents);
+}
+
+static void
+save (Fixture *f)
+{
+  GError *error = NULL;
+
+  g_assert (_mcd_manager_cache_save (f->cache, f->source, f->contents,
+        &error));
+  g_assert_no_error (error);
+}
+
+static void
+test_round_trip (Fixture *f,
+    gconstpointer unused G_GNUC_UNUSED)
+{
+  GVariant *loaded;
+
+  /* nothing there yet */
+  g_assert (_mcd_manager_cache_load (f->cache, f->source) == NULL);
+
+  save (f);
+  loaded = _mcd_manager_cache_load (f->cache, f->source);
+  g_assert (loaded != NULL);
+  g_assert (g_variant_equal (loaded, f->contents));
+  g_variant_unref (loaded);
+}
+
+static void
+test_modified (Fixture *f,
+    gconstpointer unused G_GNUC_UNUSED)
+{
+  save (f);
+
+  /* e.g. the CM was upgraded */
+  set_mtime (f->source, 1234567890);
+  g_assert (_mcd_manager_cache_load (f->cache, f->source) == NULL);
+
+  /* saving again brings it up to date */
+  save (f);
+  g_assert (_mcd_manager_cache_load (f->cache, f->source) != NULL);
+}
+
+static void
+test_moved (Fixture *f,
+    gconstpointer unused G_GNUC_UNUSED)
+{
+  gchar *elsewhere = g_build_filename (f->tmpdir, "fakecm.manager", NULL);
+
+  save (f);
+
+  /* the same mtime doesn't make a different file valid */
+  g_assert (g_rename (f->source, elsewhere) == 0);
+  g_assert (_mcd_manager_cache_load (f->cache, elsewhere) == NULL);
+
+  /* and a source that has gone away can't validate anything */
+  g_assert (_mcd_manager_cache_load (f->cache, f->source) == NULL);
+
+  g_assert (g_rename (elsewhere, f->source) == 0);
+  g_free (elsewhere);
+}
+
+static void
+test_corrupt (Fixture *f,
+    gconstpointer unused G_GNUC_UNUSED)
+{
+  GError *error = NULL;
+
+  save (f);
+  g_file_set_contents (f->cache, "not a GVariant", -1, &error);
+  g_assert_no_error (error);
+  g_assert (_mcd_manager_cache_load (f->cache, f->source) == NULL);
+}
+
+static void
+test_find_source (Fixture *f,
+    gconstpointer unused G_GNUC_UNUSED)
+{
+  gchar *found;
+
+  g_setenv ("TELEPATHY_DATA_PATH", f->tmpdir, TRUE);
+
+  found = _mcd_manager_cache_find_source ("fakecm");
+  g_assert_cmpstr (found, ==, f->source);
+  g_free (found);
+
+  g_unsetenv ("TELEPATHY_DATA_PATH");
+}
+
+int
+main (int argc,
+      char **argv)
+{
+  g_test_init (&argc, &argv, NULL);
+
+  g_test_add ("/manager-cache/round-trip", Fixture, NULL,
+      setup, test_round_trip, teardown);
+  g_test_add ("/manager-cache/modified", Fixture, NULL,
+      setup, test_modified, teardown);
+  g_test_add ("/manager-cache/moved", Fixture, NULL,
+      setup, test_moved, teardown);
+  g_test_add ("/manager-cache/corrupt", Fixture, NULL,
+      setup, test_corrupt, teardown);
+  g_test_add ("/manager-cache/find-source", Fixture, NULL,
+      setup, test_find_source, teardown);
+
+  return g_test_run ();
+}
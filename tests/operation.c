@@ -0,0 +1,211 @@
+/*
+ * Regression and stress test for McdOperation's children
+ *
+ * Copyright © 2012 Collabora Ltd.
+ *
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License as published by the Free Software Foundation; either
+ * version 2.1 of the License, or (at your option) any later version.
+ *
+ * This library is distributed in the hope that it will be useful, but
+ * WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the GNU
+ * Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with this library; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin St, Fifth Floor, Boston, MA
+ * 02110-1301 USA
+ *
+ */
+
+#include "config.h"
+
+#include "mcd-operation.h"
+
+#define N_MISSIONS 100000
+
+typedef struct {
+    McdOperation *operation;
+    guint n_taken;
+    guint n_removed;
+} Fixture;
+
+static void
+mission_taken_cb (McdOperation *operation,
+    McdMission *mission,
+    Fixture *f)
+{
+  f->n_taken++;
+}
+
+static void
+mission_removed_cb (McdOperation *operation,
+    McdMission *mission,
+    Fixture *f)
+{
+  f->n_removed++;
+}
+
+static void
+count_abort_cb (McdMission *mission,
+    guint *count)
+{
+  ++*count;
+}
+
+static void
+setup (Fixture *f,
+    gconstpointer unused G_GNUC_UNUSED)
+{
+  f->operation = mcd_operation_new ();
+  g_signal_connect (f->operation, "mission-taken",
+      G_CALLBACK (mission_taken_cb), f);
+  g_signal_connect (f->operation, "mission-removed",
+      G_CALLBACK (mission_removed_cb), f);
+}
+
+static void
+teardown (Fixture *f,
+    gconstpointer unused G_GNUC_UNUSED)
+{
+  g_object_unref (f->operation);
+}
+
+static McdMission *
+take_new_mission (Fixture *f)
+{
+  McdMission *mission = g_object_new (MCD_TYPE_MISSION, NULL);
+
+  /* the operation takes ownership; we keep a weak pointer */
+  mcd_operation_take_mission (f->operation, mission);
+  return mission;
+}
+
+static void
+test_abort (Fixture *f,
+    gconstpointer unused G_GNUC_UNUSED)
+{
+  McdMission *missions[3];
+  guint aborted[3] = { 0, 0, 0 };
+  guint i;
+
+  for (i = 0; i < 3; i++)
+    {
+      missions[i] = take_new_mission (f);
+      g_object_ref (missions[i]);
+      g_signal_connect (missions[i], "abort", G_CALLBACK (count_abort_cb),
+          aborted + i);
+      g_assert (mcd_mission_get_parent (missions[i]) ==
+          MCD_MISSION (f->operation));
+    }
+
+  /* most recently taken first */
+  g_assert (mcd_operation_get_missions (f->operation)->data == missions[2]);
+
+  /* a child that aborts is removed */
+  mcd_mission_abort (missions[1]);
+  g_assert_cmpuint (aborted[1], ==, 1);
+  g_assert_cmpuint (f->n_removed, ==, 1);
+  g_assert (mcd_mission_get_parent (missions[1]) == NULL);
+  g_assert_cmpuint (g_list_length ((GList *) mcd_operation_get_missions (
+          f->operation)), ==, 2);
+
+  /* aborting the operation aborts the rest, but it still holds them */
+  mcd_mission_abort (MCD_MISSION (f->operation));
+  g_assert_cmpuint (aborted[0], ==, 1);
+  g_assert_cmpuint (aborted[1], ==, 1);
+  g_assert_cmpuint (aborted[2], ==, 1);
+  g_assert_cmpuint (f->n_removed, ==, 1);
+  g_assert_cmpuint (g_list_length ((GList *) mcd_operation_get_missions (
+          f->operation)), ==, 2);
+
+  for (i = 0; i < 3; i++)
+    g_object_unref (missions[i]);
+}
+
+static void
+remove_one (gpointer mission,
+    gpointer operation)
+{
+  mcd_operation_remove_mission (operation, mission);
+}
+
+static void
+test_stress (Fixture *f,
+    gconstpointer unused G_GNUC_UNUSED)
+{
+  GPtrArray *missions = g_ptr_array_new_with_free_func (g_object_unref);
+  GTimer *timer = g_timer_new ();
+  gdouble take_time, remove_time;
+  guint i;
+
+  for (i = 0; i < N_MISSIONS; i++)
+    g_ptr_array_add (missions, g_object_new (MCD_TYPE_MISSION, NULL));
+
+  g_timer_start (timer);
+
+  for (i = 0; i < N_MISSIONS; i++)
+    mcd_operation_take_mission (f->operation,
+        g_object_ref (g_ptr_array_index (missions, i)));
+
+  take_time = g_timer_elapsed (timer, NULL);
+  g_assert_cmpuint (f->n_taken, ==, N_MISSIONS);
+  g_assert_cmpuint (g_list_length ((GList *) mcd_operation_get_missions (
+          f->operation)), ==, N_MISSIONS);
+
+  g_timer_start (timer);
+
+  /* every other mission, oldest first, so we remove from the far end of
+   * the list */
+  for (i = 0; i < N_MISSIONS; i += 2)
+    mcd_operation_remove_mission (f->operation,
+        g_ptr_array_index (missions, i));
+
+  g_assert_cmpuint (f->n_removed, ==, N_MISSIONS / 2);
+  g_assert (mcd_mission_get_parent (g_ptr_array_index (missions, 0)) ==
+      NULL);
+  g_assert (mcd_mission_get_parent (g_ptr_array_index (missions, 1)) ==
+      MCD_MISSION (f->operation));
+  g_assert (mcd_operation_get_missions (f->operation)->data ==
+      g_ptr_array_index (missions, N_MISSIONS - 1));
+
+  /* the rest while iterating, like McdConnection does when disposed */
+  mcd_operation_foreach (f->operation, remove_one, f->operation);
+
+  remove_time = g_timer_elapsed (timer, NULL);
+  g_assert_cmpuint (f->n_removed, ==, N_MISSIONS);
+  g_assert (mcd_operation_get_missions (f->operation) == NULL);
+
+  /* they can be taken again */
+  mcd_operation_take_mission (f->operation,
+      g_object_ref (g_ptr_array_index (missions, 0)));
+  g_assert (mcd_operation_get_missions (f->operation)->data ==
+      g_ptr_array_index (missions, 0));
+
+  g_test_message ("%u missions: taken in %.3fs, removed in %.3fs",
+      N_MISSIONS, take_time, remove_time);
+
+  if (g_test_perf ())
+    g_test_minimized_result (remove_time, "removing %u missions: %.3fs",
+        N_MISSIONS, remove_time);
+
+  g_timer_destroy (timer);
+  /* the operation still has a ref to one of them */
+  g_ptr_array_unref (missions);
+}
+
+int
+main (int argc,
+      char **argv)
+{
+  g_test_init (&argc, &argv, NULL);
+
+  g_test_add ("/operation/abort", Fixture, NULL, setup, test_abort,
+      teardown);
+  g_test_add ("/operation/stress", Fixture, NULL, setup, test_stress,
+      teardown);
+
+  return g_test_run ();
+}
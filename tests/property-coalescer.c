@@ -0,0 +1,239 @@
+/*
+ * Regression test for batching of property-change signals
+ *
+ * Copyright © 2012 Collabora Ltd.
+ *
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License as published by the Free Software Foundation; either
+ * version 2.1 of the License, or (at your option) any later version.
+ *
+ * This library is distributed in the hope that it will be useful, but
+ * WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the GNU
+ * Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with this library; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin St, Fifth Floor, Boston, MA
+ * 02110-1301 USA
+ *
+ */
+
+#include "config.h"
+
+#include "mcd-property-coalescer.h"
+
+#include <telepathy-glib/telepathy-glib.h>
+
+#define LATENCY 50
+
+typedef struct {
+    GObject *object;
+    GHashTable *properties;
+} Signal;
+
+typedef struct {
+    McdPropertyCoalescer *coalescer;
+    GObject *a;
+    GObject *b;
+    GMainLoop *loop;
+} Fixture;
+
+/* the emit callback has no user_data, so it appends to this */
+static GPtrArray *signals = NULL;
+
+static void
+signal_free (gpointer p)
+{
+  Signal *s = p;
+
+  g_object_unref (s->object);
+  g_hash_table_unref (s->properties);
+  g_slice_free (Signal, s);
+}
+
+static void
+emit_cb (GObject *object,
+    GHashTable *properties)
+{
+  Signal *s = g_slice_new0 (Signal);
+
+  s->object = g_object_ref (object);
+  s->properties = g_hash_table_ref (properties);
+  g_ptr_array_add (signals, s);
+}
+
+static void
+setup (Fixture *f,
+    gconstpointer unused G_GNUC_UNUSED)
+{
+  signals = g_ptr_array_new_with_free_func (signal_free);
+  f->coalescer = _mcd_property_coalescer_new (LATENCY, emit_cb);
+  f->a = g_object_new (G_TYPE_OBJECT, NULL);
+  f->b = g_object_new (G_TYPE_OBJECT, NULL);
+  f->loop = g_main_loop_new (NULL, FALSE);
+}
+
+static void
+teardown (Fixture *f,
+    gconstpointer unused G_GNUC_UNUSED)
+{
+  _mcd_property_coalescer_flush (f->coalescer);
+  _mcd_property_coalescer_unref (f->coalescer);
+  g_object_unref (f->a);
+  g_object_unref (f->b);
+  g_main_loop_unref (f->loop);
+  tp_clear_pointer (&signals, g_ptr_array_unref);
+}
+
+static void
+add_uint (Fixture *f,
+    GObject *object,
+    const gchar *key,
+    guint u)
+{
+  GValue value = G_VALUE_INIT;
+
+  g_value_init (&value, G_TYPE_UINT);
+  g_value_set_uint (&value, u);
+  _mcd_property_coalescer_add (f->coalescer, object, key, &value);
+  g_value_unset (&value);
+}
+
+static guint
+get_uint (guint i,
+    const gchar *key)
+{
+  Signal *s = g_ptr_array_index (signals, i);
+  GValue *value = g_hash_table_lookup (s->properties, key);
+
+  g_assert (value != NULL);
+  return g_value_get_uint (value);
+}
+
+static gboolean
+quit_cb (gpointer user_data)
+{
+  g_main_loop_quit (user_data);
+  return FALSE;
+}
+
+static void
+wait_for_signals (Fixture *f)
+{
+  g_timeout_add (LATENCY * 2, quit_cb, f->loop);
+  g_main_loop_run (f->loop);
+}
+
+static void
+test_latest_wins (Fixture *f,
+    gconstpointer unused G_GNUC_UNUSED)
+{
+  add_uint (f, f->a, "Foo", 1);
+  add_uint (f, f->a, "Bar", 2);
+  add_uint (f, f->a, "Foo", 3);
+  g_assert_cmpuint (_mcd_property_coalescer_get_n_pending (f->coalescer),
+      ==, 1);
+  g_assert_cmpuint (signals->len, ==, 0);
+
+  wait_for_signals (f);
+
+  g_assert_cmpuint (signals->len, ==, 1);
+  g_assert_cmpuint (get_uint (0, "Foo"), ==, 3);
+  g_assert_cmpuint (get_uint (0, "Bar"), ==, 2);
+  g_assert_cmpuint (_mcd_property_coalescer_get_n_pending (f->coalescer),
+      ==, 0);
+  /* changing Foo again would have cost one more signal */
+  g_assert_cmpuint (_mcd_property_coalescer_get_n_saved (f->coalescer),
+      ==, 1);
+}
+
+static void
+test_many_objects (Fixture *f,
+    gconstpointer unused G_GNUC_UNUSED)
+{
+  add_uint (f, f->b, "Foo", 1);
+  add_uint (f, f->a, "Foo", 2);
+  add_uint (f, f->b, "Foo", 3);
+  g_assert_cmpuint (_mcd_property_coalescer_get_n_pending (f->coalescer),
+      ==, 2);
+
+  wait_for_signals (f);
+
+  /* one signal each, in the order they first changed */
+  g_assert_cmpuint (signals->len, ==, 2);
+  g_assert (((Signal *) g_ptr_array_index (signals, 0))->object == f->b);
+  g_assert_cmpuint (get_uint (0, "Foo"), ==, 3);
+  g_assert (((Signal *) g_ptr_array_index (signals, 1))->object == f->a);
+  g_assert_cmpuint (get_uint (1, "Foo"), ==, 2);
+  g_assert_cmpuint (_mcd_property_coalescer_get_n_saved (f->coalescer),
+      ==, 1);
+}
+
+static void
+test_flush_object (Fixture *f,
+    gconstpointer unused G_GNUC_UNUSED)
+{
+  add_uint (f, f->a, "Foo", 1);
+  add_uint (f, f->b, "Foo", 2);
+
+  _mcd_property_coalescer_flush_object (f->coalescer, f->a);
+  g_assert_cmpuint (signals->len, ==, 1);
+  g_assert (((Signal *) g_ptr_array_index (signals, 0))->object == f->a);
+  g_assert_cmpuint (_mcd_property_coalescer_get_n_pending (f->coalescer),
+      ==, 1);
+
+  /* nothing pending for a, so nothing happens */
+  _mcd_property_coalescer_flush_object (f->coalescer, f->a);
+  g_assert_cmpuint (signals->len, ==, 1);
+
+  wait_for_signals (f);
+  g_assert_cmpuint (signals->len, ==, 2);
+  g_assert (((Signal *) g_ptr_array_index (signals, 1))->object == f->b);
+}
+
+static gboolean
+change_again_cb (gpointer user_data)
+{
+  Fixture *f = user_data;
+
+  add_uint (f, f->b, "Foo", 2);
+  return FALSE;
+}
+
+static void
+test_bounded_latency (Fixture *f,
+    gconstpointer unused G_GNUC_UNUSED)
+{
+  add_uint (f, f->a, "Foo", 1);
+
+  /* a later change joins the batch rather than postponing it */
+  g_timeout_add (LATENCY / 2, change_again_cb, f);
+  g_timeout_add (LATENCY + LATENCY / 4, quit_cb, f->loop);
+  g_main_loop_run (f->loop);
+
+  g_assert_cmpuint (signals->len, ==, 2);
+  g_assert (((Signal *) g_ptr_array_index (signals, 0))->object == f->a);
+  g_assert (((Signal *) g_ptr_array_index (signals, 1))->object == f->b);
+  g_assert_cmpuint (_mcd_property_coalescer_get_n_pending (f->coalescer),
+      ==, 0);
+}
+
+int
+main (int argc,
+      char **argv)
+{
+  g_test_init (&argc, &argv, NULL);
+
+  g_test_add ("/property-coalescer/latest-wins", Fixture, NULL,
+      setup, test_latest_wins, teardown);
+  g_test_add ("/property-coalescer/many-objects", Fixture, NULL,
+      setup, test_many_objects, teardown);
+  g_test_add ("/property-coalescer/flush-object", Fixture, NULL,
+      setup, test_flush_object, teardown);
+  g_test_add ("/property-coalescer/bounded-latency", Fixture, NULL,
+      setup, test_bounded_latency, teardown);
+
+  return g_test_run ();
+}
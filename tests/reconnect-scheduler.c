@@ -0,0 +1,291 @@
+/*
+ * Regression test for the reconnect scheduler
+ *
+ * Copyright © 2012 Collabora Ltd.
+ *
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License as published by the Free Software Foundation; either
+ * version 2.1 of the License, or (at your option) any later version.
+ *
+ * This library is distributed in the hope that it will be useful, but
+ * WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the GNU
+ * Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with this library; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin St, Fifth Floor, Boston, MA
+ * 02110-1301 USA
+ *
+ */
+
+#include "config.h"
+
+#include "mcd-reconnect-scheduler.h"
+
+typedef struct {
+    McdReconnectScheduler *scheduler;
+    /* borrowed names of the attempts that have started, in order */
+    GPtrArray *started;
+    /* if TRUE, attempts say they had nothing to do */
+    gboolean decline;
+    /* if TRUE, attempts find that we've gone offline again, so they go
+     * back to waiting for connectivity and finish at once */
+    gboolean offline;
+} Fixture;
+
+static void
+setup (Fixture *f,
+    gconstpointer data)
+{
+  /* no jitter, so the order is predictable */
+  f->scheduler = _mcd_reconnect_scheduler_new (GPOINTER_TO_UINT (data), 0);
+  f->started = g_ptr_array_new ();
+}
+
+static void
+teardown (Fixture *f,
+    gconstpointer unused G_GNUC_UNUSED)
+{
+  _mcd_reconnect_scheduler_unref (f->scheduler);
+  g_ptr_array_unref (f->started);
+}
+
+static void
+run_pending (void)
+{
+  while (g_main_context_pending (NULL))
+    g_main_context_iteration (NULL, FALSE);
+}
+
+typedef struct {
+    Fixture *f;
+    const gchar *name;
+} Attempt;
+
+static gboolean
+attempt_cb (gpointer user_data)
+{
+  Attempt *attempt = user_data;
+
+  g_ptr_array_add (attempt->f->started, (gpointer) attempt->name);
+
+  /* like an account that is still Connecting, but waiting for the network
+   * rather than for the connection manager */
+  if (attempt->f->offline)
+    _mcd_reconnect_scheduler_finished (attempt->f->scheduler, attempt);
+
+  return !attempt->f->decline;
+}
+
+static void
+add (Fixture *f,
+    Attempt *attempt,
+    const gchar *group,
+    guint delay_ms,
+    gboolean recently_online)
+{
+  attempt->f = f;
+  _mcd_reconnect_scheduler_add (f->scheduler, attempt, group, delay_ms,
+      recently_online, attempt_cb, attempt);
+}
+
+static void
+assert_started (Fixture *f,
+    const gchar * const *expected)
+{
+  guint i;
+
+  for (i = 0; i < f->started->len && expected[i] != NULL; i++)
+    g_assert_cmpstr (g_ptr_array_index (f->started, i), ==, expected[i]);
+
+  g_assert_cmpuint (i, ==, f->started->len);
+  g_assert (expected[i] == NULL);
+}
+
+static void
+test_limit (Fixture *f,
+    gconstpointer unused G_GNUC_UNUSED)
+{
+  Attempt a = { NULL, "a" }, b = { NULL, "b" }, c = { NULL, "c" };
+  const gchar * const two[] = { "a", "b", NULL };
+  const gchar * const three[] = { "a", "b", "c", NULL };
+
+  add (f, &a, "cm/proto", 0, FALSE);
+  add (f, &b, "cm/proto", 0, FALSE);
+  add (f, &c, "cm/proto", 0, FALSE);
+
+  /* nothing happens synchronously */
+  g_assert_cmpuint (f->started->len, ==, 0);
+  g_assert_cmpuint (_mcd_reconnect_scheduler_get_n_waiting (f->scheduler),
+      ==, 3);
+
+  run_pending ();
+  assert_started (f, two);
+  g_assert_cmpuint (_mcd_reconnect_scheduler_get_n_running (f->scheduler),
+      ==, 2);
+  g_assert_cmpuint (_mcd_reconnect_scheduler_get_n_waiting (f->scheduler),
+      ==, 1);
+
+  /* finishing something that isn't running is harmless */
+  _mcd_reconnect_scheduler_finished (f->scheduler, &c);
+  run_pending ();
+  assert_started (f, two);
+
+  _mcd_reconnect_scheduler_finished (f->scheduler, &a);
+  run_pending ();
+  assert_started (f, three);
+  g_assert_cmpuint (_mcd_reconnect_scheduler_get_n_running (f->scheduler),
+      ==, 2);
+  g_assert_cmpuint (_mcd_reconnect_scheduler_get_n_waiting (f->scheduler),
+      ==, 0);
+}
+
+static void
+test_priority (Fixture *f,
+    gconstpointer unused G_GNUC_UNUSED)
+{
+  Attempt a = { NULL, "a" }, b = { NULL, "b" };
+  const gchar * const expected[] = { "b", NULL };
+
+  add (f, &a, "cm/proto", 0, FALSE);
+  add (f, &b, "cm/proto", 0, TRUE);
+  run_pending ();
+  assert_started (f, expected);
+}
+
+static void
+test_fairness (Fixture *f,
+    gconstpointer unused G_GNUC_UNUSED)
+{
+  Attempt x1 = { NULL, "x1" }, x2 = { NULL, "x2" }, y1 = { NULL, "y1" };
+  const gchar * const expected[] = { "x1", "y1", NULL };
+
+  /* x2 was added before y1, but x1 is already using the same server */
+  add (f, &x1, "x/proto", 0, FALSE);
+  add (f, &x2, "x/proto", 0, FALSE);
+  add (f, &y1, "y/proto", 0, FALSE);
+  run_pending ();
+  assert_started (f, expected);
+}
+
+static void
+test_cancel (Fixture *f,
+    gconstpointer unused G_GNUC_UNUSED)
+{
+  Attempt a = { NULL, "a" }, b = { NULL, "b" };
+  const gchar * const expected[] = { "b", NULL };
+
+  add (f, &a, "cm/proto", 0, FALSE);
+  add (f, &b, "cm/proto", 0, FALSE);
+  _mcd_reconnect_scheduler_cancel (f->scheduler, &a);
+  run_pending ();
+  assert_started (f, expected);
+}
+
+static void
+test_decline (Fixture *f,
+    gconstpointer unused G_GNUC_UNUSED)
+{
+  Attempt a = { NULL, "a" }, b = { NULL, "b" }, c = { NULL, "c" };
+  const gchar * const expected[] = { "a", "b", "c", NULL };
+
+  /* attempts that don't start anything don't use up the slots */
+  f->decline = TRUE;
+  add (f, &a, "cm/proto", 0, FALSE);
+  add (f, &b, "cm/proto", 0, FALSE);
+  add (f, &c, "cm/proto", 0, FALSE);
+  run_pending ();
+  assert_started (f, expected);
+  g_assert_cmpuint (_mcd_reconnect_scheduler_get_n_running (f->scheduler),
+      ==, 0);
+}
+
+static void
+test_delay (Fixture *f,
+    gconstpointer unused G_GNUC_UNUSED)
+{
+  Attempt a = { NULL, "a" };
+  const gchar * const none[] = { NULL };
+  const gchar * const expected[] = { "a", NULL };
+
+  add (f, &a, "cm/proto", 100, FALSE);
+  run_pending ();
+  assert_started (f, none);
+
+  /* adding it again doesn't postpone it */
+  add (f, &a, "cm/proto", 1000, FALSE);
+
+  /* at most 100ms, plus up to a quarter of that as jitter */
+  g_usleep (150 * 1000);
+  run_pending ();
+  assert_started (f, expected);
+}
+
+static void
+test_offline (Fixture *f,
+    gconstpointer unused G_GNUC_UNUSED)
+{
+  const gchar * const names[] = { "a", "b", "c", "d", "e", "f", "g", "h",
+      "i", "j", "k", "l" };
+  Attempt attempts[G_N_ELEMENTS (names)];
+  guint i;
+
+  /* More accounts than there are slots. Connectivity comes back, but has
+   * gone again by the time each account gets its turn: none of them can
+   * keep a slot while it waits, or the rest would wait for the attempts
+   * to time out */
+  f->offline = TRUE;
+
+  for (i = 0; i < G_N_ELEMENTS (names); i++)
+    {
+      attempts[i].name = names[i];
+      add (f, &attempts[i], "cm/proto", 0, FALSE);
+    }
+
+  run_pending ();
+  g_assert_cmpuint (f->started->len, ==, G_N_ELEMENTS (names));
+  g_assert_cmpuint (_mcd_reconnect_scheduler_get_n_running (f->scheduler),
+      ==, 0);
+  g_assert_cmpuint (_mcd_reconnect_scheduler_get_n_waiting (f->scheduler),
+      ==, 0);
+
+  /* when it comes back for real, they get their slots as usual */
+  f->offline = FALSE;
+
+  for (i = 0; i < G_N_ELEMENTS (names); i++)
+    add (f, &attempts[i], "cm/proto", 0, FALSE);
+
+  run_pending ();
+  g_assert_cmpuint (f->started->len, ==, G_N_ELEMENTS (names) + 8);
+  g_assert_cmpuint (_mcd_reconnect_scheduler_get_n_running (f->scheduler),
+      ==, 8);
+  g_assert_cmpuint (_mcd_reconnect_scheduler_get_n_waiting (f->scheduler),
+      ==, G_N_ELEMENTS (names) - 8);
+}
+
+int
+main (int argc,
+      char **argv)
+{
+  g_test_init (&argc, &argv, NULL);
+
+  g_test_add ("/reconnect-scheduler/limit", Fixture, GUINT_TO_POINTER (2),
+      setup, test_limit, teardown);
+  g_test_add ("/reconnect-scheduler/priority", Fixture, GUINT_TO_POINTER (1),
+      setup, test_priority, teardown);
+  g_test_add ("/reconnect-scheduler/fairness", Fixture, GUINT_TO_POINTER (2),
+      setup, test_fairness, teardown);
+  g_test_add ("/reconnect-scheduler/cancel", Fixture, GUINT_TO_POINTER (1),
+      setup, test_cancel, teardown);
+  g_test_add ("/reconnect-scheduler/decline", Fixture, GUINT_TO_POINTER (1),
+      setup, test_decline, teardown);
+  g_test_add ("/reconnect-scheduler/delay", Fixture, GUINT_TO_POINTER (1),
+      setup, test_delay, teardown);
+  /* the default for MC_RECONNECT_MAX_ATTEMPTS */
+  g_test_add ("/reconnect-scheduler/offline", Fixture, GUINT_TO_POINTER (8),
+      setup, test_offline, teardown);
+
+  return g_test_run ();
+}
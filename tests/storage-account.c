@@ -0,0 +1,355 @@
+/*
+ * Regression test for McdStorage's in-memory copy of each account
+ *
+ * Copyright © 2012 Collabora Ltd.
+ *
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License as published by the Free Software Foundation; either
+ * version 2.1 of the License, or (at your option) any later version.
+ *
+ * This library is distributed in the hope that it will be useful, but
+ * WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the GNU
+ * Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with this library; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin St, Fifth Floor, Boston, MA
+ * 02110-1301 USA
+ *
+ */
+
+#include "config.h"
+
+#include <telepathy-glib/telepathy-glib.h>
+
+#include "mcd-storage.h"
+
+#define ACCOUNT "gabble/jabber/fred_40example_2ecom0"
+#define OTHER "gabble/jabber/wilma_40example_2ecom0"
+
+typedef struct {
+    /* no plugins are loaded, so this is purely an in-memory cache */
+    McdStorage *storage;
+    McpAccountManager *ma;
+} Fixture;
+
+static void
+setup (Fixture *f,
+    gconstpointer unused G_GNUC_UNUSED)
+{
+  f->storage = mcd_storage_new (NULL);
+  f->ma = MCP_ACCOUNT_MANAGER (f->storage);
+}
+
+static void
+teardown (Fixture *f,
+    gconstpointer unused G_GNUC_UNUSED)
+{
+  g_object_unref (f->storage);
+}
+
+static void
+set_string_attribute (Fixture *f,
+    const gchar *account,
+    const gchar *attribute,
+    const gchar *s)
+{
+  GValue value = G_VALUE_INIT;
+
+  g_value_init (&value, G_TYPE_STRING);
+  g_value_set_string (&value, s);
+  mcd_storage_set_attribute (f->storage, account, attribute, &value);
+  g_value_unset (&value);
+}
+
+static void
+test_attributes (Fixture *f,
+    gconstpointer unused G_GNUC_UNUSED)
+{
+  GValue value = G_VALUE_INIT;
+  GError *error = NULL;
+  GStrv attributes;
+  gchar *s;
+  gsize n;
+
+  set_string_attribute (f, ACCOUNT, "manager", "gabble");
+  set_string_attribute (f, ACCOUNT, "DisplayName", "Fred");
+  set_string_attribute (f, OTHER, "DisplayName", "Wilma");
+  set_string_attribute (f, ACCOUNT, "DisplayName", "Frederick");
+
+  g_value_init (&value, G_TYPE_BOOLEAN);
+  g_value_set_boolean (&value, TRUE);
+  g_assert (mcd_storage_set_attribute (f->storage, ACCOUNT, "Enabled",
+        &value));
+  /* setting it to the same value again is not a change */
+  g_assert (!mcd_storage_set_attribute (f->storage, ACCOUNT, "Enabled",
+        &value));
+  g_value_unset (&value);
+
+  g_assert (mcd_storage_get_boolean (f->storage, ACCOUNT, "Enabled"));
+
+  attributes = mcd_storage_dup_attributes (f->storage, ACCOUNT, &n);
+  g_assert_cmpuint (g_strv_length (attributes), ==, 3);
+  g_strfreev (attributes);
+
+  g_value_init (&value, G_TYPE_STRING);
+  mcd_storage_get_attribute (f->storage, ACCOUNT, "DisplayName", &value,
+      &error);
+  g_assert_no_error (error);
+  g_assert_cmpstr (g_value_get_string (&value), ==, "Frederick");
+  g_value_unset (&value);
+
+  /* an attribute name nobody has ever used */
+  g_value_init (&value, G_TYPE_STRING);
+  g_assert (!mcd_storage_get_attribute (f->storage, ACCOUNT,
+        "condition-never-seen-before", &value, &error));
+  g_assert_error (error, TP_ERROR, TP_ERROR_NOT_AVAILABLE);
+  g_clear_error (&error);
+  g_value_unset (&value);
+
+  /* removal */
+  g_assert (mcd_storage_set_attribute (f->storage, ACCOUNT, "DisplayName",
+        NULL));
+  s = mcd_storage_dup_string (f->storage, ACCOUNT, "DisplayName");
+  g_assert_cmpstr (s, ==, NULL);
+
+  attributes = mcd_storage_dup_attributes (f->storage, ACCOUNT, &n);
+  g_assert_cmpuint (g_strv_length (attributes), ==, 2);
+  g_strfreev (attributes);
+
+  /* the other account is unaffected */
+  s = mcd_storage_dup_string (f->storage, OTHER, "DisplayName");
+  g_assert_cmpstr (s, ==, "Wilma");
+  g_free (s);
+}
+
+static void
+test_parameters (Fixture *f,
+    gconstpointer unused G_GNUC_UNUSED)
+{
+  GValue value = G_VALUE_INIT;
+  GError *error = NULL;
+  gchar *escaped;
+
+  g_value_init (&value, G_TYPE_STRING);
+  g_value_set_string (&value, "fred@example.com");
+  g_assert (mcd_storage_set_parameter (f->storage, ACCOUNT, "account",
+        &value, FALSE));
+  g_value_set_string (&value, "hunter2");
+  g_assert (mcd_storage_set_parameter (f->storage, ACCOUNT, "password",
+        &value, TRUE));
+  g_value_unset (&value);
+
+  g_assert (!mcp_account_manager_parameter_is_secret (f->ma, ACCOUNT,
+        "param-account"));
+  g_assert (mcp_account_manager_parameter_is_secret (f->ma, ACCOUNT,
+        "param-password"));
+  /* secrecy is per-account */
+  g_assert (!mcp_account_manager_parameter_is_secret (f->ma, OTHER,
+        "param-password"));
+
+  escaped = mcp_account_manager_get_value (f->ma, ACCOUNT, "param-password");
+  g_assert_cmpstr (escaped, ==, "hunter2");
+  g_free (escaped);
+
+  /* a plugin gives us a parameter whose type we don't know yet */
+  mcp_account_manager_set_value (f->ma, ACCOUNT, "param-port", "5222");
+
+  g_value_init (&value, G_TYPE_UINT);
+  mcd_storage_get_parameter (f->storage, ACCOUNT, "port", &value, &error);
+  g_assert_no_error (error);
+  g_assert_cmpuint (g_value_get_uint (&value), ==, 5222);
+  g_value_unset (&value);
+
+  /* the second time, it comes from the decoded copy */
+  g_value_init (&value, G_TYPE_UINT);
+  mcd_storage_get_parameter (f->storage, ACCOUNT, "port", &value, &error);
+  g_assert_no_error (error);
+  g_assert_cmpuint (g_value_get_uint (&value), ==, 5222);
+  g_value_unset (&value);
+
+  /* asking for a different type decodes it again */
+  g_value_init (&value, G_TYPE_STRING);
+  mcd_storage_get_parameter (f->storage, ACCOUNT, "port", &value, &error);
+  g_assert_no_error (error);
+  g_assert_cmpstr (g_value_get_string (&value), ==, "5222");
+  g_value_unset (&value);
+
+  /* changing the parameter invalidates the decoded copy */
+  g_value_init (&value, G_TYPE_UINT);
+  g_value_set_uint (&value, 5223);
+  g_assert (mcd_storage_set_parameter (f->storage, ACCOUNT, "port",
+        &value, FALSE));
+  g_value_set_uint (&value, 0);
+  mcd_storage_get_parameter (f->storage, ACCOUNT, "port", &value, &error);
+  g_assert_no_error (error);
+  g_assert_cmpuint (g_value_get_uint (&value), ==, 5223);
+  g_value_unset (&value);
+
+  /* ... and so does a plugin changing it */
+  mcp_account_manager_set_value (f->ma, ACCOUNT, "param-port", "5224");
+  g_value_init (&value, G_TYPE_UINT);
+  mcd_storage_get_parameter (f->storage, ACCOUNT, "port", &value, &error);
+  g_assert_no_error (error);
+  g_assert_cmpuint (g_value_get_uint (&value), ==, 5224);
+  g_value_unset (&value);
+
+  /* removal */
+  mcp_account_manager_set_value (f->ma, ACCOUNT, "param-port", NULL);
+  g_value_init (&value, G_TYPE_UINT);
+  g_assert (!mcd_storage_get_parameter (f->storage, ACCOUNT, "port", &value,
+        &error));
+  g_assert_error (error, TP_ERROR, TP_ERROR_NOT_AVAILABLE);
+  g_clear_error (&error);
+  g_value_unset (&value);
+}
+
+static void
+test_parameter_types (Fixture *f,
+    gconstpointer unused G_GNUC_UNUSED)
+{
+  GHashTable *params;
+  gchar **untyped;
+  GValue *v;
+
+  /* a plugin that only stores strings gives us the types too, in either
+   * order */
+  mcp_account_manager_set_value (f->ma, ACCOUNT, "paramtype-port", "u");
+  mcp_account_manager_set_value (f->ma, ACCOUNT, "param-port", "5222");
+  mcp_account_manager_set_value (f->ma, ACCOUNT, "param-priority", "-3");
+  mcp_account_manager_set_value (f->ma, ACCOUNT, "paramtype-priority", "i");
+  /* ... except for parameters stored before we did that */
+  mcp_account_manager_set_value (f->ma, ACCOUNT, "param-account",
+      "fred@example.com");
+  mcp_account_manager_set_value (f->ma, ACCOUNT, "param-require-encryption",
+      "maybe");
+
+  params = mcd_storage_dup_typed_parameters (f->storage, ACCOUNT, &untyped);
+  g_assert_cmpuint (g_hash_table_size (params), ==, 2);
+  v = g_hash_table_lookup (params, "port");
+  g_assert (G_VALUE_HOLDS_UINT (v));
+  g_assert_cmpuint (g_value_get_uint (v), ==, 5222);
+  v = g_hash_table_lookup (params, "priority");
+  g_assert (G_VALUE_HOLDS_INT (v));
+  g_assert_cmpint (g_value_get_int (v), ==, -3);
+  g_assert_cmpuint (g_strv_length (untyped), ==, 2);
+  g_hash_table_unref (params);
+  g_strfreev (untyped);
+
+  /* once the CM has told us, we remember */
+  g_assert (mcd_storage_set_parameter_type (f->storage, ACCOUNT, "account",
+        "s"));
+  g_assert (!mcd_storage_set_parameter_type (f->storage, ACCOUNT, "account",
+        "s"));
+  /* unless it was wrong */
+  g_assert (!mcd_storage_set_parameter_type (f->storage, ACCOUNT,
+        "require-encryption", "b"));
+
+  params = mcd_storage_dup_typed_parameters (f->storage, ACCOUNT, &untyped);
+  g_assert_cmpuint (g_hash_table_size (params), ==, 3);
+  v = g_hash_table_lookup (params, "account");
+  g_assert (G_VALUE_HOLDS_STRING (v));
+  g_assert_cmpstr (g_value_get_string (v), ==, "fred@example.com");
+  g_assert_cmpuint (g_strv_length (untyped), ==, 1);
+  g_assert_cmpstr (untyped[0], ==, "require-encryption");
+  g_hash_table_unref (params);
+  g_strfreev (untyped);
+
+  /* the plugin changing a parameter doesn't lose its type */
+  mcp_account_manager_set_value (f->ma, ACCOUNT, "param-port", "5223");
+  params = mcd_storage_dup_typed_parameters (f->storage, ACCOUNT, &untyped);
+  v = g_hash_table_lookup (params, "port");
+  g_assert (G_VALUE_HOLDS_UINT (v));
+  g_assert_cmpuint (g_value_get_uint (v), ==, 5223);
+  g_hash_table_unref (params);
+  g_strfreev (untyped);
+}
+
+static void
+test_transaction (Fixture *f,
+    gconstpointer unused G_GNUC_UNUSED)
+{
+  McdStorageTransaction *transaction;
+  GValue value = G_VALUE_INIT;
+  GError *error = NULL;
+  gchar *s;
+
+  set_string_attribute (f, ACCOUNT, "condition-location", "home");
+  set_string_attribute (f, ACCOUNT, "condition-time", "evening");
+
+  transaction = mcd_storage_transaction_new (f->storage, ACCOUNT);
+  mcd_storage_transaction_set_string (transaction, "condition-location",
+      NULL);
+  mcd_storage_transaction_set_string (transaction, "condition-time", NULL);
+  mcd_storage_transaction_set_string (transaction, "DisplayName", "Fred");
+
+  /* nothing happens until the transaction is applied */
+  s = mcd_storage_dup_string (f->storage, ACCOUNT, "DisplayName");
+  g_assert_cmpstr (s, ==, NULL);
+
+  /* the last change to a key wins */
+  mcd_storage_transaction_set_string (transaction, "condition-location",
+      "home");
+  mcd_storage_transaction_set_string (transaction, "DisplayName",
+      "Frederick");
+
+  g_value_init (&value, G_TYPE_UINT);
+  g_value_set_uint (&value, 5222);
+  mcd_storage_transaction_set_parameter (transaction, "port", &value, FALSE);
+  g_value_unset (&value);
+
+  g_assert (mcd_storage_transaction_apply (transaction));
+
+  s = mcd_storage_dup_string (f->storage, ACCOUNT, "condition-location");
+  g_assert_cmpstr (s, ==, "home");
+  g_free (s);
+  s = mcd_storage_dup_string (f->storage, ACCOUNT, "condition-time");
+  g_assert_cmpstr (s, ==, NULL);
+  s = mcd_storage_dup_string (f->storage, ACCOUNT, "DisplayName");
+  g_assert_cmpstr (s, ==, "Frederick");
+  g_free (s);
+
+  g_value_init (&value, G_TYPE_UINT);
+  mcd_storage_get_parameter (f->storage, ACCOUNT, "port", &value, &error);
+  g_assert_no_error (error);
+  g_assert_cmpuint (g_value_get_uint (&value), ==, 5222);
+  g_value_unset (&value);
+
+  /* removing a condition and putting it back is not a change */
+  transaction = mcd_storage_transaction_new (f->storage, ACCOUNT);
+  mcd_storage_transaction_set_string (transaction, "condition-location",
+      NULL);
+  mcd_storage_transaction_set_string (transaction, "condition-location",
+      "home");
+  g_assert (!mcd_storage_transaction_apply (transaction));
+
+  /* a discarded transaction changes nothing */
+  transaction = mcd_storage_transaction_new (f->storage, ACCOUNT);
+  mcd_storage_transaction_set_string (transaction, "DisplayName", "Wilma");
+  mcd_storage_transaction_free (transaction);
+
+  s = mcd_storage_dup_string (f->storage, ACCOUNT, "DisplayName");
+  g_assert_cmpstr (s, ==, "Frederick");
+  g_free (s);
+}
+
+int
+main (int argc,
+      char **argv)
+{
+  g_test_init (&argc, &argv, NULL);
+  g_test_bug_base ("http://bugs.freedesktop.org/show_bug.cgi?id=");
+
+  g_test_add ("/storage-account/attributes", Fixture, NULL, setup,
+      test_attributes, teardown);
+  g_test_add ("/storage-account/parameters", Fixture, NULL, setup,
+      test_parameters, teardown);
+  g_test_add ("/storage-account/parameter-types", Fixture, NULL, setup,
+      test_parameter_types, teardown);
+  g_test_add ("/storage-account/transaction", Fixture, NULL, setup,
+      test_transaction, teardown);
+
+  return g_test_run ();
+}
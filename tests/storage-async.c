@@ -0,0 +1,485 @@
+/*
+ * Regression test for listing and committing accounts without blocking
+ *
+ * Copyright © 2012 Collabora Ltd.
+ *
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License as published by the Free Software Foundation; either
+ * version 2.1 of the License, or (at your option) any later version.
+ *
+ * This library is distributed in the hope that it will be useful, but
+ * WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the GNU
+ * Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with this library; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin St, Fifth Floor, Boston, MA
+ * 02110-1301 USA
+ *
+ */
+
+#include "config.h"
+
+#include <string.h>
+
+#include <glib/gstdio.h>
+#include <telepathy-glib/telepathy-glib.h>
+
+#include "mission-control-plugins/implementation.h"
+
+#include "mcd-account-manager-default.h"
+#include "mcd-storage.h"
+
+#define PREFIX "async/"
+#define LISTED PREFIX "jabber/listed"
+#define DEFAULT_ACCOUNT "gabble/jabber/fred_40example_2ecom0"
+
+/* how long the plugin below takes to commit */
+#define COMMIT_LATENCY 50
+
+/* A plugin that stores the accounts whose names start with PREFIX, and
+ * only ever lists and commits them in the background */
+
+typedef struct {
+    GObject parent;
+    guint list_calls;
+    guint list_async_calls;
+    guint commit_calls;
+    guint commit_async_calls;
+    guint commits_finished;
+} AsyncPlugin;
+
+typedef struct {
+    GObjectClass parent;
+} AsyncPluginClass;
+
+static void async_plugin_iface_init (McpAccountStorageIface *iface,
+    gpointer unused G_GNUC_UNUSED);
+
+static GType async_plugin_get_type (void);
+
+G_DEFINE_TYPE_WITH_CODE (AsyncPlugin, async_plugin,
+    G_TYPE_OBJECT,
+    G_IMPLEMENT_INTERFACE (MCP_TYPE_ACCOUNT_STORAGE,
+      async_plugin_iface_init))
+
+#define ASYNC_PLUGIN(o) \
+  (G_TYPE_CHECK_INSTANCE_CAST ((o), async_plugin_get_type (), \
+                               AsyncPlugin))
+
+static void
+async_plugin_init (AsyncPlugin *self)
+{
+}
+
+static void
+async_plugin_class_init (AsyncPluginClass *cls)
+{
+}
+
+static gboolean
+async_plugin_get (const McpAccountStorage *storage,
+    const McpAccountManager *am,
+    const gchar *account,
+    const gchar *key)
+{
+  if (!g_str_has_prefix (account, PREFIX))
+    return FALSE;
+
+  if (key == NULL || !tp_strdiff (key, "manager"))
+    mcp_account_manager_set_value (am, account, "manager", "gabble");
+
+  return TRUE;
+}
+
+static gboolean
+async_plugin_set (const McpAccountStorage *storage,
+    const McpAccountManager *am,
+    const gchar *account,
+    const gchar *key,
+    const gchar *val)
+{
+  return g_str_has_prefix (account, PREFIX);
+}
+
+static gboolean
+async_plugin_delete (const McpAccountStorage *storage,
+    const McpAccountManager *am,
+    const gchar *account,
+    const gchar *key)
+{
+  return TRUE;
+}
+
+static gboolean
+async_plugin_commit (const McpAccountStorage *storage,
+    const McpAccountManager *am)
+{
+  ASYNC_PLUGIN (storage)->commit_calls++;
+  return TRUE;
+}
+
+static gboolean
+async_plugin_commit_one (const McpAccountStorage *storage,
+    const McpAccountManager *am,
+    const gchar *account)
+{
+  ASYNC_PLUGIN (storage)->commit_calls++;
+  return TRUE;
+}
+
+static GList *
+async_plugin_list (const McpAccountStorage *storage,
+    const McpAccountManager *am)
+{
+  ASYNC_PLUGIN (storage)->list_calls++;
+  return g_list_prepend (NULL, g_strdup (LISTED));
+}
+
+static void
+free_account_list (gpointer p)
+{
+  g_list_free_full (p, g_free);
+}
+
+static gboolean
+async_plugin_listed_cb (gpointer user_data)
+{
+  GTask *task = user_data;
+
+  g_task_return_pointer (task, g_list_prepend (NULL, g_strdup (LISTED)),
+      free_account_list);
+  return FALSE;
+}
+
+static void
+async_plugin_list_async (McpAccountStorage *storage,
+    McpAccountManager *am,
+    GCancellable *cancellable,
+    GAsyncReadyCallback callback,
+    gpointer user_data)
+{
+  GTask *task = g_task_new (storage, cancellable, callback, user_data);
+  GSource *source = g_idle_source_new ();
+
+  ASYNC_PLUGIN (storage)->list_async_calls++;
+  /* only answers if the caller iterates the main context it was called
+   * from */
+  g_task_attach_source (task, source, async_plugin_listed_cb);
+  g_source_unref (source);
+  g_object_unref (task);
+}
+
+static GList *
+async_plugin_list_finish (McpAccountStorage *storage,
+    GAsyncResult *result,
+    GError **error)
+{
+  return g_task_propagate_pointer (G_TASK (result), error);
+}
+
+static gboolean
+async_plugin_committed_cb (gpointer user_data)
+{
+  GTask *task = user_data;
+
+  ASYNC_PLUGIN (g_task_get_source_object (task))->commits_finished++;
+  g_task_return_boolean (task, TRUE);
+  return FALSE;
+}
+
+static void
+async_plugin_commit_async (McpAccountStorage *storage,
+    McpAccountManager *am,
+    const gchar *account,
+    GCancellable *cancellable,
+    GAsyncReadyCallback callback,
+    gpointer user_data)
+{
+  GTask *task = g_task_new (storage, cancellable, callback, user_data);
+  GSource *source = g_timeout_source_new (COMMIT_LATENCY);
+
+  ASYNC_PLUGIN (storage)->commit_async_calls++;
+  g_task_attach_source (task, source, async_plugin_committed_cb);
+  g_source_unref (source);
+  g_object_unref (task);
+}
+
+static gboolean
+async_plugin_commit_finish (McpAccountStorage *storage,
+    GAsyncResult *result,
+    GError **error)
+{
+  return g_task_propagate_boolean (G_TASK (result), error);
+}
+
+static void
+async_plugin_iface_init (McpAccountStorageIface *iface,
+    gpointer unused G_GNUC_UNUSED)
+{
+  iface->name = "async";
+  iface->desc = "Regression test plugin";
+  iface->priority = MCP_ACCOUNT_STORAGE_PLUGIN_PRIO_NORMAL;
+
+  iface->get = async_plugin_get;
+  iface->set = async_plugin_set;
+  iface->delete = async_plugin_delete;
+  iface->commit = async_plugin_commit;
+  iface->commit_one = async_plugin_commit_one;
+  iface->list = async_plugin_list;
+  iface->list_async = async_plugin_list_async;
+  iface->list_finish = async_plugin_list_finish;
+  iface->commit_async = async_plugin_commit_async;
+  iface->commit_finish = async_plugin_commit_finish;
+}
+
+static AsyncPlugin *plugin = NULL;
+static gchar *data_dir = NULL;
+
+typedef struct {
+    McdStorage *storage;
+    /* for the default backend */
+    McpAccountStorage *keyfile;
+    GList *listed;
+    guint finished;
+} Fixture;
+
+static void
+setup (Fixture *f,
+    gconstpointer unused G_GNUC_UNUSED)
+{
+  plugin->list_calls = 0;
+  plugin->list_async_calls = 0;
+  plugin->commit_calls = 0;
+  plugin->commit_async_calls = 0;
+  plugin->commits_finished = 0;
+
+  f->storage = mcd_storage_new (NULL);
+  mcd_storage_load (f->storage);
+}
+
+static void
+teardown (Fixture *f,
+    gconstpointer unused G_GNUC_UNUSED)
+{
+  g_list_free_full (f->listed, g_free);
+  g_clear_object (&f->keyfile);
+  g_object_unref (f->storage);
+}
+
+static void
+test_list_async (Fixture *f,
+    gconstpointer unused G_GNUC_UNUSED)
+{
+  /* loading waited for the plugin to list its accounts in the
+   * background, and didn't ask it to block */
+  g_assert_cmpuint (plugin->list_async_calls, ==, 1);
+  g_assert_cmpuint (plugin->list_calls, ==, 0);
+  g_assert (mcd_storage_get_plugin (f->storage, LISTED) ==
+      MCP_ACCOUNT_STORAGE (plugin));
+}
+
+static void
+test_flush_sync (Fixture *f,
+    gconstpointer unused G_GNUC_UNUSED)
+{
+  GValue value = G_VALUE_INIT;
+
+  g_value_init (&value, G_TYPE_STRING);
+  g_value_set_static_string (&value, "Fred");
+  g_assert (mcd_storage_set_attribute (f->storage, LISTED, "DisplayName",
+        &value));
+  g_value_unset (&value);
+
+  /* a delayed commit happens in the background... */
+  mcd_storage_commit_later (f->storage, LISTED);
+
+  while (plugin->commit_async_calls == 0)
+    g_main_context_iteration (NULL, TRUE);
+
+  g_assert_cmpuint (plugin->commits_finished, ==, 0);
+  g_assert_cmpuint (f->storage->pending_commits, ==, 1);
+
+  /* ... but flushing before we exit doesn't run the main loop to wait
+   * for it: it commits synchronously, which the plugin has to finish
+   * behind the commit in progress */
+  mcd_storage_flush (f->storage);
+  g_assert_cmpuint (plugin->commit_calls, ==, 1);
+  g_assert_cmpuint (plugin->commits_finished, ==, 0);
+
+  while (f->storage->pending_commits > 0)
+    g_main_context_iteration (NULL, TRUE);
+
+  g_assert_cmpuint (plugin->commits_finished, ==, 1);
+}
+
+static void
+default_listed_cb (GObject *source,
+    GAsyncResult *result,
+    gpointer user_data)
+{
+  Fixture *f = user_data;
+  GError *error = NULL;
+
+  f->listed = mcp_account_storage_list_finish (MCP_ACCOUNT_STORAGE (source),
+      result, &error);
+  g_assert_no_error (error);
+  f->finished++;
+}
+
+static void
+default_committed_cb (GObject *source,
+    GAsyncResult *result,
+    gpointer user_data)
+{
+  Fixture *f = user_data;
+  GError *error = NULL;
+
+  g_assert (mcp_account_storage_commit_finish (MCP_ACCOUNT_STORAGE (source),
+        result, &error));
+  g_assert_no_error (error);
+  f->finished++;
+}
+
+static void
+wait_for (Fixture *f,
+    guint finished)
+{
+  while (f->finished < finished)
+    g_main_context_iteration (NULL, TRUE);
+}
+
+static void
+test_default (Fixture *f,
+    gconstpointer unused G_GNUC_UNUSED)
+{
+  McpAccountManager *ma = MCP_ACCOUNT_MANAGER (f->storage);
+  gchar *filename = g_build_filename (data_dir, "telepathy",
+      "mission-control", "accounts.cfg", NULL);
+  gchar *journal = g_strconcat (filename, ".journal", NULL);
+  GKeyFile *keyfile = g_key_file_new ();
+  GError *error = NULL;
+  gchar *contents;
+
+  f->keyfile = MCP_ACCOUNT_STORAGE (mcd_account_manager_default_new ());
+
+  mcp_account_storage_list_async (f->keyfile, ma, NULL, default_listed_cb, f);
+  wait_for (f, 1);
+  g_assert (f->listed == NULL);
+  g_assert (g_file_test (filename, G_FILE_TEST_EXISTS));
+
+  /* committing one account appends what it had been given so far to the
+   * journal */
+  mcp_account_storage_set (f->keyfile, ma, DEFAULT_ACCOUNT, "manager",
+      "gabble");
+  mcp_account_storage_commit_async (f->keyfile, ma, DEFAULT_ACCOUNT, NULL,
+      default_committed_cb, f);
+  mcp_account_storage_set (f->keyfile, ma, DEFAULT_ACCOUNT, "protocol",
+      "jabber");
+  wait_for (f, 2);
+
+  g_file_get_contents (journal, &contents, NULL, &error);
+  g_assert_no_error (error);
+  g_assert (strstr (contents, "manager") != NULL);
+  g_assert (strstr (contents, "protocol") == NULL);
+  g_free (contents);
+
+  /* committing everything rewrites the file, after which the journal
+   * isn't needed */
+  mcp_account_storage_commit_async (f->keyfile, ma, NULL, NULL,
+      default_committed_cb, f);
+  wait_for (f, 3);
+
+  g_assert (!g_file_test (journal, G_FILE_TEST_EXISTS));
+  g_key_file_load_from_file (keyfile, filename, 0, &error);
+  g_assert_no_error (error);
+  g_assert (g_key_file_has_key (keyfile, DEFAULT_ACCOUNT, "manager", NULL));
+  g_assert (g_key_file_has_key (keyfile, DEFAULT_ACCOUNT, "protocol", NULL));
+
+  /* a synchronous commit while an asynchronous one is still queued waits
+   * for the writer, without needing the main loop */
+  mcp_account_storage_set (f->keyfile, ma, DEFAULT_ACCOUNT, "Nickname",
+      "fred");
+  mcp_account_storage_commit_async (f->keyfile, ma, DEFAULT_ACCOUNT, NULL,
+      default_committed_cb, f);
+  g_assert (mcp_account_storage_commit_one (f->keyfile, ma,
+        DEFAULT_ACCOUNT));
+
+  g_file_get_contents (journal, &contents, NULL, &error);
+  g_assert_no_error (error);
+  g_assert (strstr (contents, "Nickname") != NULL);
+  g_free (contents);
+
+  wait_for (f, 4);
+
+  g_key_file_free (keyfile);
+  g_free (journal);
+  g_free (filename);
+}
+
+static void
+rm_r (const gchar *path)
+{
+  GDir *dir = g_dir_open (path, 0, NULL);
+  const gchar *entry;
+
+  if (dir != NULL)
+    {
+      while ((entry = g_dir_read_name (dir)) != NULL)
+        {
+          gchar *child = g_build_filename (path, entry, NULL);
+
+          rm_r (child);
+          g_free (child);
+        }
+
+      g_dir_close (dir);
+      g_rmdir (path);
+    }
+  else
+    {
+      g_unlink (path);
+    }
+}
+
+int
+main (int argc,
+      char **argv)
+{
+  GError *error = NULL;
+  gchar *dir;
+  int ret;
+
+  g_test_init (&argc, &argv, NULL);
+  g_test_bug_base ("http://bugs.freedesktop.org/show_bug.cgi?id=");
+
+  /* keep the built-in keyfile backend away from the user's accounts, and
+   * don't load any real plugins */
+  dir = g_dir_make_tmp ("mc-async-XXXXXX", &error);
+  g_assert_no_error (error);
+  data_dir = g_build_filename (dir, "data", NULL);
+  g_setenv ("XDG_DATA_HOME", data_dir, TRUE);
+  g_setenv ("XDG_DATA_DIRS", dir, TRUE);
+  g_setenv ("MC_ACCOUNT_DIR", dir, TRUE);
+  g_setenv ("XDG_CACHE_HOME", dir, TRUE);
+  g_setenv ("MC_FILTER_PLUGIN_DIR", dir, TRUE);
+
+  plugin = g_object_new (async_plugin_get_type (), NULL);
+  mcp_add_object (plugin);
+
+  g_test_add ("/storage-async/list-async", Fixture, NULL, setup,
+      test_list_async, teardown);
+  g_test_add ("/storage-async/flush-sync", Fixture, NULL, setup,
+      test_flush_sync, teardown);
+  g_test_add ("/storage-async/default", Fixture, NULL, setup,
+      test_default, teardown);
+
+  ret = g_test_run ();
+
+  rm_r (dir);
+  g_free (data_dir);
+  g_free (dir);
+  return ret;
+}
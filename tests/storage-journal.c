@@ -0,0 +1,269 @@
+/*
+ * Regression test for the account storage journal
+ *
+ * Copyright © 2012 Collabora Ltd.
+ *
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License as published by the Free Software Foundation; either
+ * version 2.1 of the License, or (at your option) any later version.
+ *
+ * This library is distributed in the hope that it will be useful, but
+ * WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the GNU
+ * Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with this library; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin St, Fifth Floor, Boston, MA
+ * 02110-1301 USA
+ *
+ */
+
+#include "config.h"
+
+#include <string.h>
+
+#include <glib/gstdio.h>
+
+#include "mcd-storage-journal.h"
+
+#define ACCOUNT "gabble/jabber/fred_40example_2ecom0"
+#define OTHER "gabble/jabber/wilma_40example_2ecom0"
+
+typedef struct {
+    gchar *dir;
+    gchar *filename;
+    McdStorageJournal *journal;
+    GKeyFile *keyfile;
+} Fixture;
+
+static void
+setup (Fixture *f,
+    gconstpointer unused G_GNUC_UNUSED)
+{
+  GError *error = NULL;
+
+  f->dir = g_dir_make_tmp ("mc-journal-XXXXXX", &error);
+  g_assert_no_error (error);
+  f->filename = g_build_filename (f->dir, "accounts.cfg.journal", NULL);
+  f->journal = mcd_storage_journal_new (f->filename);
+  f->keyfile = g_key_file_new ();
+}
+
+static void
+teardown (Fixture *f,
+    gconstpointer unused G_GNUC_UNUSED)
+{
+  mcd_storage_journal_free (f->journal);
+  g_key_file_free (f->keyfile);
+  g_unlink (f->filename);
+  g_rmdir (f->dir);
+  g_free (f->filename);
+  g_free (f->dir);
+}
+
+static void
+replay_into_fresh_keyfile (Fixture *f,
+    guint expected)
+{
+  McdStorageJournal *journal = mcd_storage_journal_new (f->filename);
+
+  g_key_file_free (f->keyfile);
+  f->keyfile = g_key_file_new ();
+  g_assert_cmpuint (mcd_storage_journal_replay (journal, f->keyfile), ==,
+      expected);
+  mcd_storage_journal_free (journal);
+}
+
+static void
+test_replay (Fixture *f,
+    gconstpointer unused G_GNUC_UNUSED)
+{
+  GError *error = NULL;
+  gchar *value;
+
+  g_assert (mcd_storage_journal_append (f->journal, ACCOUNT, "manager",
+        "gabble"));
+  g_assert (mcd_storage_journal_append (f->journal, ACCOUNT, "DisplayName",
+        "Fred\\tBloggs"));
+  g_assert (mcd_storage_journal_append (f->journal, ACCOUNT, "Nickname",
+        "fred"));
+  g_assert (mcd_storage_journal_append (f->journal, OTHER, "manager",
+        "gabble"));
+  g_assert (mcd_storage_journal_has_pending (f->journal));
+  g_assert_cmpuint (mcd_storage_journal_get_size (f->journal), ==, 0);
+
+  /* nothing reaches the disk until we flush */
+  g_assert (!g_file_test (f->filename, G_FILE_TEST_EXISTS));
+  mcd_storage_journal_flush (f->journal, &error);
+  g_assert_no_error (error);
+  g_assert (!mcd_storage_journal_has_pending (f->journal));
+  g_assert_cmpuint (mcd_storage_journal_get_size (f->journal), >, 0);
+
+  g_assert (mcd_storage_journal_append (f->journal, ACCOUNT, "Nickname",
+        NULL));
+  g_assert (mcd_storage_journal_append (f->journal, OTHER, NULL, NULL));
+  mcd_storage_journal_flush (f->journal, &error);
+  g_assert_no_error (error);
+
+  replay_into_fresh_keyfile (f, 6);
+
+  value = g_key_file_get_value (f->keyfile, ACCOUNT, "DisplayName", NULL);
+  g_assert_cmpstr (value, ==, "Fred\\tBloggs");
+  g_free (value);
+  g_assert (!g_key_file_has_key (f->keyfile, ACCOUNT, "Nickname", NULL));
+  g_assert (!g_key_file_has_group (f->keyfile, OTHER));
+}
+
+static void
+test_torn_write (Fixture *f,
+    gconstpointer unused G_GNUC_UNUSED)
+{
+  const gchar *torn =
+    "S\t" ACCOUNT "\tmanager\tgabble\nC\nS\t" ACCOUNT "\tNick";
+  GError *error = NULL;
+
+  g_file_set_contents (f->filename, torn, -1, &error);
+  g_assert_no_error (error);
+
+  replay_into_fresh_keyfile (f, 1);
+  g_assert (g_key_file_has_key (f->keyfile, ACCOUNT, "manager", NULL));
+  g_assert (!g_key_file_has_key (f->keyfile, ACCOUNT, "Nickname", NULL));
+}
+
+static void
+test_append_after_torn_write (Fixture *f,
+    gconstpointer unused G_GNUC_UNUSED)
+{
+  const gchar *torn =
+    "S\t" ACCOUNT "\tmanager\tgabble\nC\nS\t" ACCOUNT "\tNick";
+  McdStorageJournal *journal;
+  GError *error = NULL;
+  gchar *value;
+
+  g_file_set_contents (f->filename, torn, -1, &error);
+  g_assert_no_error (error);
+
+  /* replaying cuts off the partial record... */
+  journal = mcd_storage_journal_new (f->filename);
+  g_assert_cmpuint (mcd_storage_journal_replay (journal, f->keyfile), ==, 1);
+  g_assert_cmpuint (mcd_storage_journal_get_size (journal), ==,
+      strlen ("S\t" ACCOUNT "\tmanager\tgabble\nC\n"));
+
+  /* ... so that it isn't run together with the next one */
+  g_assert (mcd_storage_journal_append (journal, OTHER, "protocol",
+        "jabber"));
+  mcd_storage_journal_flush (journal, &error);
+  g_assert_no_error (error);
+  mcd_storage_journal_free (journal);
+
+  replay_into_fresh_keyfile (f, 2);
+  g_assert (g_key_file_has_key (f->keyfile, ACCOUNT, "manager", NULL));
+  g_assert (!g_key_file_has_key (f->keyfile, ACCOUNT, "Nickname", NULL));
+  value = g_key_file_get_value (f->keyfile, OTHER, "protocol", NULL);
+  g_assert_cmpstr (value, ==, "jabber");
+  g_free (value);
+}
+
+static void
+test_abandoned_batch (Fixture *f,
+    gconstpointer unused G_GNUC_UNUSED)
+{
+  /* a failed flush that couldn't be cut off, then a successful one */
+  const gchar *abandoned =
+    "S\t" ACCOUNT "\tmanager\tgabble\n"
+    "C\n"
+    "S\t" ACCOUNT "\tprotocol\tjabber\n"
+    "S\t" ACCOUNT "\tDisplayName\tFr"
+    "\nA\n"
+    "S\t" ACCOUNT "\tNickname\tfred\n"
+    "C\n";
+  GError *error = NULL;
+
+  g_file_set_contents (f->filename, abandoned, -1, &error);
+  g_assert_no_error (error);
+
+  replay_into_fresh_keyfile (f, 2);
+  g_assert (g_key_file_has_key (f->keyfile, ACCOUNT, "manager", NULL));
+  g_assert (!g_key_file_has_key (f->keyfile, ACCOUNT, "protocol", NULL));
+  g_assert (!g_key_file_has_key (f->keyfile, ACCOUNT, "DisplayName", NULL));
+  g_assert (g_key_file_has_key (f->keyfile, ACCOUNT, "Nickname", NULL));
+}
+
+static void
+test_incomplete_batch (Fixture *f,
+    gconstpointer unused G_GNUC_UNUSED)
+{
+  /* the second batch was written in full, but never finished */
+  const gchar *incomplete =
+    "S\t" ACCOUNT "\tmanager\tgabble\n"
+    "C\n"
+    "S\t" ACCOUNT "\tprotocol\tjabber\n"
+    "S\t" ACCOUNT "\tDisplayName\tFred\n";
+  GError *error = NULL;
+
+  g_file_set_contents (f->filename, incomplete, -1, &error);
+  g_assert_no_error (error);
+
+  replay_into_fresh_keyfile (f, 1);
+  g_assert (g_key_file_has_key (f->keyfile, ACCOUNT, "manager", NULL));
+  g_assert (!g_key_file_has_key (f->keyfile, ACCOUNT, "protocol", NULL));
+  g_assert (!g_key_file_has_key (f->keyfile, ACCOUNT, "DisplayName", NULL));
+}
+
+static void
+test_unrepresentable (Fixture *f,
+    gconstpointer unused G_GNUC_UNUSED)
+{
+  g_assert (!mcd_storage_journal_append (f->journal, ACCOUNT, "DisplayName",
+        "two\nlines"));
+  g_assert (!mcd_storage_journal_append (f->journal, ACCOUNT, "Tab\tbed",
+        "x"));
+  g_assert (!mcd_storage_journal_has_pending (f->journal));
+}
+
+static void
+test_reset (Fixture *f,
+    gconstpointer unused G_GNUC_UNUSED)
+{
+  GError *error = NULL;
+
+  mcd_storage_journal_append (f->journal, ACCOUNT, "manager", "gabble");
+  mcd_storage_journal_flush (f->journal, &error);
+  g_assert_no_error (error);
+  mcd_storage_journal_append (f->journal, ACCOUNT, "protocol", "jabber");
+
+  mcd_storage_journal_reset (f->journal, &error);
+  g_assert_no_error (error);
+  g_assert (!g_file_test (f->filename, G_FILE_TEST_EXISTS));
+  g_assert (!mcd_storage_journal_has_pending (f->journal));
+  g_assert_cmpuint (mcd_storage_journal_get_size (f->journal), ==, 0);
+
+  replay_into_fresh_keyfile (f, 0);
+}
+
+int
+main (int argc,
+      char **argv)
+{
+  g_test_init (&argc, &argv, NULL);
+  g_test_bug_base ("http://bugs.freedesktop.org/show_bug.cgi?id=");
+
+  g_test_add ("/storage-journal/replay", Fixture, NULL, setup, test_replay,
+      teardown);
+  g_test_add ("/storage-journal/torn-write", Fixture, NULL, setup,
+      test_torn_write, teardown);
+  g_test_add ("/storage-journal/append-after-torn-write", Fixture, NULL,
+      setup, test_append_after_torn_write, teardown);
+  g_test_add ("/storage-journal/abandoned-batch", Fixture, NULL, setup,
+      test_abandoned_batch, teardown);
+  g_test_add ("/storage-journal/incomplete-batch", Fixture, NULL, setup,
+      test_incomplete_batch, teardown);
+  g_test_add ("/storage-journal/unrepresentable", Fixture, NULL, setup,
+      test_unrepresentable, teardown);
+  g_test_add ("/storage-journal/reset", Fixture, NULL, setup, test_reset,
+      teardown);
+
+  return g_test_run ();
+}
@@ -0,0 +1,518 @@
+/*
+ * Regression test and benchmark for McdStorage sending changes only to
+ * the plugin that stores the account
+ *
+ * Copyright © 2012 Collabora Ltd.
+ *
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License as published by the Free Software Foundation; either
+ * version 2.1 of the License, or (at your option) any later version.
+ *
+ * This library is distributed in the hope that it will be useful, but
+ * WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the GNU
+ * Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with this library; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin St, Fifth Floor, Boston, MA
+ * 02110-1301 USA
+ *
+ */
+
+#include "config.h"
+
+#include <glib/gstdio.h>
+#include <telepathy-glib/telepathy-glib.h>
+
+#include "mission-control-plugins/implementation.h"
+
+#include "mcd-storage.h"
+
+#define N_PLUGINS 5
+#define N_WRITES 100
+
+/* Each plugin stores the accounts whose names start with its prefix,
+ * and counts every call that could write something. It can also be told
+ * to refuse one key for its own accounts, or to store one key for
+ * anyone's. */
+
+typedef struct {
+    GObject parent;
+    gchar *prefix;
+    const gchar *refused;
+    const gchar *accepted;
+    guint calls;
+} CountingPlugin;
+
+typedef struct {
+    GObjectClass parent;
+} CountingPluginClass;
+
+static void counting_plugin_iface_init (McpAccountStorageIface *iface,
+    gpointer unused G_GNUC_UNUSED);
+
+static GType counting_plugin_get_type (void);
+
+G_DEFINE_TYPE_WITH_CODE (CountingPlugin, counting_plugin,
+    G_TYPE_OBJECT,
+    G_IMPLEMENT_INTERFACE (MCP_TYPE_ACCOUNT_STORAGE,
+      counting_plugin_iface_init))
+
+#define COUNTING_PLUGIN(o) \
+  (G_TYPE_CHECK_INSTANCE_CAST ((o), counting_plugin_get_type (), \
+                               CountingPlugin))
+
+static void
+counting_plugin_init (CountingPlugin *self)
+{
+}
+
+static void
+counting_plugin_finalize (GObject *object)
+{
+  g_free (COUNTING_PLUGIN (object)->prefix);
+
+  G_OBJECT_CLASS (counting_plugin_parent_class)->finalize (object);
+}
+
+static void
+counting_plugin_class_init (CountingPluginClass *cls)
+{
+  G_OBJECT_CLASS (cls)->finalize = counting_plugin_finalize;
+}
+
+static gboolean
+counting_plugin_claims (const McpAccountStorage *storage,
+    const gchar *account,
+    const gchar *key)
+{
+  CountingPlugin *self = COUNTING_PLUGIN (storage);
+
+  self->calls++;
+
+  if (!tp_strdiff (key, self->accepted))
+    return TRUE;
+
+  if (!tp_strdiff (key, self->refused))
+    return FALSE;
+
+  return g_str_has_prefix (account, self->prefix);
+}
+
+static gboolean
+counting_plugin_get (const McpAccountStorage *storage,
+    const McpAccountManager *am,
+    const gchar *account,
+    const gchar *key)
+{
+  CountingPlugin *self = COUNTING_PLUGIN (storage);
+
+  if (!g_str_has_prefix (account, self->prefix))
+    return FALSE;
+
+  if (key == NULL || !tp_strdiff (key, "manager"))
+    mcp_account_manager_set_value (am, account, "manager", "gabble");
+
+  return TRUE;
+}
+
+static gboolean
+counting_plugin_set (const McpAccountStorage *storage,
+    const McpAccountManager *am,
+    const gchar *account,
+    const gchar *key,
+    const gchar *val)
+{
+  return counting_plugin_claims (storage, account, key);
+}
+
+static gboolean
+counting_plugin_set_attribute (McpAccountStorage *storage,
+    McpAccountManager *am,
+    const gchar *account,
+    const gchar *attribute,
+    GVariant *val,
+    McpAttributeFlags flags)
+{
+  return counting_plugin_claims (storage, account, attribute);
+}
+
+static gboolean
+counting_plugin_set_parameter (McpAccountStorage *storage,
+    McpAccountManager *am,
+    const gchar *account,
+    const gchar *parameter,
+    GVariant *val,
+    McpParameterFlags flags)
+{
+  return counting_plugin_claims (storage, account, parameter);
+}
+
+static gboolean
+counting_plugin_delete (const McpAccountStorage *storage,
+    const McpAccountManager *am,
+    const gchar *account,
+    const gchar *key)
+{
+  COUNTING_PLUGIN (storage)->calls++;
+  return TRUE;
+}
+
+static gboolean
+counting_plugin_commit (const McpAccountStorage *storage,
+    const McpAccountManager *am)
+{
+  COUNTING_PLUGIN (storage)->calls++;
+  return TRUE;
+}
+
+static gboolean
+counting_plugin_commit_one (const McpAccountStorage *storage,
+    const McpAccountManager *am,
+    const gchar *account)
+{
+  COUNTING_PLUGIN (storage)->calls++;
+  return TRUE;
+}
+
+static GList *
+counting_plugin_list (const McpAccountStorage *storage,
+    const McpAccountManager *am)
+{
+  CountingPlugin *self = COUNTING_PLUGIN (storage);
+
+  return g_list_prepend (NULL, g_strdup_printf ("%s/jabber/listed",
+        self->prefix));
+}
+
+static void
+counting_plugin_iface_init (McpAccountStorageIface *iface,
+    gpointer unused G_GNUC_UNUSED)
+{
+  iface->name = "counting";
+  iface->desc = "Regression test plugin";
+  iface->priority = MCP_ACCOUNT_STORAGE_PLUGIN_PRIO_NORMAL;
+
+  iface->get = counting_plugin_get;
+  iface->set = counting_plugin_set;
+  iface->set_attribute = counting_plugin_set_attribute;
+  iface->set_parameter = counting_plugin_set_parameter;
+  iface->delete = counting_plugin_delete;
+  iface->commit = counting_plugin_commit;
+  iface->commit_one = counting_plugin_commit_one;
+  iface->list = counting_plugin_list;
+}
+
+static CountingPlugin *plugins[N_PLUGINS];
+
+static guint
+total_calls (void)
+{
+  guint i;
+  guint n = 0;
+
+  for (i = 0; i < N_PLUGINS; i++)
+    n += plugins[i]->calls;
+
+  return n;
+}
+
+typedef struct {
+    McdStorage *storage;
+} Fixture;
+
+static void
+setup (Fixture *f,
+    gconstpointer unused G_GNUC_UNUSED)
+{
+  f->storage = mcd_storage_new (NULL);
+  mcd_storage_load (f->storage);
+}
+
+static void
+teardown (Fixture *f,
+    gconstpointer unused G_GNUC_UNUSED)
+{
+  g_object_unref (f->storage);
+}
+
+static void
+write_display_names (Fixture *f,
+    const gchar *account,
+    guint n)
+{
+  GValue value = G_VALUE_INIT;
+  guint i;
+
+  g_value_init (&value, G_TYPE_STRING);
+
+  for (i = 0; i < n; i++)
+    {
+      g_value_take_string (&value, g_strdup_printf ("Fred %u", i));
+      g_assert (mcd_storage_set_attribute (f->storage, account,
+            "DisplayName", &value));
+      mcd_storage_commit (f->storage, account);
+    }
+
+  g_value_unset (&value);
+}
+
+static void
+test_listed (Fixture *f,
+    gconstpointer unused G_GNUC_UNUSED)
+{
+  CountingPlugin *owner = plugins[N_PLUGINS - 1];
+  gchar *account = g_strdup_printf ("%s/jabber/listed", owner->prefix);
+  guint i;
+
+  g_assert (mcd_storage_get_plugin (f->storage, account) ==
+      MCP_ACCOUNT_STORAGE (owner));
+
+  /* asking about an account that nobody has listed or written to doesn't
+   * go looking for it, or create it */
+  g_assert (mcd_storage_get_plugin (f->storage, "plugin0/jabber/nobody") ==
+      NULL);
+
+  for (i = 0; i < N_PLUGINS; i++)
+    plugins[i]->calls = 0;
+
+  write_display_names (f, account, N_WRITES);
+
+  g_test_message ("%u plugin calls for %u writes to an account from list()",
+      total_calls (), N_WRITES);
+
+  /* one set_attribute and one commit_one per write, all to the owner */
+  g_assert_cmpuint (owner->calls, ==, 2 * N_WRITES);
+  g_assert_cmpuint (total_calls (), ==, 2 * N_WRITES);
+
+  g_free (account);
+}
+
+static void
+test_claimed (Fixture *f,
+    gconstpointer unused G_GNUC_UNUSED)
+{
+  CountingPlugin *owner = plugins[N_PLUGINS / 2];
+  gchar *account = g_strdup_printf ("%s/jabber/new", owner->prefix);
+  guint first;
+  guint i;
+
+  for (i = 0; i < N_PLUGINS; i++)
+    plugins[i]->calls = 0;
+
+  /* nobody has listed this account, so the first change has to ask every
+   * plugin in turn until one of them claims it */
+  write_display_names (f, account, 1);
+  first = total_calls ();
+  g_assert_cmpuint (first, >, 2);
+
+  for (i = 0; i < N_PLUGINS; i++)
+    plugins[i]->calls = 0;
+
+  /* after that, the plugin that claimed it is the only one we talk to */
+  write_display_names (f, account, N_WRITES);
+
+  g_test_message ("%u plugin calls for the first write to a new account, "
+      "%u for the next %u", first, total_calls (), N_WRITES);
+
+  g_assert_cmpuint (owner->calls, ==, 2 * N_WRITES);
+  g_assert_cmpuint (total_calls (), ==, 2 * N_WRITES);
+
+  /* deleting it only involves the owner, too */
+  mcd_storage_delete_account (f->storage, account);
+  g_assert_cmpuint (owner->calls, ==, 2 * N_WRITES + 1);
+  g_assert_cmpuint (total_calls (), ==, 2 * N_WRITES + 1);
+
+  g_free (account);
+}
+
+static void
+test_flush (Fixture *f,
+    gconstpointer unused G_GNUC_UNUSED)
+{
+  CountingPlugin *owner = plugins[1];
+  GValue value = G_VALUE_INIT;
+  guint i;
+
+  g_value_init (&value, G_TYPE_STRING);
+  g_value_set_static_string (&value, "Fred");
+
+  for (i = 0; i < N_WRITES; i++)
+    {
+      gchar *account = g_strdup_printf ("%s/jabber/flush%u", owner->prefix,
+          i);
+
+      g_assert (mcd_storage_set_attribute (f->storage, account,
+            "DisplayName", &value));
+      mcd_storage_commit_later (f->storage, account);
+      g_free (account);
+    }
+
+  for (i = 0; i < N_PLUGINS; i++)
+    plugins[i]->calls = 0;
+
+  /* one commit for the plugin that holds them all, however many there
+   * are, and nothing for anyone else */
+  mcd_storage_flush (f->storage);
+  g_assert_cmpuint (owner->calls, ==, 1);
+  g_assert_cmpuint (total_calls (), ==, 1);
+
+  g_value_unset (&value);
+}
+
+static void
+test_transaction (Fixture *f,
+    gconstpointer unused G_GNUC_UNUSED)
+{
+  CountingPlugin *owner = plugins[N_PLUGINS - 1];
+  gchar *account = g_strdup_printf ("%s/jabber/listed", owner->prefix);
+  McdStorageTransaction *transaction;
+  GValue value = G_VALUE_INIT;
+  guint i;
+
+  for (i = 0; i < N_PLUGINS; i++)
+    plugins[i]->calls = 0;
+
+  /* while the transaction captures the account, changes made directly
+   * reach the cache but not the plugin... */
+  transaction = mcd_storage_transaction_begin (f->storage, account);
+  write_display_names (f, account, N_WRITES);
+  mcd_storage_set_string (f->storage, account, "Nickname", "fred");
+  mcd_storage_transaction_set_string (transaction, "Icon", "im-jabber");
+
+  g_assert_cmpuint (total_calls (), ==, N_WRITES);
+  g_assert_cmpuint (owner->calls, ==, N_WRITES);
+
+  g_value_init (&value, G_TYPE_STRING);
+  g_assert (mcd_storage_get_attribute (f->storage, account, "DisplayName",
+        &value, NULL));
+  g_assert_cmpstr (g_value_get_string (&value), ==, "Fred 99");
+  g_value_unset (&value);
+
+  for (i = 0; i < N_PLUGINS; i++)
+    plugins[i]->calls = 0;
+
+  /* ... and committing passes on the latest value of each key, and what
+   * was staged, with a single commit */
+  g_assert (mcd_storage_transaction_commit (transaction));
+  g_assert_cmpuint (owner->calls, ==, 4);
+  g_assert_cmpuint (total_calls (), ==, 4);
+
+  g_free (account);
+}
+
+static void
+test_refused (Fixture *f,
+    gconstpointer unused G_GNUC_UNUSED)
+{
+  CountingPlugin *owner = plugins[N_PLUGINS - 1];
+  CountingPlugin *other = plugins[0];
+  gchar *account = g_strdup_printf ("%s/jabber/listed", owner->prefix);
+  guint i;
+
+  g_assert (mcd_storage_get_plugin (f->storage, account) ==
+      MCP_ACCOUNT_STORAGE (owner));
+
+  /* the owner won't store the nickname, so another plugin does */
+  owner->refused = "Nickname";
+  other->accepted = "Nickname";
+  mcd_storage_set_string (f->storage, account, "Nickname", "fred");
+
+  for (i = 0; i < N_PLUGINS; i++)
+    plugins[i]->calls = 0;
+
+  /* that plugin has to hear about the nickname being deleted, or it would
+   * come back next time, and its copy of the account has to be committed */
+  mcd_storage_set_string (f->storage, account, "Nickname", NULL);
+  mcd_storage_commit (f->storage, account);
+
+  g_assert_cmpuint (other->calls, ==, 2);
+  g_assert_cmpuint (owner->calls, ==, 2);
+  g_assert_cmpuint (total_calls (), ==, 4);
+
+  /* when the owner does store a key, the other plugin is told to drop
+   * any copy it might have, and is committed */
+  for (i = 0; i < N_PLUGINS; i++)
+    plugins[i]->calls = 0;
+
+  write_display_names (f, account, 1);
+  g_assert_cmpuint (owner->calls, ==, 2);
+  g_assert_cmpuint (other->calls, ==, 2);
+  g_assert_cmpuint (total_calls (), ==, 4);
+
+  owner->refused = NULL;
+  other->accepted = NULL;
+  g_free (account);
+}
+
+static void
+rm_r (const gchar *path)
+{
+  GDir *dir = g_dir_open (path, 0, NULL);
+  const gchar *entry;
+
+  if (dir != NULL)
+    {
+      while ((entry = g_dir_read_name (dir)) != NULL)
+        {
+          gchar *child = g_build_filename (path, entry, NULL);
+
+          rm_r (child);
+          g_free (child);
+        }
+
+      g_dir_close (dir);
+      g_rmdir (path);
+    }
+  else
+    {
+      g_unlink (path);
+    }
+}
+
+int
+main (int argc,
+      char **argv)
+{
+  GError *error = NULL;
+  gchar *dir;
+  guint i;
+  int ret;
+
+  g_test_init (&argc, &argv, NULL);
+  g_test_bug_base ("http://bugs.freedesktop.org/show_bug.cgi?id=");
+
+  /* keep the built-in keyfile backend away from the user's accounts, and
+   * don't load any real plugins */
+  dir = g_dir_make_tmp ("mc-routing-XXXXXX", &error);
+  g_assert_no_error (error);
+  g_setenv ("MC_ACCOUNT_DIR", dir, TRUE);
+  g_setenv ("XDG_CACHE_HOME", dir, TRUE);
+  g_setenv ("MC_FILTER_PLUGIN_DIR", dir, TRUE);
+
+  for (i = 0; i < N_PLUGINS; i++)
+    {
+      plugins[i] = g_object_new (counting_plugin_get_type (), NULL);
+      plugins[i]->prefix = g_strdup_printf ("plugin%u", i);
+      mcp_add_object (plugins[i]);
+    }
+
+  g_test_add ("/storage-routing/listed", Fixture, NULL, setup,
+      test_listed, teardown);
+  g_test_add ("/storage-routing/claimed", Fixture, NULL, setup,
+      test_claimed, teardown);
+  g_test_add ("/storage-routing/flush", Fixture, NULL, setup,
+      test_flush, teardown);
+  g_test_add ("/storage-routing/transaction", Fixture, NULL, setup,
+      test_transaction, teardown);
+  g_test_add ("/storage-routing/refused", Fixture, NULL, setup,
+      test_refused, teardown);
+
+  ret = g_test_run ();
+
+  rm_r (dir);
+  g_free (dir);
+  return ret;
+}
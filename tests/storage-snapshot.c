@@ -0,0 +1,197 @@
+/*
+ * Regression test for the account storage snapshot
+ *
+ * Copyright © 2012 Collabora Ltd.
+ *
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License as published by the Free Software Foundation; either
+ * version 2.1 of the License, or (at your option) any later version.
+ *
+ * This library is distributed in the hope that it will be useful, but
+ * WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the GNU
+ * Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with this library; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin St, Fifth Floor, Boston, MA
+ * 02110-1301 USA
+ *
+ */
+
+#include "config.h"
+
+#include <string.h>
+
+#include <glib/gstdio.h>
+
+#include "mcd-storage-snapshot.h"
+
+#define ACCOUNT "gabble/jabber/fred_40example_2ecom0"
+#define OTHER "gabble/jabber/wilma_40example_2ecom0"
+
+static const gchar keyfile_data[] =
+  "# Telepathy accounts\n"
+  "[" OTHER "]\n"
+  "manager=gabble\n"
+  "protocol=jabber\n"
+  "param-account=wilma@example.com\n"
+  "\n"
+  "[" ACCOUNT "]\n"
+  "manager=gabble\n"
+  "protocol=jabber\n"
+  "param-account=fred@example.com\n"
+  "DisplayName=Fred\\tBloggs\n"
+  "Nickname=fred\n";
+
+typedef struct {
+    gchar *dir;
+    gchar *source;
+    gchar *filename;
+    GKeyFile *keyfile;
+} Fixture;
+
+static void
+setup (Fixture *f,
+    gconstpointer unused G_GNUC_UNUSED)
+{
+  GError *error = NULL;
+
+  f->dir = g_dir_make_tmp ("mc-snapshot-XXXXXX", &error);
+  g_assert_no_error (error);
+  f->source = g_build_filename (f->dir, "accounts.cfg", NULL);
+  f->filename = g_build_filename (f->dir, "accounts.snapshot", NULL);
+
+  g_file_set_contents (f->source, keyfile_data, -1, &error);
+  g_assert_no_error (error);
+
+  f->keyfile = g_key_file_new ();
+  g_key_file_load_from_data (f->keyfile, keyfile_data, -1,
+      G_KEY_FILE_KEEP_COMMENTS, &error);
+  g_assert_no_error (error);
+}
+
+static void
+teardown (Fixture *f,
+    gconstpointer unused G_GNUC_UNUSED)
+{
+  g_key_file_free (f->keyfile);
+  g_unlink (f->filename);
+  g_unlink (f->source);
+  g_rmdir (f->dir);
+  g_free (f->filename);
+  g_free (f->source);
+  g_free (f->dir);
+}
+
+static void
+write_snapshot (Fixture *f)
+{
+  GError *error = NULL;
+
+  mcd_storage_snapshot_write (f->filename, f->source, keyfile_data,
+      strlen (keyfile_data), f->keyfile, &error);
+  g_assert_no_error (error);
+}
+
+static void
+test_lookup (Fixture *f,
+    gconstpointer unused G_GNUC_UNUSED)
+{
+  McdStorageSnapshot *snapshot;
+  GStrv strv;
+  gchar *value;
+  gsize n;
+
+  write_snapshot (f);
+  snapshot = mcd_storage_snapshot_open (f->filename, f->source);
+  g_assert (snapshot != NULL);
+
+  /* sorted, whatever order they were in */
+  strv = mcd_storage_snapshot_dup_accounts (snapshot, &n);
+  g_assert_cmpuint (n, ==, 2);
+  g_assert_cmpstr (strv[0], ==, ACCOUNT);
+  g_assert_cmpstr (strv[1], ==, OTHER);
+  g_assert_cmpstr (strv[2], ==, NULL);
+  g_strfreev (strv);
+
+  strv = mcd_storage_snapshot_dup_keys (snapshot, ACCOUNT, &n);
+  g_assert_cmpuint (n, ==, 5);
+  g_assert_cmpstr (strv[0], ==, "DisplayName");
+  g_assert_cmpstr (strv[4], ==, "protocol");
+  g_strfreev (strv);
+
+  g_assert (mcd_storage_snapshot_dup_keys (snapshot, "nope/nope/nope",
+        &n) == NULL);
+
+  /* values stay escaped, as they would from g_key_file_get_value() */
+  value = mcd_storage_snapshot_dup_value (snapshot, ACCOUNT, "DisplayName");
+  g_assert_cmpstr (value, ==, "Fred\\tBloggs");
+  g_free (value);
+
+  value = mcd_storage_snapshot_dup_value (snapshot, OTHER, "param-account");
+  g_assert_cmpstr (value, ==, "wilma@example.com");
+  g_free (value);
+
+  g_assert (mcd_storage_snapshot_dup_value (snapshot, OTHER,
+        "Nickname") == NULL);
+  g_assert (mcd_storage_snapshot_dup_value (snapshot, "nope/nope/nope",
+        "manager") == NULL);
+
+  mcd_storage_snapshot_free (snapshot);
+}
+
+static void
+test_stale (Fixture *f,
+    gconstpointer unused G_GNUC_UNUSED)
+{
+  GError *error = NULL;
+  gchar *changed;
+
+  write_snapshot (f);
+
+  /* same length, and probably the same mtime, but replacing the file
+   * gives it a new inode */
+  changed = g_strdup (keyfile_data);
+  memcpy (strstr (changed, "fred@"), "bert@", 5);
+  g_file_set_contents (f->source, changed, -1, &error);
+  g_assert_no_error (error);
+  g_free (changed);
+
+  g_assert (mcd_storage_snapshot_open (f->filename, f->source) == NULL);
+}
+
+static void
+test_garbage (Fixture *f,
+    gconstpointer unused G_GNUC_UNUSED)
+{
+  GError *error = NULL;
+
+  g_assert (mcd_storage_snapshot_open (f->filename, f->source) == NULL);
+
+  g_file_set_contents (f->filename, "", 0, &error);
+  g_assert_no_error (error);
+  g_assert (mcd_storage_snapshot_open (f->filename, f->source) == NULL);
+
+  g_file_set_contents (f->filename, keyfile_data, -1, &error);
+  g_assert_no_error (error);
+  g_assert (mcd_storage_snapshot_open (f->filename, f->source) == NULL);
+}
+
+int
+main (int argc,
+      char **argv)
+{
+  g_test_init (&argc, &argv, NULL);
+  g_test_bug_base ("http://bugs.freedesktop.org/show_bug.cgi?id=");
+
+  g_test_add ("/storage-snapshot/lookup", Fixture, NULL, setup, test_lookup,
+      teardown);
+  g_test_add ("/storage-snapshot/stale", Fixture, NULL, setup, test_stale,
+      teardown);
+  g_test_add ("/storage-snapshot/garbage", Fixture, NULL, setup,
+      test_garbage, teardown);
+
+  return g_test_run ();
+}
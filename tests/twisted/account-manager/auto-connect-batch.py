@@ -0,0 +1,99 @@
+# Copyright (C) 2012 Collabora Ltd.
+#
+# This library is free software; you can redistribute it and/or
+# modify it under the terms of the GNU Lesser General Public
+# License as published by the Free Software Foundation; either
+# version 2.1 of the License, or (at your option) any later version.
+#
+# This library is distributed in the hope that it will be useful, but
+# WITHOUT ANY WARRANTY; without even the implied warranty of
+# MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the GNU
+# Lesser General Public License for more details.
+#
+# You should have received a copy of the GNU Lesser General Public
+# License along with this library; if not, write to the Free Software
+# Foundation, Inc., 51 Franklin St, Fifth Floor, Boston, MA
+# 02110-1301 USA
+
+"""Regression test for connecting accounts automatically a few at a time
+at startup, most recently used first, without waiting for accounts that
+don't want to connect.
+"""
+
+import dbus
+import dbus.service
+
+from servicetest import EventPattern, sync_dbus
+from mctest import exec_test, MC
+import constants as cs
+
+cm_name_ref = dbus.service.BusName(
+        cs.tp_name_prefix + '.ConnectionManager.fakecm', bus=dbus.SessionBus())
+
+# One account at a time, and long enough between them that if the accounts
+# that don't want to connect took their turns, the first one that does
+# would not connect before the event queue gave up
+BATCH = '1'
+INTERVAL_MS = 3000
+
+def preseed(fake_accounts_service):
+    # name => (Enabled, ConnectAutomatically, LastOnline)
+    accounts = {
+            'disabled': (False, True, 4000),
+            'manual': (True, False, 3000),
+            'recent': (True, True, 2000),
+            'stale': (True, True, 1000),
+            }
+
+    for name, (enabled, auto, last_online) in accounts.items():
+        account_id = 'fakecm/fakeprotocol/' + name
+
+        fake_accounts_service.update_attributes(account_id, changed={
+            'manager': 'fakecm',
+            'protocol': 'fakeprotocol',
+            'DisplayName': name,
+            'Enabled': enabled,
+            'ConnectAutomatically': auto,
+            'AutomaticPresence': (dbus.UInt32(cs.PRESENCE_TYPE_AVAILABLE),
+                'available', ''),
+            'LastOnline': dbus.Int64(last_online),
+            })
+        fake_accounts_service.update_parameters(account_id, untyped={
+            'account': name + '@example.com',
+            'password': name,
+            })
+
+def request_connection(name):
+    return EventPattern('dbus-method-call', method='RequestConnection',
+            interface=cs.CM, handled=False,
+            predicate=(lambda e: e.args[0] == 'fakeprotocol' and
+                e.args[1]['account'] == name + '@example.com'))
+
+def test(q, bus, unused, **kwargs):
+    preseed(kwargs['fake_accounts_service'])
+
+    bus_daemon = dbus.Interface(bus.get_object(dbus.BUS_DAEMON_NAME,
+        dbus.BUS_DAEMON_PATH), dbus.BUS_DAEMON_IFACE)
+    bus_daemon.UpdateActivationEnvironment({
+        'MC_AUTOCONNECT_BATCH': BATCH,
+        'MC_AUTOCONNECT_INTERVAL': str(INTERVAL_MS),
+        })
+
+    # Of the accounts that want to connect, the one that was online most
+    # recently goes first; the disabled account and the one that doesn't
+    # connect automatically don't hold it up, although they were online
+    # more recently still
+    mc = MC(q, bus, wait_for_names=False)
+    mc.wait_for_names(request_connection('recent'))
+
+    # then the next one, on its own
+    q.expect_many(request_connection('stale'))
+
+    # and nothing else
+    q.forbid_events([EventPattern('dbus-method-call',
+        method='RequestConnection')])
+    sync_dbus(bus, q, mc)
+
+if __name__ == '__main__':
+    exec_test(test, {}, preload_mc=False, use_fake_accounts_service=True,
+            pass_kwargs=True)
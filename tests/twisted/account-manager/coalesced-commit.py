@@ -0,0 +1,55 @@
+# Test that bursts of changes are committed to storage together.
+#
+# Copyright (C) 2009 Nokia Corporation
+# Copyright (C) 2009-2012 Collabora Ltd.
+#
+# This library is free software; you can redistribute it and/or
+# modify it under the terms of the GNU Lesser General Public
+# License as published by the Free Software Foundation; either
+# version 2.1 of the License, or (at your option) any later version.
+#
+# This library is distributed in the hope that it will be useful, but
+# WITHOUT ANY WARRANTY; without even the implied warranty of
+# MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the GNU
+# Lesser General Public License for more details.
+#
+# You should have received a copy of the GNU Lesser General Public
+# License along with this library; if not, write to the Free Software
+# Foundation, Inc., 51 Franklin St, Fifth Floor, Boston, MA
+# 02110-1301 USA
+
+import dbus
+
+from mctest import exec_test, create_fakecm_account
+import constants as cs
+
+def test(q, bus, mc):
+    params = dbus.Dictionary({"account": "someguy@example.com",
+        "password": "secrecy"}, signature='sv')
+    (cm_name_ref, account) = create_fakecm_account(q, bus, mc, params)
+    account_path = account.__dbus_object_path__
+    account_props = dbus.Interface(account, cs.PROPERTIES_IFACE)
+
+    # Let the account's creation reach storage before we start
+    q.expect('dbus-method-call',
+            interface=cs.TEST_DBUS_ACCOUNT_SERVICE_IFACE,
+            method='UpdateAttributes')
+
+    # Several changes in quick succession...
+    account_props.Set(cs.ACCOUNT, 'DisplayName', 'Work account')
+    account_props.Set(cs.ACCOUNT, 'Icon', 'im-jabber')
+    account_props.Set(cs.ACCOUNT, 'Nickname', 'Joe Bloggs')
+
+    # ... result in a single commit
+    q.expect('dbus-method-call',
+            interface=cs.TEST_DBUS_ACCOUNT_SERVICE_IFACE,
+            method='UpdateAttributes',
+            args=[account_path[len(cs.ACCOUNT_PATH_PREFIX):],
+                {'DisplayName': 'Work account',
+                    'Icon': 'im-jabber',
+                    'Nickname': 'Joe Bloggs'},
+                {'DisplayName': 0, 'Icon': 0, 'Nickname': 0},
+                []])
+
+if __name__ == '__main__':
+    exec_test(test, {})
@@ -0,0 +1,162 @@
+# Copyright (C) 2012 Collabora Ltd.
+#
+# This library is free software; you can redistribute it and/or
+# modify it under the terms of the GNU Lesser General Public
+# License as published by the Free Software Foundation; either
+# version 2.1 of the License, or (at your option) any later version.
+#
+# This library is distributed in the hope that it will be useful, but
+# WITHOUT ANY WARRANTY; without even the implied warranty of
+# MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the GNU
+# Lesser General Public License for more details.
+#
+# You should have received a copy of the GNU Lesser General Public
+# License along with this library; if not, write to the Free Software
+# Foundation, Inc., 51 Franklin St, Fifth Floor, Boston, MA
+# 02110-1301 USA
+
+"""Regression test for remembering what a connection manager without a
+.manager file supports, so that it isn't activated and introspected every
+time MC starts.
+"""
+
+import os
+import os.path
+
+import dbus
+import dbus.service
+
+from gi.repository import GLib
+
+from servicetest import EventPattern, call_async, sync_dbus, assertEquals
+from mctest import (
+    exec_test, AccountManager, get_fakecm_account, tell_mc_to_die,
+    resuscitate_mc
+    )
+import constants as cs
+
+CM_NAME = 'cachedcm'
+CM_BUS_NAME = cs.CM + '.' + CM_NAME
+CM_PATH = cs.tp_path_prefix + '/ConnectionManager/' + CM_NAME
+PROTOCOL_NAME = 'cachedproto'
+PROTOCOL = cs.tp_name_prefix + '.Protocol'
+
+# (source filename, source mtime, (interfaces, protocols))
+CACHE_TYPE = '(sx(asa{sa{sv}}))'
+
+def write_service_file():
+    # The CM has no .manager file, only a D-Bus .service file, whose mtime
+    # tells MC whether its cache is still valid
+    service_dir = os.path.join(os.environ['XDG_DATA_DIRS'].split(':')[0],
+            'dbus-1', 'services')
+
+    if not os.path.isdir(service_dir):
+        os.makedirs(service_dir)
+
+    filename = os.path.join(service_dir, CM_BUS_NAME + '.service')
+    service_file = open(filename, 'w')
+    service_file.write('[D-BUS Service]\nName=%s\nExec=/bin/false\n'
+            % CM_BUS_NAME)
+    service_file.close()
+    return filename
+
+def read_cache(filename):
+    data = open(filename, 'rb').read()
+    return GLib.Variant.new_from_bytes(GLib.VariantType.new(CACHE_TYPE),
+            GLib.Bytes.new(data), False).unpack()
+
+def write_cache(filename, source, protocols):
+    mtime = int(os.stat(source).st_mtime)
+    contents = GLib.Variant(CACHE_TYPE, (source, mtime, ([], protocols)))
+    cache_file = open(filename, 'wb')
+    cache_file.write(contents.get_data_as_bytes().get_data())
+    cache_file.close()
+
+def expect_introspection():
+    return EventPattern('dbus-method-call', path=CM_PATH,
+            interface=cs.PROPERTIES_IFACE, method='GetAll', args=[cs.CM])
+
+def test(q, bus, mc):
+    source = write_service_file()
+    cache = os.path.join(os.environ['XDG_CACHE_HOME'], 'telepathy',
+            'mission-control', 'managers', CM_NAME + '.cache')
+
+    cm_name_ref = dbus.service.BusName(CM_BUS_NAME, bus=bus)
+
+    protocol_properties = dbus.Dictionary({
+        PROTOCOL + '.Parameters': dbus.Array([
+            ('account', dbus.UInt32(cs.PARAM_FLAG_REQUIRED), 's', ''),
+            ], signature='(susv)'),
+        PROTOCOL + '.Interfaces': dbus.Array([], signature='s'),
+        PROTOCOL + '.ConnectionInterfaces': dbus.Array([], signature='s'),
+        PROTOCOL + '.RequestableChannelClasses': dbus.Array([],
+            signature='(a{sv}as)'),
+        PROTOCOL + '.VCardField': '',
+        PROTOCOL + '.EnglishName': 'Cached',
+        PROTOCOL + '.Icon': 'im-cached',
+        PROTOCOL + '.AuthenticationTypes': dbus.Array([], signature='s'),
+        }, signature='sv')
+
+    def get_all_cm(e):
+        q.dbus_return(e.message, dbus.Dictionary({
+            'Protocols': dbus.Dictionary({
+                PROTOCOL_NAME: protocol_properties,
+                }, signature='sa{sv}'),
+            'Interfaces': dbus.Array([], signature='s'),
+            }, signature='sv'), signature='a{sv}')
+
+    q.add_dbus_method_impl(get_all_cm, path=CM_PATH,
+            interface=cs.PROPERTIES_IFACE, method='GetAll', args=[cs.CM])
+
+    # With nothing cached, MC has to ask the CM what it supports
+    account_manager = AccountManager(bus)
+    call_async(q, account_manager, 'CreateAccount', CM_NAME, PROTOCOL_NAME,
+            'cached account', {'account': 'me@example.com'}, {})
+
+    _, ret = q.expect_many(
+            expect_introspection(),
+            EventPattern('dbus-return', method='CreateAccount'),
+            )
+    account_path = ret.value[0]
+
+    source_name, _, (interfaces, protocols) = read_cache(cache)
+    assertEquals(source, source_name)
+    assertEquals([PROTOCOL_NAME], list(protocols.keys()))
+
+    # When MC starts again, the cache is still valid, so the CM isn't asked
+    # again, but MC knows enough to see that the account is valid
+    tell_mc_to_die(q, bus)
+
+    introspection = [
+            EventPattern('dbus-method-call', path=CM_PATH,
+                interface=cs.PROPERTIES_IFACE, method='GetAll'),
+            EventPattern('dbus-method-call', path=CM_PATH, interface=cs.CM,
+                method='ListProtocols'),
+            ]
+    q.forbid_events(introspection)
+
+    resuscitate_mc(q, bus, mc)
+    account = get_fakecm_account(bus, mc, account_path)
+    assert account.Properties.Get(cs.ACCOUNT, 'Valid')
+    sync_dbus(bus, q, mc)
+
+    q.unforbid_events(introspection)
+
+    # If the cached description can't be turned into protocols, MC falls
+    # back to asking the CM, and caches the right answer
+    tell_mc_to_die(q, bus)
+    write_cache(cache, source, {'not a valid protocol name': {}})
+
+    bus.call_async(dbus.BUS_DAEMON_NAME, dbus.BUS_DAEMON_PATH,
+        dbus.BUS_DAEMON_IFACE, 'StartServiceByName', 'su', (cs.MC, 0),
+        reply_handler=None, error_handler=None)
+    mc.wait_for_names(expect_introspection())
+
+    account = get_fakecm_account(bus, mc, account_path)
+    assert account.Properties.Get(cs.ACCOUNT, 'Valid')
+
+    source_name, _, (interfaces, protocols) = read_cache(cache)
+    assertEquals([PROTOCOL_NAME], list(protocols.keys()))
+
+if __name__ == '__main__':
+    exec_test(test, {})
@@ -0,0 +1,177 @@
+# Test for the sharded (one keyfile per account) storage backend.
+#
+# Copyright (C) 2009-2010 Nokia Corporation
+# Copyright (C) 2009-2010 Collabora Ltd.
+#
+# This library is free software; you can redistribute it and/or
+# modify it under the terms of the GNU Lesser General Public
+# License as published by the Free Software Foundation; either
+# version 2.1 of the License, or (at your option) any later version.
+#
+# This library is distributed in the hope that it will be useful, but
+# WITHOUT ANY WARRANTY; without even the implied warranty of
+# MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the GNU
+# Lesser General Public License for more details.
+#
+# You should have received a copy of the GNU Lesser General Public
+# License along with this library; if not, write to the Free Software
+# Foundation, Inc., 51 Franklin St, Fifth Floor, Boston, MA
+# 02110-1301 USA
+
+import os
+import os.path
+
+import dbus
+
+from servicetest import EventPattern, assertEquals
+from mctest import (
+    exec_test, get_fakecm_account, keyfile_read, tell_mc_to_die,
+    resuscitate_mc
+    )
+import constants as cs
+
+def read_shards(directory):
+    shards = {}
+
+    for basename in os.listdir(directory):
+        if not basename.endswith('.cfg'):
+            continue
+
+        kf = keyfile_read(os.path.join(directory, basename))
+
+        for group in kf:
+            if group is not None:
+                shards[group] = (basename, kf[group])
+
+    return shards
+
+def test(q, bus, mc):
+    mc_dir = os.path.join(os.environ['XDG_DATA_HOME'], 'telepathy',
+            'mission-control')
+    key_file_name = os.path.join(mc_dir, 'accounts.cfg')
+    shard_dir = os.path.join(mc_dir, 'accounts.d')
+    group = 'fakecm/fakeprotocol/dontdivert_40example_2ecom0'
+    other = 'fakecm/fakeprotocol/dontdivert2_40example_2ecom0'
+    account_path = cs.ACCOUNT_PATH_PREFIX + group
+
+    tell_mc_to_die(q, bus)
+
+    # Write out a monolithic configuration, to test migration
+    if not os.path.isdir(mc_dir):
+        os.makedirs(mc_dir, 0o700)
+
+    open(key_file_name, 'w').write(
+r"""# Telepathy accounts
+[%s]
+manager=fakecm
+protocol=fakeprotocol
+param-account=dontdivert@example.com
+DisplayName=Monolithic account
+AutomaticPresence=2;available;;
+
+[%s]
+manager=fakecm
+protocol=fakeprotocol
+param-account=dontdivert2@example.com
+DisplayName=Bystander
+AutomaticPresence=2;available;;
+""" % (group, other))
+
+    # default-gkeyfile hadn't compacted its journal yet: the complete batch
+    # is migrated, the torn one after it isn't
+    open(key_file_name + '.journal', 'w').write(
+            'S\t%s\tNickname\tJournalled\nC\n'
+            'S\t%s\tDisplayName\tTorn\n' % (group, group))
+
+    bus_daemon = dbus.Interface(bus.get_object(dbus.BUS_DAEMON_NAME,
+        dbus.BUS_DAEMON_PATH), dbus.BUS_DAEMON_IFACE)
+    bus_daemon.UpdateActivationEnvironment(
+            { 'MC_ACCOUNT_STORAGE': 'sharded-gkeyfile' })
+
+    account_manager, properties, interfaces = resuscitate_mc(q, bus, mc)
+    account = get_fakecm_account(bus, mc, account_path)
+    account_props = dbus.Interface(account, cs.PROPERTIES_IFACE)
+
+    # Each account got its own file during startup
+    shards = read_shards(shard_dir)
+    assert group in shards, shards
+    assert other in shards, shards
+    assertEquals('Monolithic account', shards[group][1]['DisplayName'])
+    assertEquals('Journalled', shards[group][1]['Nickname'])
+    assertEquals('Bystander', shards[other][1]['DisplayName'])
+
+    # Note when the other account was last written
+    other_file = os.path.join(shard_dir, shards[other][0])
+    os.utime(other_file, (0, 0))
+
+    account_props.Set(cs.ACCOUNT, 'DisplayName', 'Sharded account')
+
+    tell_mc_to_die(q, bus)
+
+    # Only the account that changed was rewritten
+    shards = read_shards(shard_dir)
+    assertEquals('Sharded account', shards[group][1]['DisplayName'])
+    assertEquals('Bystander', shards[other][1]['DisplayName'])
+    assertEquals(0, os.stat(other_file).st_mtime)
+
+    # The monolithic file is left alone
+    kf = keyfile_read(key_file_name)
+    assertEquals('Monolithic account', kf[group]['DisplayName'])
+
+    account_manager, properties, interfaces = resuscitate_mc(q, bus, mc)
+    account = get_fakecm_account(bus, mc, account_path)
+    account_iface = dbus.Interface(account, cs.ACCOUNT)
+
+    # Migration only happens once
+    assertEquals('Sharded account',
+            account.Get(cs.ACCOUNT, 'DisplayName',
+                dbus_interface=cs.PROPERTIES_IFACE))
+
+    # Delete the account
+    assert account_iface.Remove() is None
+    q.expect_many(
+        EventPattern('dbus-signal',
+            path=account_path,
+            signal='Removed',
+            interface=cs.ACCOUNT,
+            args=[]
+            ),
+        EventPattern('dbus-signal',
+            path=cs.AM_PATH,
+            signal='AccountRemoved',
+            interface=cs.AM,
+            args=[account_path]
+            ),
+        )
+
+    # Its file is deleted, the other account's is not
+    shards = read_shards(shard_dir)
+    assert group not in shards, shards
+    assert other in shards, shards
+
+    # Start again, this time with a corrupt accounts.cfg
+    tell_mc_to_die(q, bus)
+
+    for basename in os.listdir(shard_dir):
+        os.remove(os.path.join(shard_dir, basename))
+    os.rmdir(shard_dir)
+
+    open(key_file_name, 'w').write('[this is not a keyfile\n')
+
+    account_manager, properties, interfaces = resuscitate_mc(q, bus, mc)
+
+    # We don't migrate from anywhere else instead, but we keep the file
+    assertEquals([], properties['ValidAccounts'] + properties['InvalidAccounts'])
+    assert not os.path.exists(key_file_name)
+    assertEquals('[this is not a keyfile\n',
+            open(key_file_name + '.broken').read())
+    assert os.path.isdir(shard_dir)
+
+    tell_mc_to_die(q, bus)
+
+    # Next time, the empty directory is what we use
+    account_manager, properties, interfaces = resuscitate_mc(q, bus, mc)
+    assertEquals([], properties['ValidAccounts'] + properties['InvalidAccounts'])
+
+if __name__ == '__main__':
+    exec_test(test, {}, timeout=10, use_fake_accounts_service=False)
@@ -0,0 +1,131 @@
+# Copyright (C) 2012 Collabora Ltd.
+#
+# This library is free software; you can redistribute it and/or
+# modify it under the terms of the GNU Lesser General Public
+# License as published by the Free Software Foundation; either
+# version 2.1 of the License, or (at your option) any later version.
+#
+# This library is distributed in the hope that it will be useful, but
+# WITHOUT ANY WARRANTY; without even the implied warranty of
+# MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the GNU
+# Lesser General Public License for more details.
+#
+# You should have received a copy of the GNU Lesser General Public
+# License along with this library; if not, write to the Free Software
+# Foundation, Inc., 51 Franklin St, Fifth Floor, Boston, MA
+# 02110-1301 USA
+
+"""Regression test for telling connections about several Handlers' new
+capabilities in one UpdateCapabilities call, and not telling them about
+capabilities that haven't changed.
+"""
+
+import dbus
+import dbus.bus
+import dbus.service
+
+from servicetest import EventPattern, sync_dbus
+from mctest import exec_test, SimulatedClient, create_fakecm_account, \
+        enable_fakecm_account
+import constants as cs
+
+def test(q, bus, mc):
+    params = dbus.Dictionary({"account": "someguy@example.com",
+        "password": "secrecy"}, signature='sv')
+    cm_name_ref, account = create_fakecm_account(q, bus, mc, params)
+    conn, before = enable_fakecm_account(q, bus, mc, account, params,
+            extra_interfaces=[cs.CONN_IFACE_CONTACT_CAPS],
+            expect_before_connect=[
+                EventPattern('dbus-method-call', handled=False,
+                    interface=cs.CONN_IFACE_CONTACT_CAPS,
+                    method='UpdateCapabilities'),
+                ])
+    q.dbus_return(before.message, signature='')
+
+    # let the connection settle down
+    sync_dbus(bus, q, mc)
+
+    room_fixed_properties = dbus.Dictionary({
+        cs.CHANNEL + '.ChannelType': cs.CHANNEL_TYPE_TEXT,
+        cs.CHANNEL + '.TargetHandleType': cs.HT_ROOM,
+        }, signature='sv')
+
+    # Two Handlers start at the same time. We hold on to their Handler
+    # properties, so that MC finishes introspecting both of them in the same
+    # main loop iteration.
+    names = ['Irssi', 'Xchat']
+    held = []
+
+    for name in names:
+        q.add_dbus_method_impl(held.append,
+                path=cs.tp_path_prefix + '/Client/' + name,
+                interface=cs.PROPERTIES_IFACE, method='GetAll',
+                args=[cs.HANDLER])
+
+    clients_bus = dbus.bus.BusConnection()
+    clients_bus.set_exit_on_disconnect(False)
+    q.attach_to_bus(clients_bus)
+    clients = [SimulatedClient(q, clients_bus, name,
+        observe=[], approve=[], handle=[room_fixed_properties],
+        cap_tokens=[], bypass_approval=False) for name in names]
+
+    q.expect_many(*[EventPattern('dbus-method-call',
+        path=client.object_path, interface=cs.PROPERTIES_IFACE,
+        method='GetAll', args=[cs.HANDLER]) for client in clients])
+    assert len(held) == 2, held
+
+    for e in held:
+        for client in clients:
+            if e.path == client.object_path:
+                client.GetAll_Handler(e)
+
+    e = q.expect('dbus-method-call', handled=False,
+        interface=cs.CONN_IFACE_CONTACT_CAPS,
+        method='UpdateCapabilities')
+
+    announced = sorted([struct[0] for struct in e.args[0]])
+    assert announced == [cs.CLIENT + '.Irssi', cs.CLIENT + '.Xchat'], \
+            announced
+
+    for struct in e.args[0]:
+        assert struct[1] == [room_fixed_properties], struct
+        assert struct[2] == [], struct
+
+    # that was the only call
+    forbidden = [EventPattern('dbus-method-call', handled=False,
+        interface=cs.CONN_IFACE_CONTACT_CAPS, method='UpdateCapabilities')]
+    q.forbid_events(forbidden)
+    sync_dbus(bus, q, mc)
+
+    # A new instance of Irssi, with the same capabilities, was waiting for
+    # the name; the old instance exits and the name passes straight to the
+    # new one. Irssi's capabilities haven't changed, so the connection
+    # isn't told about them again.
+    new_irssi_bus = dbus.bus.BusConnection()
+    new_irssi_bus.set_exit_on_disconnect(False)
+    q.attach_to_bus(new_irssi_bus)
+    new_irssi = SimulatedClient(q, new_irssi_bus, 'Irssi',
+            observe=[], approve=[], handle=[room_fixed_properties],
+            cap_tokens=[], bypass_approval=False)
+
+    clients[0].release_name()
+    sync_dbus(bus, q, mc)
+
+    q.unforbid_events(forbidden)
+
+    # When Xchat exits, the connection is told it has gone, and it's the
+    # only thing that changed
+    clients[1].release_name()
+
+    e = q.expect('dbus-method-call', handled=False,
+        interface=cs.CONN_IFACE_CONTACT_CAPS,
+        method='UpdateCapabilities')
+
+    assert len(e.args[0]) == 1, e.args
+    struct = e.args[0][0]
+    assert struct[0] == cs.CLIENT + '.Xchat'
+    assert struct[1] == []
+    assert struct[2] == []
+
+if __name__ == '__main__':
+    exec_test(test, {})
@@ -0,0 +1,171 @@
+# Copyright (C) 2012 Collabora Ltd.
+#
+# This library is free software; you can redistribute it and/or
+# modify it under the terms of the GNU Lesser General Public
+# License as published by the Free Software Foundation; either
+# version 2.1 of the License, or (at your option) any later version.
+#
+# This library is distributed in the hope that it will be useful, but
+# WITHOUT ANY WARRANTY; without even the implied warranty of
+# MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the GNU
+# Lesser General Public License for more details.
+#
+# You should have received a copy of the GNU Lesser General Public
+# License along with this library; if not, write to the Free Software
+# Foundation, Inc., 51 Franklin St, Fifth Floor, Boston, MA
+# 02110-1301 USA
+
+"""Regression test for building the arguments of ObserveChannels,
+AddDispatchOperation and HandleChannels once per dispatch operation, however
+many clients are called.
+"""
+
+import dbus
+import dbus.bus
+import dbus.service
+
+from servicetest import EventPattern, call_async
+from mctest import exec_test, SimulatedClient, SimulatedChannel, \
+        create_fakecm_account, enable_fakecm_account, expect_client_setup
+import constants as cs
+
+N_CLIENTS = 4
+
+DEBUG_IFACE = cs.tp_name_prefix + '.Debug'
+DEBUG_PATH = cs.tp_path_prefix + '/debug'
+
+def test(q, bus, mc):
+    params = dbus.Dictionary({"account": "someguy@example.com",
+        "password": "secrecy"}, signature='sv')
+    cm_name_ref, account = create_fakecm_account(q, bus, mc, params)
+    conn = enable_fakecm_account(q, bus, mc, account, params)
+
+    text_fixed_properties = dbus.Dictionary({
+        cs.CHANNEL + '.TargetHandleType': cs.HT_CONTACT,
+        cs.CHANNEL + '.ChannelType': cs.CHANNEL_TYPE_TEXT,
+        }, signature='sv')
+
+    # several clients, each of which wants to observe, approve and handle
+    # the channel
+    buses = []
+    clients = []
+
+    for i in range(N_CLIENTS):
+        client_bus = dbus.bus.BusConnection()
+        q.attach_to_bus(client_bus)
+        buses.append(client_bus)
+        clients.append(SimulatedClient(q, client_bus, 'Client%d' % i,
+            observe=[text_fixed_properties], approve=[text_fixed_properties],
+            handle=[text_fixed_properties], bypass_approval=False))
+
+    expect_client_setup(q, clients)
+
+    # watch MC's debug messages from here on
+    built = []
+    collected = []
+
+    def new_debug_message(timestamp, domain, level, message):
+        if 'building Channel_Details' in message:
+            built.append(message)
+        elif 'collecting satisfied requests' in message:
+            collected.append(message)
+
+    bus.add_signal_receiver(new_debug_message,
+            signal_name='NewDebugMessage', dbus_interface=DEBUG_IFACE,
+            path=DEBUG_PATH)
+    debug = bus.get_object(cs.AM, DEBUG_PATH)
+    debug.Set(DEBUG_IFACE, 'Enabled', True,
+            dbus_interface=cs.PROPERTIES_IFACE)
+
+    cd = bus.get_object(cs.CD, cs.CD_PATH)
+    cd_props = dbus.Interface(cd, cs.PROPERTIES_IFACE)
+    assert cd_props.Get(cs.CD_IFACE_OP_LIST, 'DispatchOperations') == []
+
+    channel_properties = dbus.Dictionary(text_fixed_properties,
+            signature='sv')
+    channel_properties[cs.CHANNEL + '.TargetID'] = 'juliet'
+    channel_properties[cs.CHANNEL + '.TargetHandle'] = \
+            conn.ensure_handle(cs.HT_CONTACT, 'juliet')
+    channel_properties[cs.CHANNEL + '.InitiatorID'] = 'juliet'
+    channel_properties[cs.CHANNEL + '.InitiatorHandle'] = \
+            conn.ensure_handle(cs.HT_CONTACT, 'juliet')
+    channel_properties[cs.CHANNEL + '.Requested'] = False
+    channel_properties[cs.CHANNEL + '.Interfaces'] = dbus.Array(signature='s')
+
+    chan = SimulatedChannel(conn, channel_properties)
+    chan.announce()
+
+    e = q.expect('dbus-signal',
+            path=cs.CD_PATH,
+            interface=cs.CD_IFACE_OP_LIST,
+            signal='NewDispatchOperation')
+    cdo_path = e.args[0]
+    cdo = bus.get_object(cs.CD, cdo_path)
+    cdo_iface = dbus.Interface(cdo, cs.CDO)
+
+    # every Observer is told about the channel, with the same arguments
+    observations = q.expect_many(*[EventPattern('dbus-method-call',
+                path=client.object_path,
+                interface=cs.OBSERVER, method='ObserveChannels',
+                handled=False) for client in clients])
+
+    for e in observations:
+        assert e.args == observations[0].args, e.args
+        assert e.args[2] == [(chan.object_path, channel_properties)], e.args
+
+    for e, client_bus in zip(observations, buses):
+        q.dbus_return(e.message, bus=client_bus, signature='')
+
+    # then every Approver
+    approvals = q.expect_many(*[EventPattern('dbus-method-call',
+                path=client.object_path,
+                interface=cs.APPROVER, method='AddDispatchOperation',
+                handled=False) for client in clients])
+
+    for e in approvals:
+        assert e.args == approvals[0].args, e.args
+        assert e.args[0] == [(chan.object_path, channel_properties)], e.args
+
+    for e, client_bus in zip(approvals, buses):
+        q.dbus_return(e.message, bus=client_bus, signature='')
+
+    # the user chooses a handler, which fails, so MC has to call HandleChannels
+    # again: each attempt reuses the same arguments
+    call_async(q, cdo_iface, 'HandleWith', clients[0].bus_name)
+
+    e = q.expect('dbus-method-call',
+            path=clients[0].object_path,
+            interface=cs.HANDLER, method='HandleChannels',
+            handled=False)
+    assert e.args[2] == [(chan.object_path, channel_properties)], e.args
+    q.dbus_raise(e.message, cs.NOT_AVAILABLE, 'Not today',
+            bus=buses[0])
+
+    q.expect('dbus-error', method='HandleWith')
+
+    call_async(q, cdo_iface, 'HandleWith', clients[1].bus_name)
+
+    e = q.expect('dbus-method-call',
+            path=clients[1].object_path,
+            interface=cs.HANDLER, method='HandleChannels',
+            handled=False)
+    assert e.args[2] == [(chan.object_path, channel_properties)], e.args
+    q.dbus_return(e.message, bus=buses[1], signature='')
+
+    q.expect_many(
+            EventPattern('dbus-return', method='HandleWith'),
+            EventPattern('dbus-signal', interface=cs.CDO, signal='Finished'),
+            )
+
+    # make sure we have seen every debug message up to this point: the
+    # signals arrive before the reply
+    call_async(q, dbus.Interface(debug, cs.PROPERTIES_IFACE), 'Set',
+            DEBUG_IFACE, 'Enabled', False)
+    q.expect('dbus-return', method='Set')
+
+    # 2 * N_CLIENTS + 2 calls, but only one of each
+    assert len(built) == 1, built
+    assert len(collected) == 1, collected
+
+if __name__ == '__main__':
+    exec_test(test, {})
@@ -1295,7 +1295,14 @@ def resuscitate_mc(q, bus, mc):
 def keyfile_read(fname):
     groups = { None: {} }
     group = None
-    for line in open(fname):
+    journal = fname + '.journal'
+
+    if os.path.exists(journal) and not os.path.exists(fname):
+        lines = []
+    else:
+        lines = open(fname)
+
+    for line in lines:
         line = line[:-1].decode('utf-8').strip()
         if not line or line.startswith('#'):
             continue
@@ -1312,8 +1319,44 @@ def keyfile_read(fname):
             v = None
 
         groups[group][k] = v
+
+    if os.path.exists(journal):
+        keyfile_replay_journal(groups, journal)
+
     return groups
 
+def keyfile_replay_journal(groups, fname):
+    """Applies the changes that the default keyfile storage backend has
+    journalled but not yet written back to the keyfile itself. Only
+    batches that were finished with a C record count."""
+    batch = []
+
+    for line in open(fname):
+        if not line.endswith('\n'):
+            # torn write
+            break
+
+        fields = line[:-1].decode('utf-8').split('\t', 3)
+
+        if fields[0] == 'C' and len(fields) == 1:
+            for record in batch:
+                keyfile_apply_journal_record(groups, record)
+            batch = []
+        else:
+            batch.append(fields)
+
+def keyfile_apply_journal_record(groups, fields):
+    if fields[0] == 'S' and len(fields) == 4:
+        groups.setdefault(fields[1], {})[fields[2]] = fields[3]
+    elif fields[0] == 'D' and len(fields) == 3:
+        group = groups.get(fields[1], {})
+        group.pop(fields[2], None)
+
+        if not group:
+            groups.pop(fields[1], None)
+    elif fields[0] == 'R' and len(fields) == 2:
+        groups.pop(fields[1], None)
+
 def read_account_keyfile():
     """Reads the keyfile used by the 'diverted' storage plugin used by most of
     the tests."""